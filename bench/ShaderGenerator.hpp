@@ -0,0 +1,288 @@
+//
+//  OSL
+//
+
+#ifndef SHADERGENERATOR_HPP
+#define SHADERGENERATOR_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace ouzel
+{
+    // Generates deterministic synthetic OSL shaders, the same options always produce the same source
+    class ShaderGenerator final
+    {
+    public:
+        struct Options final
+        {
+            std::uint64_t seed = 1;
+            std::size_t structCount = 8;
+            std::size_t memberCount = 6;
+            std::size_t functionCount = 32;
+            std::size_t overloadCount = 3;
+            std::size_t statementCount = 8;
+            std::size_t expressionDepth = 6;
+            std::size_t swizzleLength = 4;
+        };
+
+        explicit ShaderGenerator(const Options& initOptions):
+            options{initOptions}, state{initOptions.seed}
+        {
+        }
+
+        [[nodiscard]]
+        std::string generate()
+        {
+            std::string result;
+
+            for (std::size_t i = 0; i < options.structCount; ++i)
+                generateStruct(i, result);
+
+            for (std::size_t i = 0; i < options.functionCount; ++i)
+                for (std::size_t overload = 0; overload < options.overloadCount; ++overload)
+                    generateFunction(i, overload, result);
+
+            generateEntryPoint(result);
+
+            return result;
+        }
+
+    private:
+        // float, float2, float3 and float4 are identified by their component count
+        struct Variable final
+        {
+            Variable(const std::string& initName, std::size_t initComponents):
+                name{initName}, components{initComponents} {}
+
+            std::string name;
+            std::size_t components;
+        };
+
+        struct Struct final
+        {
+            std::string name;
+            std::vector<Variable> members;
+        };
+
+        struct Function final
+        {
+            std::string name;
+            std::vector<std::size_t> parameters;
+            std::size_t result;
+        };
+
+        // splitmix64, used instead of the standard distributions because their output is implementation-defined
+        std::uint64_t next() noexcept
+        {
+            auto z = (state += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            return z ^ (z >> 31);
+        }
+
+        std::size_t random(std::size_t count) noexcept
+        {
+            return static_cast<std::size_t>(next() % count);
+        }
+
+        static std::string getTypeName(std::size_t components)
+        {
+            return components == 1 ? "float" : "float" + std::to_string(components);
+        }
+
+        std::string generateLiteral()
+        {
+            return std::to_string(random(10)) + "." + std::to_string(random(10)) + "f";
+        }
+
+        void generateStruct(std::size_t index, std::string& code)
+        {
+            Struct structure;
+            structure.name = "S" + std::to_string(index);
+
+            code += "struct " + structure.name + "\n{\n";
+
+            for (std::size_t i = 0; i < options.memberCount; ++i)
+            {
+                structure.members.emplace_back("m" + std::to_string(i), random(4) + 1);
+                code += "    var " + structure.members.back().name + ":" + getTypeName(structure.members.back().components) + ";\n";
+            }
+
+            code += "}\n\n";
+
+            structs.push_back(structure);
+        }
+
+        // picks a chain of swizzles on a float4 that ends in a value with the given component count
+        std::string generateSwizzleChain(const std::string& base, std::size_t components)
+        {
+            constexpr char names[4] = {'x', 'y', 'z', 'w'};
+
+            std::string result = base;
+            std::size_t width = 4;
+
+            const auto length = std::max(options.swizzleLength, std::size_t{1});
+
+            for (std::size_t i = 0; i < length; ++i)
+            {
+                const auto newWidth = (i + 1 == length) ? components : random(3) + 2;
+
+                result += ".";
+                for (std::size_t c = 0; c < newWidth; ++c)
+                    result += names[random(width)];
+
+                width = newWidth;
+            }
+
+            return result;
+        }
+
+        std::string generateConstant(std::size_t components)
+        {
+            if (components == 1) return generateLiteral();
+
+            std::string result = getTypeName(components) + "(";
+            for (std::size_t c = 0; c < components; ++c)
+                result += (c ? ", " : "") + generateLiteral();
+            return result + ")";
+        }
+
+        std::string generateLeaf(std::size_t components, const std::vector<Variable>& variables)
+        {
+            std::vector<const Variable*> candidates;
+            for (const auto& variable : variables)
+                if (variable.components == components) candidates.push_back(&variable);
+
+            const auto vector = std::find_if(variables.begin(), variables.end(),
+                                             [](const Variable& variable) { return variable.components == 4; });
+
+            switch (random(3))
+            {
+                case 0:
+                    if (!candidates.empty()) return candidates[random(candidates.size())]->name;
+                    break;
+                case 1:
+                    if (vector != variables.end()) return generateSwizzleChain(vector->name, components);
+                    break;
+                default:
+                    break;
+            }
+
+            return generateConstant(components);
+        }
+
+        std::string generateExpression(std::size_t components, std::size_t depth,
+                                       const std::vector<Variable>& variables)
+        {
+            if (depth == 0) return generateLeaf(components, variables);
+
+            switch (random(5))
+            {
+                case 0:
+                {
+                    std::vector<const Function*> candidates;
+                    for (const auto& function : functions)
+                        if (function.result == components) candidates.push_back(&function);
+
+                    if (candidates.empty()) break;
+
+                    const auto& function = *candidates[random(candidates.size())];
+
+                    std::string result = function.name + "(";
+                    for (std::size_t i = 0; i < function.parameters.size(); ++i)
+                        result += (i ? ", " : "") + generateExpression(function.parameters[i], depth / 2, variables);
+                    return result + ")";
+                }
+                case 1:
+                    return "(" + generateExpression(4, depth - 1, variables) + ")" +
+                        generateSwizzleChain("", components);
+                default:
+                    break;
+            }
+
+            constexpr const char* operators[] = {" + ", " - ", " * "};
+
+            return "(" + generateExpression(components, depth - 1, variables) +
+                operators[random(std::size(operators))] +
+                generateExpression(components, depth - 1, variables) + ")";
+        }
+
+        void generateBody(std::size_t result, std::vector<Variable> variables, std::string& code)
+        {
+            code += "{\n";
+
+            for (std::size_t i = 0; i < options.statementCount; ++i)
+            {
+                if (!structs.empty() && random(3) == 0)
+                {
+                    const auto& structure = structs[random(structs.size())];
+                    const auto& member = structure.members[random(structure.members.size())];
+                    const auto name = "s" + std::to_string(i);
+
+                    code += "    var " + name + ":" + structure.name + ";\n";
+                    code += "    " + name + "." + member.name + " = " +
+                        generateExpression(member.components, options.expressionDepth, variables) + ";\n";
+
+                    variables.emplace_back(name + "." + member.name, member.components);
+                }
+                else
+                {
+                    const auto components = random(4) + 1;
+                    const auto name = "l" + std::to_string(i);
+
+                    code += "    var " + name + ":" + getTypeName(components) + " = " +
+                        generateExpression(components, options.expressionDepth, variables) + ";\n";
+
+                    variables.emplace_back(name, components);
+                }
+            }
+
+            code += "    return " + generateExpression(result, options.expressionDepth, variables) + ";\n}\n\n";
+        }
+
+        void generateFunction(std::size_t index, std::size_t overload, std::string& code)
+        {
+            Function function;
+            function.name = "f" + std::to_string(index);
+            if (overload >= 3) function.name += "_" + std::to_string(overload / 3);
+            function.result = random(4) + 1;
+
+            // overloads differ in the type of the first parameter, which is never a scalar,
+            // because scalar arguments are viable for any parameter type
+            function.parameters.push_back(overload % 3 + 2);
+            for (std::size_t i = random(3); i > 0; --i)
+                function.parameters.push_back(random(4) + 1);
+
+            std::vector<Variable> parameters;
+
+            code += "function " + function.name + "(";
+            for (std::size_t i = 0; i < function.parameters.size(); ++i)
+            {
+                parameters.emplace_back("p" + std::to_string(i), function.parameters[i]);
+                code += (i ? ", " : "") + parameters.back().name + ":" + getTypeName(function.parameters[i]);
+            }
+            code += "):" + getTypeName(function.result) + "\n";
+
+            generateBody(function.result, parameters, code);
+
+            functions.push_back(function);
+        }
+
+        void generateEntryPoint(std::string& code)
+        {
+            code += "fragment main():float4\n";
+            generateBody(4, {}, code);
+        }
+
+        Options options;
+        std::uint64_t state;
+        std::vector<Struct> structs;
+        std::vector<Function> functions;
+    };
+}
+
+#endif // SHADERGENERATOR_HPP
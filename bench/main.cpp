@@ -0,0 +1,692 @@
+//
+//  OSL
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#if defined(__unix__) || defined(__APPLE__)
+#  include <dlfcn.h>
+#  include <unistd.h>
+#endif
+#include "AllocationTracker.hpp"
+#include "BytecodeCompiler.hpp"
+#include "CommonSubexpressionEliminator.hpp"
+#include "ConstantFolder.hpp"
+#include "DeadCodeEliminator.hpp"
+#include "Inliner.hpp"
+#include "Interpreter.hpp"
+#include "SimdInterpreter.hpp"
+#include "Tokenizer.hpp"
+#include "VirtualMachine.hpp"
+#include "Parser.hpp"
+#include "Preprocessor.hpp"
+#include "OutputHLSL.hpp"
+#include "OutputGLSL.hpp"
+#include "OutputMSL.hpp"
+#include "OutputCPP.hpp"
+#include "ShaderGenerator.hpp"
+
+OSL_DEFINE_ALLOCATION_TRACKER()
+
+namespace
+{
+    struct Stage final
+    {
+        Stage(const std::string& initName):
+            name{initName} {}
+
+        std::string name;
+        double seconds = 0.0;
+        std::size_t allocationCount = 0;
+        std::size_t allocatedBytes = 0;
+        std::size_t invocationCount = 0; // shader invocations of the interpreter stages
+    };
+
+    struct Results final
+    {
+        std::size_t sourceBytes = 0;
+        std::size_t tokenCount = 0;
+        std::size_t constructCount = 0;
+        std::vector<Stage> stages;
+    };
+
+    // fragment shader run by the interpreter stage,
+    // the generated shader calls too many functions to be run once per pixel
+    const std::string interpreterShader = R"OSL(
+    struct Input
+    {
+        var uv:float2;
+    }
+    extern diffuse:Texture2D;
+    extern transform:float2x2;
+    fragment main(input:Input):float4
+    {
+        var uv = input.uv * transform;
+        var color = sample(diffuse, uv);
+        var weight = 0.0f;
+        for (var i = 0; i < 4; ++i)
+            weight += abs(uv.x - 0.5f) * float(i);
+        if (color.w < 0.1f) discard();
+        return color * weight;
+    }
+    )OSL";
+
+    // keeps the fastest of the runs, which is the least affected by noise,
+    // allocations are the same in every run, so they are counted in the last one
+    Stage measure(const std::string& name, std::size_t iterations, const std::function<void()>& function)
+    {
+        Stage result{name};
+
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+            const auto allocationCount = ouzel::AllocationTracker::getAllocationCount();
+            const auto allocatedBytes = ouzel::AllocationTracker::getAllocatedBytes();
+            const auto start = std::chrono::steady_clock::now();
+
+            function();
+
+            const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+
+            if (i == 0 || duration.count() < result.seconds)
+                result.seconds = duration.count();
+
+            result.allocationCount = ouzel::AllocationTracker::getAllocationCount() - allocationCount;
+            result.allocatedBytes = ouzel::AllocationTracker::getAllocatedBytes() - allocatedBytes;
+        }
+
+        return result;
+    }
+
+    // runs the interpreter shader over a square tile laneCount pixels at a time
+    template <std::size_t laneCount>
+    Stage measureTile(const std::string& name, std::size_t iterations,
+                      const ouzel::Context& context, const ouzel::Texture& texture, std::size_t tileSize)
+    {
+        using Interpreter = ouzel::SimdInterpreter<laneCount>;
+
+        Interpreter interpreter(context, ouzel::Program::Fragment);
+        interpreter.setTexture("diffuse", texture);
+
+        auto& transform = interpreter.getGlobal("transform");
+        const float matrix[] = {1.0F, 0.5F, -0.5F, 1.0F};
+        for (std::size_t component = 0; component < 4; ++component)
+            for (std::size_t lane = 0; lane < laneCount; ++lane)
+                transform.setFloat(component, lane, matrix[component]);
+
+        const auto setArguments = [tileSize](std::size_t x, std::size_t y, std::size_t lane,
+                                             std::vector<typename Interpreter::Value>& arguments) {
+            auto& uv = arguments[0].elements[0];
+            uv.setFloat(0, lane, static_cast<float>((static_cast<double>(x) + 0.5) / static_cast<double>(tileSize)));
+            uv.setFloat(1, lane, static_cast<float>((static_cast<double>(y) + 0.5) / static_cast<double>(tileSize)));
+        };
+
+        // discarded pixels keep the negative color
+        std::vector<float> colors(tileSize * tileSize * 4);
+        auto stage = measure(name, iterations, [&interpreter, &setArguments, &colors, tileSize]() {
+            std::fill(colors.begin(), colors.end(), -1.0F);
+            interpreter.runTile(tileSize, tileSize, setArguments, colors);
+        });
+
+        if (std::all_of(colors.begin(), colors.end(), [](float color) { return color < 0.0F; }))
+            throw std::runtime_error{"Interpreter discarded every invocation"};
+
+        stage.invocationCount = tileSize * tileSize;
+        return stage;
+    }
+
+    // runs the invocations of the interpreter shader compiled to native code by the host compiler,
+    // returns nothing if the compiler or the dynamic loader is not available
+    std::optional<Stage> measureNative(const std::string& name, std::size_t iterations,
+                                       const ouzel::Context& context, const ouzel::Texture& texture,
+                                       const std::vector<float>& coordinates, std::size_t& discarded)
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        ouzel::OutputCPP output(ouzel::Program::Fragment);
+        const auto code = output.output(context, true) + R"CPP(
+extern "C" std::size_t runShader(const float* coordinates, std::size_t count,
+                                 const float* pixels, std::size_t width, std::size_t height,
+                                 const float* transform, float* colors)
+{
+    shader::diffuse = osl::Texture2D{pixels, width, height};
+    shader::transform = osl::float2x2(osl::float2(transform[0], transform[1]), osl::float2(transform[2], transform[3]));
+
+    std::size_t discarded = 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        osl::float4 color;
+        if (shader::run(shader::Input{osl::float2(coordinates[i * 2], coordinates[i * 2 + 1])}, color))
+            for (std::size_t component = 0; component < 4; ++component) colors[i * 4 + component] = color[component];
+        else
+            ++discarded;
+    }
+    return discarded;
+}
+)CPP";
+
+        char directory[] = "/tmp/oslbenchXXXXXX";
+        if (!mkdtemp(directory))
+            return std::nullopt;
+
+        const std::string sourceFilename = std::string(directory) + "/shader.cpp";
+        const std::string libraryFilename = std::string(directory) + "/shader.so";
+        std::ofstream(sourceFilename, std::ios::binary) << code;
+
+        const auto compiler = std::getenv("CXX");
+        const std::string command = std::string(compiler ? compiler : "c++") +
+            " -std=c++17 -O3 -shared -fPIC -o " + libraryFilename + " " + sourceFilename;
+
+        using RunShader = std::size_t(*)(const float*, std::size_t, const float*, std::size_t, std::size_t, const float*, float*);
+        void* library = (std::system(command.c_str()) == 0) ? dlopen(libraryFilename.c_str(), RTLD_NOW | RTLD_LOCAL) : nullptr;
+        const auto runShader = library ? reinterpret_cast<RunShader>(dlsym(library, "runShader")) : nullptr;
+
+        std::remove(sourceFilename.c_str());
+        std::remove(libraryFilename.c_str());
+        rmdir(directory);
+
+        if (!runShader)
+        {
+            if (library) dlclose(library);
+            return std::nullopt;
+        }
+
+        std::vector<float> pixels(texture.getWidth() * texture.getHeight() * 4);
+        for (std::size_t y = 0; y < texture.getHeight(); ++y)
+            for (std::size_t x = 0; x < texture.getWidth(); ++x)
+            {
+                const auto texel = texture.load(static_cast<std::int64_t>(x), static_cast<std::int64_t>(y));
+                std::copy(texel.begin(), texel.end(), pixels.begin() + static_cast<std::ptrdiff_t>((y * texture.getWidth() + x) * 4));
+            }
+
+        const float transform[] = {1.0F, 0.5F, -0.5F, 1.0F};
+        const auto count = coordinates.size() / 2;
+        std::vector<float> colors(count * 4);
+
+        auto stage = measure(name, iterations, [&]() {
+            discarded = runShader(coordinates.data(), count, pixels.data(), texture.getWidth(), texture.getHeight(), transform, colors.data());
+        });
+
+        dlclose(library);
+
+        stage.invocationCount = count;
+        return stage;
+#else
+        (void)name;
+        (void)iterations;
+        (void)context;
+        (void)texture;
+        (void)coordinates;
+        (void)discarded;
+        return std::nullopt;
+#endif
+    }
+
+    std::string toString(double value)
+    {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.3f", value);
+        return buffer;
+    }
+
+    double getInvocationsPerSecond(const Stage& stage)
+    {
+        return static_cast<double>(stage.invocationCount) / stage.seconds;
+    }
+
+    double getMegabytesPerSecond(const Results& results, const Stage& stage)
+    {
+        return static_cast<double>(results.sourceBytes) / (1024.0 * 1024.0) / stage.seconds;
+    }
+
+    std::string getJson(const Results& results)
+    {
+        std::string result = "{\"sourceBytes\":" + std::to_string(results.sourceBytes) +
+            ",\"tokens\":" + std::to_string(results.tokenCount) +
+            ",\"nodes\":" + std::to_string(results.constructCount) +
+            ",\"stages\":[";
+
+        bool first = true;
+        for (const auto& stage : results.stages)
+        {
+            if (!first) result += ",";
+            first = false;
+
+            result += "{\"name\":\"" + stage.name + "\"" +
+                ",\"milliseconds\":" + toString(stage.seconds * 1000.0) +
+                ",\"megabytesPerSecond\":" + toString(getMegabytesPerSecond(results, stage)) +
+                ",\"tokensPerSecond\":" + toString(static_cast<double>(results.tokenCount) / stage.seconds) +
+                ",\"nodesPerSecond\":" + toString(static_cast<double>(results.constructCount) / stage.seconds) +
+                ",\"allocations\":" + std::to_string(stage.allocationCount) +
+                ",\"allocatedBytes\":" + std::to_string(stage.allocatedBytes);
+
+            if (stage.invocationCount > 0)
+                result += ",\"invocations\":" + std::to_string(stage.invocationCount) +
+                    ",\"invocationsPerSecond\":" + toString(getInvocationsPerSecond(stage));
+
+            result += "}";
+        }
+
+        result += "]}";
+
+        return result;
+    }
+
+    std::string getText(const Results& results)
+    {
+        std::string result = "source: " + std::to_string(results.sourceBytes) + " bytes, " +
+            std::to_string(results.tokenCount) + " tokens, " +
+            std::to_string(results.constructCount) + " nodes\n";
+
+        for (const auto& stage : results.stages)
+        {
+            char buffer[256];
+            if (stage.invocationCount > 0)
+                std::snprintf(buffer, sizeof(buffer), "%-16s %10.3f ms %14.0f invocations/s %39zu allocations\n",
+                              stage.name.c_str(), stage.seconds * 1000.0,
+                              getInvocationsPerSecond(stage),
+                              stage.allocationCount);
+            else
+                std::snprintf(buffer, sizeof(buffer), "%-16s %10.3f ms %10.2f MB/s %14.0f tokens/s %14.0f nodes/s %10zu allocations\n",
+                              stage.name.c_str(), stage.seconds * 1000.0,
+                              getMegabytesPerSecond(results, stage),
+                              static_cast<double>(results.tokenCount) / stage.seconds,
+                              static_cast<double>(results.constructCount) / stage.seconds,
+                              stage.allocationCount);
+            result += buffer;
+        }
+
+        return result;
+    }
+
+    // finds a numeric value of a stage in results previously written by getJson
+    bool findStageValue(const std::string& json, const std::string& stageName,
+                        const std::string& key, double& value)
+    {
+        const auto stageStart = json.find("{\"name\":\"" + stageName + "\"");
+        if (stageStart == std::string::npos) return false;
+
+        const auto stageEnd = json.find('}', stageStart);
+        const auto keyStart = json.find("\"" + key + "\":", stageStart);
+        if (keyStart == std::string::npos || keyStart > stageEnd) return false;
+
+        value = std::stod(json.substr(keyStart + key.size() + 3));
+        return true;
+    }
+
+    // returns the number of stages that are slower or allocate more than the baseline by more than the tolerance
+    std::size_t compare(const Results& results, const std::string& baseline,
+                        double tolerance, double allocationTolerance)
+    {
+        std::size_t regressions = 0;
+
+        for (const auto& stage : results.stages)
+        {
+            // the interpreter stages are measured in invocations instead of source bytes
+            const std::string throughputKey = (stage.invocationCount > 0) ? "invocationsPerSecond" : "megabytesPerSecond";
+            const std::string throughputUnit = (stage.invocationCount > 0) ? " invocations/s" : " MB/s";
+
+            double baselineThroughput;
+            if (findStageValue(baseline, stage.name, throughputKey, baselineThroughput))
+            {
+                const auto throughput = (stage.invocationCount > 0) ?
+                    getInvocationsPerSecond(stage) :
+                    getMegabytesPerSecond(results, stage);
+
+                if (throughput < baselineThroughput * (1.0 - tolerance))
+                {
+                    std::cerr << "Regression in " << stage.name << ": " << toString(throughput) <<
+                        throughputUnit << ", baseline " << toString(baselineThroughput) << throughputUnit << '\n';
+                    ++regressions;
+                }
+            }
+
+            double baselineAllocationCount;
+            if (findStageValue(baseline, stage.name, "allocations", baselineAllocationCount))
+            {
+                if (static_cast<double>(stage.allocationCount) > baselineAllocationCount * (1.0 + allocationTolerance))
+                {
+                    std::cerr << "Allocation regression in " << stage.name << ": " << stage.allocationCount <<
+                        " allocations, baseline " << static_cast<std::size_t>(baselineAllocationCount) << '\n';
+                    ++regressions;
+                }
+            }
+        }
+
+        return regressions;
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    ouzel::ShaderGenerator::Options generatorOptions;
+    std::size_t scale = 1;
+    std::size_t iterations = 5;
+    std::size_t invocations = 4096;
+    std::string format = "text";
+    std::string outputFilename;
+    std::string baselineFilename;
+    double tolerance = 0.1;
+    double allocationTolerance = 0.0;
+    bool printShader = false;
+    std::size_t maxParseThreads = 16;
+
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            if (std::string(argv[i]) == "--seed")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+                generatorOptions.seed = std::stoull(argv[i]);
+            }
+            else if (std::string(argv[i]) == "--scale")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+                scale = static_cast<std::size_t>(std::stoul(argv[i]));
+            }
+            else if (std::string(argv[i]) == "--expression-depth")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+                generatorOptions.expressionDepth = static_cast<std::size_t>(std::stoul(argv[i]));
+            }
+            else if (std::string(argv[i]) == "--swizzle-length")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+                generatorOptions.swizzleLength = static_cast<std::size_t>(std::stoul(argv[i]));
+            }
+            else if (std::string(argv[i]) == "--iterations")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+                iterations = static_cast<std::size_t>(std::stoul(argv[i]));
+            }
+            else if (std::string(argv[i]) == "--invocations")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+                invocations = static_cast<std::size_t>(std::stoul(argv[i]));
+            }
+            else if (std::string(argv[i]) == "--format")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+
+                if (std::string(argv[i]) != "text" && std::string(argv[i]) != "json")
+                    throw std::runtime_error{"Invalid format: " + std::string(argv[i])};
+
+                format = argv[i];
+            }
+            else if (std::string(argv[i]) == "--output")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+                outputFilename = argv[i];
+            }
+            else if (std::string(argv[i]) == "--baseline")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+                baselineFilename = argv[i];
+            }
+            else if (std::string(argv[i]) == "--tolerance")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+                tolerance = std::stod(argv[i]);
+            }
+            else if (std::string(argv[i]) == "--allocation-tolerance")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+                allocationTolerance = std::stod(argv[i]);
+            }
+            else if (std::string(argv[i]) == "--parse-threads")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+                maxParseThreads = static_cast<std::size_t>(std::stoul(argv[i]));
+            }
+            else if (std::string(argv[i]) == "--print-shader")
+                printShader = true;
+            else
+                throw std::runtime_error{"Invalid argument " + std::string(argv[i])};
+        }
+
+        if (iterations == 0)
+            throw std::runtime_error{"Iteration count must be positive"};
+
+        generatorOptions.structCount *= scale;
+        generatorOptions.functionCount *= scale;
+
+        ouzel::ShaderGenerator generator(generatorOptions);
+        const std::string source = generator.generate();
+
+        if (printShader)
+        {
+            std::cout << source;
+            return EXIT_SUCCESS;
+        }
+
+        Results results;
+        results.sourceBytes = source.size();
+
+        std::string preprocessed;
+        results.stages.push_back(measure("preprocess", iterations, [&source, &preprocessed]() {
+            ouzel::Preprocessor preprocessor;
+            preprocessed = preprocessor.preprocess(source);
+        }));
+
+        std::vector<ouzel::Token> tokens;
+        results.stages.push_back(measure("tokenize", iterations, [&preprocessed, &tokens]() {
+            tokens = ouzel::tokenize(preprocessed);
+        }));
+        results.tokenCount = tokens.size();
+
+        results.stages.push_back(measure("parse", iterations, [&tokens]() {
+            ouzel::Context context(tokens);
+        }));
+
+        const ouzel::Context context(tokens);
+        results.constructCount = context.getConstructs().size();
+
+        // the function bodies are parsed in parallel, the result must be the same for every thread count
+        const auto expectedOutput = ouzel::OutputHLSL(ouzel::Program::Fragment).output(context, false);
+        for (std::size_t threadCount = 1; threadCount <= maxParseThreads; threadCount *= 2)
+        {
+            const auto name = "parse " + std::to_string(threadCount) + (threadCount == 1 ? " thread" : " threads");
+            results.stages.push_back(measure(name, iterations, [&tokens, threadCount]() {
+                ouzel::Context parallelContext(tokens, nullptr, threadCount);
+            }));
+
+            ouzel::Context parallelContext(tokens, nullptr, threadCount);
+            if (ouzel::OutputHLSL(ouzel::Program::Fragment).output(parallelContext, false) != expectedOutput)
+                throw std::runtime_error{"Parallel parse produced a different result"};
+        }
+
+        // the passes transform the context, so every iteration gets its own one parsed before the measurement
+        std::vector<std::unique_ptr<ouzel::Context>> optimizedContexts;
+        for (std::size_t i = 0; i < iterations; ++i)
+            optimizedContexts.emplace_back(new ouzel::Context(tokens));
+
+        std::size_t optimizedCount = 0;
+        results.stages.push_back(measure("optimize", iterations, [&optimizedContexts, &optimizedCount]() {
+            auto& optimizedContext = *optimizedContexts[optimizedCount++];
+            ouzel::Inliner(optimizedContext).transform();
+            ouzel::ConstantFolder(optimizedContext).transform();
+            ouzel::CommonSubexpressionEliminator(optimizedContext).transform();
+            ouzel::DeadCodeEliminator(optimizedContext, ouzel::Program::Fragment).transform();
+        }));
+
+        if (optimizedContexts.back()->getDeclarations().empty())
+            throw std::runtime_error{"Optimizer removed every declaration"};
+
+        std::size_t outputSize = 0;
+
+        results.stages.push_back(measure("output hlsl", iterations, [&context, &outputSize]() {
+            ouzel::OutputHLSL output(ouzel::Program::Fragment);
+            outputSize += output.output(context, false).size();
+        }));
+
+        results.stages.push_back(measure("output glsl", iterations, [&context, &outputSize]() {
+            ouzel::OutputGLSL output(ouzel::Program::Fragment, 110);
+            outputSize += output.output(context, false).size();
+        }));
+
+        results.stages.push_back(measure("output msl", iterations, [&context, &outputSize]() {
+            ouzel::OutputMSL output(ouzel::Program::Fragment);
+            outputSize += output.output(context, false).size();
+        }));
+
+        results.stages.push_back(measure("output cpp", iterations, [&context, &outputSize]() {
+            ouzel::OutputCPP output(ouzel::Program::Fragment);
+            outputSize += output.output(context, false).size();
+        }));
+
+        if (outputSize == 0)
+            throw std::runtime_error{"Backends produced no output"};
+
+        if (invocations > 0)
+        {
+            const ouzel::Context interpreterContext(ouzel::tokenize(interpreterShader));
+            ouzel::Interpreter interpreter(interpreterContext, ouzel::Program::Fragment);
+
+            std::vector<float> pixels(16 * 16 * 4);
+            for (std::size_t i = 0; i < pixels.size(); ++i)
+                pixels[i] = static_cast<float>(i % 7) / 6.0F;
+
+            const ouzel::Texture texture{16, 16, std::move(pixels)};
+            interpreter.setTexture("diffuse", texture);
+            interpreter.getGlobal("transform").components = {1.0, 0.5, -0.5, 1.0};
+
+            // one invocation per pixel of a square tile
+            const auto tileSize = static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(invocations))));
+            std::vector<ouzel::Value> inputs;
+            inputs.reserve(invocations);
+
+            for (std::size_t i = 0; i < invocations; ++i)
+            {
+                ouzel::Value input{interpreter.getEntryPoint().parameterDeclarations[0]->qualifiedType.type};
+                input.elements[0].components[0] = (static_cast<double>(i % tileSize) + 0.5) / static_cast<double>(tileSize);
+                input.elements[0].components[1] = (static_cast<double>(i / tileSize) + 0.5) / static_cast<double>(tileSize);
+                inputs.push_back(std::move(input));
+            }
+
+            std::size_t discarded = 0;
+            auto stage = measure("interpret", iterations, [&interpreter, &inputs, &discarded]() {
+                std::vector<ouzel::Value> arguments(1);
+                for (const auto& input : inputs)
+                {
+                    arguments[0] = input;
+                    if (!interpreter.run(arguments)) ++discarded;
+                }
+            });
+
+            if (discarded == inputs.size() * iterations)
+                throw std::runtime_error{"Interpreter discarded every invocation"};
+
+            stage.invocationCount = invocations;
+            results.stages.push_back(stage);
+
+            // the same invocations on the bytecode of the shader
+            ouzel::VirtualMachine virtualMachine(ouzel::BytecodeCompiler(interpreterContext, ouzel::Program::Fragment).getBytecode());
+            virtualMachine.setTexture("diffuse", texture);
+            virtualMachine.setGlobal("transform", {
+                ouzel::VirtualMachine::fromFloat(1.0F), ouzel::VirtualMachine::fromFloat(0.5F),
+                ouzel::VirtualMachine::fromFloat(-0.5F), ouzel::VirtualMachine::fromFloat(1.0F)
+            });
+
+            std::vector<std::uint32_t> cells;
+            cells.reserve(invocations * 2);
+            for (const auto& input : inputs)
+            {
+                cells.push_back(ouzel::VirtualMachine::fromFloat(static_cast<float>(input.elements[0].components[0])));
+                cells.push_back(ouzel::VirtualMachine::fromFloat(static_cast<float>(input.elements[0].components[1])));
+            }
+
+            std::size_t virtualMachineDiscarded = 0;
+            auto virtualMachineStage = measure("bytecode vm", iterations, [&virtualMachine, &cells, &virtualMachineDiscarded]() {
+                std::vector<std::uint32_t> arguments(2);
+                std::vector<std::uint32_t> result;
+                for (std::size_t i = 0; i < cells.size(); i += 2)
+                {
+                    arguments[0] = cells[i];
+                    arguments[1] = cells[i + 1];
+                    if (!virtualMachine.run(arguments, result)) ++virtualMachineDiscarded;
+                }
+            });
+
+            if (virtualMachineDiscarded != discarded)
+                throw std::runtime_error{"Virtual machine and interpreter results differ"};
+
+            virtualMachineStage.invocationCount = invocations;
+            results.stages.push_back(virtualMachineStage);
+
+            // the virtual machine takes the same coordinates as the native code
+            std::vector<float> coordinates;
+            coordinates.reserve(invocations * 2);
+            for (const auto cell : cells)
+                coordinates.push_back(ouzel::VirtualMachine::toFloat(cell));
+
+            std::size_t nativeDiscarded = 0;
+            if (auto nativeStage = measureNative("native cpp", iterations, interpreterContext, texture, coordinates, nativeDiscarded))
+            {
+                if (nativeDiscarded * iterations != discarded)
+                    throw std::runtime_error{"Native code and interpreter results differ"};
+
+                results.stages.push_back(*nativeStage);
+            }
+            else
+                std::cerr << "Skipping the native cpp stage, the shader could not be compiled\n";
+
+            results.stages.push_back(measureTile<8>("interpret simd8", iterations, interpreterContext, texture, tileSize));
+            results.stages.push_back(measureTile<16>("interpret simd16", iterations, interpreterContext, texture, tileSize));
+        }
+
+        const auto json = getJson(results);
+
+        if (format == "json")
+            std::cout << json << '\n';
+        else
+            std::cout << getText(results);
+
+        if (!outputFilename.empty())
+        {
+            std::ofstream outputFile(outputFilename, std::ios::binary);
+
+            if (!outputFile)
+                throw std::runtime_error{"Failed to open file " + outputFilename};
+
+            outputFile << json << '\n';
+        }
+
+        if (!baselineFilename.empty())
+        {
+            std::ifstream baselineFile(baselineFilename, std::ios::binary);
+
+            if (!baselineFile)
+                throw std::runtime_error{"Failed to open file " + baselineFilename};
+
+            const std::string baseline{std::istreambuf_iterator<char>(baselineFile), std::istreambuf_iterator<char>()};
+
+            if (compare(results, baseline, tolerance, allocationTolerance) > 0)
+                return EXIT_FAILURE;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
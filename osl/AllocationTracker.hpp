@@ -0,0 +1,118 @@
+//
+//  OSL
+//
+
+#ifndef ALLOCATIONTRACKER_HPP
+#define ALLOCATIONTRACKER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace ouzel
+{
+    // Counts heap allocations when the global allocation functions are replaced with
+    // OSL_DEFINE_ALLOCATION_TRACKER, otherwise all of the counters stay at zero
+    class AllocationTracker final
+    {
+    public:
+        AllocationTracker() = delete;
+
+        [[nodiscard]]
+        static void* allocate(std::size_t size)
+        {
+            const auto pointer = static_cast<unsigned char*>(std::malloc(size + headerSize));
+            if (!pointer)
+                throw std::bad_alloc{};
+
+            *reinterpret_cast<std::size_t*>(pointer) = size;
+
+            allocationCount.fetch_add(1, std::memory_order_relaxed);
+            allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+
+            const auto current = currentBytes.fetch_add(size, std::memory_order_relaxed) + size;
+
+            auto peak = peakBytes.load(std::memory_order_relaxed);
+            while (current > peak &&
+                   !peakBytes.compare_exchange_weak(peak, current, std::memory_order_relaxed));
+
+            return pointer + headerSize;
+        }
+
+        static void deallocate(void* pointer) noexcept
+        {
+            if (!pointer) return;
+
+            const auto block = static_cast<unsigned char*>(pointer) - headerSize;
+            const auto size = *reinterpret_cast<const std::size_t*>(block);
+
+            currentBytes.fetch_sub(size, std::memory_order_relaxed);
+
+            std::free(block);
+        }
+
+        [[nodiscard]]
+        static std::size_t getCurrentBytes() noexcept
+        {
+            return currentBytes.load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]]
+        static std::size_t getPeakBytes() noexcept
+        {
+            return peakBytes.load(std::memory_order_relaxed);
+        }
+
+        // number of allocations made since the start of the program
+        [[nodiscard]]
+        static std::size_t getAllocationCount() noexcept
+        {
+            return allocationCount.load(std::memory_order_relaxed);
+        }
+
+        // sum of the sizes of all allocations made since the start of the program
+        [[nodiscard]]
+        static std::size_t getAllocatedBytes() noexcept
+        {
+            return allocatedBytes.load(std::memory_order_relaxed);
+        }
+
+        static void resetPeak() noexcept
+        {
+            peakBytes.store(currentBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+
+    private:
+        // keeps the returned pointer aligned for any fundamental type
+        static constexpr std::size_t headerSize = alignof(std::max_align_t);
+
+        static inline std::atomic<std::size_t> currentBytes{0};
+        static inline std::atomic<std::size_t> peakBytes{0};
+        static inline std::atomic<std::size_t> allocationCount{0};
+        static inline std::atomic<std::size_t> allocatedBytes{0};
+    };
+}
+
+// Replaces the global allocation functions, must be used in exactly one translation unit
+#define OSL_DEFINE_ALLOCATION_TRACKER() \
+    void* operator new(std::size_t size) { return ouzel::AllocationTracker::allocate(size); } \
+    void* operator new[](std::size_t size) { return ouzel::AllocationTracker::allocate(size); } \
+    void* operator new(std::size_t size, const std::nothrow_t&) noexcept \
+    { \
+        try { return ouzel::AllocationTracker::allocate(size); } \
+        catch (...) { return nullptr; } \
+    } \
+    void* operator new[](std::size_t size, const std::nothrow_t&) noexcept \
+    { \
+        try { return ouzel::AllocationTracker::allocate(size); } \
+        catch (...) { return nullptr; } \
+    } \
+    void operator delete(void* pointer) noexcept { ouzel::AllocationTracker::deallocate(pointer); } \
+    void operator delete[](void* pointer) noexcept { ouzel::AllocationTracker::deallocate(pointer); } \
+    void operator delete(void* pointer, std::size_t) noexcept { ouzel::AllocationTracker::deallocate(pointer); } \
+    void operator delete[](void* pointer, std::size_t) noexcept { ouzel::AllocationTracker::deallocate(pointer); } \
+    void operator delete(void* pointer, const std::nothrow_t&) noexcept { ouzel::AllocationTracker::deallocate(pointer); } \
+    void operator delete[](void* pointer, const std::nothrow_t&) noexcept { ouzel::AllocationTracker::deallocate(pointer); }
+
+#endif // ALLOCATIONTRACKER_HPP
@@ -0,0 +1,156 @@
+//
+//  OSL
+//
+
+#ifndef ASYNCCOMPILER_HPP
+#define ASYNCCOMPILER_HPP
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Compiler.hpp"
+#include "ThreadPool.hpp"
+
+namespace ouzel
+{
+    class CompileCancelled final: public std::runtime_error
+    {
+    public:
+        CompileCancelled(): std::runtime_error{"Compilation cancelled"} {}
+    };
+
+    // A submitted compilation, its future throws CompileCancelled if it was cancelled before it finished
+    class CompileJob final
+    {
+    public:
+        CompileJob(std::future<Compiler::Result> initFuture,
+                   std::shared_ptr<std::atomic<bool>> initCancelled):
+            future{std::move(initFuture)}, cancelled{std::move(initCancelled)}
+        {
+        }
+
+        [[nodiscard]] std::future<Compiler::Result>& getFuture() noexcept { return future; }
+
+        // waits for the result
+        Compiler::Result get() { return future.get(); }
+
+        // a job that is already running finishes, but its result is dropped
+        void cancel() noexcept { cancelled->store(true, std::memory_order_relaxed); }
+
+        [[nodiscard]] bool isCancelled() const noexcept { return cancelled->load(std::memory_order_relaxed); }
+
+    private:
+        std::future<Compiler::Result> future;
+        std::shared_ptr<std::atomic<bool>> cancelled;
+    };
+
+    // Compiles shaders in the background on a thread pool, every thread has its own compiler,
+    // so that the buffers of the compilers are reused by the following jobs
+    class AsyncCompiler final
+    {
+    public:
+        // called on the thread that compiled the source, unless the job was cancelled
+        using Callback = std::function<void(const Compiler::Result&)>;
+
+        // zero threads means one per hardware thread, the errors of the prelude are thrown here
+        explicit AsyncCompiler(const Compiler::Options& options = Compiler::Options(),
+                               const std::string& prelude = std::string(),
+                               std::size_t threadCount = 0):
+            pool{threadCount}
+        {
+            for (std::size_t i = 0; i < pool.getThreadCount(); ++i)
+            {
+                compilers.emplace_back(options);
+                if (!prelude.empty()) compilers.back().setPrelude(prelude);
+            }
+        }
+
+        // the jobs that have not started yet are cancelled
+        ~AsyncCompiler()
+        {
+            stopping.store(true, std::memory_order_relaxed);
+        }
+
+        AsyncCompiler(const AsyncCompiler&) = delete;
+        AsyncCompiler& operator=(const AsyncCompiler&) = delete;
+
+        [[nodiscard]] std::size_t getThreadCount() const noexcept { return pool.getThreadCount(); }
+
+        CompileJob submit(const std::string& source, Target target, Program program,
+                          const Callback& callback = nullptr)
+        {
+            return submit(std::string(), source, target, program, callback);
+        }
+
+        // cancels the previous job with the same key, for example the path of a file that changed again,
+        // an empty key cancels nothing
+        CompileJob submit(const std::string& key, const std::string& source, Target target, Program program,
+                          const Callback& callback = nullptr)
+        {
+            auto cancelled = std::make_shared<std::atomic<bool>>(false);
+
+            if (!key.empty())
+            {
+                std::lock_guard<std::mutex> lock(jobMutex);
+                auto& job = jobs[key];
+                if (job) job->store(true, std::memory_order_relaxed);
+                job = cancelled;
+            }
+
+            auto promise = std::make_shared<std::promise<Compiler::Result>>();
+            CompileJob result(promise->get_future(), cancelled);
+
+            pool.submit([this, key, source, target, program, callback, cancelled, promise](std::size_t index) {
+                try
+                {
+                    if (isCancelled(*cancelled))
+                        throw CompileCancelled{};
+
+                    auto compileResult = compilers[index].compile(source, target, program);
+
+                    if (isCancelled(*cancelled))
+                        throw CompileCancelled{};
+
+                    if (callback) callback(compileResult);
+                    promise->set_value(std::move(compileResult));
+                }
+                catch (...)
+                {
+                    promise->set_exception(std::current_exception());
+                }
+
+                if (!key.empty())
+                {
+                    std::lock_guard<std::mutex> lock(jobMutex);
+                    const auto job = jobs.find(key);
+                    if (job != jobs.end() && job->second == cancelled)
+                        jobs.erase(job);
+                }
+            });
+
+            return result;
+        }
+
+    private:
+        bool isCancelled(const std::atomic<bool>& cancelled) const noexcept
+        {
+            return cancelled.load(std::memory_order_relaxed) || stopping.load(std::memory_order_relaxed);
+        }
+
+        std::vector<Compiler> compilers;
+        std::atomic<bool> stopping{false};
+        std::mutex jobMutex;
+        std::map<std::string, std::shared_ptr<std::atomic<bool>>> jobs;
+        // destroyed first, so that the running jobs finish before the compilers go away
+        ThreadPool pool;
+    };
+}
+
+#endif // ASYNCCOMPILER_HPP
@@ -0,0 +1,568 @@
+//
+//  OSL
+//
+
+#ifndef BYTECODE_HPP
+#define BYTECODE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace ouzel
+{
+    // kind of the 32-bit cells an instruction operates on
+    enum class ValueKind: std::uint8_t
+    {
+        Boolean,
+        Integer,
+        UnsignedInteger,
+        FloatingPoint
+    };
+
+    // typed opcodes, the vector width of an instruction is in Instruction::width
+    enum class Opcode: std::uint8_t
+    {
+        Constant, // a = constants[b]
+        Clear, // a = 0
+        Move, // a = b
+        LoadGlobal, // a = globals[b]
+        StoreGlobal, // globals[a] = b
+        LoadIndirect, // a = registers[b + c]
+        StoreIndirect, // registers[a + c] = b
+        LoadGlobalIndirect, // a = globals[b + c]
+        StoreGlobalIndirect, // globals[a + c] = b
+        Splat, // a = b repeated width times
+        Bound, // a = b if 0 <= b < c, traps otherwise
+
+        FloatAdd, // a = b + c
+        FloatSubtract,
+        FloatMultiply,
+        FloatDivide,
+        FloatNegate, // a = -b
+        FloatAbs,
+        FloatLess, // a = b < c
+        FloatLessEqual,
+        FloatEqual, // a = all components of b and c are equal
+        MatrixMultiply, // a = b * c with the dimensions packed in width
+
+        IntegerAdd,
+        IntegerSubtract,
+        IntegerMultiply,
+        IntegerDivide,
+        UnsignedDivide,
+        IntegerNegate,
+        IntegerAbs,
+        IntegerLess,
+        IntegerLessEqual,
+        UnsignedLess,
+        UnsignedLessEqual,
+        IntegerEqual,
+
+        Not, // a = !b
+        And, // a = b && c
+        Convert, // a = b converted from the kind c to kind
+
+        Jump, // goto b
+        JumpIfFalse, // if (!a) goto b
+        JumpIfTrue, // if (a) goto b
+        Call, // calls function b with the frame starting at register a
+        Return,
+        Discard,
+        TextureSample, // a = sample(b, c)
+        TextureLoad // a = load(b, c)
+    };
+
+    constexpr std::size_t opcodeCount = static_cast<std::size_t>(Opcode::TextureLoad) + 1;
+
+    struct Instruction final
+    {
+        Opcode opcode = Opcode::Return;
+        ValueKind kind = ValueKind::FloatingPoint;
+        std::uint16_t width = 1;
+        std::uint32_t a = 0;
+        std::uint32_t b = 0;
+        std::uint32_t c = 0;
+    };
+
+    // program lowered to register bytecode, every value is a range of 32-bit registers
+    // in the frame of the function or in the global memory
+    class Bytecode final
+    {
+    public:
+        struct Function final
+        {
+            std::string name;
+            std::uint32_t entry = 0;
+            std::uint32_t frameSize = 0; // the result is followed by the parameters at the start of the frame
+            std::uint32_t resultSize = 0;
+            std::vector<std::uint32_t> parameterSizes;
+        };
+
+        struct Global final
+        {
+            std::string name;
+            std::uint32_t offset = 0;
+            std::uint32_t size = 0;
+            bool texture = false; // holds the index of a texture slot
+        };
+
+        static constexpr std::uint32_t version = 1;
+
+        std::vector<Instruction> instructions;
+        std::vector<std::uint32_t> constants;
+        std::vector<Function> functions;
+        std::vector<Global> globals;
+        std::uint32_t globalSize = 0;
+        std::uint32_t initializer = 0; // function that initializes the globals
+        std::uint32_t entryPoint = 0;
+
+        [[nodiscard]]
+        std::vector<std::uint8_t> serialize() const
+        {
+            std::vector<std::uint8_t> data{'O', 'S', 'L', 'B'};
+
+            write(data, version);
+            write(data, globalSize);
+            write(data, initializer);
+            write(data, entryPoint);
+
+            write(data, static_cast<std::uint32_t>(constants.size()));
+            for (const auto constant : constants)
+                write(data, constant);
+
+            write(data, static_cast<std::uint32_t>(functions.size()));
+            for (const auto& function : functions)
+            {
+                write(data, function.name);
+                write(data, function.entry);
+                write(data, function.frameSize);
+                write(data, function.resultSize);
+                write(data, static_cast<std::uint32_t>(function.parameterSizes.size()));
+                for (const auto parameterSize : function.parameterSizes)
+                    write(data, parameterSize);
+            }
+
+            write(data, static_cast<std::uint32_t>(globals.size()));
+            for (const auto& global : globals)
+            {
+                write(data, global.name);
+                write(data, global.offset);
+                write(data, global.size);
+                data.push_back(global.texture ? 1 : 0);
+            }
+
+            write(data, static_cast<std::uint32_t>(instructions.size()));
+            for (const auto& instruction : instructions)
+            {
+                data.push_back(static_cast<std::uint8_t>(instruction.opcode));
+                data.push_back(static_cast<std::uint8_t>(instruction.kind));
+                data.push_back(static_cast<std::uint8_t>(instruction.width & 0xFF));
+                data.push_back(static_cast<std::uint8_t>(instruction.width >> 8));
+                write(data, instruction.a);
+                write(data, instruction.b);
+                write(data, instruction.c);
+            }
+
+            return data;
+        }
+
+        // throws if the data is truncated or the bytecode is not valid
+        static Bytecode deserialize(const std::vector<std::uint8_t>& data)
+        {
+            std::size_t position = 0;
+
+            if (data.size() < 4 || std::memcmp(data.data(), "OSLB", 4) != 0)
+                throw std::runtime_error{"Invalid bytecode header"};
+            position = 4;
+
+            if (readInteger(data, position) != version)
+                throw std::runtime_error{"Unsupported bytecode version"};
+
+            Bytecode result;
+            result.globalSize = readInteger(data, position);
+            result.initializer = readInteger(data, position);
+            result.entryPoint = readInteger(data, position);
+
+            result.constants.resize(readCount(data, position, 4));
+            for (auto& constant : result.constants)
+                constant = readInteger(data, position);
+
+            result.functions.resize(readCount(data, position, 20));
+            for (auto& function : result.functions)
+            {
+                function.name = readString(data, position);
+                function.entry = readInteger(data, position);
+                function.frameSize = readInteger(data, position);
+                function.resultSize = readInteger(data, position);
+                function.parameterSizes.resize(readCount(data, position, 4));
+                for (auto& parameterSize : function.parameterSizes)
+                    parameterSize = readInteger(data, position);
+            }
+
+            result.globals.resize(readCount(data, position, 17));
+            for (auto& global : result.globals)
+            {
+                global.name = readString(data, position);
+                global.offset = readInteger(data, position);
+                global.size = readInteger(data, position);
+                global.texture = readByte(data, position) != 0;
+            }
+
+            result.instructions.resize(readCount(data, position, 16));
+            for (auto& instruction : result.instructions)
+            {
+                const auto opcode = readByte(data, position);
+                const auto kind = readByte(data, position);
+                if (opcode >= opcodeCount || kind > static_cast<std::uint8_t>(ValueKind::FloatingPoint))
+                    throw std::runtime_error{"Invalid instruction"};
+
+                instruction.opcode = static_cast<Opcode>(opcode);
+                instruction.kind = static_cast<ValueKind>(kind);
+                instruction.width = readByte(data, position);
+                instruction.width = static_cast<std::uint16_t>(instruction.width | (readByte(data, position) << 8));
+                instruction.a = readInteger(data, position);
+                instruction.b = readInteger(data, position);
+                instruction.c = readInteger(data, position);
+            }
+
+            if (position != data.size())
+                throw std::runtime_error{"Unexpected data after the bytecode"};
+
+            result.validate();
+            return result;
+        }
+
+        // checks that every operand is in range, so that the virtual machine only has to check
+        // the indirect accesses and the stack size at run time
+        void validate() const
+        {
+            if (functions.empty() || initializer >= functions.size() || entryPoint >= functions.size())
+                throw std::runtime_error{"Invalid function index"};
+
+            for (const auto& global : globals)
+                if (!fits(global.offset, global.size, globalSize) || (global.texture && global.size != 1))
+                    throw std::runtime_error{"Invalid global " + global.name};
+
+            for (std::size_t index = 0; index < functions.size(); ++index)
+            {
+                const auto& function = functions[index];
+                const auto end = getFunctionEnd(index);
+
+                std::uint64_t size = function.resultSize;
+                for (const auto parameterSize : function.parameterSizes) size += parameterSize;
+
+                if (function.entry >= end || size > function.frameSize)
+                    throw std::runtime_error{"Invalid function " + function.name};
+
+                // the code of a function ends with a return or a jump, so it never falls through to the next function
+                const auto last = instructions[end - 1].opcode;
+                if (last != Opcode::Return && last != Opcode::Jump)
+                    throw std::runtime_error{"Function " + function.name + " does not end with a return"};
+
+                for (auto pc = function.entry; pc < end; ++pc)
+                    if (!isValid(instructions[pc], function, end))
+                        throw std::runtime_error{"Invalid instruction " + std::to_string(pc) + " in function " + function.name};
+            }
+        }
+
+        [[nodiscard]]
+        std::string disassemble() const
+        {
+            std::string result;
+
+            for (std::size_t index = 0; index < functions.size(); ++index)
+            {
+                const auto& function = functions[index];
+
+                result += "function " + function.name + " (frame " + std::to_string(function.frameSize) +
+                    ", result " + std::to_string(function.resultSize) + ")";
+                if (index == entryPoint) result += " entry point";
+                if (index == initializer) result += " initializer";
+                result += '\n';
+
+                for (auto pc = function.entry; pc < getFunctionEnd(index); ++pc)
+                    result += disassemble(pc) + '\n';
+            }
+
+            for (const auto& global : globals)
+                result += "global " + global.name + ": g" + std::to_string(global.offset) +
+                    " (" + std::to_string(global.size) + (global.texture ? ", texture)\n" : ")\n");
+
+            return result;
+        }
+
+        // the code of a function extends to the entry of the next function
+        [[nodiscard]]
+        std::uint32_t getFunctionEnd(std::size_t index) const noexcept
+        {
+            auto end = static_cast<std::uint32_t>(instructions.size());
+            for (const auto& function : functions)
+                if (function.entry > functions[index].entry && function.entry < end)
+                    end = function.entry;
+            return end;
+        }
+
+        static std::uint32_t packMatrixDimensions(std::uint32_t rows, std::uint32_t inner, std::uint32_t columns) noexcept
+        {
+            return rows | (inner << 4) | (columns << 8);
+        }
+
+    private:
+        static void write(std::vector<std::uint8_t>& data, std::uint32_t value)
+        {
+            for (std::size_t i = 0; i < 4; ++i)
+                data.push_back(static_cast<std::uint8_t>(value >> (i * 8)));
+        }
+
+        static void write(std::vector<std::uint8_t>& data, const std::string& value)
+        {
+            write(data, static_cast<std::uint32_t>(value.size()));
+            data.insert(data.end(), value.begin(), value.end());
+        }
+
+        static std::uint8_t readByte(const std::vector<std::uint8_t>& data, std::size_t& position)
+        {
+            if (position >= data.size())
+                throw std::runtime_error{"Unexpected end of bytecode"};
+            return data[position++];
+        }
+
+        static std::uint32_t readInteger(const std::vector<std::uint8_t>& data, std::size_t& position)
+        {
+            std::uint32_t result = 0;
+            for (std::size_t i = 0; i < 4; ++i)
+                result |= static_cast<std::uint32_t>(readByte(data, position)) << (i * 8);
+            return result;
+        }
+
+        // counts are checked against the remaining data before anything is allocated
+        static std::uint32_t readCount(const std::vector<std::uint8_t>& data, std::size_t& position, std::size_t elementSize)
+        {
+            const auto count = readInteger(data, position);
+            if (count > (data.size() - position) / elementSize)
+                throw std::runtime_error{"Unexpected end of bytecode"};
+            return count;
+        }
+
+        static std::string readString(const std::vector<std::uint8_t>& data, std::size_t& position)
+        {
+            const auto size = readCount(data, position, 1);
+            std::string result(data.begin() + static_cast<std::ptrdiff_t>(position),
+                               data.begin() + static_cast<std::ptrdiff_t>(position + size));
+            position += size;
+            return result;
+        }
+
+        static bool fits(std::uint64_t start, std::uint64_t size, std::uint64_t limit) noexcept
+        {
+            return start + size <= limit;
+        }
+
+        bool isValid(const Instruction& instruction, const Function& function, std::uint32_t end) const noexcept
+        {
+            const auto width = instruction.width;
+            const auto frameSize = function.frameSize;
+            const auto isLocal = [frameSize](std::uint32_t index, std::uint32_t size) {
+                return fits(index, size, frameSize);
+            };
+            const auto isTarget = [&function, end](std::uint32_t target) {
+                return target >= function.entry && target < end;
+            };
+
+            switch (instruction.opcode)
+            {
+                case Opcode::Constant:
+                    return isLocal(instruction.a, width) && fits(instruction.b, width, constants.size());
+                case Opcode::Clear:
+                    return isLocal(instruction.a, width);
+                case Opcode::Move:
+                    return isLocal(instruction.a, width) && isLocal(instruction.b, width);
+                case Opcode::LoadGlobal:
+                    return isLocal(instruction.a, width) && fits(instruction.b, width, globalSize);
+                case Opcode::StoreGlobal:
+                    return fits(instruction.a, width, globalSize) && isLocal(instruction.b, width);
+                case Opcode::LoadIndirect:
+                case Opcode::LoadGlobalIndirect:
+                    return isLocal(instruction.a, width) && isLocal(instruction.c, 1);
+                case Opcode::StoreIndirect:
+                case Opcode::StoreGlobalIndirect:
+                    return isLocal(instruction.b, width) && isLocal(instruction.c, 1);
+                case Opcode::Splat:
+                    return isLocal(instruction.a, width) && isLocal(instruction.b, 1);
+                case Opcode::Bound:
+                    return isLocal(instruction.a, 1) && isLocal(instruction.b, 1);
+
+                case Opcode::FloatAdd:
+                case Opcode::FloatSubtract:
+                case Opcode::FloatMultiply:
+                case Opcode::FloatDivide:
+                case Opcode::IntegerAdd:
+                case Opcode::IntegerSubtract:
+                case Opcode::IntegerMultiply:
+                case Opcode::IntegerDivide:
+                case Opcode::UnsignedDivide:
+                    return isLocal(instruction.a, width) && isLocal(instruction.b, width) && isLocal(instruction.c, width);
+
+                case Opcode::FloatNegate:
+                case Opcode::FloatAbs:
+                case Opcode::IntegerNegate:
+                case Opcode::IntegerAbs:
+                    return isLocal(instruction.a, width) && isLocal(instruction.b, width);
+
+                case Opcode::FloatLess:
+                case Opcode::FloatLessEqual:
+                case Opcode::IntegerLess:
+                case Opcode::IntegerLessEqual:
+                case Opcode::UnsignedLess:
+                case Opcode::UnsignedLessEqual:
+                case Opcode::And:
+                    return isLocal(instruction.a, 1) && isLocal(instruction.b, 1) && isLocal(instruction.c, 1);
+
+                case Opcode::FloatEqual:
+                case Opcode::IntegerEqual:
+                    return isLocal(instruction.a, 1) && isLocal(instruction.b, width) && isLocal(instruction.c, width);
+
+                case Opcode::MatrixMultiply:
+                {
+                    const std::uint32_t rows = width & 0x0F;
+                    const std::uint32_t inner = (width >> 4) & 0x0F;
+                    const std::uint32_t columns = (width >> 8) & 0x0F;
+                    return rows >= 1 && rows <= 4 && inner >= 1 && inner <= 4 && columns >= 1 && columns <= 4 &&
+                        isLocal(instruction.a, rows * columns) &&
+                        isLocal(instruction.b, rows * inner) &&
+                        isLocal(instruction.c, inner * columns);
+                }
+
+                case Opcode::Not:
+                    return isLocal(instruction.a, 1) && isLocal(instruction.b, 1);
+                case Opcode::Convert:
+                    return isLocal(instruction.a, width) && isLocal(instruction.b, width) &&
+                        instruction.c <= static_cast<std::uint32_t>(ValueKind::FloatingPoint);
+
+                case Opcode::Jump:
+                    return isTarget(instruction.b);
+                case Opcode::JumpIfFalse:
+                case Opcode::JumpIfTrue:
+                    return isLocal(instruction.a, 1) && isTarget(instruction.b);
+                case Opcode::Call:
+                    return instruction.a <= frameSize && instruction.b < functions.size();
+                case Opcode::Return:
+                case Opcode::Discard:
+                    return true;
+                case Opcode::TextureSample:
+                case Opcode::TextureLoad:
+                    return isLocal(instruction.a, 4) && isLocal(instruction.b, 1) && isLocal(instruction.c, 2);
+            }
+
+            return false;
+        }
+
+        std::string disassemble(std::uint32_t pc) const
+        {
+            static const char* names[opcodeCount] = {
+                "const", "clear", "mov", "ldg", "stg", "ldi", "sti", "ldgi", "stgi", "splat", "bound",
+                "add.f32", "sub.f32", "mul.f32", "div.f32", "neg.f32", "abs.f32", "lt.f32", "le.f32", "eq.f32", "mmul.f32",
+                "add.i32", "sub.i32", "mul.i32", "div.i32", "div.u32", "neg.i32", "abs.i32", "lt.i32", "le.i32", "lt.u32", "le.u32", "eq.i32",
+                "not", "and", "cvt",
+                "jmp", "jz", "jnz", "call", "ret", "discard", "sample", "load"
+            };
+            static const char* kinds[] = {"bool", "i32", "u32", "f32"};
+
+            const auto& instruction = instructions[pc];
+            const auto r = [](std::uint32_t index) { return "r" + std::to_string(index); };
+            const auto g = [](std::uint32_t index) { return "g" + std::to_string(index); };
+
+            std::string name = names[static_cast<std::size_t>(instruction.opcode)];
+            std::string operands;
+            std::string comment;
+
+            switch (instruction.opcode)
+            {
+                case Opcode::Constant:
+                    operands = r(instruction.a) + ", k" + std::to_string(instruction.b);
+                    comment = formatConstant(constants[instruction.b], instruction.kind);
+                    break;
+                case Opcode::Clear: operands = r(instruction.a); break;
+                case Opcode::Move: operands = r(instruction.a) + ", " + r(instruction.b); break;
+                case Opcode::LoadGlobal: operands = r(instruction.a) + ", " + g(instruction.b); break;
+                case Opcode::StoreGlobal: operands = g(instruction.a) + ", " + r(instruction.b); break;
+                case Opcode::LoadIndirect: operands = r(instruction.a) + ", " + r(instruction.b) + "[" + r(instruction.c) + "]"; break;
+                case Opcode::StoreIndirect: operands = r(instruction.a) + "[" + r(instruction.c) + "], " + r(instruction.b); break;
+                case Opcode::LoadGlobalIndirect: operands = r(instruction.a) + ", " + g(instruction.b) + "[" + r(instruction.c) + "]"; break;
+                case Opcode::StoreGlobalIndirect: operands = g(instruction.a) + "[" + r(instruction.c) + "], " + r(instruction.b); break;
+                case Opcode::Bound:
+                    name += std::string(".") + kinds[static_cast<std::size_t>(instruction.kind)];
+                    operands = r(instruction.a) + ", " + r(instruction.b) + ", " + std::to_string(instruction.c);
+                    break;
+                case Opcode::Convert:
+                    name += std::string(".") + kinds[static_cast<std::size_t>(instruction.kind)] +
+                        "." + kinds[std::min<std::size_t>(instruction.c, 3)];
+                    operands = r(instruction.a) + ", " + r(instruction.b);
+                    break;
+                case Opcode::MatrixMultiply:
+                    name += "." + std::to_string(instruction.width & 0x0F) + "x" +
+                        std::to_string((instruction.width >> 4) & 0x0F) + "x" + std::to_string((instruction.width >> 8) & 0x0F);
+                    operands = r(instruction.a) + ", " + r(instruction.b) + ", " + r(instruction.c);
+                    break;
+                case Opcode::Jump: operands = std::to_string(instruction.b); break;
+                case Opcode::JumpIfFalse:
+                case Opcode::JumpIfTrue:
+                    operands = r(instruction.a) + ", " + std::to_string(instruction.b);
+                    break;
+                case Opcode::Call:
+                    operands = r(instruction.a) + ", " + std::to_string(instruction.b);
+                    if (instruction.b < functions.size()) comment = functions[instruction.b].name;
+                    break;
+                case Opcode::Return:
+                case Opcode::Discard:
+                    break;
+                case Opcode::Splat:
+                case Opcode::FloatNegate:
+                case Opcode::FloatAbs:
+                case Opcode::IntegerNegate:
+                case Opcode::IntegerAbs:
+                case Opcode::Not:
+                    operands = r(instruction.a) + ", " + r(instruction.b);
+                    break;
+                default:
+                    operands = r(instruction.a) + ", " + r(instruction.b) + ", " + r(instruction.c);
+                    break;
+            }
+
+            if (instruction.width > 1 && instruction.opcode != Opcode::MatrixMultiply)
+                name += "x" + std::to_string(instruction.width);
+
+            char line[32];
+            std::snprintf(line, sizeof(line), "  %04u  %-16s ", pc, name.c_str());
+
+            return line + operands + (comment.empty() ? "" : " ; " + comment);
+        }
+
+        static std::string formatConstant(std::uint32_t bits, ValueKind kind)
+        {
+            switch (kind)
+            {
+                case ValueKind::Boolean: return bits ? "true" : "false";
+                case ValueKind::Integer: return std::to_string(static_cast<std::int32_t>(bits));
+                case ValueKind::UnsignedInteger: return std::to_string(bits) + "u";
+                case ValueKind::FloatingPoint:
+                {
+                    float value;
+                    std::memcpy(&value, &bits, sizeof(value));
+                    char buffer[32];
+                    std::snprintf(buffer, sizeof(buffer), "%gf", static_cast<double>(value));
+                    return buffer;
+                }
+            }
+
+            return std::to_string(bits);
+        }
+    };
+}
+
+#endif // BYTECODE_HPP
@@ -0,0 +1,1644 @@
+//
+//  OSL
+//
+
+#ifndef BYTECODECOMPILER_HPP
+#define BYTECODECOMPILER_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Bytecode.hpp"
+#include "Output.hpp"
+#include "Parser.hpp"
+
+namespace ouzel
+{
+    // Lowers the entry point of a program and the functions it calls to register bytecode,
+    // the semantics match the Interpreter
+    class BytecodeCompiler final
+    {
+    public:
+        BytecodeCompiler(const Context& context, Program program)
+        {
+            const auto qualifier = (program == Program::Fragment) ?
+                FunctionDeclaration::Qualifier::Fragment :
+                FunctionDeclaration::Qualifier::Vertex;
+
+            const FunctionDeclaration* entryPoint = nullptr;
+
+            for (const auto declaration : context.getDeclarations())
+                if (declaration->declarationKind == Declaration::Kind::Callable &&
+                    static_cast<const CallableDeclaration*>(declaration)->callableDeclarationKind == CallableDeclaration::Kind::Function &&
+                    static_cast<const FunctionDeclaration*>(declaration)->qualifier == qualifier &&
+                    static_cast<const FunctionDeclaration*>(declaration)->body)
+                    entryPoint = static_cast<const FunctionDeclaration*>(declaration);
+                else if (declaration->declarationKind == Declaration::Kind::Variable)
+                {
+                    auto& type = static_cast<const VariableDeclaration*>(declaration)->qualifiedType.type;
+
+                    Bytecode::Global global;
+                    global.name = declaration->name;
+                    global.offset = bytecode.globalSize;
+                    global.size = getCellCount(type);
+                    global.texture = isHandle(type);
+
+                    globalOffsets[declaration] = global.offset;
+                    bytecode.globalSize += global.size;
+                    bytecode.globals.push_back(global);
+                }
+
+            if (!entryPoint)
+                throw std::runtime_error{"No entry point found"};
+
+            compileInitializer(context);
+
+            bytecode.entryPoint = getFunctionIndex(*entryPoint);
+
+            while (!pendingFunctions.empty())
+            {
+                const auto function = pendingFunctions.back();
+                pendingFunctions.pop_back();
+                compileFunction(*function);
+            }
+
+            bytecode.validate();
+        }
+
+        [[nodiscard]]
+        const Bytecode& getBytecode() const noexcept
+        {
+            return bytecode;
+        }
+
+    private:
+        // registers of an lvalue, the components of a swizzle are offsets from the base
+        struct Place final
+        {
+            bool global = false;
+            std::uint32_t base = 0;
+            std::optional<std::uint32_t> offset; // register holding a dynamic offset
+            bool contiguous = true;
+            std::uint32_t count = 0;
+            std::array<std::uint32_t, 16> components{};
+        };
+
+        // jumps to patch at the end of a loop or switch
+        struct Target final
+        {
+            bool loop = false;
+            std::vector<std::size_t> breaks;
+            std::vector<std::size_t> continues;
+        };
+
+        static constexpr std::uint32_t maxWidth = 0xFFFF;
+
+        // textures and other structs without fields are opaque handles in one register
+        static bool isHandle(const Type& type) noexcept
+        {
+            if (type.typeKind != Type::Kind::Struct) return false;
+
+            for (const Declaration& memberDeclaration : static_cast<const StructType&>(type).memberDeclarations)
+                if (memberDeclaration.declarationKind == Declaration::Kind::Field) return false;
+
+            return true;
+        }
+
+        static std::uint32_t getCellCount(const Type& type)
+        {
+            switch (type.typeKind)
+            {
+                case Type::Kind::Void: return 0;
+                case Type::Kind::Scalar: return 1;
+                case Type::Kind::Vector: return static_cast<std::uint32_t>(static_cast<const VectorType&>(type).componentCount);
+                case Type::Kind::Matrix:
+                {
+                    auto& matrixType = static_cast<const MatrixType&>(type);
+                    return static_cast<std::uint32_t>(matrixType.rowCount * matrixType.rowType.componentCount);
+                }
+                case Type::Kind::Array:
+                {
+                    auto& arrayType = static_cast<const ArrayType&>(type);
+                    return static_cast<std::uint32_t>(arrayType.size) * getCellCount(arrayType.elementType.type);
+                }
+                case Type::Kind::Struct:
+                {
+                    if (isHandle(type)) return 1;
+
+                    std::uint32_t count = 0;
+                    for (const Declaration& memberDeclaration : static_cast<const StructType&>(type).memberDeclarations)
+                        if (memberDeclaration.declarationKind == Declaration::Kind::Field)
+                            count += getCellCount(static_cast<const FieldDeclaration&>(memberDeclaration).qualifiedType.type);
+                    return count;
+                }
+            }
+
+            return 0;
+        }
+
+        static std::uint32_t getFieldOffset(const FieldDeclaration& fieldDeclaration, const StructType& structType)
+        {
+            std::uint32_t offset = 0;
+            for (const Declaration& memberDeclaration : structType.memberDeclarations)
+                if (&memberDeclaration == &fieldDeclaration)
+                    return offset;
+                else if (memberDeclaration.declarationKind == Declaration::Kind::Field)
+                    offset += getCellCount(static_cast<const FieldDeclaration&>(memberDeclaration).qualifiedType.type);
+
+            throw std::runtime_error{"Field " + fieldDeclaration.name + " not found"};
+        }
+
+        static const ScalarType* getScalarType(const Type& type) noexcept
+        {
+            switch (type.typeKind)
+            {
+                case Type::Kind::Scalar: return &static_cast<const ScalarType&>(type);
+                case Type::Kind::Vector: return &static_cast<const VectorType&>(type).componentType;
+                case Type::Kind::Matrix: return &static_cast<const MatrixType&>(type).rowType.componentType;
+                default: return nullptr;
+            }
+        }
+
+        static ValueKind getValueKind(const ScalarType& scalarType) noexcept
+        {
+            switch (scalarType.scalarTypeKind)
+            {
+                case ScalarType::Kind::Boolean: return ValueKind::Boolean;
+                case ScalarType::Kind::Integer: return scalarType.isUnsigned ? ValueKind::UnsignedInteger : ValueKind::Integer;
+                case ScalarType::Kind::FloatingPoint: return ValueKind::FloatingPoint;
+            }
+
+            return ValueKind::Integer;
+        }
+
+        static ValueKind getValueKind(const Type& type) noexcept
+        {
+            const auto scalarType = getScalarType(type);
+            return scalarType ? getValueKind(*scalarType) : ValueKind::UnsignedInteger;
+        }
+
+        // whether evaluating the expression can write a local variable, in which case
+        // the operands evaluated before it can not be read directly from the registers of the variables
+        static bool mayWriteLocals(const Expression& expression) noexcept
+        {
+            switch (expression.expressionKind)
+            {
+                case Expression::Kind::Call:
+                {
+                    auto& callExpression = static_cast<const CallExpression&>(expression);
+                    auto& declaration = callExpression.declarationReference.declaration;
+
+                    if (declaration.declarationKind == Declaration::Kind::Callable)
+                        for (const auto parameterDeclaration : static_cast<const CallableDeclaration&>(declaration).parameterDeclarations)
+                            if (parameterDeclaration->inputModifier != InputModifier::In) return true;
+
+                    for (const Expression& argument : callExpression.arguments)
+                        if (mayWriteLocals(argument)) return true;
+                    return false;
+                }
+                case Expression::Kind::Literal:
+                case Expression::Kind::DeclarationReference:
+                    return false;
+                case Expression::Kind::Paren:
+                    return mayWriteLocals(static_cast<const ParenExpression&>(expression).expression);
+                case Expression::Kind::Member:
+                    return mayWriteLocals(static_cast<const MemberExpression&>(expression).expression);
+                case Expression::Kind::ArraySubscript:
+                {
+                    auto& arraySubscriptExpression = static_cast<const ArraySubscriptExpression&>(expression);
+                    return mayWriteLocals(arraySubscriptExpression.expression) || mayWriteLocals(arraySubscriptExpression.subscript);
+                }
+                case Expression::Kind::UnaryOperator:
+                {
+                    auto& unaryOperatorExpression = static_cast<const UnaryOperatorExpression&>(expression);
+                    return unaryOperatorExpression.operatorKind == UnaryOperatorExpression::Kind::PrefixIncrement ||
+                        unaryOperatorExpression.operatorKind == UnaryOperatorExpression::Kind::PrefixDecrement ||
+                        unaryOperatorExpression.operatorKind == UnaryOperatorExpression::Kind::PostfixIncrement ||
+                        unaryOperatorExpression.operatorKind == UnaryOperatorExpression::Kind::PostfixDecrement ||
+                        mayWriteLocals(unaryOperatorExpression.expression);
+                }
+                case Expression::Kind::BinaryOperator:
+                {
+                    auto& binaryOperatorExpression = static_cast<const BinaryOperatorExpression&>(expression);
+                    return (binaryOperatorExpression.category == Expression::Category::Lvalue &&
+                            binaryOperatorExpression.operatorKind != BinaryOperatorExpression::Kind::Subscript &&
+                            binaryOperatorExpression.operatorKind != BinaryOperatorExpression::Kind::Comma) ||
+                        mayWriteLocals(binaryOperatorExpression.leftExpression) ||
+                        mayWriteLocals(binaryOperatorExpression.rightExpression);
+                }
+                case Expression::Kind::TernaryOperator:
+                {
+                    auto& ternaryOperatorExpression = static_cast<const TernaryOperatorExpression&>(expression);
+                    return mayWriteLocals(ternaryOperatorExpression.condition) ||
+                        mayWriteLocals(ternaryOperatorExpression.leftExpression) ||
+                        mayWriteLocals(ternaryOperatorExpression.rightExpression);
+                }
+                case Expression::Kind::TemporaryObject:
+                    for (const Expression& parameter : static_cast<const TemporaryObjectExpression&>(expression).parameters)
+                        if (mayWriteLocals(parameter)) return true;
+                    return false;
+                case Expression::Kind::InitializerList:
+                    for (const Expression& child : static_cast<const InitializerListExpression&>(expression).expressions)
+                        if (mayWriteLocals(child)) return true;
+                    return false;
+                case Expression::Kind::Cast:
+                    return mayWriteLocals(static_cast<const CastExpression&>(expression).expression);
+                case Expression::Kind::VectorInitialize:
+                    for (const Expression& parameter : static_cast<const VectorInitializeExpression&>(expression).parameters)
+                        if (mayWriteLocals(parameter)) return true;
+                    return false;
+                case Expression::Kind::MatrixInitialize:
+                    for (const Expression& parameter : static_cast<const MatrixInitializeExpression&>(expression).parameters)
+                        if (mayWriteLocals(parameter)) return true;
+                    return false;
+                case Expression::Kind::VectorElement:
+                    return mayWriteLocals(static_cast<const VectorElementExpression&>(expression).expression);
+            }
+
+            return true;
+        }
+
+        std::size_t emit(Opcode opcode, std::uint32_t a, std::uint32_t b = 0, std::uint32_t c = 0,
+                         std::uint32_t width = 1, ValueKind kind = ValueKind::FloatingPoint)
+        {
+            if (width > maxWidth)
+                throw std::runtime_error{"Value is too large"};
+
+            Instruction instruction;
+            instruction.opcode = opcode;
+            instruction.kind = kind;
+            instruction.width = static_cast<std::uint16_t>(width);
+            instruction.a = a;
+            instruction.b = b;
+            instruction.c = c;
+            bytecode.instructions.push_back(instruction);
+            return bytecode.instructions.size() - 1;
+        }
+
+        std::uint32_t getPosition() const noexcept
+        {
+            return static_cast<std::uint32_t>(bytecode.instructions.size());
+        }
+
+        void patch(std::size_t jump, std::uint32_t target) noexcept
+        {
+            bytecode.instructions[jump].b = target;
+        }
+
+        std::uint32_t allocate(std::uint32_t count) noexcept
+        {
+            const auto result = top;
+            top += count;
+            if (top > frameSize) frameSize = top;
+            return result;
+        }
+
+        std::uint32_t getConstant(std::uint32_t bits)
+        {
+            const auto iterator = constantIndices.find(bits);
+            if (iterator != constantIndices.end()) return iterator->second;
+
+            const auto index = static_cast<std::uint32_t>(bytecode.constants.size());
+            bytecode.constants.push_back(bits);
+            constantIndices[bits] = index;
+            return index;
+        }
+
+        // reuses an equal sequence in the constant pool
+        std::uint32_t getConstants(const std::vector<std::uint32_t>& values)
+        {
+            const auto iterator = std::search(bytecode.constants.begin(), bytecode.constants.end(), values.begin(), values.end());
+            if (iterator != bytecode.constants.end())
+                return static_cast<std::uint32_t>(iterator - bytecode.constants.begin());
+
+            const auto index = static_cast<std::uint32_t>(bytecode.constants.size());
+            for (const auto value : values)
+            {
+                constantIndices.emplace(value, static_cast<std::uint32_t>(bytecode.constants.size()));
+                bytecode.constants.push_back(value);
+            }
+            return index;
+        }
+
+        // appends the bits of a literal converted to the scalar type
+        static bool getLiteralBits(const Expression& expression, const ScalarType& scalarType, std::vector<std::uint32_t>& bits)
+        {
+            if (expression.expressionKind != Expression::Kind::Literal) return false;
+
+            auto& literalExpression = static_cast<const LiteralExpression&>(expression);
+            double value;
+
+            switch (literalExpression.literalKind)
+            {
+                case LiteralExpression::Kind::Boolean:
+                    value = static_cast<const BooleanLiteralExpression&>(literalExpression).value ? 1.0 : 0.0;
+                    break;
+                case LiteralExpression::Kind::Integer:
+                    value = static_cast<double>(static_cast<const IntegerLiteralExpression&>(literalExpression).value);
+                    break;
+                case LiteralExpression::Kind::FloatingPoint:
+                    value = static_cast<double>(static_cast<float>(static_cast<const FloatingPointLiteralExpression&>(literalExpression).value));
+                    break;
+                default:
+                    return false;
+            }
+
+            switch (scalarType.scalarTypeKind)
+            {
+                case ScalarType::Kind::Boolean:
+                    bits.push_back(value != 0.0 ? 1U : 0U);
+                    return true;
+                case ScalarType::Kind::Integer:
+                    if (literalExpression.literalKind == LiteralExpression::Kind::FloatingPoint) return false;
+                    bits.push_back(static_cast<std::uint32_t>(static_cast<std::int64_t>(value)));
+                    return true;
+                case ScalarType::Kind::FloatingPoint:
+                {
+                    const auto floatValue = static_cast<float>(value);
+                    std::uint32_t result;
+                    std::memcpy(&result, &floatValue, sizeof(result));
+                    bits.push_back(result);
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        std::uint32_t loadConstant(std::uint32_t bits, ValueKind kind)
+        {
+            const auto result = allocate(1);
+            emit(Opcode::Constant, result, getConstant(bits), 0, 1, kind);
+            return result;
+        }
+
+        std::uint32_t getFunctionIndex(const CallableDeclaration& declaration)
+        {
+            const auto iterator = functionIndices.find(&declaration);
+            if (iterator != functionIndices.end()) return iterator->second;
+
+            const auto index = static_cast<std::uint32_t>(bytecode.functions.size());
+            functionIndices[&declaration] = index;
+
+            Bytecode::Function function;
+            function.name = declaration.name;
+            bytecode.functions.push_back(function);
+            pendingFunctions.push_back(&declaration);
+            return index;
+        }
+
+        void compileInitializer(const Context& context)
+        {
+            Bytecode::Function function;
+            function.name = "$initialize";
+            function.entry = getPosition();
+
+            bytecode.initializer = static_cast<std::uint32_t>(bytecode.functions.size());
+            bytecode.functions.push_back(function);
+
+            top = 0;
+            frameSize = 0;
+            locals.clear();
+
+            for (const auto declaration : context.getDeclarations())
+                if (declaration->declarationKind == Declaration::Kind::Variable)
+                {
+                    auto& variableDeclaration = static_cast<const VariableDeclaration&>(*declaration);
+                    if (!variableDeclaration.initialization) continue;
+
+                    const auto mark = top;
+                    const auto value = convert(compile(*variableDeclaration.initialization),
+                                               variableDeclaration.initialization->qualifiedType.type,
+                                               variableDeclaration.qualifiedType.type);
+                    emit(Opcode::StoreGlobal, globalOffsets[declaration], value, 0, getCellCount(variableDeclaration.qualifiedType.type));
+                    top = mark;
+                }
+
+            emit(Opcode::Return, 0);
+            bytecode.functions[bytecode.initializer].frameSize = frameSize;
+        }
+
+        void compileFunction(const CallableDeclaration& declaration)
+        {
+            const auto index = functionIndices[&declaration];
+            auto& resultType = static_cast<const FunctionDeclaration&>(declaration).resultType.type;
+
+            top = 0;
+            frameSize = 0;
+            locals.clear();
+            targets.clear();
+            currentResultType = &resultType;
+
+            const auto resultSize = getCellCount(resultType);
+            allocate(resultSize);
+
+            std::vector<std::uint32_t> parameterSizes;
+            for (const auto parameterDeclaration : declaration.parameterDeclarations)
+            {
+                parameterSizes.push_back(getCellCount(parameterDeclaration->qualifiedType.type));
+                locals[parameterDeclaration] = allocate(parameterSizes.back());
+            }
+
+            const auto entry = getPosition();
+            compile(*declaration.body);
+            emit(Opcode::Return, 0);
+
+            auto& function = bytecode.functions[index];
+            function.entry = entry;
+            function.frameSize = frameSize;
+            function.resultSize = resultSize;
+            function.parameterSizes = std::move(parameterSizes);
+        }
+
+        void declare(const Declaration& declaration)
+        {
+            if (declaration.declarationKind != Declaration::Kind::Variable) return;
+
+            auto& variableDeclaration = static_cast<const VariableDeclaration&>(declaration);
+            auto& type = variableDeclaration.qualifiedType.type;
+            const auto count = getCellCount(type);
+
+            // a declaration in a switch has its registers before the first label
+            const auto iterator = locals.find(&declaration);
+            const auto variable = (iterator != locals.end()) ? iterator->second : allocate(count);
+            locals[&declaration] = variable;
+
+            const auto mark = top;
+
+            if (variableDeclaration.initialization)
+            {
+                const auto value = convert(compile(*variableDeclaration.initialization),
+                                           variableDeclaration.initialization->qualifiedType.type, type);
+                emit(Opcode::Move, variable, value, 0, count);
+            }
+            else if (count > 0)
+                emit(Opcode::Clear, variable, 0, 0, count);
+
+            top = mark;
+        }
+
+        std::uint32_t compileCondition(const Construct& condition)
+        {
+            if (condition.kind == Construct::Kind::Declaration)
+            {
+                auto& declaration = static_cast<const Declaration&>(condition);
+                declare(declaration);
+                return locals[&declaration];
+            }
+
+            return compile(static_cast<const Expression&>(condition));
+        }
+
+        void compile(const Statement& statement)
+        {
+            const auto mark = top;
+
+            switch (statement.statementKind)
+            {
+                case Statement::Kind::Empty:
+                    return;
+
+                case Statement::Kind::Expression:
+                    compile(static_cast<const ExpressionStatement&>(statement).expression);
+                    top = mark;
+                    return;
+
+                case Statement::Kind::Declaration:
+                    declare(static_cast<const DeclarationStatement&>(statement).declaration);
+                    return;
+
+                case Statement::Kind::Compound:
+                    for (const Statement& child : static_cast<const CompoundStatement&>(statement).statements)
+                        compile(child);
+                    top = mark;
+                    return;
+
+                case Statement::Kind::If:
+                {
+                    auto& ifStatement = static_cast<const IfStatement&>(statement);
+                    const auto condition = compileCondition(ifStatement.condition);
+                    const auto skip = emit(Opcode::JumpIfFalse, condition);
+
+                    compile(ifStatement.body);
+
+                    if (ifStatement.elseBody)
+                    {
+                        const auto end = emit(Opcode::Jump, 0);
+                        patch(skip, getPosition());
+                        compile(*ifStatement.elseBody);
+                        patch(end, getPosition());
+                    }
+                    else
+                        patch(skip, getPosition());
+
+                    top = mark;
+                    return;
+                }
+
+                case Statement::Kind::For:
+                {
+                    auto& forStatement = static_cast<const ForStatement&>(statement);
+
+                    if (forStatement.initialization)
+                    {
+                        if (forStatement.initialization->kind == Construct::Kind::Declaration)
+                            declare(static_cast<const Declaration&>(*forStatement.initialization));
+                        else if (forStatement.initialization->kind == Construct::Kind::Expression)
+                        {
+                            const auto initializationMark = top;
+                            compile(static_cast<const Expression&>(*forStatement.initialization));
+                            top = initializationMark;
+                        }
+                    }
+
+                    const auto start = getPosition();
+                    std::optional<std::size_t> exit;
+                    if (forStatement.condition)
+                    {
+                        // a declared condition stays in scope in the body
+                        const auto conditionMark = top;
+                        exit = emit(Opcode::JumpIfFalse, compileCondition(*forStatement.condition));
+                        if (forStatement.condition->kind != Construct::Kind::Declaration) top = conditionMark;
+                    }
+
+                    targets.emplace_back();
+                    targets.back().loop = true;
+                    compile(forStatement.body);
+
+                    const auto increment = getPosition();
+                    if (forStatement.increment)
+                    {
+                        const auto incrementMark = top;
+                        compile(*forStatement.increment);
+                        top = incrementMark;
+                    }
+                    emit(Opcode::Jump, 0, start);
+
+                    const auto end = getPosition();
+                    if (exit) patch(*exit, end);
+                    finishTarget(increment, end);
+
+                    top = mark;
+                    return;
+                }
+
+                case Statement::Kind::While:
+                {
+                    auto& whileStatement = static_cast<const WhileStatement&>(statement);
+
+                    const auto start = getPosition();
+                    const auto exit = emit(Opcode::JumpIfFalse, compileCondition(whileStatement.condition));
+                    if (whileStatement.condition.kind != Construct::Kind::Declaration) top = mark;
+
+                    targets.emplace_back();
+                    targets.back().loop = true;
+                    compile(whileStatement.body);
+                    emit(Opcode::Jump, 0, start);
+
+                    const auto end = getPosition();
+                    patch(exit, end);
+                    finishTarget(start, end);
+
+                    top = mark;
+                    return;
+                }
+
+                case Statement::Kind::Do:
+                {
+                    auto& doStatement = static_cast<const DoStatement&>(statement);
+
+                    const auto start = getPosition();
+                    targets.emplace_back();
+                    targets.back().loop = true;
+                    compile(doStatement.body);
+
+                    const auto condition = getPosition();
+                    emit(Opcode::JumpIfTrue, compile(doStatement.condition), start);
+
+                    finishTarget(condition, getPosition());
+                    top = mark;
+                    return;
+                }
+
+                case Statement::Kind::Switch:
+                    compileSwitch(static_cast<const SwitchStatement&>(statement));
+                    top = mark;
+                    return;
+
+                case Statement::Kind::Case:
+                    compile(static_cast<const CaseStatement&>(statement).body);
+                    return;
+
+                case Statement::Kind::Default:
+                    compile(static_cast<const DefaultStatement&>(statement).body);
+                    return;
+
+                case Statement::Kind::Break:
+                    targets.back().breaks.push_back(emit(Opcode::Jump, 0));
+                    return;
+
+                case Statement::Kind::Continue:
+                {
+                    auto target = targets.rbegin();
+                    while (!target->loop) ++target;
+                    target->continues.push_back(emit(Opcode::Jump, 0));
+                    return;
+                }
+
+                case Statement::Kind::Return:
+                {
+                    auto& returnStatement = static_cast<const ReturnStatement&>(statement);
+                    if (returnStatement.result)
+                    {
+                        const auto value = convert(compile(*returnStatement.result),
+                                                   returnStatement.result->qualifiedType.type, *currentResultType);
+                        const auto count = getCellCount(*currentResultType);
+                        if (value != 0 && count > 0) emit(Opcode::Move, 0, value, 0, count);
+                    }
+
+                    emit(Opcode::Return, 0);
+                    top = mark;
+                    return;
+                }
+            }
+
+            throw std::runtime_error{"Unknown statement"};
+        }
+
+        void finishTarget(std::uint32_t continueTarget, std::uint32_t breakTarget)
+        {
+            for (const auto jump : targets.back().continues) patch(jump, continueTarget);
+            for (const auto jump : targets.back().breaks) patch(jump, breakTarget);
+            targets.pop_back();
+        }
+
+        // compares the condition with every case and jumps to the matching label,
+        // the labels fall through to the following ones
+        void compileSwitch(const SwitchStatement& switchStatement)
+        {
+            const auto condition = compileCondition(switchStatement.condition);
+
+            std::vector<StatementRef> statements;
+            if (switchStatement.body.statementKind == Statement::Kind::Compound)
+                statements = static_cast<const CompoundStatement&>(switchStatement.body).statements;
+            else
+                statements.push_back(switchStatement.body);
+
+            // the declarations are zero initialized, because the jumps can skip them
+            for (const Statement& child : statements)
+                if (child.statementKind == Statement::Kind::Declaration)
+                {
+                    auto& declaration = static_cast<const DeclarationStatement&>(child).declaration;
+                    if (declaration.declarationKind != Declaration::Kind::Variable) continue;
+
+                    const auto count = getCellCount(static_cast<const VariableDeclaration&>(declaration).qualifiedType.type);
+                    locals[&declaration] = allocate(count);
+                    if (count > 0) emit(Opcode::Clear, locals[&declaration], 0, 0, count);
+                }
+
+            std::vector<std::pair<std::size_t, std::size_t>> caseJumps; // statement index and jump
+            std::optional<std::size_t> defaultIndex;
+            auto& conditionType = (switchStatement.condition.kind == Construct::Kind::Declaration) ?
+                static_cast<const VariableDeclaration&>(switchStatement.condition).qualifiedType.type :
+                static_cast<const Expression&>(switchStatement.condition).qualifiedType.type;
+
+            for (std::size_t i = 0; i < statements.size(); ++i)
+                if (statements[i].get().statementKind == Statement::Kind::Case)
+                {
+                    const auto mark = top;
+                    auto& caseCondition = static_cast<const CaseStatement&>(statements[i].get()).condition;
+                    const auto value = convert(compile(caseCondition), caseCondition.qualifiedType.type, conditionType);
+                    const auto equal = compileEquality(condition, value, conditionType);
+                    caseJumps.emplace_back(i, emit(Opcode::JumpIfTrue, equal));
+                    top = mark;
+                }
+                else if (statements[i].get().statementKind == Statement::Kind::Default)
+                    defaultIndex = i;
+
+            targets.emplace_back();
+            targets.back().breaks.push_back(emit(Opcode::Jump, 0));
+            std::optional<std::size_t> defaultJump;
+            if (defaultIndex) defaultJump = targets.back().breaks.back();
+
+            for (std::size_t i = 0; i < statements.size(); ++i)
+            {
+                for (const auto& caseJump : caseJumps)
+                    if (caseJump.first == i) patch(caseJump.second, getPosition());
+
+                if (defaultIndex && *defaultIndex == i)
+                {
+                    patch(*defaultJump, getPosition());
+                    targets.back().breaks.erase(targets.back().breaks.begin());
+                }
+
+                compile(statements[i]);
+            }
+
+            const auto end = getPosition();
+            for (const auto jump : targets.back().breaks) patch(jump, end);
+            targets.pop_back();
+        }
+
+        Place locateDeclaration(const Declaration& declaration)
+        {
+            Place place;
+
+            const auto local = locals.find(&declaration);
+            if (local != locals.end())
+                place.base = local->second;
+            else
+            {
+                const auto global = globalOffsets.find(&declaration);
+                if (global == globalOffsets.end())
+                    throw std::runtime_error{"Variable " + declaration.name + " not found"};
+
+                place.global = true;
+                place.base = global->second;
+            }
+
+            return place;
+        }
+
+        // adds index * stride to the offset of the place, constant indices are added to the base
+        void addIndex(Place& place, const Expression& subscript, std::uint32_t index, std::uint32_t count, std::uint32_t stride)
+        {
+            if (!place.contiguous)
+                throw std::runtime_error{"Subscripts of swizzles are not supported"};
+
+            if (subscript.expressionKind == Expression::Kind::Literal &&
+                static_cast<const LiteralExpression&>(subscript).literalKind == LiteralExpression::Kind::Integer)
+            {
+                const auto value = static_cast<const IntegerLiteralExpression&>(subscript).value;
+                if (value < 0 || value >= static_cast<std::int64_t>(count))
+                    throw std::runtime_error{"Subscript out of range"};
+
+                place.base += static_cast<std::uint32_t>(value) * stride;
+                return;
+            }
+
+            const auto offset = allocate(1);
+            emit(Opcode::Bound, offset, index, count, 1, getValueKind(subscript.qualifiedType.type));
+
+            if (stride != 1)
+                emit(Opcode::IntegerMultiply, offset, offset, loadConstant(stride, ValueKind::UnsignedInteger));
+
+            if (place.offset)
+                emit(Opcode::IntegerAdd, offset, offset, *place.offset);
+
+            place.offset = offset;
+        }
+
+        Place locate(const Expression& expression)
+        {
+            switch (expression.expressionKind)
+            {
+                case Expression::Kind::DeclarationReference:
+                {
+                    auto& declaration = static_cast<const DeclarationReferenceExpression&>(expression).declaration;
+                    auto place = locateDeclaration(declaration);
+                    place.count = getCellCount(expression.qualifiedType.type);
+                    return place;
+                }
+
+                case Expression::Kind::Paren:
+                    return locate(static_cast<const ParenExpression&>(expression).expression);
+
+                case Expression::Kind::Member:
+                {
+                    auto& memberExpression = static_cast<const MemberExpression&>(expression);
+                    auto place = locate(memberExpression.expression);
+                    auto& structType = static_cast<const StructType&>(memberExpression.expression.qualifiedType.type);
+
+                    place.base += getFieldOffset(memberExpression.fieldDeclaration, structType);
+                    place.count = getCellCount(expression.qualifiedType.type);
+                    return place;
+                }
+
+                case Expression::Kind::ArraySubscript:
+                {
+                    auto& arraySubscriptExpression = static_cast<const ArraySubscriptExpression&>(expression);
+                    auto& arrayType = static_cast<const ArrayType&>(arraySubscriptExpression.expression.qualifiedType.type);
+
+                    const auto index = compile(arraySubscriptExpression.subscript);
+                    auto place = locate(arraySubscriptExpression.expression);
+                    place.count = getCellCount(expression.qualifiedType.type);
+                    addIndex(place, arraySubscriptExpression.subscript, index,
+                             static_cast<std::uint32_t>(arrayType.size), place.count);
+                    return place;
+                }
+
+                case Expression::Kind::BinaryOperator:
+                {
+                    auto& binaryOperatorExpression = static_cast<const BinaryOperatorExpression&>(expression);
+
+                    if (binaryOperatorExpression.operatorKind == BinaryOperatorExpression::Kind::Subscript)
+                    {
+                        // a subscript of a vector is a component and a subscript of a matrix is a row
+                        auto& type = binaryOperatorExpression.leftExpression.qualifiedType.type;
+                        const auto count = (type.typeKind == Type::Kind::Matrix) ?
+                            static_cast<std::uint32_t>(static_cast<const MatrixType&>(type).rowCount) : getCellCount(type);
+
+                        const auto index = compile(binaryOperatorExpression.rightExpression);
+                        auto place = locate(binaryOperatorExpression.leftExpression);
+                        place.count = getCellCount(expression.qualifiedType.type);
+                        addIndex(place, binaryOperatorExpression.rightExpression, index, count, place.count);
+                        return place;
+                    }
+                    else if (binaryOperatorExpression.operatorKind == BinaryOperatorExpression::Kind::Comma)
+                    {
+                        compile(binaryOperatorExpression.leftExpression);
+                        return locate(binaryOperatorExpression.rightExpression);
+                    }
+                    else if (binaryOperatorExpression.category == Expression::Category::Lvalue)
+                    {
+                        // assignments return their left operand
+                        compile(binaryOperatorExpression);
+                        return locate(binaryOperatorExpression.leftExpression);
+                    }
+
+                    break;
+                }
+
+                case Expression::Kind::UnaryOperator:
+                {
+                    auto& unaryOperatorExpression = static_cast<const UnaryOperatorExpression&>(expression);
+                    if (unaryOperatorExpression.operatorKind != UnaryOperatorExpression::Kind::PrefixIncrement &&
+                        unaryOperatorExpression.operatorKind != UnaryOperatorExpression::Kind::PrefixDecrement)
+                        break;
+
+                    compile(unaryOperatorExpression);
+                    return locate(unaryOperatorExpression.expression);
+                }
+
+                case Expression::Kind::VectorElement:
+                {
+                    auto& vectorElementExpression = static_cast<const VectorElementExpression&>(expression);
+                    auto place = locate(vectorElementExpression.expression);
+
+                    std::array<std::uint32_t, 16> components{};
+                    for (std::size_t i = 0; i < vectorElementExpression.positions.size(); ++i)
+                        components[i] = place.contiguous ?
+                            static_cast<std::uint32_t>(vectorElementExpression.positions[i]) :
+                            place.components[vectorElementExpression.positions[i]];
+
+                    place.count = static_cast<std::uint32_t>(vectorElementExpression.positions.size());
+
+                    // consecutive components are a range of registers
+                    place.contiguous = true;
+                    for (std::uint32_t i = 1; i < place.count; ++i)
+                        if (components[i] != components[0] + i) place.contiguous = false;
+
+                    if (place.contiguous)
+                        place.base += components[0];
+                    else
+                        place.components = components;
+
+                    return place;
+                }
+
+                default:
+                    break;
+            }
+
+            // rvalues are located in the registers they are computed to
+            Place place;
+            place.base = compile(expression);
+            place.count = getCellCount(expression.qualifiedType.type);
+            return place;
+        }
+
+        static Opcode getLoadOpcode(const Place& place) noexcept
+        {
+            return place.global ?
+                (place.offset ? Opcode::LoadGlobalIndirect : Opcode::LoadGlobal) :
+                (place.offset ? Opcode::LoadIndirect : Opcode::Move);
+        }
+
+        static Opcode getStoreOpcode(const Place& place) noexcept
+        {
+            return place.global ?
+                (place.offset ? Opcode::StoreGlobalIndirect : Opcode::StoreGlobal) :
+                (place.offset ? Opcode::StoreIndirect : Opcode::Move);
+        }
+
+        // local variables are read directly from their registers
+        std::uint32_t load(const Place& place)
+        {
+            if (!place.global && !place.offset && place.contiguous)
+                return place.base;
+
+            const auto result = allocate(place.count);
+            const auto opcode = getLoadOpcode(place);
+            const auto offset = place.offset ? *place.offset : 0;
+
+            if (place.contiguous)
+            {
+                if (place.count > 0) emit(opcode, result, place.base, offset, place.count);
+            }
+            else
+                for (std::uint32_t i = 0; i < place.count; ++i)
+                    emit(opcode, result + i, place.base + place.components[i], offset);
+
+            return result;
+        }
+
+        void store(const Place& place, std::uint32_t value)
+        {
+            const auto opcode = getStoreOpcode(place);
+            const auto offset = place.offset ? *place.offset : 0;
+
+            if (place.contiguous)
+            {
+                if (place.count > 0 && (place.global || place.offset || value != place.base))
+                    emit(opcode, place.base, value, offset, place.count);
+                return;
+            }
+
+            // a swizzle of the same variable, like v.yx = v.xy, must not overwrite its source
+            if (!place.global && !place.offset && value < place.base + 16 && value + place.count > place.base)
+            {
+                const auto copy = allocate(place.count);
+                emit(Opcode::Move, copy, value, 0, place.count);
+                value = copy;
+            }
+
+            for (std::uint32_t i = 0; i < place.count; ++i)
+                emit(opcode, place.base + place.components[i], value + i, offset);
+        }
+
+        // copies an operand that a following operand could overwrite
+        std::uint32_t protect(std::uint32_t value, std::uint32_t mark, const Type& type, const Expression& next)
+        {
+            if (value >= mark || !mayWriteLocals(next)) return value;
+
+            const auto count = getCellCount(type);
+            const auto copy = allocate(count);
+            if (count > 0) emit(Opcode::Move, copy, value, 0, count);
+            return copy;
+        }
+
+        // converts between scalar types, vectors with the same number of components
+        // and from a scalar to a vector by repeating it
+        std::uint32_t convert(std::uint32_t value, const Type& source, const Type& target)
+        {
+            if (&source == &target) return value;
+
+            const auto sourceScalarType = getScalarType(source);
+            const auto targetScalarType = getScalarType(target);
+
+            if (!sourceScalarType || !targetScalarType)
+            {
+                if (source.typeKind != target.typeKind)
+                    throw std::runtime_error{"Invalid conversion from " + source.name + " to " + target.name};
+                return value;
+            }
+
+            const auto sourceCount = getCellCount(source);
+            const auto targetCount = getCellCount(target);
+
+            if (sourceCount != targetCount && sourceCount != 1)
+                throw std::runtime_error{"Invalid conversion from " + source.name + " to " + target.name};
+
+            // int and uint have the same bits
+            const auto sourceKind = getValueKind(*sourceScalarType);
+            const auto targetKind = getValueKind(*targetScalarType);
+            const auto isInteger = [](ValueKind kind) {
+                return kind == ValueKind::Integer || kind == ValueKind::UnsignedInteger;
+            };
+
+            if (sourceKind != targetKind && !(isInteger(sourceKind) && isInteger(targetKind)))
+            {
+                const auto converted = allocate(sourceCount);
+                emit(Opcode::Convert, converted, value, static_cast<std::uint32_t>(sourceKind), sourceCount, targetKind);
+                value = converted;
+            }
+
+            if (sourceCount == 1 && targetCount > 1)
+            {
+                const auto splat = allocate(targetCount);
+                emit(Opcode::Splat, splat, value, 0, targetCount, targetKind);
+                value = splat;
+            }
+
+            return value;
+        }
+
+        std::uint32_t compile(const Expression& expression)
+        {
+            switch (expression.expressionKind)
+            {
+                case Expression::Kind::Call:
+                    return compileCall(static_cast<const CallExpression&>(expression));
+
+                case Expression::Kind::Literal:
+                {
+                    auto& literalExpression = static_cast<const LiteralExpression&>(expression);
+
+                    switch (literalExpression.literalKind)
+                    {
+                        case LiteralExpression::Kind::Boolean:
+                            return loadConstant(static_cast<const BooleanLiteralExpression&>(literalExpression).value ? 1U : 0U,
+                                                ValueKind::Boolean);
+                        case LiteralExpression::Kind::Integer:
+                            return loadConstant(static_cast<std::uint32_t>(static_cast<const IntegerLiteralExpression&>(literalExpression).value),
+                                                getValueKind(expression.qualifiedType.type));
+                        case LiteralExpression::Kind::FloatingPoint:
+                        {
+                            const auto value = static_cast<float>(static_cast<const FloatingPointLiteralExpression&>(literalExpression).value);
+                            std::uint32_t bits;
+                            std::memcpy(&bits, &value, sizeof(bits));
+                            return loadConstant(bits, ValueKind::FloatingPoint);
+                        }
+                        case LiteralExpression::Kind::String:
+                            throw std::runtime_error{"String literals are not supported"};
+                    }
+
+                    break;
+                }
+
+                case Expression::Kind::DeclarationReference:
+                case Expression::Kind::Paren:
+                case Expression::Kind::Member:
+                case Expression::Kind::ArraySubscript:
+                case Expression::Kind::VectorElement:
+                    return load(locate(expression));
+
+                case Expression::Kind::UnaryOperator:
+                    return compileUnary(static_cast<const UnaryOperatorExpression&>(expression));
+
+                case Expression::Kind::BinaryOperator:
+                    return compileBinary(static_cast<const BinaryOperatorExpression&>(expression));
+
+                case Expression::Kind::TernaryOperator:
+                {
+                    auto& ternaryOperatorExpression = static_cast<const TernaryOperatorExpression&>(expression);
+                    auto& type = expression.qualifiedType.type;
+                    const auto count = getCellCount(type);
+                    const auto result = allocate(count);
+
+                    const auto skip = emit(Opcode::JumpIfFalse, compile(ternaryOperatorExpression.condition));
+
+                    const auto left = convert(compile(ternaryOperatorExpression.leftExpression),
+                                              ternaryOperatorExpression.leftExpression.qualifiedType.type, type);
+                    if (count > 0) emit(Opcode::Move, result, left, 0, count);
+                    const auto end = emit(Opcode::Jump, 0);
+
+                    patch(skip, getPosition());
+                    const auto right = convert(compile(ternaryOperatorExpression.rightExpression),
+                                               ternaryOperatorExpression.rightExpression.qualifiedType.type, type);
+                    if (count > 0) emit(Opcode::Move, result, right, 0, count);
+                    patch(end, getPosition());
+
+                    return result;
+                }
+
+                case Expression::Kind::TemporaryObject:
+                {
+                    // the parameters initialize the fields in order
+                    auto& temporaryObjectExpression = static_cast<const TemporaryObjectExpression&>(expression);
+                    auto& type = expression.qualifiedType.type;
+                    const auto result = allocate(getCellCount(type));
+                    if (getCellCount(type) > 0) emit(Opcode::Clear, result, 0, 0, getCellCount(type));
+
+                    if (type.typeKind == Type::Kind::Struct)
+                    {
+                        std::size_t parameter = 0;
+                        for (const Declaration& memberDeclaration : static_cast<const StructType&>(type).memberDeclarations)
+                        {
+                            if (memberDeclaration.declarationKind != Declaration::Kind::Field) continue;
+                            if (parameter >= temporaryObjectExpression.parameters.size()) break;
+
+                            auto& fieldDeclaration = static_cast<const FieldDeclaration&>(memberDeclaration);
+                            const Expression& argument = temporaryObjectExpression.parameters[parameter++];
+                            const auto count = getCellCount(fieldDeclaration.qualifiedType.type);
+                            const auto value = compile(argument);
+                            if (count > 0)
+                                emit(Opcode::Move, result + getFieldOffset(fieldDeclaration, static_cast<const StructType&>(type)), value, 0, count);
+                        }
+                    }
+
+                    return result;
+                }
+
+                case Expression::Kind::InitializerList:
+                {
+                    auto& initializerListExpression = static_cast<const InitializerListExpression&>(expression);
+                    auto& arrayType = static_cast<const ArrayType&>(expression.qualifiedType.type);
+                    auto& elementType = arrayType.elementType.type;
+                    const auto elementCount = getCellCount(elementType);
+                    const auto result = allocate(getCellCount(arrayType));
+                    if (getCellCount(arrayType) > 0) emit(Opcode::Clear, result, 0, 0, getCellCount(arrayType));
+
+                    for (std::size_t i = 0; i < initializerListExpression.expressions.size() && i < arrayType.size; ++i)
+                    {
+                        const Expression& element = initializerListExpression.expressions[i];
+                        const auto value = convert(compile(element), element.qualifiedType.type, elementType);
+                        if (elementCount > 0)
+                            emit(Opcode::Move, result + static_cast<std::uint32_t>(i) * elementCount, value, 0, elementCount);
+                    }
+
+                    return result;
+                }
+
+                case Expression::Kind::Cast:
+                {
+                    auto& castExpression = static_cast<const CastExpression&>(expression);
+                    return convert(compile(castExpression.expression),
+                                   castExpression.expression.qualifiedType.type,
+                                   expression.qualifiedType.type);
+                }
+
+                case Expression::Kind::VectorInitialize:
+                case Expression::Kind::MatrixInitialize:
+                {
+                    auto& parameters = (expression.expressionKind == Expression::Kind::VectorInitialize) ?
+                        static_cast<const VectorInitializeExpression&>(expression).parameters :
+                        static_cast<const MatrixInitializeExpression&>(expression).parameters;
+
+                    auto& type = expression.qualifiedType.type;
+                    const auto scalarType = getScalarType(type);
+                    const auto count = getCellCount(type);
+                    const auto result = allocate(count);
+
+                    // literal components are loaded by one instruction
+                    std::vector<std::uint32_t> literals;
+                    for (const Expression& parameter : parameters)
+                        if (!getLiteralBits(parameter, *scalarType, literals)) break;
+
+                    if (literals.size() == count || literals.size() == 1)
+                    {
+                        literals.resize(count, literals.front());
+                        emit(Opcode::Constant, result, getConstants(literals), 0, count, getValueKind(*scalarType));
+                        return result;
+                    }
+
+                    emit(Opcode::Clear, result, 0, 0, count);
+
+                    std::uint32_t component = 0;
+                    for (const Expression& parameter : parameters)
+                    {
+                        auto& parameterType = parameter.qualifiedType.type;
+                        const auto parameterScalarType = getScalarType(parameterType);
+                        if (!parameterScalarType)
+                            throw std::runtime_error{"Invalid initializer"};
+
+                        const auto parameterCount = std::min(getCellCount(parameterType), count - component);
+                        const auto mark = top;
+                        auto value = compile(parameter);
+
+                        if (getValueKind(*parameterScalarType) != getValueKind(*scalarType) && parameterCount > 0)
+                        {
+                            const auto converted = allocate(parameterCount);
+                            emit(Opcode::Convert, converted, value, static_cast<std::uint32_t>(getValueKind(*parameterScalarType)),
+                                 parameterCount, getValueKind(*scalarType));
+                            value = converted;
+                        }
+
+                        if (parameterCount > 0) emit(Opcode::Move, result + component, value, 0, parameterCount);
+                        component += parameterCount;
+                        top = mark;
+                    }
+
+                    // a single scalar initializes all components
+                    if (component == 1 && count > 1)
+                        emit(Opcode::Splat, result, result, 0, count, getValueKind(*scalarType));
+
+                    return result;
+                }
+            }
+
+            throw std::runtime_error{"Unknown expression"};
+        }
+
+        std::uint32_t compileUnary(const UnaryOperatorExpression& expression)
+        {
+            auto& type = expression.qualifiedType.type;
+            const auto scalarType = getScalarType(type);
+            const auto count = getCellCount(type);
+
+            switch (expression.operatorKind)
+            {
+                case UnaryOperatorExpression::Kind::Negation:
+                {
+                    const auto value = compile(expression.expression);
+                    const auto result = allocate(1);
+                    emit(Opcode::Not, result, value);
+                    return result;
+                }
+
+                case UnaryOperatorExpression::Kind::Positive:
+                    return compile(expression.expression);
+
+                case UnaryOperatorExpression::Kind::Negative:
+                {
+                    const auto value = compile(expression.expression);
+                    const auto result = allocate(count);
+                    emit(scalarType->scalarTypeKind == ScalarType::Kind::FloatingPoint ? Opcode::FloatNegate : Opcode::IntegerNegate,
+                         result, value, 0, count);
+                    return result;
+                }
+
+                case UnaryOperatorExpression::Kind::PrefixIncrement:
+                case UnaryOperatorExpression::Kind::PrefixDecrement:
+                case UnaryOperatorExpression::Kind::PostfixIncrement:
+                case UnaryOperatorExpression::Kind::PostfixDecrement:
+                {
+                    const auto place = locate(expression.expression);
+
+                    // the previous value is copied, because the variable is updated in place
+                    const auto previous = allocate(count);
+                    emit(Opcode::Move, previous, load(place), 0, count);
+
+                    const auto isFloat = scalarType->scalarTypeKind == ScalarType::Kind::FloatingPoint;
+                    std::uint32_t one = 1;
+                    if (isFloat)
+                    {
+                        const auto value = 1.0F;
+                        std::memcpy(&one, &value, sizeof(one));
+                    }
+
+                    auto step = loadConstant(one, getValueKind(*scalarType));
+                    if (count > 1)
+                    {
+                        const auto splat = allocate(count);
+                        emit(Opcode::Splat, splat, step, 0, count);
+                        step = splat;
+                    }
+
+                    const auto increment = expression.operatorKind == UnaryOperatorExpression::Kind::PrefixIncrement ||
+                        expression.operatorKind == UnaryOperatorExpression::Kind::PostfixIncrement;
+
+                    const auto value = allocate(count);
+                    emit(isFloat ?
+                         (increment ? Opcode::FloatAdd : Opcode::FloatSubtract) :
+                         (increment ? Opcode::IntegerAdd : Opcode::IntegerSubtract),
+                         value, previous, step, count);
+
+                    if (scalarType->scalarTypeKind == ScalarType::Kind::Boolean)
+                        emit(Opcode::Convert, value, value, static_cast<std::uint32_t>(ValueKind::Integer), count, ValueKind::Boolean);
+
+                    store(place, value);
+
+                    return (expression.operatorKind == UnaryOperatorExpression::Kind::PrefixIncrement ||
+                            expression.operatorKind == UnaryOperatorExpression::Kind::PrefixDecrement) ? value : previous;
+                }
+            }
+
+            throw std::runtime_error{"Unknown operator"};
+        }
+
+        std::uint32_t compileBinary(const BinaryOperatorExpression& expression)
+        {
+            auto& leftType = expression.leftExpression.qualifiedType.type;
+            auto& rightType = expression.rightExpression.qualifiedType.type;
+
+            switch (expression.operatorKind)
+            {
+                case BinaryOperatorExpression::Kind::Assignment:
+                {
+                    const auto mark = top;
+                    const auto value = protect(convert(compile(expression.rightExpression), rightType, leftType),
+                                               mark, leftType, expression.leftExpression);
+                    store(locate(expression.leftExpression), value);
+                    return value;
+                }
+
+                case BinaryOperatorExpression::Kind::AdditionAssignment:
+                case BinaryOperatorExpression::Kind::SubtractAssignment:
+                case BinaryOperatorExpression::Kind::MultiplicationAssignment:
+                case BinaryOperatorExpression::Kind::DivisionAssignment:
+                {
+                    const auto mark = top;
+                    const auto right = protect(compile(expression.rightExpression), mark, rightType, expression.leftExpression);
+                    const auto place = locate(expression.leftExpression);
+
+                    const auto operatorKind =
+                        (expression.operatorKind == BinaryOperatorExpression::Kind::AdditionAssignment) ? BinaryOperatorExpression::Kind::Addition :
+                        (expression.operatorKind == BinaryOperatorExpression::Kind::SubtractAssignment) ? BinaryOperatorExpression::Kind::Subtraction :
+                        (expression.operatorKind == BinaryOperatorExpression::Kind::MultiplicationAssignment) ? BinaryOperatorExpression::Kind::Multiplication :
+                        BinaryOperatorExpression::Kind::Division;
+
+                    const auto value = compileArithmetic(operatorKind, load(place), leftType, right, rightType, leftType);
+                    store(place, value);
+                    return value;
+                }
+
+                case BinaryOperatorExpression::Kind::Or:
+                case BinaryOperatorExpression::Kind::And:
+                {
+                    // the right operand is evaluated only if the left one does not decide the result
+                    const auto result = allocate(1);
+                    emit(Opcode::Move, result, compile(expression.leftExpression), 0, 1);
+
+                    const auto skip = emit(expression.operatorKind == BinaryOperatorExpression::Kind::And ?
+                                           Opcode::JumpIfFalse : Opcode::JumpIfTrue, result);
+                    emit(Opcode::Move, result, compile(expression.rightExpression), 0, 1);
+                    patch(skip, getPosition());
+
+                    return result;
+                }
+
+                case BinaryOperatorExpression::Kind::Comma:
+                    compile(expression.leftExpression);
+                    return compile(expression.rightExpression);
+
+                case BinaryOperatorExpression::Kind::Subscript:
+                    return load(locate(expression));
+
+                case BinaryOperatorExpression::Kind::Equality:
+                case BinaryOperatorExpression::Kind::Inequality:
+                {
+                    const auto mark = top;
+                    const auto left = protect(compile(expression.leftExpression), mark, leftType, expression.rightExpression);
+                    const auto right = compile(expression.rightExpression);
+                    const auto result = compileEquality(left, right, leftType);
+
+                    if (expression.operatorKind == BinaryOperatorExpression::Kind::Inequality)
+                        emit(Opcode::Not, result, result);
+
+                    return result;
+                }
+
+                default:
+                {
+                    const auto mark = top;
+                    const auto left = protect(compile(expression.leftExpression), mark, leftType, expression.rightExpression);
+                    const auto right = compile(expression.rightExpression);
+                    return compileArithmetic(expression.operatorKind, left, leftType, right, rightType,
+                                             expression.qualifiedType.type);
+                }
+            }
+        }
+
+        // compares the scalars, vectors and matrices in the values and combines the results
+        std::uint32_t compileEquality(std::uint32_t left, std::uint32_t right, const Type& type)
+        {
+            const auto result = allocate(1);
+
+            if (type.typeKind == Type::Kind::Array)
+            {
+                auto& arrayType = static_cast<const ArrayType&>(type);
+                const auto elementCount = getCellCount(arrayType.elementType.type);
+
+                emit(Opcode::Constant, result, getConstant(1), 0, 1, ValueKind::Boolean);
+                for (std::uint32_t i = 0; i < arrayType.size; ++i)
+                    emit(Opcode::And, result, result,
+                         compileEquality(left + i * elementCount, right + i * elementCount, arrayType.elementType.type));
+            }
+            else if (type.typeKind == Type::Kind::Struct && !isHandle(type))
+            {
+                auto& structType = static_cast<const StructType&>(type);
+
+                emit(Opcode::Constant, result, getConstant(1), 0, 1, ValueKind::Boolean);
+                for (const Declaration& memberDeclaration : structType.memberDeclarations)
+                    if (memberDeclaration.declarationKind == Declaration::Kind::Field)
+                    {
+                        auto& fieldDeclaration = static_cast<const FieldDeclaration&>(memberDeclaration);
+                        const auto offset = getFieldOffset(fieldDeclaration, structType);
+                        emit(Opcode::And, result, result,
+                             compileEquality(left + offset, right + offset, fieldDeclaration.qualifiedType.type));
+                    }
+            }
+            else
+                emit(getValueKind(type) == ValueKind::FloatingPoint ? Opcode::FloatEqual : Opcode::IntegerEqual,
+                     result, left, right, getCellCount(type));
+
+            return result;
+        }
+
+        // arithmetic and comparison operators, componentwise with a scalar operand repeated,
+        // except for the products of a matrix with a vector or matrix, which are linear algebra products
+        std::uint32_t compileArithmetic(BinaryOperatorExpression::Kind operatorKind,
+                                        std::uint32_t left, const Type& leftType,
+                                        std::uint32_t right, const Type& rightType,
+                                        const Type& resultType)
+        {
+            const auto scalarType = getScalarType(leftType);
+            if (!scalarType)
+                throw std::runtime_error{"Invalid operands"};
+
+            const auto kind = getValueKind(*scalarType);
+            const auto isFloat = kind == ValueKind::FloatingPoint;
+
+            switch (operatorKind)
+            {
+                case BinaryOperatorExpression::Kind::LessThan:
+                case BinaryOperatorExpression::Kind::LessThanEqual:
+                case BinaryOperatorExpression::Kind::GreaterThan:
+                case BinaryOperatorExpression::Kind::GraterThanEqual:
+                {
+                    // b > c is c < b
+                    const auto swap = operatorKind == BinaryOperatorExpression::Kind::GreaterThan ||
+                        operatorKind == BinaryOperatorExpression::Kind::GraterThanEqual;
+                    const auto orEqual = operatorKind == BinaryOperatorExpression::Kind::LessThanEqual ||
+                        operatorKind == BinaryOperatorExpression::Kind::GraterThanEqual;
+
+                    const auto opcode = isFloat ? (orEqual ? Opcode::FloatLessEqual : Opcode::FloatLess) :
+                        (kind == ValueKind::Integer) ? (orEqual ? Opcode::IntegerLessEqual : Opcode::IntegerLess) :
+                        (orEqual ? Opcode::UnsignedLessEqual : Opcode::UnsignedLess);
+
+                    const auto result = allocate(1);
+                    emit(opcode, result, swap ? right : left, swap ? left : right);
+                    return result;
+                }
+
+                case BinaryOperatorExpression::Kind::Addition:
+                case BinaryOperatorExpression::Kind::Subtraction:
+                case BinaryOperatorExpression::Kind::Multiplication:
+                case BinaryOperatorExpression::Kind::Division:
+                    break;
+
+                default:
+                    throw std::runtime_error{"Unsupported operator"};
+            }
+
+            if (operatorKind == BinaryOperatorExpression::Kind::Multiplication &&
+                (leftType.typeKind == Type::Kind::Matrix || rightType.typeKind == Type::Kind::Matrix) &&
+                leftType.typeKind != Type::Kind::Scalar && rightType.typeKind != Type::Kind::Scalar)
+            {
+                // a vector on the left is a row vector and a vector on the right is a column vector
+                const auto rows = (leftType.typeKind == Type::Kind::Matrix) ? static_cast<std::uint32_t>(static_cast<const MatrixType&>(leftType).rowCount) : 1;
+                const auto inner = (rightType.typeKind == Type::Kind::Matrix) ? static_cast<std::uint32_t>(static_cast<const MatrixType&>(rightType).rowCount) : getCellCount(rightType);
+                const auto columns = (rightType.typeKind == Type::Kind::Matrix) ? static_cast<std::uint32_t>(static_cast<const MatrixType&>(rightType).rowType.componentCount) : 1;
+
+                const auto result = allocate(rows * columns);
+                emit(Opcode::MatrixMultiply, result, left, right, Bytecode::packMatrixDimensions(rows, inner, columns));
+                return result;
+            }
+
+            const auto count = getCellCount(resultType);
+
+            if (getCellCount(leftType) == 1 && count > 1)
+            {
+                const auto splat = allocate(count);
+                emit(Opcode::Splat, splat, left, 0, count, kind);
+                left = splat;
+            }
+
+            if (getCellCount(rightType) == 1 && count > 1)
+            {
+                const auto splat = allocate(count);
+                emit(Opcode::Splat, splat, right, 0, count, kind);
+                right = splat;
+            }
+
+            Opcode opcode;
+            switch (operatorKind)
+            {
+                case BinaryOperatorExpression::Kind::Addition: opcode = isFloat ? Opcode::FloatAdd : Opcode::IntegerAdd; break;
+                case BinaryOperatorExpression::Kind::Subtraction: opcode = isFloat ? Opcode::FloatSubtract : Opcode::IntegerSubtract; break;
+                case BinaryOperatorExpression::Kind::Multiplication: opcode = isFloat ? Opcode::FloatMultiply : Opcode::IntegerMultiply; break;
+                default:
+                    opcode = isFloat ? Opcode::FloatDivide :
+                        (kind == ValueKind::Integer) ? Opcode::IntegerDivide : Opcode::UnsignedDivide;
+                    break;
+            }
+
+            const auto result = allocate(count);
+            emit(opcode, result, left, right, count, kind);
+
+            // booleans stay 0 or 1
+            if (kind == ValueKind::Boolean)
+                emit(Opcode::Convert, result, result, static_cast<std::uint32_t>(ValueKind::Integer), count, ValueKind::Boolean);
+
+            return result;
+        }
+
+        std::uint32_t compileCall(const CallExpression& expression)
+        {
+            auto& declaration = expression.declarationReference.declaration;
+            if (declaration.declarationKind != Declaration::Kind::Callable)
+                throw std::runtime_error{"Invalid call"};
+
+            auto& callableDeclaration = static_cast<const CallableDeclaration&>(declaration);
+
+            if (callableDeclaration.callableDeclarationKind == CallableDeclaration::Kind::Function &&
+                static_cast<const FunctionDeclaration&>(callableDeclaration).isBuiltin)
+                return compileBuiltin(expression, callableDeclaration.name);
+
+            const auto definition = static_cast<const CallableDeclaration*>(declaration.definition);
+            if (!definition || !definition->body ||
+                definition->callableDeclarationKind != CallableDeclaration::Kind::Function)
+                throw std::runtime_error{"Function " + declaration.name + " is not defined"};
+
+            const auto functionIndex = getFunctionIndex(*definition);
+            auto& resultType = static_cast<const FunctionDeclaration&>(*definition).resultType.type;
+
+            // the arguments are evaluated first, so that the frame of the callee is above their temporaries
+            const auto mark = top;
+            std::vector<std::uint32_t> values;
+            std::vector<std::optional<Place>> places;
+
+            for (std::size_t i = 0; i < expression.arguments.size(); ++i)
+            {
+                const Expression& argument = expression.arguments[i];
+                auto& parameterType = definition->parameterDeclarations[i]->qualifiedType.type;
+                const auto modifier = definition->parameterDeclarations[i]->inputModifier;
+
+                if (modifier == InputModifier::In)
+                {
+                    auto value = convert(compile(argument), argument.qualifiedType.type, parameterType);
+                    for (std::size_t j = i + 1; j < expression.arguments.size(); ++j)
+                        value = protect(value, mark, parameterType, expression.arguments[j]);
+
+                    values.push_back(value);
+                    places.emplace_back();
+                }
+                else
+                {
+                    places.push_back(locate(argument));
+                    values.push_back(modifier == InputModifier::Inout ? load(*places.back()) : 0);
+                }
+            }
+
+            const auto frame = allocate(getCellCount(resultType));
+            auto parameter = frame + getCellCount(resultType);
+
+            for (std::size_t i = 0; i < values.size(); ++i)
+            {
+                const auto count = getCellCount(definition->parameterDeclarations[i]->qualifiedType.type);
+                allocate(count);
+
+                if (definition->parameterDeclarations[i]->inputModifier == InputModifier::Out)
+                    emit(Opcode::Clear, parameter, 0, 0, count);
+                else if (count > 0)
+                    emit(Opcode::Move, parameter, values[i], 0, count);
+
+                parameter += count;
+            }
+
+            emit(Opcode::Call, frame, functionIndex);
+
+            parameter = frame + getCellCount(resultType);
+            for (std::size_t i = 0; i < values.size(); ++i)
+            {
+                if (places[i]) store(*places[i], parameter);
+                parameter += getCellCount(definition->parameterDeclarations[i]->qualifiedType.type);
+            }
+
+            return frame;
+        }
+
+        std::uint32_t compileBuiltin(const CallExpression& expression, const std::string& name)
+        {
+            if (name == "discard")
+            {
+                emit(Opcode::Discard, 0);
+                return allocate(0);
+            }
+
+            std::vector<std::uint32_t> arguments;
+            const auto mark = top;
+            for (std::size_t i = 0; i < expression.arguments.size(); ++i)
+            {
+                auto value = compile(expression.arguments[i]);
+                for (std::size_t j = i + 1; j < expression.arguments.size(); ++j)
+                    value = protect(value, mark, expression.arguments[i].get().qualifiedType.type, expression.arguments[j]);
+                arguments.push_back(value);
+            }
+
+            if (name == "abs")
+            {
+                auto& type = expression.arguments[0].get().qualifiedType.type;
+                const auto kind = getValueKind(type);
+                const auto count = getCellCount(type);
+
+                // the absolute value of an unsigned integer or a boolean is itself
+                if (kind != ValueKind::FloatingPoint && kind != ValueKind::Integer)
+                    return arguments[0];
+
+                const auto result = allocate(count);
+                emit(kind == ValueKind::FloatingPoint ? Opcode::FloatAbs : Opcode::IntegerAbs, result, arguments[0], 0, count, kind);
+                return result;
+            }
+            else if (name == "sample" || name == "load")
+            {
+                const auto result = allocate(4);
+                emit(name == "sample" ? Opcode::TextureSample : Opcode::TextureLoad, result, arguments[0], arguments[1]);
+                return result;
+            }
+
+            throw std::runtime_error{"Unsupported builtin function " + name};
+        }
+
+        Bytecode bytecode;
+        std::unordered_map<const Declaration*, std::uint32_t> globalOffsets;
+        std::unordered_map<const Declaration*, std::uint32_t> locals;
+        std::unordered_map<const CallableDeclaration*, std::uint32_t> functionIndices;
+        std::vector<const CallableDeclaration*> pendingFunctions;
+        std::map<std::uint32_t, std::uint32_t> constantIndices;
+        std::vector<Target> targets;
+        const Type* currentResultType = nullptr;
+        std::uint32_t top = 0;
+        std::uint32_t frameSize = 0;
+    };
+}
+
+#endif // BYTECODECOMPILER_HPP
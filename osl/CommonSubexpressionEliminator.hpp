@@ -0,0 +1,786 @@
+//
+//  OSL
+//
+
+#ifndef COMMONSUBEXPRESSIONELIMINATOR_HPP
+#define COMMONSUBEXPRESSIONELIMINATOR_HPP
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Transformer.hpp"
+
+namespace ouzel
+{
+    // Evaluates the side-effect-free expressions that are repeated in a sequence of statements
+    // only once by storing them in temporaries declared before their first use
+    // and collapses nested swizzles into one
+    class CommonSubexpressionEliminator final: public Transformer
+    {
+    public:
+        explicit CommonSubexpressionEliminator(Context& initContext) noexcept:
+            Transformer{initContext}
+        {
+        }
+
+        void transform() override
+        {
+            for (const auto& construct : context.getConstructs())
+                if (construct->kind == Construct::Kind::Declaration)
+                    names.insert(static_cast<const Declaration&>(*construct).name);
+
+            for (const auto& type : context.getTypes())
+                names.insert(type->name);
+
+            Transformer::transform();
+        }
+
+        // number of evaluations that were replaced by a reference to a temporary
+        [[nodiscard]]
+        std::size_t getEliminatedCount() const noexcept
+        {
+            return eliminatedCount;
+        }
+
+        [[nodiscard]]
+        std::size_t getTemporaryCount() const noexcept
+        {
+            return temporaryCount;
+        }
+
+        // number of swizzles that were merged into another one or removed
+        [[nodiscard]]
+        std::size_t getCollapsedSwizzleCount() const noexcept
+        {
+            return collapsedSwizzleCount;
+        }
+
+    private:
+        // All the occurrences of an expression between two writes to any of the variables it uses
+        struct Value final
+        {
+            const Expression* expression = nullptr;
+            std::set<const Declaration*> declarations;
+            std::size_t count = 0;
+            std::size_t visibleCount = 0; // occurrences that are not inside a replaced expression
+            bool shared = false;
+            const VariableDeclaration* temporary = nullptr;
+        };
+
+        // State of the sequence of statements that is being processed
+        struct Block final
+        {
+            std::vector<std::unique_ptr<Value>> values;
+            std::unordered_multimap<std::size_t, Value*> availableValues;
+            std::map<const Expression*, Value*> occurrences;
+            std::vector<StatementRef>* statements = nullptr; // temporaries are appended here
+        };
+
+        struct Info final
+        {
+            bool pure = true;
+            bool expensive = false;
+            std::size_t hash = 0;
+        };
+
+        const Statement& transformStatement(const Statement& statement) override
+        {
+            if (statement.statementKind == Statement::Kind::Compound)
+            {
+                auto& compoundStatement = static_cast<const CompoundStatement&>(statement);
+
+                std::vector<StatementRef> result;
+                if (!transformStatements(compoundStatement.statements, result)) return statement;
+                return context.create<CompoundStatement>(std::move(result));
+            }
+
+            // a statement that is the body of an if or a loop gets a compound statement for its temporaries
+            std::vector<StatementRef> result;
+            if (!transformStatements({statement}, result)) return statement;
+            if (result.size() == 1) return result.front();
+            return context.create<CompoundStatement>(std::move(result));
+        }
+
+        const Expression& transformExpression(const Expression& expression) override
+        {
+            if (block)
+            {
+                const auto i = block->occurrences.find(&expression);
+                if (i != block->occurrences.end() && i->second->visibleCount > 1)
+                {
+                    auto& value = *i->second;
+
+                    if (!value.temporary)
+                    {
+                        // the replaced subexpressions of the first occurrence are declared before it
+                        auto& initialization = Transformer::transformExpression(expression);
+                        value.temporary = &context.create<VariableDeclaration>(getUniqueName("temporary"),
+                                                                               QualifiedType{expression.qualifiedType.type},
+                                                                               StorageClass::Auto,
+                                                                               &initialization);
+                        block->statements->push_back(context.create<DeclarationStatement>(*value.temporary));
+                        ++temporaryCount;
+                    }
+                    else
+                        ++eliminatedCount;
+
+                    return context.create<DeclarationReferenceExpression>(value.temporary->qualifiedType,
+                                                                          *value.temporary,
+                                                                          Expression::Category::Lvalue);
+                }
+            }
+
+            return collapseSwizzle(Transformer::transformExpression(expression));
+        }
+
+        // returns true if any of the statements changed
+        bool transformStatements(const std::vector<StatementRef>& statements,
+                                 std::vector<StatementRef>& result)
+        {
+            Block currentBlock;
+            const auto previousBlock = block;
+            block = &currentBlock;
+
+            // temporaries declared after a case label would be visible in the following cases
+            bool hasLabels = false;
+            for (const Statement& statement : statements)
+                if (statement.statementKind == Statement::Kind::Case ||
+                    statement.statementKind == Statement::Kind::Default)
+                    hasLabels = true;
+
+            if (!hasLabels)
+            {
+                for (const Statement& statement : statements)
+                    collectStatement(statement);
+
+                for (const Statement& statement : statements)
+                    for (const auto expression : getExpressions(statement))
+                        markVisible(*expression);
+            }
+
+            result.reserve(statements.size());
+            currentBlock.statements = &result;
+            bool changed = false;
+
+            for (const Statement& statement : statements)
+            {
+                const auto size = result.size();
+                auto& transformed = Transformer::transformStatement(statement);
+                if (&transformed != &statement || result.size() != size) changed = true;
+                result.push_back(transformed);
+            }
+
+            block = previousBlock;
+            return changed;
+        }
+
+        // expressions that are evaluated once before the rest of the statement
+        static std::vector<const Expression*> getExpressions(const Statement& statement)
+        {
+            switch (statement.statementKind)
+            {
+                case Statement::Kind::Expression:
+                {
+                    auto& expression = static_cast<const ExpressionStatement&>(statement).expression;
+
+                    if (isAssignment(expression))
+                        return {&static_cast<const BinaryOperatorExpression&>(expression).rightExpression};
+                    return {&expression};
+                }
+
+                case Statement::Kind::Declaration:
+                {
+                    auto& declaration = static_cast<const DeclarationStatement&>(statement).declaration;
+                    if (declaration.declarationKind != Declaration::Kind::Variable) return {};
+
+                    auto initialization = static_cast<const VariableDeclaration&>(declaration).initialization;
+                    if (!initialization) return {};
+                    return {initialization};
+                }
+
+                case Statement::Kind::Return:
+                {
+                    auto result = static_cast<const ReturnStatement&>(statement).result;
+                    if (!result) return {};
+                    return {result};
+                }
+
+                case Statement::Kind::If:
+                case Statement::Kind::Switch:
+                {
+                    auto& condition = (statement.statementKind == Statement::Kind::If) ?
+                        static_cast<const IfStatement&>(statement).condition :
+                        static_cast<const SwitchStatement&>(statement).condition;
+                    if (condition.kind != Construct::Kind::Expression) return {};
+                    return {&static_cast<const Expression&>(condition)};
+                }
+
+                default:
+                    return {};
+            }
+        }
+
+        // values become unavailable when a variable they use is written
+        // or when control flow can write to any variable
+        void collectStatement(const Statement& statement)
+        {
+            const auto expressions = getExpressions(statement);
+
+            Info info;
+            if (statement.statementKind == Statement::Kind::Expression &&
+                isAssignment(static_cast<const ExpressionStatement&>(statement).expression))
+            {
+                auto& assignment = static_cast<const BinaryOperatorExpression&>(static_cast<const ExpressionStatement&>(statement).expression);
+
+                const auto variable = getAssignedVariable(assignment.leftExpression);
+                if (!variable) info.pure = false;
+                else
+                {
+                    info = collectExpression(assignment.leftExpression, false);
+
+                    const auto rightInfo = collectExpression(assignment.rightExpression, info.pure);
+                    if (!rightInfo.pure) info.pure = false;
+                    if (info.pure) makeUnavailable(*variable);
+                }
+            }
+            else
+                for (const auto expression : expressions)
+                    if (!collectExpression(*expression, true).pure)
+                        info.pure = false;
+
+            if (!info.pure ||
+                (statement.statementKind != Statement::Kind::Expression &&
+                 statement.statementKind != Statement::Kind::Declaration &&
+                 statement.statementKind != Statement::Kind::Return))
+                block->availableValues.clear();
+
+            // the occurrences of an impure expression are evaluated in an unknown order
+            if (!info.pure)
+                for (const auto expression : expressions)
+                    removeOccurrences(*expression);
+        }
+
+        // computes the hash of the expression and records the occurrences of its subexpressions
+        Info collectExpression(const Expression& expression, bool record)
+        {
+            Info info;
+            info.hash = std::hash<int>{}(static_cast<int>(expression.expressionKind));
+            combine(info.hash, std::hash<const Type*>{}(&expression.qualifiedType.type));
+
+            const auto collect = [this, &info](const Expression& subExpression, bool recordSubExpression) {
+                const auto subInfo = collectExpression(subExpression, recordSubExpression);
+                if (!subInfo.pure) info.pure = false;
+                if (subInfo.expensive) info.expensive = true;
+                combine(info.hash, subInfo.hash);
+            };
+
+            switch (expression.expressionKind)
+            {
+                case Expression::Kind::Call:
+                {
+                    auto& callExpression = static_cast<const CallExpression&>(expression);
+                    auto& declaration = callExpression.declarationReference.declaration;
+
+                    // only the built-in functions are known not to write to the globals
+                    if (declaration.declarationKind != Declaration::Kind::Callable ||
+                        static_cast<const CallableDeclaration&>(declaration).callableDeclarationKind != CallableDeclaration::Kind::Function ||
+                        !static_cast<const FunctionDeclaration&>(declaration).isBuiltin ||
+                        declaration.name == "discard")
+                        info.pure = false;
+
+                    info.expensive = true;
+                    combine(info.hash, std::hash<const Declaration*>{}(&declaration));
+                    for (const Expression& argument : callExpression.arguments)
+                        collect(argument, record);
+                    break;
+                }
+
+                case Expression::Kind::Literal:
+                    combine(info.hash, hashLiteral(static_cast<const LiteralExpression&>(expression)));
+                    break;
+
+                case Expression::Kind::DeclarationReference:
+                    combine(info.hash, std::hash<const Declaration*>{}(&static_cast<const DeclarationReferenceExpression&>(expression).declaration));
+                    break;
+
+                case Expression::Kind::Paren:
+                    // parentheses do not change the value
+                    return collectExpression(static_cast<const ParenExpression&>(expression).expression, record);
+
+                case Expression::Kind::Member:
+                {
+                    auto& memberExpression = static_cast<const MemberExpression&>(expression);
+                    combine(info.hash, std::hash<const Declaration*>{}(&memberExpression.fieldDeclaration));
+                    collect(memberExpression.expression, record);
+                    break;
+                }
+
+                case Expression::Kind::ArraySubscript:
+                {
+                    auto& arraySubscriptExpression = static_cast<const ArraySubscriptExpression&>(expression);
+                    collect(arraySubscriptExpression.expression, record);
+                    collect(arraySubscriptExpression.subscript, record);
+                    break;
+                }
+
+                case Expression::Kind::UnaryOperator:
+                {
+                    auto& unaryOperatorExpression = static_cast<const UnaryOperatorExpression&>(expression);
+                    if (unaryOperatorExpression.operatorKind != UnaryOperatorExpression::Kind::Negation &&
+                        unaryOperatorExpression.operatorKind != UnaryOperatorExpression::Kind::Positive &&
+                        unaryOperatorExpression.operatorKind != UnaryOperatorExpression::Kind::Negative)
+                        info.pure = false;
+
+                    info.expensive = true;
+                    combine(info.hash, std::hash<int>{}(static_cast<int>(unaryOperatorExpression.operatorKind)));
+                    collect(unaryOperatorExpression.expression, record);
+                    break;
+                }
+
+                case Expression::Kind::BinaryOperator:
+                {
+                    auto& binaryOperatorExpression = static_cast<const BinaryOperatorExpression&>(expression);
+                    if (isAssignment(binaryOperatorExpression))
+                        info.pure = false;
+
+                    // the right operand is not always evaluated, so it is not moved before the statement
+                    const auto conditional = binaryOperatorExpression.operatorKind == BinaryOperatorExpression::Kind::And ||
+                        binaryOperatorExpression.operatorKind == BinaryOperatorExpression::Kind::Or;
+
+                    info.expensive = true;
+                    combine(info.hash, std::hash<int>{}(static_cast<int>(binaryOperatorExpression.operatorKind)));
+                    collect(binaryOperatorExpression.leftExpression, record);
+                    collect(binaryOperatorExpression.rightExpression, record && !conditional);
+                    break;
+                }
+
+                case Expression::Kind::TernaryOperator:
+                {
+                    auto& ternaryOperatorExpression = static_cast<const TernaryOperatorExpression&>(expression);
+                    info.expensive = true;
+                    collect(ternaryOperatorExpression.condition, record);
+                    collect(ternaryOperatorExpression.leftExpression, false);
+                    collect(ternaryOperatorExpression.rightExpression, false);
+                    break;
+                }
+
+                case Expression::Kind::TemporaryObject:
+                {
+                    auto& temporaryObjectExpression = static_cast<const TemporaryObjectExpression&>(expression);
+                    combine(info.hash, std::hash<const Declaration*>{}(&temporaryObjectExpression.constructorDeclaration));
+                    for (const Expression& parameter : temporaryObjectExpression.parameters)
+                        collect(parameter, record);
+                    break;
+                }
+
+                case Expression::Kind::InitializerList:
+                    // initializer lists can only be used to initialize variables
+                    for (const Expression& subExpression : static_cast<const InitializerListExpression&>(expression).expressions)
+                        collect(subExpression, record);
+                    return info;
+
+                case Expression::Kind::Cast:
+                    collect(static_cast<const CastExpression&>(expression).expression, record);
+                    break;
+
+                case Expression::Kind::VectorInitialize:
+                    for (const Expression& parameter : static_cast<const VectorInitializeExpression&>(expression).parameters)
+                        collect(parameter, record);
+                    break;
+
+                case Expression::Kind::VectorElement:
+                {
+                    auto& vectorElementExpression = static_cast<const VectorElementExpression&>(expression);
+                    for (const auto position : vectorElementExpression.positions)
+                        combine(info.hash, std::hash<int>{}(position));
+                    collect(vectorElementExpression.expression, record);
+                    break;
+                }
+
+                case Expression::Kind::MatrixInitialize:
+                    for (const Expression& parameter : static_cast<const MatrixInitializeExpression&>(expression).parameters)
+                        collect(parameter, record);
+                    break;
+            }
+
+            if (record && info.pure && info.expensive &&
+                expression.qualifiedType.type.typeKind != Type::Kind::Void &&
+                expression.qualifiedType.type.typeKind != Type::Kind::Array)
+                addOccurrence(expression, info.hash);
+
+            return info;
+        }
+
+        void addOccurrence(const Expression& expression, std::size_t hash)
+        {
+            Value* value = nullptr;
+
+            const auto range = block->availableValues.equal_range(hash);
+            for (auto i = range.first; i != range.second; ++i)
+                if (isEqual(*i->second->expression, expression))
+                {
+                    value = i->second;
+                    break;
+                }
+
+            if (!value)
+            {
+                block->values.push_back(std::make_unique<Value>());
+                value = block->values.back().get();
+                value->expression = &expression;
+                collectDeclarations(expression, value->declarations);
+                block->availableValues.emplace(hash, value);
+            }
+
+            // a node that is shared by two places in the tree can not be told apart, so it is never replaced
+            const auto result = block->occurrences.emplace(&expression, value);
+            if (!result.second)
+            {
+                result.first->second->shared = true;
+                return;
+            }
+
+            ++value->count;
+        }
+
+        void removeOccurrences(const Expression& expression)
+        {
+            struct Remover final: Transformer
+            {
+                Remover(Context& initContext, Block& initBlock) noexcept:
+                    Transformer{initContext}, block{initBlock}
+                {
+                }
+
+                const Expression& transformExpression(const Expression& subExpression) override
+                {
+                    const auto i = block.occurrences.find(&subExpression);
+                    if (i != block.occurrences.end())
+                    {
+                        --i->second->count;
+                        block.occurrences.erase(i);
+                    }
+
+                    return Transformer::transformExpression(subExpression);
+                }
+
+                Block& block;
+            } remover{context, *block};
+
+            remover.transformExpression(expression);
+        }
+
+        void makeUnavailable(const Declaration& declaration)
+        {
+            for (auto i = block->availableValues.begin(); i != block->availableValues.end();)
+                if (i->second->declarations.find(&declaration) != i->second->declarations.end())
+                    i = block->availableValues.erase(i);
+                else
+                    ++i;
+        }
+
+        // the subexpressions of a replaced occurrence are only evaluated in the first one
+        void markVisible(const Expression& expression)
+        {
+            struct Marker final: Transformer
+            {
+                Marker(Context& initContext, Block& initBlock) noexcept:
+                    Transformer{initContext}, block{initBlock}
+                {
+                }
+
+                const Expression& transformExpression(const Expression& subExpression) override
+                {
+                    const auto i = block.occurrences.find(&subExpression);
+                    if (i != block.occurrences.end() && i->second->count > 1 && !i->second->shared)
+                        if (++i->second->visibleCount > 1) return subExpression;
+
+                    return Transformer::transformExpression(subExpression);
+                }
+
+                Block& block;
+            } marker{context, *block};
+
+            marker.transformExpression(expression);
+        }
+
+        const Expression& collapseSwizzle(const Expression& expression)
+        {
+            if (expression.expressionKind != Expression::Kind::VectorElement) return expression;
+
+            auto& vectorElementExpression = static_cast<const VectorElementExpression&>(expression);
+            auto positions = vectorElementExpression.positions;
+            auto subExpression = &vectorElementExpression.expression;
+            bool collapsed = false;
+
+            for (;;)
+            {
+                auto innerExpression = subExpression;
+                while (innerExpression->expressionKind == Expression::Kind::Paren)
+                    innerExpression = &static_cast<const ParenExpression*>(innerExpression)->expression;
+
+                if (innerExpression->expressionKind != Expression::Kind::VectorElement) break;
+
+                auto& innerVectorElementExpression = static_cast<const VectorElementExpression&>(*innerExpression);
+                for (auto& position : positions)
+                    position = innerVectorElementExpression.positions[position];
+
+                subExpression = &innerVectorElementExpression.expression;
+                collapsed = true;
+            }
+
+            // selecting all the components in order is the vector itself
+            auto& vectorType = static_cast<const VectorType&>(subExpression->qualifiedType.type);
+            bool identity = positions.size() == vectorType.componentCount;
+            for (std::size_t i = 0; i < positions.size() && identity; ++i)
+                if (positions[i] != i) identity = false;
+
+            if (identity)
+            {
+                ++collapsedSwizzleCount;
+                return *subExpression;
+            }
+
+            if (!collapsed) return expression;
+
+            ++collapsedSwizzleCount;
+            return context.create<VectorElementExpression>(*subExpression,
+                                                           expression.qualifiedType.type,
+                                                           expression.qualifiedType.qualifiers,
+                                                           expression.category,
+                                                           std::move(positions));
+        }
+
+        static bool isAssignment(const Expression& expression) noexcept
+        {
+            if (expression.expressionKind != Expression::Kind::BinaryOperator) return false;
+
+            switch (static_cast<const BinaryOperatorExpression&>(expression).operatorKind)
+            {
+                case BinaryOperatorExpression::Kind::AdditionAssignment:
+                case BinaryOperatorExpression::Kind::SubtractAssignment:
+                case BinaryOperatorExpression::Kind::MultiplicationAssignment:
+                case BinaryOperatorExpression::Kind::DivisionAssignment:
+                case BinaryOperatorExpression::Kind::Assignment:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        // the variable that is written when assigning to a member, element or component of it
+        static const Declaration* getAssignedVariable(const Expression& expression) noexcept
+        {
+            switch (expression.expressionKind)
+            {
+                case Expression::Kind::DeclarationReference:
+                    return &static_cast<const DeclarationReferenceExpression&>(expression).declaration;
+                case Expression::Kind::Paren:
+                    return getAssignedVariable(static_cast<const ParenExpression&>(expression).expression);
+                case Expression::Kind::Member:
+                    return getAssignedVariable(static_cast<const MemberExpression&>(expression).expression);
+                case Expression::Kind::ArraySubscript:
+                    return getAssignedVariable(static_cast<const ArraySubscriptExpression&>(expression).expression);
+                case Expression::Kind::VectorElement:
+                    return getAssignedVariable(static_cast<const VectorElementExpression&>(expression).expression);
+                default:
+                    return nullptr;
+            }
+        }
+
+        void collectDeclarations(const Expression& expression, std::set<const Declaration*>& declarations)
+        {
+            struct Collector final: Transformer
+            {
+                Collector(Context& initContext, std::set<const Declaration*>& initDeclarations) noexcept:
+                    Transformer{initContext}, declarations{initDeclarations}
+                {
+                }
+
+                const Expression& transformExpression(const Expression& subExpression) override
+                {
+                    if (subExpression.expressionKind == Expression::Kind::DeclarationReference)
+                        declarations.insert(&static_cast<const DeclarationReferenceExpression&>(subExpression).declaration);
+
+                    return Transformer::transformExpression(subExpression);
+                }
+
+                std::set<const Declaration*>& declarations;
+            } collector{context, declarations};
+
+            collector.transformExpression(expression);
+        }
+
+        static bool isEqual(const Expression& first, const Expression& second)
+        {
+            if (first.expressionKind == Expression::Kind::Paren)
+                return isEqual(static_cast<const ParenExpression&>(first).expression, second);
+            if (second.expressionKind == Expression::Kind::Paren)
+                return isEqual(first, static_cast<const ParenExpression&>(second).expression);
+
+            if (first.expressionKind != second.expressionKind ||
+                &first.qualifiedType.type != &second.qualifiedType.type)
+                return false;
+
+            const auto isEqualList = [](const std::vector<ExpressionRef>& firstList,
+                                        const std::vector<ExpressionRef>& secondList) {
+                if (firstList.size() != secondList.size()) return false;
+                for (std::size_t i = 0; i < firstList.size(); ++i)
+                    if (!isEqual(firstList[i], secondList[i])) return false;
+                return true;
+            };
+
+            switch (first.expressionKind)
+            {
+                case Expression::Kind::Call:
+                {
+                    auto& firstCall = static_cast<const CallExpression&>(first);
+                    auto& secondCall = static_cast<const CallExpression&>(second);
+                    return &firstCall.declarationReference.declaration == &secondCall.declarationReference.declaration &&
+                        isEqualList(firstCall.arguments, secondCall.arguments);
+                }
+
+                case Expression::Kind::Literal:
+                {
+                    auto& firstLiteral = static_cast<const LiteralExpression&>(first);
+                    auto& secondLiteral = static_cast<const LiteralExpression&>(second);
+                    if (firstLiteral.literalKind != secondLiteral.literalKind) return false;
+
+                    switch (firstLiteral.literalKind)
+                    {
+                        case LiteralExpression::Kind::Boolean:
+                            return static_cast<const BooleanLiteralExpression&>(first).value == static_cast<const BooleanLiteralExpression&>(second).value;
+                        case LiteralExpression::Kind::Integer:
+                            return static_cast<const IntegerLiteralExpression&>(first).value == static_cast<const IntegerLiteralExpression&>(second).value;
+                        case LiteralExpression::Kind::FloatingPoint:
+                            return static_cast<const FloatingPointLiteralExpression&>(first).value == static_cast<const FloatingPointLiteralExpression&>(second).value;
+                        case LiteralExpression::Kind::String:
+                            return static_cast<const StringLiteralExpression&>(first).value == static_cast<const StringLiteralExpression&>(second).value;
+                    }
+                    return false;
+                }
+
+                case Expression::Kind::DeclarationReference:
+                    return &static_cast<const DeclarationReferenceExpression&>(first).declaration ==
+                        &static_cast<const DeclarationReferenceExpression&>(second).declaration;
+
+                case Expression::Kind::Member:
+                {
+                    auto& firstMember = static_cast<const MemberExpression&>(first);
+                    auto& secondMember = static_cast<const MemberExpression&>(second);
+                    return &firstMember.fieldDeclaration == &secondMember.fieldDeclaration &&
+                        isEqual(firstMember.expression, secondMember.expression);
+                }
+
+                case Expression::Kind::ArraySubscript:
+                {
+                    auto& firstSubscript = static_cast<const ArraySubscriptExpression&>(first);
+                    auto& secondSubscript = static_cast<const ArraySubscriptExpression&>(second);
+                    return isEqual(firstSubscript.expression, secondSubscript.expression) &&
+                        isEqual(firstSubscript.subscript, secondSubscript.subscript);
+                }
+
+                case Expression::Kind::UnaryOperator:
+                {
+                    auto& firstUnary = static_cast<const UnaryOperatorExpression&>(first);
+                    auto& secondUnary = static_cast<const UnaryOperatorExpression&>(second);
+                    return firstUnary.operatorKind == secondUnary.operatorKind &&
+                        isEqual(firstUnary.expression, secondUnary.expression);
+                }
+
+                case Expression::Kind::BinaryOperator:
+                {
+                    auto& firstBinary = static_cast<const BinaryOperatorExpression&>(first);
+                    auto& secondBinary = static_cast<const BinaryOperatorExpression&>(second);
+                    return firstBinary.operatorKind == secondBinary.operatorKind &&
+                        isEqual(firstBinary.leftExpression, secondBinary.leftExpression) &&
+                        isEqual(firstBinary.rightExpression, secondBinary.rightExpression);
+                }
+
+                case Expression::Kind::TernaryOperator:
+                {
+                    auto& firstTernary = static_cast<const TernaryOperatorExpression&>(first);
+                    auto& secondTernary = static_cast<const TernaryOperatorExpression&>(second);
+                    return isEqual(firstTernary.condition, secondTernary.condition) &&
+                        isEqual(firstTernary.leftExpression, secondTernary.leftExpression) &&
+                        isEqual(firstTernary.rightExpression, secondTernary.rightExpression);
+                }
+
+                case Expression::Kind::TemporaryObject:
+                {
+                    auto& firstObject = static_cast<const TemporaryObjectExpression&>(first);
+                    auto& secondObject = static_cast<const TemporaryObjectExpression&>(second);
+                    return &firstObject.constructorDeclaration == &secondObject.constructorDeclaration &&
+                        isEqualList(firstObject.parameters, secondObject.parameters);
+                }
+
+                case Expression::Kind::Cast:
+                    return isEqual(static_cast<const CastExpression&>(first).expression,
+                                   static_cast<const CastExpression&>(second).expression);
+
+                case Expression::Kind::VectorInitialize:
+                    return isEqualList(static_cast<const VectorInitializeExpression&>(first).parameters,
+                                       static_cast<const VectorInitializeExpression&>(second).parameters);
+
+                case Expression::Kind::VectorElement:
+                {
+                    auto& firstElement = static_cast<const VectorElementExpression&>(first);
+                    auto& secondElement = static_cast<const VectorElementExpression&>(second);
+                    return firstElement.positions == secondElement.positions &&
+                        isEqual(firstElement.expression, secondElement.expression);
+                }
+
+                case Expression::Kind::MatrixInitialize:
+                    return isEqualList(static_cast<const MatrixInitializeExpression&>(first).parameters,
+                                       static_cast<const MatrixInitializeExpression&>(second).parameters);
+
+                default:
+                    return false;
+            }
+        }
+
+        static std::size_t hashLiteral(const LiteralExpression& literalExpression)
+        {
+            switch (literalExpression.literalKind)
+            {
+                case LiteralExpression::Kind::Boolean:
+                    return std::hash<bool>{}(static_cast<const BooleanLiteralExpression&>(literalExpression).value);
+                case LiteralExpression::Kind::Integer:
+                    return std::hash<std::int64_t>{}(static_cast<const IntegerLiteralExpression&>(literalExpression).value);
+                case LiteralExpression::Kind::FloatingPoint:
+                    return std::hash<double>{}(static_cast<const FloatingPointLiteralExpression&>(literalExpression).value);
+                case LiteralExpression::Kind::String:
+                    return std::hash<std::string>{}(static_cast<const StringLiteralExpression&>(literalExpression).value);
+            }
+
+            return 0;
+        }
+
+        static void combine(std::size_t& seed, std::size_t hash) noexcept
+        {
+            seed ^= hash + 0x9E3779B9U + (seed << 6) + (seed >> 2);
+        }
+
+        std::string getUniqueName(const std::string& name)
+        {
+            for (;;)
+            {
+                auto result = name + "_" + std::to_string(++nameCounter);
+                if (names.insert(result).second) return result;
+            }
+        }
+
+        Block* block = nullptr;
+        std::set<std::string> names;
+        std::size_t nameCounter = 0;
+        std::size_t eliminatedCount = 0;
+        std::size_t temporaryCount = 0;
+        std::size_t collapsedSwizzleCount = 0;
+    };
+}
+
+#endif // COMMONSUBEXPRESSIONELIMINATOR_HPP
@@ -0,0 +1,476 @@
+//
+//  OSL
+//
+
+#ifndef COMPILER_HPP
+#define COMPILER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "AllocationTracker.hpp"
+#include "BytecodeCompiler.hpp"
+#include "CommonSubexpressionEliminator.hpp"
+#include "ConstantFolder.hpp"
+#include "DeadCodeEliminator.hpp"
+#include "Diagnostics.hpp"
+#include "Inliner.hpp"
+#include "Layout.hpp"
+#include "Minifier.hpp"
+#include "Module.hpp"
+#include "OutputCPP.hpp"
+#include "OutputGLSL.hpp"
+#include "OutputHLSL.hpp"
+#include "OutputMSL.hpp"
+#include "Parser.hpp"
+#include "Preprocessor.hpp"
+#include "Reflection.hpp"
+#include "Statistics.hpp"
+#include "Tokenizer.hpp"
+#include "Trace.hpp"
+
+namespace ouzel
+{
+    enum class Target
+    {
+        HLSL,
+        GLSL,
+        MSL,
+        CPP,
+        Bytecode
+    };
+
+    [[nodiscard]]
+    inline std::string toString(Target target)
+    {
+        switch (target)
+        {
+            case Target::HLSL: return "hlsl";
+            case Target::GLSL: return "glsl";
+            case Target::MSL: return "msl";
+            case Target::CPP: return "cpp";
+            case Target::Bytecode: return "bytecode";
+        }
+
+        throw std::runtime_error{"Unknown target"};
+    }
+
+    // the rules by which the output of a target lays out its extern variables
+    [[nodiscard]]
+    inline Layout::Rules getLayoutRules(Target target, std::uint32_t glslVersion)
+    {
+        switch (target)
+        {
+            case Target::HLSL: return Layout::Rules::HLSL;
+            case Target::GLSL: return (glslVersion >= 140) ? Layout::Rules::Std140 : Layout::Rules::Packed;
+            case Target::MSL: return Layout::Rules::Metal;
+            case Target::CPP:
+            case Target::Bytecode:
+                return Layout::Rules::Packed;
+        }
+
+        throw std::runtime_error{"Unknown target"};
+    }
+
+    // Runs the whole pipeline from the source to the output of a target with the same options,
+    // the token buffer and the storage of a reused result are kept between the calls, so that a compiler
+    // that is reused does not allocate them again, the contexts of the sources are kept,
+    // so that only their changed declarations are parsed again
+    class Compiler final
+    {
+    public:
+        struct Options final
+        {
+            std::map<std::string, std::string> defines;
+            bool optimize = false;
+            std::size_t inlineThreshold = 16;
+            bool optimizationReport = false;
+            bool minify = false;
+            bool nameMap = false; // the names picked by the minifier are returned in the result
+            bool whitespaces = false;
+            std::uint32_t outputVersion = 0; // GLSL version
+            std::string outputNamespace = "shader"; // C++ namespace
+            std::size_t parseThreads = 0;
+            bool reflection = false;
+            // the included files are read from the disk if there is no handler
+            Preprocessor::IncludeHandler includeHandler;
+            std::vector<std::string> includeDirectories;
+            // the imported modules are read from the include directories if there is no loader
+            Module::Loader moduleLoader;
+            // the phases and the parsing of the declarations are traced if there is a tracer
+            Tracer* tracer = nullptr;
+        };
+
+        struct Result final
+        {
+            // keeps the storage of the buffers
+            void clear()
+            {
+                success = false;
+                output.clear();
+                diagnostics.clear();
+                reflection.clear();
+                includes.clear();
+                optimizationReport.clear();
+                nameMap.clear();
+                statistics = Statistics();
+            }
+
+            // false if there are diagnostics
+            bool success = false;
+            // the code or the serialized bytecode
+            std::string output;
+            std::vector<Diagnostic> diagnostics;
+            // the serialized reflection of the program if it was requested
+            std::vector<std::uint8_t> reflection;
+            // the paths of the included files and of the imported module files
+            std::vector<std::string> includes;
+            // the optimizations that were done if the report was requested
+            std::string optimizationReport;
+            // one "original renamed" line per renamed declaration if the name map was requested
+            std::string nameMap;
+            Statistics statistics;
+        };
+
+        // Records the duration and the allocations of the phases in the statistics and in the tracer
+        class Phases final
+        {
+        public:
+            explicit Phases(Statistics& initStatistics, Tracer* initTracer = nullptr) noexcept:
+                statistics{initStatistics},
+                tracer{initTracer}
+            {
+            }
+
+            void start()
+            {
+                allocationCount = AllocationTracker::getAllocationCount();
+                allocatedBytes = AllocationTracker::getAllocatedBytes();
+                startTime = std::chrono::steady_clock::now();
+            }
+
+            void end(const std::string& name)
+            {
+                const auto endTime = std::chrono::steady_clock::now();
+                statistics.addPhase(name, endTime - startTime,
+                                    AllocationTracker::getAllocationCount() - allocationCount,
+                                    AllocationTracker::getAllocatedBytes() - allocatedBytes);
+                if (tracer) tracer->addEvent(name, "phase", startTime, endTime);
+            }
+
+        private:
+            Statistics& statistics;
+            Tracer* tracer = nullptr;
+            std::chrono::steady_clock::time_point startTime;
+            std::size_t allocationCount = 0;
+            std::size_t allocatedBytes = 0;
+        };
+
+        Compiler() = default;
+
+        explicit Compiler(const Options& initOptions):
+            options{initOptions}
+        {
+        }
+
+        [[nodiscard]] Options& getOptions() noexcept { return options; }
+        [[nodiscard]] const Options& getOptions() const noexcept { return options; }
+
+        // declarations that are compiled before every source, they are preprocessed with the current defines
+        // and checked right away, so that their errors are thrown here instead of being reported for each source
+        void setPrelude(const std::string& code)
+        {
+            auto preludeTokens = ouzel::tokenize(createPreprocessor().preprocess(code));
+            const Context context(preludeTokens);
+            prelude = std::move(preludeTokens);
+        }
+
+        [[nodiscard]] const std::vector<Token>& getPrelude() const noexcept { return prelude; }
+
+        [[nodiscard]]
+        Result compile(const std::string& source, Target target, Program program)
+        {
+            Result result;
+            compile(source, target, program, result);
+            return result;
+        }
+
+        // reuses the storage of the previous result, the errors in the source are reported as diagnostics,
+        // the other failures are thrown, the includes are looked up from the current directory
+        void compile(const std::string& source, Target target, Program program, Result& result)
+        {
+            compile(std::string(), source, target, program, result);
+        }
+
+        // the name is the path the includes are looked up from, the next source with the same name
+        // only parses the declarations that changed
+        void compile(const std::string& name, const std::string& source, Target target, Program program, Result& result)
+        {
+            result.clear();
+
+            if (!preprocess(source, name, result) || !tokenize(result) || !import(result)) return;
+
+            const auto context = parse(name, result);
+            if (!context) return;
+
+            if (options.optimize) optimize(*context, program, result);
+            result.statistics.addContext(*context);
+
+            generate(*context, target, program, result);
+        }
+
+        // drops the context kept for the name
+        void removeCached(const std::string& name)
+        {
+            contexts.erase(name);
+        }
+
+        [[nodiscard]] bool isCached(const std::string& name) const
+        {
+            const auto i = contexts.find(name);
+            return i != contexts.end() && i->second;
+        }
+
+        // the stages of compile for the callers that use the intermediate results, they are run in order on a cleared
+        // result, each of them records its phase and adds its errors to the diagnostics, so it returns false or null
+
+        bool preprocess(const std::string& source, const std::string& path, Result& result)
+        {
+            Phases phases(result.statistics, options.tracer);
+            phases.start();
+
+            auto preprocessor = createPreprocessor();
+            try
+            {
+                preprocessed = preprocessor.preprocess(source, path);
+                result.includes = preprocessor.getIncludes();
+            }
+            catch (const SourceError& e)
+            {
+                result.diagnostics.push_back(getDiagnostic(ErrorCode::InvalidDirective, e));
+                return false;
+            }
+
+            phases.end("preprocess");
+            return true;
+        }
+
+        // with the line markers of the included files
+        [[nodiscard]] const std::string& getPreprocessed() const noexcept { return preprocessed; }
+
+        // the source is tokenized after the prelude
+        bool tokenize(Result& result)
+        {
+            Phases phases(result.statistics, options.tracer);
+            phases.start();
+
+            tokens.assign(prelude.begin(), prelude.end());
+            try
+            {
+                ouzel::tokenize(preprocessed, tokens);
+            }
+            catch (const SourceError& e)
+            {
+                result.diagnostics.push_back(getDiagnostic(ErrorCode::InvalidToken, e));
+                return false;
+            }
+
+            phases.end("tokenize");
+            return true;
+        }
+
+        [[nodiscard]] const std::vector<Token>& getTokens() const noexcept { return tokens; }
+
+        bool import(Result& result)
+        {
+            Phases phases(result.statistics, options.tracer);
+            phases.start();
+
+            try
+            {
+                for (const auto& module : Module::import(tokens, getModuleLoader()))
+                    if (!module->getPath().empty()) result.includes.push_back(module->getPath());
+            }
+            catch (const SourceError& e)
+            {
+                result.diagnostics.push_back(getDiagnostic(ErrorCode::InvalidImport, e));
+                return false;
+            }
+
+            phases.end("import");
+            result.statistics.tokenCount = tokens.size();
+            return true;
+        }
+
+        // the context is kept for the name and updated by the next parse with the same name, except when optimizing,
+        // because a transformed context can not be updated, then it is kept only until the next parse
+        Context* parse(const std::string& name, Result& result)
+        {
+            Phases phases(result.statistics, options.tracer);
+            phases.start();
+
+            if (options.optimize)
+            {
+                contexts.erase(name);
+                transformedContext.reset(new Context(tokens, result.diagnostics, options.tracer, options.parseThreads));
+                if (!result.diagnostics.empty()) return nullptr;
+
+                phases.end("parse");
+                return transformedContext.get();
+            }
+
+            auto& context = contexts[name];
+            try
+            {
+                if (context)
+                    context->update(tokens);
+                else
+                    context.reset(new Context(tokens, options.tracer, options.parseThreads));
+            }
+            catch (const ParseError&)
+            {
+                // the errors are collected by parsing again, the cached context is kept as it was
+                if (!context) contexts.erase(name);
+                const Context failedContext(tokens, result.diagnostics, nullptr, options.parseThreads);
+                return nullptr;
+            }
+
+            phases.end("parse");
+            return context.get();
+        }
+
+        // without a program the unused declarations are kept, because the entry point is not known
+        void optimize(Context& context, std::optional<Program> program, Result& result)
+        {
+            Phases phases(result.statistics, options.tracer);
+            phases.start();
+
+            Inliner inliner(context, options.inlineThreshold);
+            inliner.transform();
+
+            ConstantFolder constantFolder(context);
+            constantFolder.transform();
+
+            CommonSubexpressionEliminator commonSubexpressionEliminator(context);
+            commonSubexpressionEliminator.transform();
+
+            std::unique_ptr<DeadCodeEliminator> deadCodeEliminator;
+            if (program)
+            {
+                deadCodeEliminator.reset(new DeadCodeEliminator(context, *program));
+                deadCodeEliminator->transform();
+            }
+
+            phases.end("optimize");
+
+            if (!options.optimizationReport) return;
+
+            auto& report = result.optimizationReport;
+            for (const auto& inlinedCall : inliner.getInlinedCalls())
+                report += "Inlined " + inlinedCall.function + " into " + inlinedCall.caller +
+                    " (cost " + std::to_string(inlinedCall.cost) + ")\n";
+
+            report += "Folded constant expressions: " + std::to_string(constantFolder.getFoldedCount()) + '\n';
+            report += "Eliminated common subexpressions: " + std::to_string(commonSubexpressionEliminator.getEliminatedCount()) +
+                " (" + std::to_string(commonSubexpressionEliminator.getTemporaryCount()) + " temporaries)\n";
+            report += "Collapsed swizzles: " + std::to_string(commonSubexpressionEliminator.getCollapsedSwizzleCount()) + '\n';
+
+            if (deadCodeEliminator)
+            {
+                report += "Removed unreachable declarations: " + std::to_string(deadCodeEliminator->getRemovedDeclarationCount()) + '\n';
+                report += "Removed unreachable statements: " + std::to_string(deadCodeEliminator->getRemovedStatementCount()) + '\n';
+            }
+        }
+
+        // the reflection describes the program after the optimizations removed the unused externs
+        void reflect(const Context& context, Program program, Layout::Rules layoutRules, Result& result)
+        {
+            Phases phases(result.statistics, options.tracer);
+            phases.start();
+            result.reflection = Reflection(context, program, layoutRules).serialize();
+            phases.end("reflection");
+        }
+
+        // the output is written to the storage of the result
+        void generate(Context& context, Target target, Program program, Result& result)
+        {
+            if (options.reflection)
+                reflect(context, program, getLayoutRules(target, options.outputVersion), result);
+
+            Phases phases(result.statistics, options.tracer);
+            phases.start();
+
+            if (target == Target::Bytecode)
+            {
+                const auto data = BytecodeCompiler(context, program).getBytecode().serialize();
+                result.output.assign(data.begin(), data.end());
+            }
+            else
+            {
+                std::unique_ptr<Minifier> minifier;
+                if (options.minify)
+                {
+                    minifier.reset(new Minifier(context));
+                    if (options.nameMap) result.nameMap = minifier->getNameMap();
+                }
+
+                createOutput(target, program, minifier.get())->output(context, options.whitespaces, result.output);
+            }
+
+            phases.end("output " + toString(target));
+            result.statistics.outputSize = result.output.size();
+            result.success = true;
+        }
+
+        // the file loader keeps the loaded modules, so it is created again only if the directories change
+        const Module::Loader& getModuleLoader()
+        {
+            if (options.moduleLoader) return options.moduleLoader;
+
+            if (!fileModuleLoader || moduleDirectories != options.includeDirectories)
+            {
+                moduleDirectories = options.includeDirectories;
+                fileModuleLoader = Module::getFileLoader(moduleDirectories);
+            }
+
+            return fileModuleLoader;
+        }
+
+    private:
+        Preprocessor createPreprocessor() const
+        {
+            Preprocessor preprocessor(options.defines);
+            preprocessor.setIncludeHandler(options.includeHandler ? options.includeHandler :
+                                           Preprocessor::getFileIncludeHandler(options.includeDirectories));
+            return preprocessor;
+        }
+
+        std::unique_ptr<Output> createOutput(Target target, Program program, const Minifier* minifier) const
+        {
+            switch (target)
+            {
+                case Target::HLSL: return std::unique_ptr<Output>(new OutputHLSL(program, minifier));
+                case Target::GLSL: return std::unique_ptr<Output>(new OutputGLSL(program, options.outputVersion, minifier));
+                case Target::MSL: return std::unique_ptr<Output>(new OutputMSL(program, minifier));
+                case Target::CPP: return std::unique_ptr<Output>(new OutputCPP(program, options.outputNamespace, minifier));
+                default: throw std::runtime_error{"Invalid target"};
+            }
+        }
+
+        Options options;
+        std::vector<Token> prelude;
+        std::string preprocessed;
+        std::vector<Token> tokens;
+        std::map<std::string, std::unique_ptr<Context>> contexts;
+        std::unique_ptr<Context> transformedContext;
+        Module::Loader fileModuleLoader;
+        std::vector<std::string> moduleDirectories;
+    };
+}
+
+#endif // COMPILER_HPP
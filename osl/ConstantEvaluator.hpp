@@ -0,0 +1,418 @@
+//
+//  OSL
+//
+
+#ifndef CONSTANTEVALUATOR_HPP
+#define CONSTANTEVALUATOR_HPP
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Declarations.hpp"
+#include "Expressions.hpp"
+
+namespace ouzel
+{
+    // Value of a scalar or vector expression known at compile time
+    class Constant final
+    {
+    public:
+        explicit Constant(const Type& initType) noexcept:
+            type{&initType},
+            scalarType{getScalarType(initType)},
+            componentCount{initType.typeKind == Type::Kind::Vector ?
+                static_cast<const VectorType&>(initType).componentCount : 1}
+        {
+        }
+
+        [[nodiscard]]
+        static const ScalarType* getScalarType(const Type& type) noexcept
+        {
+            if (type.typeKind == Type::Kind::Scalar)
+                return &static_cast<const ScalarType&>(type);
+            else if (type.typeKind == Type::Kind::Vector)
+                return &static_cast<const VectorType&>(type).componentType;
+            else
+                return nullptr;
+        }
+
+        [[nodiscard]]
+        bool isFloatingPoint() const noexcept
+        {
+            return scalarType->scalarTypeKind == ScalarType::Kind::FloatingPoint;
+        }
+
+        // booleans and integers are kept in integers, floating point values in floats
+        const Type* type;
+        const ScalarType* scalarType;
+        std::size_t componentCount;
+        std::array<std::int64_t, 4> integers{};
+        std::array<double, 4> floats{};
+    };
+
+    namespace detail
+    {
+        // wraps the value to the 32-bit range of the int and uint types
+        inline std::int64_t wrap(const ScalarType& scalarType, std::int64_t value) noexcept
+        {
+            if (scalarType.scalarTypeKind == ScalarType::Kind::Boolean)
+                return value != 0 ? 1 : 0;
+            else if (scalarType.isUnsigned)
+                return static_cast<std::int64_t>(static_cast<std::uint32_t>(value));
+            else
+                return static_cast<std::int64_t>(static_cast<std::int32_t>(static_cast<std::uint32_t>(value)));
+        }
+
+        // arithmetic is done in single precision to match the shader float type
+        inline bool makeFloat(double value, double& result) noexcept
+        {
+            const auto singlePrecision = static_cast<float>(value);
+            if (!std::isfinite(singlePrecision)) return false;
+            result = static_cast<double>(singlePrecision);
+            return true;
+        }
+
+        inline bool convert(const Constant& source, std::size_t component,
+                            const ScalarType& targetType, Constant& target, std::size_t targetComponent)
+        {
+            if (targetType.scalarTypeKind == ScalarType::Kind::FloatingPoint)
+                return makeFloat(source.isFloatingPoint() ?
+                                 source.floats[component] :
+                                 static_cast<double>(source.integers[component]),
+                                 target.floats[targetComponent]);
+
+            if (source.isFloatingPoint())
+            {
+                const auto value = source.floats[component];
+
+                if (targetType.scalarTypeKind == ScalarType::Kind::Boolean)
+                    target.integers[targetComponent] = value != 0.0 ? 1 : 0;
+                else if (value > -2147483649.0 && value < 4294967296.0) // truncate as in C++
+                    target.integers[targetComponent] = wrap(targetType, static_cast<std::int64_t>(value));
+                else
+                    return false;
+            }
+            else
+                target.integers[targetComponent] = wrap(targetType, source.integers[component]);
+
+            return true;
+        }
+
+        inline std::optional<Constant> evaluateUnary(const UnaryOperatorExpression& expression,
+                                                     const Constant& operand)
+        {
+            Constant result{expression.qualifiedType.type};
+            if (!result.scalarType || result.componentCount != operand.componentCount)
+                return std::nullopt;
+
+            for (std::size_t i = 0; i < result.componentCount; ++i)
+                switch (expression.operatorKind)
+                {
+                    case UnaryOperatorExpression::Kind::Negation:
+                        result.integers[i] = operand.integers[i] ? 0 : 1;
+                        break;
+                    case UnaryOperatorExpression::Kind::Positive:
+                        result.integers[i] = operand.integers[i];
+                        result.floats[i] = operand.floats[i];
+                        break;
+                    case UnaryOperatorExpression::Kind::Negative:
+                        if (result.isFloatingPoint())
+                            result.floats[i] = -operand.floats[i];
+                        else
+                            result.integers[i] = wrap(*result.scalarType, -operand.integers[i]);
+                        break;
+                    default: // increments and decrements have side effects
+                        return std::nullopt;
+                }
+
+            return result;
+        }
+
+        inline std::optional<Constant> evaluateBinary(const BinaryOperatorExpression& expression,
+                                                      const Constant& left, const Constant& right)
+        {
+            Constant result{expression.qualifiedType.type};
+            if (!result.scalarType) return std::nullopt;
+
+            if (expression.operatorKind == BinaryOperatorExpression::Kind::Subscript)
+            {
+                if (left.componentCount == 1 || right.isFloatingPoint() ||
+                    right.integers[0] < 0 || static_cast<std::size_t>(right.integers[0]) >= left.componentCount)
+                    return std::nullopt;
+
+                const auto index = static_cast<std::size_t>(right.integers[0]);
+                result.integers[0] = left.integers[index];
+                result.floats[0] = left.floats[index];
+                return result;
+            }
+
+            if (left.componentCount != right.componentCount || left.scalarType != right.scalarType)
+                return std::nullopt;
+
+            const auto floatingPoint = left.isFloatingPoint();
+
+            switch (expression.operatorKind)
+            {
+                case BinaryOperatorExpression::Kind::Addition:
+                case BinaryOperatorExpression::Kind::Subtraction:
+                case BinaryOperatorExpression::Kind::Multiplication:
+                case BinaryOperatorExpression::Kind::Division:
+                {
+                    if (result.componentCount != left.componentCount) return std::nullopt;
+
+                    for (std::size_t i = 0; i < result.componentCount; ++i)
+                        if (floatingPoint)
+                        {
+                            const auto a = static_cast<float>(left.floats[i]);
+                            const auto b = static_cast<float>(right.floats[i]);
+
+                            float value = 0.0F;
+                            switch (expression.operatorKind)
+                            {
+                                case BinaryOperatorExpression::Kind::Addition: value = a + b; break;
+                                case BinaryOperatorExpression::Kind::Subtraction: value = a - b; break;
+                                case BinaryOperatorExpression::Kind::Multiplication: value = a * b; break;
+                                default:
+                                    if (b == 0.0F) return std::nullopt;
+                                    value = a / b;
+                                    break;
+                            }
+
+                            if (!makeFloat(static_cast<double>(value), result.floats[i]))
+                                return std::nullopt;
+                        }
+                        else
+                        {
+                            const auto a = left.integers[i];
+                            const auto b = right.integers[i];
+
+                            std::int64_t value = 0;
+                            switch (expression.operatorKind)
+                            {
+                                case BinaryOperatorExpression::Kind::Addition: value = a + b; break;
+                                case BinaryOperatorExpression::Kind::Subtraction: value = a - b; break;
+                                case BinaryOperatorExpression::Kind::Multiplication: value = a * b; break;
+                                default:
+                                    if (b == 0) return std::nullopt;
+                                    value = a / b;
+                                    break;
+                            }
+
+                            result.integers[i] = wrap(*result.scalarType, value);
+                        }
+
+                    return result;
+                }
+
+                case BinaryOperatorExpression::Kind::LessThan:
+                case BinaryOperatorExpression::Kind::LessThanEqual:
+                case BinaryOperatorExpression::Kind::GreaterThan:
+                case BinaryOperatorExpression::Kind::GraterThanEqual:
+                {
+                    if (left.componentCount != 1) return std::nullopt;
+
+                    const auto a = floatingPoint ? left.floats[0] : static_cast<double>(left.integers[0]);
+                    const auto b = floatingPoint ? right.floats[0] : static_cast<double>(right.integers[0]);
+
+                    switch (expression.operatorKind)
+                    {
+                        case BinaryOperatorExpression::Kind::LessThan: result.integers[0] = a < b; break;
+                        case BinaryOperatorExpression::Kind::LessThanEqual: result.integers[0] = a <= b; break;
+                        case BinaryOperatorExpression::Kind::GreaterThan: result.integers[0] = a > b; break;
+                        default: result.integers[0] = a >= b; break;
+                    }
+
+                    return result;
+                }
+
+                case BinaryOperatorExpression::Kind::Equality:
+                case BinaryOperatorExpression::Kind::Inequality:
+                {
+                    bool equal = true;
+                    for (std::size_t i = 0; i < left.componentCount; ++i)
+                        if (floatingPoint ? left.floats[i] != right.floats[i] : left.integers[i] != right.integers[i])
+                            equal = false;
+
+                    result.integers[0] = (expression.operatorKind == BinaryOperatorExpression::Kind::Equality) == equal;
+                    return result;
+                }
+
+                case BinaryOperatorExpression::Kind::Or:
+                    result.integers[0] = left.integers[0] || right.integers[0];
+                    return result;
+
+                case BinaryOperatorExpression::Kind::And:
+                    result.integers[0] = left.integers[0] && right.integers[0];
+                    return result;
+
+                default: // assignments and the comma operator are not constant
+                    return std::nullopt;
+            }
+        }
+    }
+
+    // Evaluates scalar and vector expressions built from literals and constants,
+    // returns nothing if the value is not known at compile time
+    inline std::optional<Constant> evaluate(const Expression& expression)
+    {
+        switch (expression.expressionKind)
+        {
+            case Expression::Kind::Literal:
+            {
+                auto& literalExpression = static_cast<const LiteralExpression&>(expression);
+
+                Constant result{expression.qualifiedType.type};
+                if (!result.scalarType) return std::nullopt;
+
+                switch (literalExpression.literalKind)
+                {
+                    case LiteralExpression::Kind::Boolean:
+                        result.integers[0] = static_cast<const BooleanLiteralExpression&>(literalExpression).value ? 1 : 0;
+                        return result;
+                    case LiteralExpression::Kind::Integer:
+                        result.integers[0] = detail::wrap(*result.scalarType, static_cast<const IntegerLiteralExpression&>(literalExpression).value);
+                        return result;
+                    case LiteralExpression::Kind::FloatingPoint:
+                        if (!detail::makeFloat(static_cast<const FloatingPointLiteralExpression&>(literalExpression).value, result.floats[0]))
+                            return std::nullopt;
+                        return result;
+                    case LiteralExpression::Kind::String:
+                        return std::nullopt;
+                }
+
+                return std::nullopt;
+            }
+
+            case Expression::Kind::Paren:
+                return evaluate(static_cast<const ParenExpression&>(expression).expression);
+
+            case Expression::Kind::DeclarationReference:
+            {
+                auto& declaration = static_cast<const DeclarationReferenceExpression&>(expression).declaration;
+                if (declaration.declarationKind != Declaration::Kind::Variable) return std::nullopt;
+
+                auto& variableDeclaration = static_cast<const VariableDeclaration&>(declaration);
+
+                if ((variableDeclaration.qualifiedType.qualifiers & Type::Qualifiers::Const) != Type::Qualifiers::Const ||
+                    variableDeclaration.storageClass == StorageClass::Extern ||
+                    !variableDeclaration.initialization)
+                    return std::nullopt;
+
+                return evaluate(*variableDeclaration.initialization);
+            }
+
+            case Expression::Kind::UnaryOperator:
+            {
+                auto& unaryOperatorExpression = static_cast<const UnaryOperatorExpression&>(expression);
+
+                const auto operand = evaluate(unaryOperatorExpression.expression);
+                if (!operand) return std::nullopt;
+
+                return detail::evaluateUnary(unaryOperatorExpression, *operand);
+            }
+
+            case Expression::Kind::BinaryOperator:
+            {
+                auto& binaryOperatorExpression = static_cast<const BinaryOperatorExpression&>(expression);
+
+                const auto left = evaluate(binaryOperatorExpression.leftExpression);
+                if (!left) return std::nullopt;
+
+                const auto right = evaluate(binaryOperatorExpression.rightExpression);
+                if (!right) return std::nullopt;
+
+                return detail::evaluateBinary(binaryOperatorExpression, *left, *right);
+            }
+
+            case Expression::Kind::TernaryOperator:
+            {
+                auto& ternaryOperatorExpression = static_cast<const TernaryOperatorExpression&>(expression);
+
+                const auto condition = evaluate(ternaryOperatorExpression.condition);
+                if (!condition || condition->componentCount != 1) return std::nullopt;
+
+                const auto condionValue = condition->isFloatingPoint() ?
+                    condition->floats[0] != 0.0 :
+                    condition->integers[0] != 0;
+
+                return evaluate(condionValue ?
+                                ternaryOperatorExpression.leftExpression :
+                                ternaryOperatorExpression.rightExpression);
+            }
+
+            case Expression::Kind::Cast:
+            {
+                auto& castExpression = static_cast<const CastExpression&>(expression);
+
+                const auto operand = evaluate(castExpression.expression);
+                if (!operand || operand->componentCount != 1) return std::nullopt;
+
+                Constant result{expression.qualifiedType.type};
+                if (!result.scalarType || result.componentCount != 1) return std::nullopt;
+
+                if (!detail::convert(*operand, 0, *result.scalarType, result, 0))
+                    return std::nullopt;
+
+                return result;
+            }
+
+            case Expression::Kind::VectorInitialize:
+            {
+                auto& vectorInitializeExpression = static_cast<const VectorInitializeExpression&>(expression);
+
+                Constant result{expression.qualifiedType.type};
+                if (!result.scalarType) return std::nullopt;
+
+                std::size_t component = 0;
+
+                for (const Expression& parameter : vectorInitializeExpression.parameters)
+                {
+                    const auto value = evaluate(parameter);
+                    if (!value || component + value->componentCount > result.componentCount)
+                        return std::nullopt;
+
+                    for (std::size_t i = 0; i < value->componentCount; ++i, ++component)
+                        if (!detail::convert(*value, i, *result.scalarType, result, component))
+                            return std::nullopt;
+                }
+
+                if (component != result.componentCount) return std::nullopt;
+
+                return result;
+            }
+
+            case Expression::Kind::VectorElement:
+            {
+                auto& vectorElementExpression = static_cast<const VectorElementExpression&>(expression);
+
+                const auto vector = evaluate(vectorElementExpression.expression);
+                if (!vector) return std::nullopt;
+
+                Constant result{expression.qualifiedType.type};
+                if (!result.scalarType || result.componentCount != vectorElementExpression.positions.size())
+                    return std::nullopt;
+
+                for (std::size_t i = 0; i < result.componentCount; ++i)
+                {
+                    const auto position = vectorElementExpression.positions[i];
+                    if (position >= vector->componentCount) return std::nullopt;
+
+                    result.integers[i] = vector->integers[position];
+                    result.floats[i] = vector->floats[position];
+                }
+
+                return result;
+            }
+
+            default:
+                return std::nullopt;
+        }
+    }
+}
+
+#endif // CONSTANTEVALUATOR_HPP
@@ -0,0 +1,108 @@
+//
+//  OSL
+//
+
+#ifndef CONSTANTFOLDER_HPP
+#define CONSTANTFOLDER_HPP
+
+#include "ConstantEvaluator.hpp"
+#include "Transformer.hpp"
+
+namespace ouzel
+{
+    // Replaces expressions with literal operands by their values
+    class ConstantFolder final: public Transformer
+    {
+    public:
+        explicit ConstantFolder(Context& initContext) noexcept:
+            Transformer{initContext}
+        {
+        }
+
+        [[nodiscard]]
+        std::size_t getFoldedCount() const noexcept
+        {
+            return foldedCount;
+        }
+
+    private:
+        const Expression& transformExpression(const Expression& expression) override
+        {
+            auto& result = Transformer::transformExpression(expression);
+
+            if (!isFoldable(result)) return result;
+
+            const auto constant = evaluate(result);
+            if (!constant) return result;
+
+            ++foldedCount;
+
+            if (constant->componentCount == 1)
+                return createLiteral(*constant, 0);
+
+            std::vector<ExpressionRef> parameters;
+            parameters.reserve(constant->componentCount);
+            for (std::size_t i = 0; i < constant->componentCount; ++i)
+                parameters.push_back(createLiteral(*constant, i));
+
+            return context.create<VectorInitializeExpression>(static_cast<const VectorType&>(*constant->type),
+                                                              std::move(parameters));
+        }
+
+        // literals and vectors initialized from one literal per component are already folded,
+        // references are not replaced so that the constants keep their names
+        static bool isFoldable(const Expression& expression) noexcept
+        {
+            switch (expression.expressionKind)
+            {
+                case Expression::Kind::Paren:
+                case Expression::Kind::UnaryOperator:
+                case Expression::Kind::BinaryOperator:
+                case Expression::Kind::TernaryOperator:
+                case Expression::Kind::Cast:
+                case Expression::Kind::VectorElement:
+                    return true;
+
+                case Expression::Kind::VectorInitialize:
+                {
+                    auto& vectorInitializeExpression = static_cast<const VectorInitializeExpression&>(expression);
+                    auto& vectorType = static_cast<const VectorType&>(expression.qualifiedType.type);
+
+                    if (vectorInitializeExpression.parameters.size() != vectorType.componentCount)
+                        return true;
+
+                    for (const Expression& parameter : vectorInitializeExpression.parameters)
+                        if (parameter.expressionKind != Expression::Kind::Literal ||
+                            &parameter.qualifiedType.type != &vectorType.componentType)
+                            return true;
+
+                    return false;
+                }
+
+                default:
+                    return false;
+            }
+        }
+
+        const LiteralExpression& createLiteral(const Constant& constant, std::size_t component)
+        {
+            auto& scalarType = *constant.scalarType;
+
+            switch (scalarType.scalarTypeKind)
+            {
+                case ScalarType::Kind::Boolean:
+                    return context.create<BooleanLiteralExpression>(scalarType, constant.integers[component] != 0);
+                case ScalarType::Kind::Integer:
+                    return context.create<IntegerLiteralExpression>(scalarType, constant.integers[component]);
+                case ScalarType::Kind::FloatingPoint:
+                    return context.create<FloatingPointLiteralExpression>(scalarType, constant.floats[component]);
+            }
+
+            throw std::runtime_error{"Unknown scalar type kind"};
+        }
+
+        std::size_t foldedCount = 0;
+    };
+}
+
+#endif // CONSTANTFOLDER_HPP
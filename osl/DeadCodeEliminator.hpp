@@ -0,0 +1,283 @@
+//
+//  OSL
+//
+
+#ifndef DEADCODEELIMINATOR_HPP
+#define DEADCODEELIMINATOR_HPP
+
+#include <set>
+#include "ConstantEvaluator.hpp"
+#include "Output.hpp"
+#include "Transformer.hpp"
+
+namespace ouzel
+{
+    // Removes the functions, structs and globals that are not reachable from the entry point
+    // of the program and the statements that can never be executed,
+    // if the program has no entry point, all declarations are kept
+    class DeadCodeEliminator final: public Transformer
+    {
+    public:
+        DeadCodeEliminator(Context& initContext, Program initProgram) noexcept:
+            Transformer{initContext},
+            program{initProgram}
+        {
+        }
+
+        void transform() override
+        {
+            const auto qualifier = (program == Program::Fragment) ?
+                FunctionDeclaration::Qualifier::Fragment :
+                FunctionDeclaration::Qualifier::Vertex;
+
+            for (const auto declaration : context.getDeclarations())
+                if (declaration->declarationKind == Declaration::Kind::Variable)
+                    globalVariables.insert(declaration);
+
+            for (const auto declaration : context.getDeclarations())
+                if (declaration->declarationKind == Declaration::Kind::Callable &&
+                    static_cast<const CallableDeclaration*>(declaration)->callableDeclarationKind == CallableDeclaration::Kind::Function &&
+                    static_cast<const FunctionDeclaration*>(declaration)->qualifier == qualifier)
+                    reachDeclaration(*declaration);
+
+            if (reachedDeclarations.empty()) return;
+
+            // only the reachable declarations are traversed, so the unreachable code is never visited
+            while (!pendingDeclarations.empty())
+            {
+                const auto declaration = pendingDeclarations.back();
+                pendingDeclarations.pop_back();
+                transformDeclaration(*declaration);
+            }
+
+            removedDeclarationCount += context.removeDeclarations([this](const Declaration* declaration) {
+                return !isReached(*declaration);
+            });
+        }
+
+        [[nodiscard]]
+        std::size_t getRemovedDeclarationCount() const noexcept
+        {
+            return removedDeclarationCount;
+        }
+
+        [[nodiscard]]
+        std::size_t getRemovedStatementCount() const noexcept
+        {
+            return removedStatementCount;
+        }
+
+    private:
+        const Declaration& transformDeclaration(const Declaration& declaration) override
+        {
+            if (declaration.declarationKind == Declaration::Kind::Variable)
+                reachType(static_cast<const VariableDeclaration&>(declaration).qualifiedType.type);
+
+            return Transformer::transformDeclaration(declaration);
+        }
+
+        const Statement& transformStatement(const Statement& statement) override
+        {
+            switch (statement.statementKind)
+            {
+                case Statement::Kind::Compound:
+                    return transformCompoundStatement(static_cast<const CompoundStatement&>(statement));
+
+                case Statement::Kind::If:
+                {
+                    auto& ifStatement = static_cast<const IfStatement&>(statement);
+
+                    bool value;
+                    if (!getConstantCondition(ifStatement.condition, value)) break;
+
+                    ++removedStatementCount;
+
+                    if (value)
+                        return transformStatement(ifStatement.body);
+                    else if (ifStatement.elseBody)
+                        return transformStatement(*ifStatement.elseBody);
+                    else
+                        return context.create<Statement>(Statement::Kind::Empty);
+                }
+
+                case Statement::Kind::While:
+                {
+                    auto& whileStatement = static_cast<const WhileStatement&>(statement);
+
+                    bool value;
+                    if (!getConstantCondition(whileStatement.condition, value) || value) break;
+
+                    ++removedStatementCount;
+                    return context.create<Statement>(Statement::Kind::Empty);
+                }
+
+                default:
+                    break;
+            }
+
+            return Transformer::transformStatement(statement);
+        }
+
+        const Expression& transformExpression(const Expression& expression) override
+        {
+            reachType(expression.qualifiedType.type);
+
+            if (expression.expressionKind == Expression::Kind::DeclarationReference)
+                reachDeclaration(static_cast<const DeclarationReferenceExpression&>(expression).declaration);
+            else if (expression.expressionKind == Expression::Kind::Call)
+                reachDeclaration(static_cast<const CallExpression&>(expression).declarationReference.declaration);
+
+            return Transformer::transformExpression(expression);
+        }
+
+        // statements after a return, break, continue or discard are dropped until the next case label
+        const Statement& transformCompoundStatement(const CompoundStatement& compoundStatement)
+        {
+            // declarations can still be used after a label that follows them
+            std::size_t lastLabel = 0;
+            for (std::size_t i = 0; i < compoundStatement.statements.size(); ++i)
+            {
+                const auto statementKind = compoundStatement.statements[i].get().statementKind;
+                if (statementKind == Statement::Kind::Case || statementKind == Statement::Kind::Default)
+                    lastLabel = i + 1;
+            }
+
+            std::vector<StatementRef> statements;
+            statements.reserve(compoundStatement.statements.size());
+            bool changed = false;
+            bool reachable = true;
+
+            for (std::size_t i = 0; i < compoundStatement.statements.size(); ++i)
+            {
+                const Statement& statement = compoundStatement.statements[i];
+
+                if (statement.statementKind == Statement::Kind::Case ||
+                    statement.statementKind == Statement::Kind::Default)
+                    reachable = true;
+                else if (!reachable &&
+                         (statement.statementKind != Statement::Kind::Declaration || i >= lastLabel))
+                {
+                    ++removedStatementCount;
+                    changed = true;
+                    continue;
+                }
+
+                auto& result = transformStatement(statement);
+                if (&result != &statement) changed = true;
+                statements.push_back(result);
+
+                if (isTerminator(result)) reachable = false;
+            }
+
+            if (!changed) return compoundStatement;
+            return context.create<CompoundStatement>(std::move(statements));
+        }
+
+        static bool isTerminator(const Statement& statement) noexcept
+        {
+            switch (statement.statementKind)
+            {
+                case Statement::Kind::Return:
+                case Statement::Kind::Break:
+                case Statement::Kind::Continue:
+                    return true;
+
+                case Statement::Kind::Expression:
+                {
+                    auto& expression = static_cast<const ExpressionStatement&>(statement).expression;
+                    if (expression.expressionKind != Expression::Kind::Call) return false;
+
+                    auto& declaration = static_cast<const CallExpression&>(expression).declarationReference.declaration;
+                    if (declaration.declarationKind != Declaration::Kind::Callable ||
+                        static_cast<const CallableDeclaration&>(declaration).callableDeclarationKind != CallableDeclaration::Kind::Function)
+                        return false;
+
+                    auto& functionDeclaration = static_cast<const FunctionDeclaration&>(declaration);
+                    return functionDeclaration.isBuiltin && functionDeclaration.name == "discard";
+                }
+
+                default:
+                    return false;
+            }
+        }
+
+        static bool getConstantCondition(const Construct& condition, bool& value)
+        {
+            if (condition.kind != Construct::Kind::Expression) return false;
+
+            const auto constant = evaluate(static_cast<const Expression&>(condition));
+            if (!constant || constant->componentCount != 1 ||
+                constant->scalarType->scalarTypeKind != ScalarType::Kind::Boolean) return false;
+
+            value = constant->integers[0] != 0;
+            return true;
+        }
+
+        // all declarations of a function share the first declaration
+        static const Declaration* getKey(const Declaration& declaration) noexcept
+        {
+            return declaration.firstDeclaration ? declaration.firstDeclaration : &declaration;
+        }
+
+        void reachDeclaration(const Declaration& declaration)
+        {
+            if (declaration.declarationKind != Declaration::Kind::Callable &&
+                declaration.declarationKind != Declaration::Kind::Variable)
+                return;
+
+            if (!reachedDeclarations.insert(getKey(declaration)).second) return;
+
+            if (declaration.declarationKind == Declaration::Kind::Callable)
+            {
+                auto& callableDeclaration = static_cast<const CallableDeclaration&>(declaration);
+
+                for (const auto parameterDeclaration : callableDeclaration.parameterDeclarations)
+                    reachType(parameterDeclaration->qualifiedType.type);
+
+                if (callableDeclaration.callableDeclarationKind == CallableDeclaration::Kind::Function)
+                    reachType(static_cast<const FunctionDeclaration&>(callableDeclaration).resultType.type);
+
+                if (declaration.definition)
+                    pendingDeclarations.push_back(declaration.definition);
+            }
+            else if (globalVariables.find(&declaration) != globalVariables.end()) // local initializers are visited with their statements
+                pendingDeclarations.push_back(&declaration);
+        }
+
+        void reachType(const Type& type)
+        {
+            if (!reachedTypes.insert(&type).second) return;
+
+            if (type.typeKind == Type::Kind::Array)
+                reachType(static_cast<const ArrayType&>(type).elementType.type);
+            else if (type.typeKind == Type::Kind::Struct)
+                for (const Declaration& memberDeclaration : static_cast<const StructType&>(type).memberDeclarations)
+                    if (memberDeclaration.declarationKind == Declaration::Kind::Field)
+                        reachType(static_cast<const FieldDeclaration&>(memberDeclaration).qualifiedType.type);
+        }
+
+        bool isReached(const Declaration& declaration) const
+        {
+            switch (declaration.declarationKind)
+            {
+                case Declaration::Kind::Callable:
+                case Declaration::Kind::Variable:
+                    return reachedDeclarations.find(getKey(declaration)) != reachedDeclarations.end();
+                case Declaration::Kind::Type:
+                    return reachedTypes.find(&static_cast<const TypeDeclaration&>(declaration).type) != reachedTypes.end();
+                default:
+                    return true;
+            }
+        }
+
+        Program program;
+        std::set<const Declaration*> globalVariables;
+        std::set<const Declaration*> reachedDeclarations;
+        std::set<const Type*> reachedTypes;
+        std::vector<const Declaration*> pendingDeclarations;
+        std::size_t removedDeclarationCount = 0;
+        std::size_t removedStatementCount = 0;
+    };
+}
+
+#endif // DEADCODEELIMINATOR_HPP
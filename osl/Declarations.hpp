@@ -159,7 +159,8 @@ namespace ouzel
                             std::vector<AttributeRef> initAttributes,
                             std::vector<ParameterDeclaration*> initParameterDeclarations,
                             Qualifier initQualifier,
-                            bool initIsBuiltin = false):
+                            bool initIsBuiltin = false,
+                            bool initIsInline = false):
             CallableDeclaration{
                 CallableDeclaration::Kind::Function, initName,
                 initStorageClass,
@@ -168,11 +169,13 @@ namespace ouzel
             },
             qualifier{initQualifier},
             resultType{initQualifiedType},
-            isBuiltin{initIsBuiltin} {}
+            isBuiltin{initIsBuiltin},
+            isInline{initIsInline} {}
 
         const Qualifier qualifier = Qualifier::None;
         const QualifiedType resultType;
         const bool isBuiltin = false;
+        const bool isInline = false;
     };
 
     class ConstructorDeclaration final: public CallableDeclaration
@@ -0,0 +1,75 @@
+//
+//  OSL
+//
+
+#ifndef DIAGNOSTICS_HPP
+#define DIAGNOSTICS_HPP
+
+#include <string>
+#include <vector>
+#include "Parser.hpp"
+#include "Tokenizer.hpp"
+#include "Trace.hpp"
+
+namespace ouzel
+{
+    // converts an error of the preprocessor or the tokenizer to a diagnostic at one character
+    [[nodiscard]]
+    inline Diagnostic getDiagnostic(ErrorCode errorCode, const SourceError& error)
+    {
+        return Diagnostic{errorCode, error.what(),
+            error.getLine(), error.getColumn(),
+            error.getLine(), error.getColumn() + 1,
+            error.getFile()};
+    }
+
+    // the path of the file a diagnostic was found in, given the path of the source and the files it included
+    [[nodiscard]]
+    inline const std::string& getDiagnosticFile(const Diagnostic& diagnostic, const std::string& file,
+                                                const std::vector<std::string>& includes)
+    {
+        return (diagnostic.file > 0 && diagnostic.file <= includes.size()) ? includes[diagnostic.file - 1] : file;
+    }
+
+    // one file:line:column: message line per diagnostic
+    [[nodiscard]]
+    inline std::string getDiagnosticsText(const std::string& file, const std::vector<Diagnostic>& diagnostics,
+                                          const std::vector<std::string>& includes = std::vector<std::string>())
+    {
+        std::string result;
+
+        for (const auto& diagnostic : diagnostics)
+            result += getDiagnosticFile(diagnostic, file, includes) + ':' + std::to_string(diagnostic.line) + ':' +
+                std::to_string(diagnostic.column) + ": " + diagnostic.message + '\n';
+
+        return result;
+    }
+
+    [[nodiscard]]
+    inline std::string getDiagnosticsJson(const std::string& file, const std::vector<Diagnostic>& diagnostics,
+                                          const std::vector<std::string>& includes = std::vector<std::string>())
+    {
+        std::string result = "{\"diagnostics\":[";
+
+        bool first = true;
+        for (const auto& diagnostic : diagnostics)
+        {
+            if (!first) result += ",";
+            first = false;
+
+            result += "{\"file\":\"" + escapeJson(getDiagnosticFile(diagnostic, file, includes)) +
+                "\",\"severity\":\"error\",\"code\":\"" + toString(diagnostic.errorCode) +
+                "\",\"message\":\"" + escapeJson(diagnostic.message) +
+                "\",\"range\":{\"start\":{\"line\":" + std::to_string(diagnostic.line) +
+                ",\"column\":" + std::to_string(diagnostic.column) +
+                "},\"end\":{\"line\":" + std::to_string(diagnostic.endLine) +
+                ",\"column\":" + std::to_string(diagnostic.endColumn) + "}}}";
+        }
+
+        result += "]}";
+
+        return result;
+    }
+}
+
+#endif // DIAGNOSTICS_HPP
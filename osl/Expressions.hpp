@@ -379,7 +379,8 @@ namespace ouzel
     class VectorElementExpression final: public Expression
     {
     public:
-        VectorElementExpression(const Type& resultType,
+        VectorElementExpression(const Expression& initExpression,
+                                const Type& resultType,
                                 Type::Qualifiers qualifiers,
                                 Category category,
                                 std::vector<std::uint8_t> initPositions) noexcept:
@@ -388,8 +389,10 @@ namespace ouzel
                 QualifiedType{resultType, qualifiers},
                 category
             },
+            expression{initExpression},
             positions{std::move(initPositions)} {}
 
+        const Expression& expression;
         const std::vector<std::uint8_t> positions;
     };
 
@@ -0,0 +1,160 @@
+//
+//  OSL
+//
+
+#ifndef FILEWATCHER_HPP
+#define FILEWATCHER_HPP
+
+#include <cerrno>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+#ifdef __linux__
+#  include <poll.h>
+#  include <sys/inotify.h>
+#  include <unistd.h>
+#endif
+
+namespace ouzel
+{
+    // Reports the files that were written, created, moved or removed in a directory and its subdirectories,
+    // implemented with inotify, so it is only available on Linux
+    class FileWatcher final
+    {
+    public:
+        struct Change final
+        {
+            std::string path;
+            bool removed = false;
+        };
+
+        explicit FileWatcher(const std::string& directory)
+        {
+#ifdef __linux__
+            descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (descriptor == -1)
+                throw std::system_error{errno, std::system_category(), "Failed to initialize inotify"};
+
+            try
+            {
+                addDirectory(directory);
+
+                for (const auto& entry : std::filesystem::recursive_directory_iterator(directory))
+                    if (entry.is_directory())
+                        addDirectory(entry.path().string());
+            }
+            catch (...)
+            {
+                close(descriptor);
+                throw;
+            }
+#else
+            (void)directory;
+            throw std::runtime_error{"Watching files is not supported on this platform"};
+#endif
+        }
+
+        ~FileWatcher()
+        {
+#ifdef __linux__
+            close(descriptor);
+#endif
+        }
+
+        FileWatcher(const FileWatcher&) = delete;
+        FileWatcher& operator=(const FileWatcher&) = delete;
+
+        // waits up to the timeout for the first change and then until no change comes in for the settle time,
+        // so that a file that is saved in several writes is reported once, the changes are sorted by path
+        std::vector<Change> wait(std::chrono::milliseconds timeout,
+                                 std::chrono::milliseconds settleTime = std::chrono::milliseconds(20))
+        {
+            std::map<std::string, bool> changes;
+
+#ifdef __linux__
+            for (auto waitTime = timeout; poll(waitTime); waitTime = settleTime)
+                read(changes);
+#else
+            (void)timeout;
+            (void)settleTime;
+#endif
+
+            std::vector<Change> result;
+            for (const auto& change : changes)
+                result.push_back(Change{change.first, change.second});
+            return result;
+        }
+
+    private:
+#ifdef __linux__
+        void addDirectory(const std::string& directory)
+        {
+            const auto watch = inotify_add_watch(descriptor, directory.c_str(),
+                                                 IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
+            if (watch == -1)
+                throw std::system_error{errno, std::system_category(), "Failed to watch " + directory};
+
+            directories[watch] = directory;
+        }
+
+        bool poll(std::chrono::milliseconds timeout)
+        {
+            pollfd pollDescriptor{descriptor, POLLIN, 0};
+            const auto result = ::poll(&pollDescriptor, 1, static_cast<int>(timeout.count()));
+            if (result == -1 && errno != EINTR)
+                throw std::system_error{errno, std::system_category(), "Failed to poll inotify"};
+
+            return result > 0;
+        }
+
+        void read(std::map<std::string, bool>& changes)
+        {
+            alignas(inotify_event) char buffer[4096];
+
+            for (;;)
+            {
+                const auto size = ::read(descriptor, buffer, sizeof(buffer));
+                if (size <= 0) break;
+
+                for (const char* i = buffer; i < buffer + size;)
+                {
+                    const auto& event = *reinterpret_cast<const inotify_event*>(i);
+                    i += sizeof(inotify_event) + event.len;
+
+                    // the watch of a removed directory is gone
+                    if (event.mask & IN_IGNORED)
+                    {
+                        directories.erase(event.wd);
+                        continue;
+                    }
+
+                    const auto directory = directories.find(event.wd);
+                    if (directory == directories.end() || event.len == 0) continue;
+
+                    const auto path = (std::filesystem::path(directory->second) / event.name).string();
+
+                    if (event.mask & IN_ISDIR)
+                    {
+                        if (event.mask & (IN_CREATE | IN_MOVED_TO))
+                            addDirectory(path);
+                    }
+                    else if (event.mask & (IN_DELETE | IN_MOVED_FROM))
+                        changes[path] = true;
+                    else if (event.mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+                        changes[path] = false;
+                    // a created file is reported when it is closed after writing
+                }
+            }
+        }
+
+        int descriptor = -1;
+        std::map<int, std::string> directories;
+#endif
+    };
+}
+
+#endif // FILEWATCHER_HPP
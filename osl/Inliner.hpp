@@ -0,0 +1,557 @@
+//
+//  OSL
+//
+
+#ifndef INLINER_HPP
+#define INLINER_HPP
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "Transformer.hpp"
+
+namespace ouzel
+{
+    // Replaces calls to small functions and functions marked inline with their bodies,
+    // the statements of the body are placed before the statement that contains the call
+    // and the call is replaced by a reference to a variable that holds the result
+    class Inliner final: public Transformer
+    {
+    public:
+        struct InlinedCall final
+        {
+            InlinedCall(const std::string& initFunction,
+                        const std::string& initCaller,
+                        std::size_t initCost):
+                function{initFunction},
+                caller{initCaller},
+                cost{initCost}
+            {
+            }
+
+            std::string function;
+            std::string caller;
+            std::size_t cost;
+        };
+
+        explicit Inliner(Context& initContext, std::size_t initMaxCost = 16):
+            Transformer{initContext},
+            maxCost{initMaxCost},
+            emptyStatement{initContext.create<Statement>(Statement::Kind::Empty)}
+        {
+        }
+
+        void transform() override
+        {
+            for (const auto& construct : context.getConstructs())
+                if (construct->kind == Construct::Kind::Declaration)
+                    names.insert(static_cast<const Declaration&>(*construct).name);
+
+            for (const auto& type : context.getTypes())
+                names.insert(type->name);
+
+            // functions are processed in the order of declaration, so the calls in the bodies
+            // of the functions declared before the caller are already inlined
+            for (const auto declaration : context.getDeclarations())
+                if (declaration->declarationKind == Declaration::Kind::Callable)
+                {
+                    caller = static_cast<const CallableDeclaration*>(declaration);
+                    if (!caller->body) continue;
+
+                    Analyzer analyzer{context};
+                    analyzer.analyze(*caller->body);
+
+                    callerNames.clear();
+                    for (const auto parameterDeclaration : caller->parameterDeclarations)
+                        callerNames.insert(parameterDeclaration->name);
+                    for (const auto localDeclaration : analyzer.declarations)
+                        callerNames.insert(localDeclaration->name);
+
+                    transformDeclaration(*declaration);
+                }
+
+            caller = nullptr;
+        }
+
+        [[nodiscard]]
+        const std::vector<InlinedCall>& getInlinedCalls() const noexcept
+        {
+            return inlinedCalls;
+        }
+
+    private:
+        // Counts the nodes and return statements of a function body and finds side effects
+        class Analyzer final: public Transformer
+        {
+        public:
+            explicit Analyzer(Context& initContext) noexcept:
+                Transformer{initContext}
+            {
+            }
+
+            void analyze(const Statement& statement)
+            {
+                transformStatement(statement);
+            }
+
+            void analyze(const Expression& expression)
+            {
+                transformExpression(expression);
+            }
+
+            std::size_t nodeCount = 0;
+            std::size_t returnCount = 0;
+            bool hasSideEffects = false;
+            std::set<const Declaration*> declarations;
+            std::set<const Declaration*> references;
+
+        private:
+            const Declaration& transformDeclaration(const Declaration& declaration) override
+            {
+                declarations.insert(&declaration);
+                return Transformer::transformDeclaration(declaration);
+            }
+
+            const Statement& transformStatement(const Statement& statement) override
+            {
+                ++nodeCount;
+                if (statement.statementKind == Statement::Kind::Return) ++returnCount;
+
+                return Transformer::transformStatement(statement);
+            }
+
+            const Expression& transformExpression(const Expression& expression) override
+            {
+                ++nodeCount;
+
+                switch (expression.expressionKind)
+                {
+                    case Expression::Kind::DeclarationReference:
+                        references.insert(&static_cast<const DeclarationReferenceExpression&>(expression).declaration);
+                        break;
+
+                    case Expression::Kind::Call:
+                    {
+                        auto& declaration = static_cast<const CallExpression&>(expression).declarationReference.declaration;
+                        references.insert(&declaration);
+
+                        if (declaration.declarationKind != Declaration::Kind::Callable ||
+                            static_cast<const CallableDeclaration&>(declaration).callableDeclarationKind != CallableDeclaration::Kind::Function ||
+                            !static_cast<const FunctionDeclaration&>(declaration).isBuiltin ||
+                            declaration.name == "discard")
+                            hasSideEffects = true;
+                        break;
+                    }
+
+                    case Expression::Kind::UnaryOperator:
+                        switch (static_cast<const UnaryOperatorExpression&>(expression).operatorKind)
+                        {
+                            case UnaryOperatorExpression::Kind::PrefixIncrement:
+                            case UnaryOperatorExpression::Kind::PrefixDecrement:
+                            case UnaryOperatorExpression::Kind::PostfixIncrement:
+                            case UnaryOperatorExpression::Kind::PostfixDecrement:
+                                hasSideEffects = true;
+                                break;
+                            default:
+                                break;
+                        }
+                        break;
+
+                    case Expression::Kind::BinaryOperator:
+                        switch (static_cast<const BinaryOperatorExpression&>(expression).operatorKind)
+                        {
+                            case BinaryOperatorExpression::Kind::AdditionAssignment:
+                            case BinaryOperatorExpression::Kind::SubtractAssignment:
+                            case BinaryOperatorExpression::Kind::MultiplicationAssignment:
+                            case BinaryOperatorExpression::Kind::DivisionAssignment:
+                            case BinaryOperatorExpression::Kind::Assignment:
+                                hasSideEffects = true;
+                                break;
+                            default:
+                                break;
+                        }
+                        break;
+
+                    default:
+                        break;
+                }
+
+                return Transformer::transformExpression(expression);
+            }
+        };
+
+        // Copies a function body, replacing the parameters and giving the local variables unique names
+        class Renamer final: public Transformer
+        {
+        public:
+            Renamer(Context& initContext, Inliner& initInliner) noexcept:
+                Transformer{initContext},
+                inliner{initInliner}
+            {
+            }
+
+            void addDeclaration(const Declaration& original, const Declaration& replacement)
+            {
+                declarations[&original] = &replacement;
+            }
+
+            const Statement& rename(const Statement& statement)
+            {
+                return transformStatement(statement);
+            }
+
+            const Expression& rename(const Expression& expression)
+            {
+                return transformExpression(expression);
+            }
+
+        private:
+            const Declaration& transformDeclaration(const Declaration& declaration) override
+            {
+                if (declaration.declarationKind != Declaration::Kind::Variable) return declaration;
+
+                auto& variableDeclaration = static_cast<const VariableDeclaration&>(declaration);
+                auto initialization = variableDeclaration.initialization ?
+                    &transformExpression(*variableDeclaration.initialization) : nullptr;
+
+                auto& result = context.create<VariableDeclaration>(inliner.getUniqueName(variableDeclaration.name),
+                                                                   variableDeclaration.qualifiedType,
+                                                                   variableDeclaration.storageClass,
+                                                                   initialization);
+                addDeclaration(declaration, result);
+                return result;
+            }
+
+            const Expression& transformExpression(const Expression& expression) override
+            {
+                if (expression.expressionKind != Expression::Kind::DeclarationReference)
+                    return Transformer::transformExpression(expression);
+
+                auto& declarationReferenceExpression = static_cast<const DeclarationReferenceExpression&>(expression);
+
+                const auto i = declarations.find(&declarationReferenceExpression.declaration);
+                if (i == declarations.end()) return expression;
+
+                return context.create<DeclarationReferenceExpression>(expression.qualifiedType, *i->second, expression.category);
+            }
+
+            Inliner& inliner;
+            std::map<const Declaration*, const Declaration*> declarations;
+        };
+
+        struct Candidate final
+        {
+            bool inlinable = false;
+            std::size_t cost = 0;
+            std::set<std::string> globalNames; // names of the functions and globals used by the body
+        };
+
+        const Statement& transformStatement(const Statement& statement) override
+        {
+            std::vector<StatementRef> statements;
+            auto& result = inlineStatement(statement, statements);
+            if (statements.empty()) return result;
+
+            // the statement is not in a compound statement, so one is created for the inlined code
+            if (&result != &emptyStatement) statements.push_back(result);
+            return context.create<CompoundStatement>(std::move(statements));
+        }
+
+        // the inlined code that has to run before the statement is appended to the statements
+        const Statement& inlineStatement(const Statement& statement, std::vector<StatementRef>& statements)
+        {
+            const auto previousTarget = target;
+
+            switch (statement.statementKind)
+            {
+                case Statement::Kind::Compound:
+                {
+                    auto& compoundStatement = static_cast<const CompoundStatement&>(statement);
+
+                    std::vector<StatementRef> result;
+                    result.reserve(compoundStatement.statements.size());
+                    bool changed = false;
+
+                    for (const Statement& subStatement : compoundStatement.statements)
+                    {
+                        auto& transformed = inlineStatement(subStatement, result);
+                        if (&transformed != &subStatement) changed = true;
+                        if (&transformed != &emptyStatement) result.push_back(transformed);
+                    }
+
+                    if (!changed) return statement;
+                    return context.create<CompoundStatement>(std::move(result));
+                }
+
+                case Statement::Kind::Expression:
+                {
+                    auto& expressionStatement = static_cast<const ExpressionStatement&>(statement);
+
+                    target = &statements;
+                    auto& expression = transformExpression(expressionStatement.expression);
+                    target = previousTarget;
+
+                    // calls to void functions are statements of their own, so they leave nothing behind
+                    if (expression.expressionKind == Expression::Kind::Call)
+                    {
+                        auto& callExpression = static_cast<const CallExpression&>(expression);
+
+                        if (callExpression.qualifiedType.type.typeKind == Type::Kind::Void &&
+                            inlineCall(callExpression, statements))
+                            return emptyStatement;
+                    }
+
+                    if (&expression == &expressionStatement.expression) return statement;
+                    return context.create<ExpressionStatement>(expression);
+                }
+
+                // conditions of if and switch statements are evaluated once before the statement,
+                // conditions of loops are evaluated on each iteration, so their calls are not inlined
+                case Statement::Kind::Declaration:
+                case Statement::Kind::Return:
+                case Statement::Kind::If:
+                case Statement::Kind::Switch:
+                    target = &statements;
+                    break;
+
+                default:
+                    target = nullptr;
+                    break;
+            }
+
+            auto& result = Transformer::transformStatement(statement);
+            target = previousTarget;
+            return result;
+        }
+
+        const Expression& transformExpression(const Expression& expression) override
+        {
+            const auto previousTarget = target;
+
+            // only the first operand of conditional and sequenced operators is always evaluated first
+            if (expression.expressionKind == Expression::Kind::TernaryOperator)
+            {
+                auto& ternaryOperatorExpression = static_cast<const TernaryOperatorExpression&>(expression);
+                auto& condition = transformExpression(ternaryOperatorExpression.condition);
+
+                target = nullptr;
+                auto& leftExpression = transformExpression(ternaryOperatorExpression.leftExpression);
+                auto& rightExpression = transformExpression(ternaryOperatorExpression.rightExpression);
+                target = previousTarget;
+
+                if (&condition == &ternaryOperatorExpression.condition &&
+                    &leftExpression == &ternaryOperatorExpression.leftExpression &&
+                    &rightExpression == &ternaryOperatorExpression.rightExpression) return expression;
+                return context.create<TernaryOperatorExpression>(condition, leftExpression, rightExpression);
+            }
+
+            if (expression.expressionKind == Expression::Kind::BinaryOperator)
+            {
+                auto& binaryOperatorExpression = static_cast<const BinaryOperatorExpression&>(expression);
+
+                if (binaryOperatorExpression.operatorKind == BinaryOperatorExpression::Kind::And ||
+                    binaryOperatorExpression.operatorKind == BinaryOperatorExpression::Kind::Or ||
+                    binaryOperatorExpression.operatorKind == BinaryOperatorExpression::Kind::Comma)
+                {
+                    auto& leftExpression = transformExpression(binaryOperatorExpression.leftExpression);
+
+                    target = nullptr;
+                    auto& rightExpression = transformExpression(binaryOperatorExpression.rightExpression);
+                    target = previousTarget;
+
+                    if (&leftExpression == &binaryOperatorExpression.leftExpression &&
+                        &rightExpression == &binaryOperatorExpression.rightExpression) return expression;
+                    return context.create<BinaryOperatorExpression>(binaryOperatorExpression.operatorKind,
+                                                                    expression.qualifiedType.type,
+                                                                    expression.category,
+                                                                    leftExpression,
+                                                                    rightExpression);
+                }
+            }
+
+            auto& result = Transformer::transformExpression(expression);
+
+            if (target &&
+                result.expressionKind == Expression::Kind::Call &&
+                result.qualifiedType.type.typeKind != Type::Kind::Void)
+            {
+                auto& callExpression = static_cast<const CallExpression&>(result);
+                const Expression* resultExpression = nullptr;
+
+                if (inlineCall(callExpression, *target, &resultExpression))
+                    return *resultExpression;
+            }
+
+            return result;
+        }
+
+        const FunctionDeclaration* getCallee(const CallExpression& callExpression) const noexcept
+        {
+            auto& declaration = callExpression.declarationReference.declaration;
+
+            if (declaration.declarationKind != Declaration::Kind::Callable ||
+                static_cast<const CallableDeclaration&>(declaration).callableDeclarationKind != CallableDeclaration::Kind::Function ||
+                static_cast<const FunctionDeclaration&>(declaration).isBuiltin ||
+                !declaration.definition ||
+                declaration.definition == caller)
+                return nullptr;
+
+            return static_cast<const FunctionDeclaration*>(declaration.definition);
+        }
+
+        // functions are inlined if they are marked inline or are cheap enough,
+        // a function can only return at the end, because there is no way to jump out of the inlined code
+        const Candidate& getCandidate(const FunctionDeclaration& function)
+        {
+            const auto i = candidates.find(&function);
+            if (i != candidates.end()) return i->second;
+
+            Candidate& candidate = candidates[&function];
+
+            if (!function.body || function.body->statementKind != Statement::Kind::Compound)
+                return candidate;
+
+            auto& body = static_cast<const CompoundStatement&>(*function.body);
+
+            Analyzer analyzer{context};
+            analyzer.analyze(body);
+            candidate.cost = analyzer.nodeCount;
+
+            for (const auto declaration : analyzer.references)
+                if (declaration->declarationKind != Declaration::Kind::Parameter &&
+                    analyzer.declarations.find(declaration) == analyzer.declarations.end())
+                    candidate.globalNames.insert(declaration->name);
+
+            const auto returnsAtEnd = !body.statements.empty() &&
+                body.statements.back().get().statementKind == Statement::Kind::Return;
+
+            if (analyzer.returnCount != (returnsAtEnd ? 1 : 0) ||
+                (function.resultType.type.typeKind != Type::Kind::Void && !returnsAtEnd))
+                return candidate;
+
+            bool isInline = false;
+            for (auto declaration = static_cast<const Declaration*>(&function); declaration; declaration = declaration->previousDeclaration)
+                if (static_cast<const FunctionDeclaration*>(declaration)->isInline)
+                    isInline = true;
+
+            candidate.inlinable = isInline || candidate.cost <= maxCost;
+
+            return candidate;
+        }
+
+        // in parameters are copied into new variables,
+        // out and inout parameters are copied back into the arguments after the body
+        bool inlineCall(const CallExpression& callExpression,
+                        std::vector<StatementRef>& statements,
+                        const Expression** result = nullptr)
+        {
+            const auto function = getCallee(callExpression);
+            if (!function) return false;
+
+            const auto& candidate = getCandidate(*function);
+            if (!candidate.inlinable) return false;
+
+            // a local variable of the caller would hide the globals used by the inlined code
+            for (const auto& name : candidate.globalNames)
+                if (callerNames.find(name) != callerNames.end()) return false;
+
+            // arguments of out parameters are evaluated twice, so they can not have side effects
+            for (std::size_t i = 0; i < function->parameterDeclarations.size(); ++i)
+                if (function->parameterDeclarations[i]->inputModifier != InputModifier::In)
+                {
+                    Analyzer analyzer{context};
+                    analyzer.analyze(callExpression.arguments[i].get());
+                    if (analyzer.hasSideEffects) return false;
+                }
+
+            Renamer renamer{context, *this};
+            std::vector<const VariableDeclaration*> parameterVariables;
+
+            for (std::size_t i = 0; i < function->parameterDeclarations.size(); ++i)
+            {
+                auto& parameterDeclaration = *function->parameterDeclarations[i];
+                const Expression& argument = callExpression.arguments[i];
+
+                auto& variableDeclaration = context.create<VariableDeclaration>(getUniqueName(parameterDeclaration.name),
+                                                                                QualifiedType{parameterDeclaration.qualifiedType.type},
+                                                                                StorageClass::Auto,
+                                                                                parameterDeclaration.inputModifier == InputModifier::Out ? nullptr : &argument);
+                statements.push_back(context.create<DeclarationStatement>(variableDeclaration));
+                renamer.addDeclaration(parameterDeclaration, variableDeclaration);
+                parameterVariables.push_back(&variableDeclaration);
+            }
+
+            const VariableDeclaration* resultVariable = nullptr;
+            if (function->resultType.type.typeKind != Type::Kind::Void)
+            {
+                resultVariable = &context.create<VariableDeclaration>(getUniqueName(function->name + "Result"),
+                                                                      QualifiedType{function->resultType.type},
+                                                                      StorageClass::Auto);
+                statements.push_back(context.create<DeclarationStatement>(*resultVariable));
+            }
+
+            for (const Statement& statement : static_cast<const CompoundStatement&>(*function->body).statements)
+                if (statement.statementKind == Statement::Kind::Return)
+                {
+                    auto& returnStatement = static_cast<const ReturnStatement&>(statement);
+
+                    if (returnStatement.result && resultVariable)
+                        statements.push_back(context.create<ExpressionStatement>(createAssignment(createReference(*resultVariable),
+                                                                                                  renamer.rename(*returnStatement.result))));
+                }
+                else
+                    statements.push_back(renamer.rename(statement));
+
+            for (std::size_t i = 0; i < function->parameterDeclarations.size(); ++i)
+                if (function->parameterDeclarations[i]->inputModifier != InputModifier::In)
+                    statements.push_back(context.create<ExpressionStatement>(createAssignment(callExpression.arguments[i].get(),
+                                                                                              createReference(*parameterVariables[i]))));
+
+            if (result && resultVariable)
+                *result = &createReference(*resultVariable);
+
+            inlinedCalls.emplace_back(function->name, caller ? caller->name : std::string{}, candidate.cost);
+
+            return true;
+        }
+
+        const DeclarationReferenceExpression& createReference(const VariableDeclaration& variableDeclaration)
+        {
+            return context.create<DeclarationReferenceExpression>(variableDeclaration.qualifiedType,
+                                                                  variableDeclaration,
+                                                                  Expression::Category::Lvalue);
+        }
+
+        const BinaryOperatorExpression& createAssignment(const Expression& leftExpression,
+                                                         const Expression& rightExpression)
+        {
+            return context.create<BinaryOperatorExpression>(BinaryOperatorExpression::Kind::Assignment,
+                                                            leftExpression.qualifiedType.type,
+                                                            Expression::Category::Lvalue,
+                                                            leftExpression,
+                                                            rightExpression);
+        }
+
+        std::string getUniqueName(const std::string& name)
+        {
+            for (;;)
+            {
+                auto result = name + "_" + std::to_string(++nameCounter);
+                if (names.insert(result).second) return result;
+            }
+        }
+
+        std::size_t maxCost;
+        const Statement& emptyStatement;
+        const CallableDeclaration* caller = nullptr;
+        std::set<std::string> callerNames;
+        std::vector<StatementRef>* target = nullptr;
+        std::map<const FunctionDeclaration*, Candidate> candidates;
+        std::set<std::string> names;
+        std::size_t nameCounter = 0;
+        std::vector<InlinedCall> inlinedCalls;
+    };
+}
+
+#endif // INLINER_HPP
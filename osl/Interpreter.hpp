@@ -0,0 +1,1228 @@
+//
+//  OSL
+//
+
+#ifndef INTERPRETER_HPP
+#define INTERPRETER_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ConstantEvaluator.hpp"
+#include "Output.hpp"
+#include "Parser.hpp"
+
+namespace ouzel
+{
+    // RGBA texture with float components that the sample and load builtins read from
+    class Texture final
+    {
+    public:
+        Texture(std::size_t initWidth, std::size_t initHeight, std::vector<float> initPixels):
+            width{initWidth}, height{initHeight}, pixels{std::move(initPixels)}
+        {
+            if (width == 0 || height == 0 || pixels.size() != width * height * 4)
+                throw std::runtime_error{"Invalid texture size"};
+        }
+
+        [[nodiscard]] std::size_t getWidth() const noexcept { return width; }
+        [[nodiscard]] std::size_t getHeight() const noexcept { return height; }
+
+        // clamps the coordinates to the edge of the texture
+        [[nodiscard]]
+        std::array<float, 4> load(std::int64_t x, std::int64_t y) const noexcept
+        {
+            x = (x < 0) ? 0 : (x >= static_cast<std::int64_t>(width)) ? static_cast<std::int64_t>(width) - 1 : x;
+            y = (y < 0) ? 0 : (y >= static_cast<std::int64_t>(height)) ? static_cast<std::int64_t>(height) - 1 : y;
+
+            const auto pixel = &pixels[(static_cast<std::size_t>(y) * width + static_cast<std::size_t>(x)) * 4];
+            return {pixel[0], pixel[1], pixel[2], pixel[3]};
+        }
+
+        // bilinear filtering with repeating texture coordinates
+        [[nodiscard]]
+        std::array<float, 4> sample(float u, float v) const noexcept
+        {
+            if (!std::isfinite(u) || !std::isfinite(v)) return {};
+
+            const auto x = (u - std::floor(u)) * static_cast<float>(width) - 0.5F;
+            const auto y = (v - std::floor(v)) * static_cast<float>(height) - 0.5F;
+            const auto x0 = std::floor(x);
+            const auto y0 = std::floor(y);
+            const auto fractionX = x - x0;
+            const auto fractionY = y - y0;
+
+            const auto left = wrap(static_cast<std::int64_t>(x0), width);
+            const auto right = wrap(static_cast<std::int64_t>(x0) + 1, width);
+            const auto top = wrap(static_cast<std::int64_t>(y0), height);
+            const auto bottom = wrap(static_cast<std::int64_t>(y0) + 1, height);
+
+            const auto topLeft = load(left, top);
+            const auto topRight = load(right, top);
+            const auto bottomLeft = load(left, bottom);
+            const auto bottomRight = load(right, bottom);
+
+            std::array<float, 4> result;
+            for (std::size_t i = 0; i < 4; ++i)
+            {
+                const auto topValue = topLeft[i] + (topRight[i] - topLeft[i]) * fractionX;
+                const auto bottomValue = bottomLeft[i] + (bottomRight[i] - bottomLeft[i]) * fractionX;
+                result[i] = topValue + (bottomValue - topValue) * fractionY;
+            }
+
+            return result;
+        }
+
+    private:
+        static std::int64_t wrap(std::int64_t coordinate, std::size_t size) noexcept
+        {
+            const auto result = coordinate % static_cast<std::int64_t>(size);
+            return (result < 0) ? result + static_cast<std::int64_t>(size) : result;
+        }
+
+        std::size_t width;
+        std::size_t height;
+        std::vector<float> pixels;
+    };
+
+    // Value of any type during the interpretation,
+    // scalars, vectors and matrices are kept in components (matrices row by row),
+    // arrays and structs in elements (structs in the order of their fields)
+    class Value final
+    {
+    public:
+        Value() = default;
+
+        explicit Value(const Type& initType):
+            type{&initType}
+        {
+            if (initType.typeKind == Type::Kind::Array)
+            {
+                auto& arrayType = static_cast<const ArrayType&>(initType);
+                elements.assign(arrayType.size, Value{arrayType.elementType.type});
+            }
+            else if (initType.typeKind == Type::Kind::Struct)
+                for (const Declaration& memberDeclaration : static_cast<const StructType&>(initType).memberDeclarations)
+                    if (memberDeclaration.declarationKind == Declaration::Kind::Field)
+                        elements.emplace_back(static_cast<const FieldDeclaration&>(memberDeclaration).qualifiedType.type);
+        }
+
+        // booleans are kept as 0 and 1, integers are wrapped to 32 bits and floats rounded to single precision
+        const Type* type = nullptr;
+        std::array<double, 16> components{};
+        std::vector<Value> elements;
+        const Texture* texture = nullptr;
+    };
+
+    // Executes the entry point of a program on the CPU by walking its syntax tree,
+    // meant for validating shaders and rendering reference images, not for speed
+    class Interpreter final
+    {
+    public:
+        Interpreter(const Context& context, Program program)
+        {
+            const auto qualifier = (program == Program::Fragment) ?
+                FunctionDeclaration::Qualifier::Fragment :
+                FunctionDeclaration::Qualifier::Vertex;
+
+            for (const auto declaration : context.getDeclarations())
+                if (declaration->declarationKind == Declaration::Kind::Callable &&
+                    static_cast<const CallableDeclaration*>(declaration)->callableDeclarationKind == CallableDeclaration::Kind::Function &&
+                    static_cast<const FunctionDeclaration*>(declaration)->qualifier == qualifier &&
+                    static_cast<const FunctionDeclaration*>(declaration)->body)
+                    entryPoint = static_cast<const FunctionDeclaration*>(declaration);
+
+            if (!entryPoint)
+                throw std::runtime_error{"No entry point found"};
+
+            for (const auto declaration : context.getDeclarations())
+                if (declaration->declarationKind == Declaration::Kind::Variable)
+                {
+                    auto& variableDeclaration = static_cast<const VariableDeclaration&>(*declaration);
+                    globals.emplace(declaration, variableDeclaration.initialization ?
+                                    evaluate(*variableDeclaration.initialization) :
+                                    Value{variableDeclaration.qualifiedType.type});
+                }
+        }
+
+        [[nodiscard]]
+        const FunctionDeclaration& getEntryPoint() const noexcept
+        {
+            return *entryPoint;
+        }
+
+        // sets the value of a global variable, usually an extern,
+        // writes of the shader to globals are kept between invocations
+        void setGlobal(const std::string& name, const Value& value)
+        {
+            getGlobal(name) = value;
+        }
+
+        [[nodiscard]]
+        Value& getGlobal(const std::string& name)
+        {
+            for (auto& global : globals)
+                if (global.first->name == name) return global.second;
+
+            throw std::runtime_error{"Global variable " + name + " not found"};
+        }
+
+        // binds the texture to a Texture2D or Texture2DMS global, the texture must outlive the interpreter
+        void setTexture(const std::string& name, const Texture& texture)
+        {
+            getGlobal(name).texture = &texture;
+        }
+
+        // runs the entry point with one argument per parameter,
+        // returns nothing if the invocation was discarded
+        std::optional<Value> run(const std::vector<Value>& arguments)
+        {
+            if (arguments.size() != entryPoint->parameterDeclarations.size())
+                throw std::runtime_error{"Invalid number of arguments"};
+
+            variables.clear();
+            frameStart = 0;
+            callDepth = 0;
+
+            for (std::size_t i = 0; i < arguments.size(); ++i)
+                variables.emplace_back(entryPoint->parameterDeclarations[i], arguments[i]);
+
+            try
+            {
+                result = Value{entryPoint->resultType.type};
+                execute(*entryPoint->body);
+            }
+            catch (const Discard&)
+            {
+                return std::nullopt;
+            }
+
+            return result;
+        }
+
+    private:
+        class Discard final {};
+
+        enum class Flow
+        {
+            Next,
+            Break,
+            Continue,
+            Return
+        };
+
+        // component indices of an lvalue, whole values (arrays, structs and textures) have no components
+        struct Location final
+        {
+            Value* value = nullptr;
+            bool whole = true;
+            std::size_t componentCount = 0;
+            std::array<std::uint8_t, 16> components{};
+        };
+
+        static constexpr std::size_t maxCallDepth = 256;
+
+        static const ScalarType* getScalarType(const Type& type) noexcept
+        {
+            switch (type.typeKind)
+            {
+                case Type::Kind::Scalar: return &static_cast<const ScalarType&>(type);
+                case Type::Kind::Vector: return &static_cast<const VectorType&>(type).componentType;
+                case Type::Kind::Matrix: return &static_cast<const MatrixType&>(type).rowType.componentType;
+                default: return nullptr;
+            }
+        }
+
+        static std::size_t getComponentCount(const Type& type) noexcept
+        {
+            switch (type.typeKind)
+            {
+                case Type::Kind::Scalar: return 1;
+                case Type::Kind::Vector: return static_cast<const VectorType&>(type).componentCount;
+                case Type::Kind::Matrix:
+                {
+                    auto& matrixType = static_cast<const MatrixType&>(type);
+                    return matrixType.rowCount * matrixType.rowType.componentCount;
+                }
+                default: return 0;
+            }
+        }
+
+        static double round(double value) noexcept
+        {
+            return static_cast<double>(static_cast<float>(value));
+        }
+
+        // converts a component to the scalar type, floats are truncated towards zero as in C++
+        static double convert(double value, const ScalarType& source, const ScalarType& target) noexcept
+        {
+            switch (target.scalarTypeKind)
+            {
+                case ScalarType::Kind::Boolean:
+                    return (value != 0.0) ? 1.0 : 0.0;
+                case ScalarType::Kind::FloatingPoint:
+                    return round(value);
+                case ScalarType::Kind::Integer:
+                    if (source.scalarTypeKind == ScalarType::Kind::FloatingPoint &&
+                        !(value > -9.2e18 && value < 9.2e18))
+                        return 0.0;
+                    return static_cast<double>(detail::wrap(target, static_cast<std::int64_t>(value)));
+            }
+
+            return value;
+        }
+
+        static bool isTrue(const Value& value) noexcept
+        {
+            return value.components[0] != 0.0;
+        }
+
+        Value& getVariable(const Declaration& declaration)
+        {
+            for (auto i = variables.size(); i > frameStart; --i)
+                if (variables[i - 1].first == &declaration) return variables[i - 1].second;
+
+            const auto global = globals.find(&declaration);
+            if (global == globals.end())
+                throw std::runtime_error{"Variable " + declaration.name + " not found"};
+
+            return global->second;
+        }
+
+        std::size_t getFieldIndex(const FieldDeclaration& fieldDeclaration, const StructType& structType)
+        {
+            const auto iterator = fieldIndices.find(&fieldDeclaration);
+            if (iterator != fieldIndices.end()) return iterator->second;
+
+            std::size_t index = 0;
+            for (const Declaration& memberDeclaration : structType.memberDeclarations)
+                if (&memberDeclaration == &fieldDeclaration)
+                    return fieldIndices[&fieldDeclaration] = index;
+                else if (memberDeclaration.declarationKind == Declaration::Kind::Field)
+                    ++index;
+
+            throw std::runtime_error{"Field " + fieldDeclaration.name + " not found"};
+        }
+
+        void popVariables(std::size_t count)
+        {
+            while (variables.size() > count) variables.pop_back();
+        }
+
+        void declare(const Declaration& declaration)
+        {
+            if (declaration.declarationKind != Declaration::Kind::Variable) return;
+
+            auto& variableDeclaration = static_cast<const VariableDeclaration&>(declaration);
+            auto value = variableDeclaration.initialization ?
+                evaluate(*variableDeclaration.initialization) :
+                Value{variableDeclaration.qualifiedType.type};
+
+            variables.emplace_back(&declaration, std::move(value));
+        }
+
+        // conditions can declare a variable whose value is tested
+        bool evaluateCondition(const Construct& condition)
+        {
+            if (condition.kind == Construct::Kind::Declaration)
+            {
+                auto& declaration = static_cast<const Declaration&>(condition);
+                declare(declaration);
+                return isTrue(getVariable(declaration));
+            }
+
+            return isTrue(evaluate(static_cast<const Expression&>(condition)));
+        }
+
+        Flow execute(const Statement& statement)
+        {
+            switch (statement.statementKind)
+            {
+                case Statement::Kind::Empty:
+                    return Flow::Next;
+
+                case Statement::Kind::Expression:
+                    evaluate(static_cast<const ExpressionStatement&>(statement).expression);
+                    return Flow::Next;
+
+                case Statement::Kind::Declaration:
+                    declare(static_cast<const DeclarationStatement&>(statement).declaration);
+                    return Flow::Next;
+
+                case Statement::Kind::Compound:
+                {
+                    const auto variableCount = variables.size();
+                    auto flow = Flow::Next;
+
+                    for (const Statement& child : static_cast<const CompoundStatement&>(statement).statements)
+                        if ((flow = execute(child)) != Flow::Next) break;
+
+                    popVariables(variableCount);
+                    return flow;
+                }
+
+                case Statement::Kind::If:
+                {
+                    auto& ifStatement = static_cast<const IfStatement&>(statement);
+                    const auto variableCount = variables.size();
+                    auto flow = Flow::Next;
+
+                    if (evaluateCondition(ifStatement.condition))
+                        flow = execute(ifStatement.body);
+                    else if (ifStatement.elseBody)
+                        flow = execute(*ifStatement.elseBody);
+
+                    popVariables(variableCount);
+                    return flow;
+                }
+
+                case Statement::Kind::For:
+                {
+                    auto& forStatement = static_cast<const ForStatement&>(statement);
+                    const auto variableCount = variables.size();
+                    auto flow = Flow::Next;
+
+                    if (forStatement.initialization)
+                    {
+                        if (forStatement.initialization->kind == Construct::Kind::Declaration)
+                            declare(static_cast<const Declaration&>(*forStatement.initialization));
+                        else if (forStatement.initialization->kind == Construct::Kind::Expression)
+                            evaluate(static_cast<const Expression&>(*forStatement.initialization));
+                    }
+
+                    for (;;)
+                    {
+                        const auto iterationVariableCount = variables.size();
+                        if (forStatement.condition && !evaluateCondition(*forStatement.condition)) break;
+
+                        flow = execute(forStatement.body);
+                        popVariables(iterationVariableCount);
+
+                        if (flow == Flow::Break || flow == Flow::Return) break;
+                        flow = Flow::Next;
+
+                        if (forStatement.increment) evaluate(*forStatement.increment);
+                    }
+
+                    popVariables(variableCount);
+                    return (flow == Flow::Return) ? flow : Flow::Next;
+                }
+
+                case Statement::Kind::Switch:
+                    return executeSwitch(static_cast<const SwitchStatement&>(statement));
+
+                case Statement::Kind::Case:
+                    return execute(static_cast<const CaseStatement&>(statement).body);
+
+                case Statement::Kind::Default:
+                    return execute(static_cast<const DefaultStatement&>(statement).body);
+
+                case Statement::Kind::While:
+                {
+                    auto& whileStatement = static_cast<const WhileStatement&>(statement);
+                    auto flow = Flow::Next;
+
+                    for (;;)
+                    {
+                        const auto variableCount = variables.size();
+                        const auto condition = evaluateCondition(whileStatement.condition);
+                        if (condition) flow = execute(whileStatement.body);
+                        popVariables(variableCount);
+
+                        if (!condition || flow == Flow::Break || flow == Flow::Return) break;
+                    }
+
+                    return (flow == Flow::Return) ? flow : Flow::Next;
+                }
+
+                case Statement::Kind::Do:
+                {
+                    auto& doStatement = static_cast<const DoStatement&>(statement);
+                    auto flow = Flow::Next;
+
+                    do
+                    {
+                        flow = execute(doStatement.body);
+                        if (flow == Flow::Break || flow == Flow::Return) break;
+                    }
+                    while (isTrue(evaluate(doStatement.condition)));
+
+                    return (flow == Flow::Return) ? flow : Flow::Next;
+                }
+
+                case Statement::Kind::Break:
+                    return Flow::Break;
+
+                case Statement::Kind::Continue:
+                    return Flow::Continue;
+
+                case Statement::Kind::Return:
+                {
+                    auto& returnStatement = static_cast<const ReturnStatement&>(statement);
+                    if (returnStatement.result) result = evaluate(*returnStatement.result);
+                    return Flow::Return;
+                }
+            }
+
+            throw std::runtime_error{"Unknown statement"};
+        }
+
+        // jumps to the matching label and falls through the following ones
+        Flow executeSwitch(const SwitchStatement& switchStatement)
+        {
+            const auto variableCount = variables.size();
+            auto flow = Flow::Next;
+
+            const auto condition = (switchStatement.condition.kind == Construct::Kind::Declaration) ?
+                (declare(static_cast<const Declaration&>(switchStatement.condition)),
+                 getVariable(static_cast<const Declaration&>(switchStatement.condition)).components[0]) :
+                evaluate(static_cast<const Expression&>(switchStatement.condition)).components[0];
+
+            if (switchStatement.body.statementKind == Statement::Kind::Compound)
+            {
+                auto& statements = static_cast<const CompoundStatement&>(switchStatement.body).statements;
+
+                auto start = statements.size();
+                for (std::size_t i = 0; i < statements.size() && start == statements.size(); ++i)
+                {
+                    const Statement& child = statements[i];
+                    if (child.statementKind == Statement::Kind::Case &&
+                        evaluate(static_cast<const CaseStatement&>(child).condition).components[0] == condition)
+                        start = i;
+                }
+
+                for (std::size_t i = 0; i < statements.size() && start == statements.size(); ++i)
+                    if (statements[i].get().statementKind == Statement::Kind::Default)
+                        start = i;
+
+                const auto bodyVariableCount = variables.size();
+
+                // declarations before the label are in scope, but not initialized
+                for (std::size_t i = 0; i < start; ++i)
+                {
+                    const Statement& child = statements[i];
+                    if (child.statementKind == Statement::Kind::Declaration)
+                    {
+                        auto& declaration = static_cast<const DeclarationStatement&>(child).declaration;
+                        if (declaration.declarationKind == Declaration::Kind::Variable)
+                            variables.emplace_back(&declaration, Value{static_cast<const VariableDeclaration&>(declaration).qualifiedType.type});
+                    }
+                }
+
+                for (std::size_t i = start; i < statements.size(); ++i)
+                    if ((flow = execute(statements[i])) != Flow::Next) break;
+
+                popVariables(bodyVariableCount);
+            }
+            else if (switchStatement.body.statementKind == Statement::Kind::Case)
+            {
+                auto& caseStatement = static_cast<const CaseStatement&>(switchStatement.body);
+                if (evaluate(caseStatement.condition).components[0] == condition)
+                    flow = execute(caseStatement.body);
+            }
+            else if (switchStatement.body.statementKind == Statement::Kind::Default)
+                flow = execute(switchStatement.body);
+
+            popVariables(variableCount);
+            return (flow == Flow::Return || flow == Flow::Continue) ? flow : Flow::Next;
+        }
+
+        Location locate(const Expression& expression)
+        {
+            switch (expression.expressionKind)
+            {
+                case Expression::Kind::DeclarationReference:
+                {
+                    Location location;
+                    location.value = &getVariable(static_cast<const DeclarationReferenceExpression&>(expression).declaration);
+                    return makeWhole(location);
+                }
+
+                case Expression::Kind::Paren:
+                    return locate(static_cast<const ParenExpression&>(expression).expression);
+
+                case Expression::Kind::Member:
+                {
+                    auto& memberExpression = static_cast<const MemberExpression&>(expression);
+                    auto location = locate(memberExpression.expression);
+                    auto& structType = static_cast<const StructType&>(*location.value->type);
+
+                    location.value = &location.value->elements[getFieldIndex(memberExpression.fieldDeclaration, structType)];
+                    return makeWhole(location);
+                }
+
+                case Expression::Kind::ArraySubscript:
+                {
+                    auto& arraySubscriptExpression = static_cast<const ArraySubscriptExpression&>(expression);
+                    const auto index = evaluate(arraySubscriptExpression.subscript).components[0];
+                    auto location = locate(arraySubscriptExpression.expression);
+
+                    if (index < 0.0 || index >= static_cast<double>(location.value->elements.size()))
+                        throw std::runtime_error{"Array subscript out of range"};
+
+                    location.value = &location.value->elements[static_cast<std::size_t>(index)];
+                    return makeWhole(location);
+                }
+
+                case Expression::Kind::BinaryOperator:
+                {
+                    auto& binaryOperatorExpression = static_cast<const BinaryOperatorExpression&>(expression);
+
+                    if (binaryOperatorExpression.operatorKind == BinaryOperatorExpression::Kind::Subscript)
+                    {
+                        const auto index = evaluate(binaryOperatorExpression.rightExpression).components[0];
+                        auto location = locate(binaryOperatorExpression.leftExpression);
+                        auto& type = binaryOperatorExpression.leftExpression.qualifiedType.type;
+
+                        // a subscript of a vector is a component and a subscript of a matrix is a row
+                        const auto rowCount = (type.typeKind == Type::Kind::Matrix) ?
+                            static_cast<const MatrixType&>(type).rowCount : getComponentCount(type);
+                        const auto stride = (type.typeKind == Type::Kind::Matrix) ?
+                            static_cast<const MatrixType&>(type).rowType.componentCount : 1;
+
+                        if (index < 0.0 || index >= static_cast<double>(rowCount))
+                            throw std::runtime_error{"Subscript out of range"};
+
+                        const auto first = static_cast<std::size_t>(index) * stride;
+                        for (std::size_t i = 0; i < stride; ++i)
+                            location.components[i] = location.components[first + i];
+                        location.componentCount = stride;
+                        return location;
+                    }
+                    else if (binaryOperatorExpression.operatorKind == BinaryOperatorExpression::Kind::Comma)
+                    {
+                        evaluate(binaryOperatorExpression.leftExpression);
+                        return locate(binaryOperatorExpression.rightExpression);
+                    }
+                    else if (binaryOperatorExpression.category == Expression::Category::Lvalue)
+                    {
+                        // assignments return their left operand
+                        evaluate(binaryOperatorExpression);
+                        return locate(binaryOperatorExpression.leftExpression);
+                    }
+
+                    break;
+                }
+
+                case Expression::Kind::UnaryOperator:
+                {
+                    auto& unaryOperatorExpression = static_cast<const UnaryOperatorExpression&>(expression);
+                    if (unaryOperatorExpression.operatorKind != UnaryOperatorExpression::Kind::PrefixIncrement &&
+                        unaryOperatorExpression.operatorKind != UnaryOperatorExpression::Kind::PrefixDecrement)
+                        break;
+
+                    evaluate(unaryOperatorExpression);
+                    return locate(unaryOperatorExpression.expression);
+                }
+
+                case Expression::Kind::TernaryOperator:
+                {
+                    auto& ternaryOperatorExpression = static_cast<const TernaryOperatorExpression&>(expression);
+                    return locate(isTrue(evaluate(ternaryOperatorExpression.condition)) ?
+                                  ternaryOperatorExpression.leftExpression :
+                                  ternaryOperatorExpression.rightExpression);
+                }
+
+                case Expression::Kind::VectorElement:
+                {
+                    auto& vectorElementExpression = static_cast<const VectorElementExpression&>(expression);
+                    auto location = locate(vectorElementExpression.expression);
+                    const auto components = location.components;
+
+                    for (std::size_t i = 0; i < vectorElementExpression.positions.size(); ++i)
+                        location.components[i] = components[vectorElementExpression.positions[i]];
+                    location.componentCount = vectorElementExpression.positions.size();
+                    return location;
+                }
+
+                default:
+                    break;
+            }
+
+            throw std::runtime_error{"Expression is not assignable"};
+        }
+
+        static Location& makeWhole(Location& location) noexcept
+        {
+            location.componentCount = getComponentCount(*location.value->type);
+            location.whole = location.componentCount == 0;
+
+            for (std::size_t i = 0; i < location.componentCount; ++i)
+                location.components[i] = static_cast<std::uint8_t>(i);
+
+            return location;
+        }
+
+        static Value load(const Location& location, const Type& type)
+        {
+            if (location.whole) return *location.value;
+
+            Value value{type};
+            for (std::size_t i = 0; i < location.componentCount; ++i)
+                value.components[i] = location.value->components[location.components[i]];
+            return value;
+        }
+
+        static void store(const Location& location, const Value& value)
+        {
+            if (location.whole)
+            {
+                const auto type = location.value->type;
+                *location.value = value;
+                location.value->type = type;
+            }
+            else
+                for (std::size_t i = 0; i < location.componentCount; ++i)
+                    location.value->components[location.components[i]] = value.components[i];
+        }
+
+        Value evaluate(const Expression& expression)
+        {
+            switch (expression.expressionKind)
+            {
+                case Expression::Kind::Call:
+                    return evaluateCall(static_cast<const CallExpression&>(expression));
+
+                case Expression::Kind::Literal:
+                {
+                    auto& literalExpression = static_cast<const LiteralExpression&>(expression);
+                    Value value{expression.qualifiedType.type};
+
+                    switch (literalExpression.literalKind)
+                    {
+                        case LiteralExpression::Kind::Boolean:
+                            value.components[0] = static_cast<const BooleanLiteralExpression&>(literalExpression).value ? 1.0 : 0.0;
+                            return value;
+                        case LiteralExpression::Kind::Integer:
+                            value.components[0] = static_cast<double>(detail::wrap(static_cast<const ScalarType&>(expression.qualifiedType.type),
+                                                                                   static_cast<const IntegerLiteralExpression&>(literalExpression).value));
+                            return value;
+                        case LiteralExpression::Kind::FloatingPoint:
+                            value.components[0] = round(static_cast<const FloatingPointLiteralExpression&>(literalExpression).value);
+                            return value;
+                        case LiteralExpression::Kind::String:
+                            break;
+                    }
+
+                    throw std::runtime_error{"String literals are not supported"};
+                }
+
+                case Expression::Kind::DeclarationReference:
+                    return getVariable(static_cast<const DeclarationReferenceExpression&>(expression).declaration);
+
+                case Expression::Kind::Paren:
+                    return evaluate(static_cast<const ParenExpression&>(expression).expression);
+
+                case Expression::Kind::Member:
+                {
+                    auto& memberExpression = static_cast<const MemberExpression&>(expression);
+                    auto value = evaluate(memberExpression.expression);
+                    auto& structType = static_cast<const StructType&>(*value.type);
+                    return std::move(value.elements[getFieldIndex(memberExpression.fieldDeclaration, structType)]);
+                }
+
+                case Expression::Kind::ArraySubscript:
+                {
+                    auto& arraySubscriptExpression = static_cast<const ArraySubscriptExpression&>(expression);
+                    auto value = evaluate(arraySubscriptExpression.expression);
+                    const auto index = evaluate(arraySubscriptExpression.subscript).components[0];
+
+                    if (index < 0.0 || index >= static_cast<double>(value.elements.size()))
+                        throw std::runtime_error{"Array subscript out of range"};
+
+                    return std::move(value.elements[static_cast<std::size_t>(index)]);
+                }
+
+                case Expression::Kind::UnaryOperator:
+                    return evaluateUnary(static_cast<const UnaryOperatorExpression&>(expression));
+
+                case Expression::Kind::BinaryOperator:
+                    return evaluateBinary(static_cast<const BinaryOperatorExpression&>(expression));
+
+                case Expression::Kind::TernaryOperator:
+                {
+                    auto& ternaryOperatorExpression = static_cast<const TernaryOperatorExpression&>(expression);
+                    return evaluate(isTrue(evaluate(ternaryOperatorExpression.condition)) ?
+                                    ternaryOperatorExpression.leftExpression :
+                                    ternaryOperatorExpression.rightExpression);
+                }
+
+                case Expression::Kind::TemporaryObject:
+                {
+                    // the parameters initialize the fields in order
+                    auto& temporaryObjectExpression = static_cast<const TemporaryObjectExpression&>(expression);
+                    Value value{expression.qualifiedType.type};
+
+                    for (std::size_t i = 0; i < temporaryObjectExpression.parameters.size() && i < value.elements.size(); ++i)
+                    {
+                        const auto type = value.elements[i].type;
+                        value.elements[i] = evaluate(temporaryObjectExpression.parameters[i]);
+                        value.elements[i].type = type;
+                    }
+
+                    return value;
+                }
+
+                case Expression::Kind::InitializerList:
+                {
+                    auto& initializerListExpression = static_cast<const InitializerListExpression&>(expression);
+                    Value value{expression.qualifiedType.type};
+
+                    for (std::size_t i = 0; i < initializerListExpression.expressions.size() && i < value.elements.size(); ++i)
+                        value.elements[i] = convert(evaluate(initializerListExpression.expressions[i]), *value.elements[i].type);
+
+                    return value;
+                }
+
+                case Expression::Kind::Cast:
+                    return convert(evaluate(static_cast<const CastExpression&>(expression).expression),
+                                   expression.qualifiedType.type);
+
+                case Expression::Kind::VectorInitialize:
+                case Expression::Kind::MatrixInitialize:
+                {
+                    auto& parameters = (expression.expressionKind == Expression::Kind::VectorInitialize) ?
+                        static_cast<const VectorInitializeExpression&>(expression).parameters :
+                        static_cast<const MatrixInitializeExpression&>(expression).parameters;
+
+                    Value value{expression.qualifiedType.type};
+                    const auto scalarType = getScalarType(expression.qualifiedType.type);
+                    const auto componentCount = getComponentCount(expression.qualifiedType.type);
+                    std::size_t component = 0;
+
+                    for (const Expression& parameter : parameters)
+                    {
+                        const auto parameterValue = evaluate(parameter);
+                        const auto parameterScalarType = getScalarType(*parameterValue.type);
+                        if (!parameterScalarType)
+                            throw std::runtime_error{"Invalid initializer"};
+
+                        for (std::size_t i = 0; i < getComponentCount(*parameterValue.type) && component < componentCount; ++i)
+                            value.components[component++] = convert(parameterValue.components[i], *parameterScalarType, *scalarType);
+                    }
+
+                    // a single scalar initializes all components
+                    if (component == 1)
+                        for (std::size_t i = 1; i < componentCount; ++i)
+                            value.components[i] = value.components[0];
+
+                    return value;
+                }
+
+                case Expression::Kind::VectorElement:
+                {
+                    auto& vectorElementExpression = static_cast<const VectorElementExpression&>(expression);
+                    const auto vector = evaluate(vectorElementExpression.expression);
+
+                    Value value{expression.qualifiedType.type};
+                    for (std::size_t i = 0; i < vectorElementExpression.positions.size(); ++i)
+                        value.components[i] = vector.components[vectorElementExpression.positions[i]];
+
+                    return value;
+                }
+            }
+
+            throw std::runtime_error{"Unknown expression"};
+        }
+
+        // converts between scalar types, vectors with the same number of components
+        // and from a scalar to a vector by repeating it
+        static Value convert(const Value& value, const Type& type)
+        {
+            if (value.type == &type) return value;
+
+            const auto sourceScalarType = getScalarType(*value.type);
+            const auto targetScalarType = getScalarType(type);
+
+            if (!sourceScalarType || !targetScalarType)
+            {
+                if (value.type->typeKind != type.typeKind)
+                    throw std::runtime_error{"Invalid conversion from " + value.type->name + " to " + type.name};
+
+                return value;
+            }
+
+            const auto sourceCount = getComponentCount(*value.type);
+            const auto targetCount = getComponentCount(type);
+
+            if (sourceCount != targetCount && sourceCount != 1)
+                throw std::runtime_error{"Invalid conversion from " + value.type->name + " to " + type.name};
+
+            Value result{type};
+            for (std::size_t i = 0; i < targetCount; ++i)
+                result.components[i] = convert(value.components[(sourceCount == 1) ? 0 : i], *sourceScalarType, *targetScalarType);
+
+            return result;
+        }
+
+        Value evaluateUnary(const UnaryOperatorExpression& expression)
+        {
+            auto& type = expression.qualifiedType.type;
+            const auto scalarType = getScalarType(type);
+            const auto componentCount = getComponentCount(type);
+
+            switch (expression.operatorKind)
+            {
+                case UnaryOperatorExpression::Kind::Negation:
+                {
+                    auto value = evaluate(expression.expression);
+                    value.components[0] = isTrue(value) ? 0.0 : 1.0;
+                    return value;
+                }
+
+                case UnaryOperatorExpression::Kind::Positive:
+                    return evaluate(expression.expression);
+
+                case UnaryOperatorExpression::Kind::Negative:
+                {
+                    auto value = evaluate(expression.expression);
+                    for (std::size_t i = 0; i < componentCount; ++i)
+                        value.components[i] = (scalarType->scalarTypeKind == ScalarType::Kind::FloatingPoint) ?
+                            -value.components[i] :
+                            static_cast<double>(detail::wrap(*scalarType, -static_cast<std::int64_t>(value.components[i])));
+                    return value;
+                }
+
+                case UnaryOperatorExpression::Kind::PrefixIncrement:
+                case UnaryOperatorExpression::Kind::PrefixDecrement:
+                case UnaryOperatorExpression::Kind::PostfixIncrement:
+                case UnaryOperatorExpression::Kind::PostfixDecrement:
+                {
+                    const auto location = locate(expression.expression);
+                    const auto previous = load(location, expression.expression.qualifiedType.type);
+                    auto value = previous;
+
+                    const auto step = (expression.operatorKind == UnaryOperatorExpression::Kind::PrefixIncrement ||
+                                       expression.operatorKind == UnaryOperatorExpression::Kind::PostfixIncrement) ? 1 : -1;
+
+                    for (std::size_t i = 0; i < componentCount; ++i)
+                        value.components[i] = (scalarType->scalarTypeKind == ScalarType::Kind::FloatingPoint) ?
+                            round(value.components[i] + step) :
+                            static_cast<double>(detail::wrap(*scalarType, static_cast<std::int64_t>(value.components[i]) + step));
+
+                    store(location, value);
+
+                    return (expression.operatorKind == UnaryOperatorExpression::Kind::PrefixIncrement ||
+                            expression.operatorKind == UnaryOperatorExpression::Kind::PrefixDecrement) ? value : previous;
+                }
+            }
+
+            throw std::runtime_error{"Unknown operator"};
+        }
+
+        Value evaluateBinary(const BinaryOperatorExpression& expression)
+        {
+            switch (expression.operatorKind)
+            {
+                case BinaryOperatorExpression::Kind::Assignment:
+                {
+                    auto value = convert(evaluate(expression.rightExpression), expression.leftExpression.qualifiedType.type);
+                    store(locate(expression.leftExpression), value);
+                    return value;
+                }
+
+                case BinaryOperatorExpression::Kind::AdditionAssignment:
+                case BinaryOperatorExpression::Kind::SubtractAssignment:
+                case BinaryOperatorExpression::Kind::MultiplicationAssignment:
+                case BinaryOperatorExpression::Kind::DivisionAssignment:
+                {
+                    const auto right = evaluate(expression.rightExpression);
+                    const auto location = locate(expression.leftExpression);
+                    auto& type = expression.leftExpression.qualifiedType.type;
+
+                    const auto operatorKind =
+                        (expression.operatorKind == BinaryOperatorExpression::Kind::AdditionAssignment) ? BinaryOperatorExpression::Kind::Addition :
+                        (expression.operatorKind == BinaryOperatorExpression::Kind::SubtractAssignment) ? BinaryOperatorExpression::Kind::Subtraction :
+                        (expression.operatorKind == BinaryOperatorExpression::Kind::MultiplicationAssignment) ? BinaryOperatorExpression::Kind::Multiplication :
+                        BinaryOperatorExpression::Kind::Division;
+
+                    const auto value = calculate(operatorKind, load(location, type), right, type);
+                    store(location, value);
+                    return value;
+                }
+
+                case BinaryOperatorExpression::Kind::Or:
+                case BinaryOperatorExpression::Kind::And:
+                {
+                    auto value = evaluate(expression.leftExpression);
+                    if (isTrue(value) == (expression.operatorKind == BinaryOperatorExpression::Kind::And))
+                        value.components[0] = isTrue(evaluate(expression.rightExpression)) ? 1.0 : 0.0;
+                    return value;
+                }
+
+                case BinaryOperatorExpression::Kind::Comma:
+                    evaluate(expression.leftExpression);
+                    return evaluate(expression.rightExpression);
+
+                case BinaryOperatorExpression::Kind::Subscript:
+                {
+                    const auto left = evaluate(expression.leftExpression);
+                    const auto index = evaluate(expression.rightExpression).components[0];
+                    Value value{expression.qualifiedType.type};
+
+                    const auto count = getComponentCount(expression.qualifiedType.type);
+                    if (index < 0.0 || (index + 1.0) * static_cast<double>(count) > static_cast<double>(getComponentCount(*left.type)))
+                        throw std::runtime_error{"Subscript out of range"};
+
+                    for (std::size_t i = 0; i < count; ++i)
+                        value.components[i] = left.components[static_cast<std::size_t>(index) * count + i];
+
+                    return value;
+                }
+
+                case BinaryOperatorExpression::Kind::Equality:
+                case BinaryOperatorExpression::Kind::Inequality:
+                {
+                    Value value{expression.qualifiedType.type};
+                    const auto equal = isEqual(evaluate(expression.leftExpression),
+                                               evaluate(expression.rightExpression));
+                    value.components[0] = (equal == (expression.operatorKind == BinaryOperatorExpression::Kind::Equality)) ? 1.0 : 0.0;
+                    return value;
+                }
+
+                default:
+                    return calculate(expression.operatorKind,
+                                     evaluate(expression.leftExpression),
+                                     evaluate(expression.rightExpression),
+                                     expression.qualifiedType.type);
+            }
+        }
+
+        static bool isEqual(const Value& left, const Value& right) noexcept
+        {
+            if (left.components != right.components || left.elements.size() != right.elements.size())
+                return false;
+
+            for (std::size_t i = 0; i < left.elements.size(); ++i)
+                if (!isEqual(left.elements[i], right.elements[i])) return false;
+
+            return true;
+        }
+
+        static double calculate(BinaryOperatorExpression::Kind operatorKind,
+                                double left, double right, const ScalarType& scalarType) noexcept
+        {
+            if (scalarType.scalarTypeKind == ScalarType::Kind::FloatingPoint)
+            {
+                const auto a = static_cast<float>(left);
+                const auto b = static_cast<float>(right);
+
+                switch (operatorKind)
+                {
+                    case BinaryOperatorExpression::Kind::Addition: return static_cast<double>(a + b);
+                    case BinaryOperatorExpression::Kind::Subtraction: return static_cast<double>(a - b);
+                    case BinaryOperatorExpression::Kind::Multiplication: return static_cast<double>(a * b);
+                    default: return static_cast<double>(a / b);
+                }
+            }
+
+            // unsigned 64-bit arithmetic wraps instead of overflowing
+            const auto a = static_cast<std::uint64_t>(static_cast<std::int64_t>(left));
+            const auto b = static_cast<std::uint64_t>(static_cast<std::int64_t>(right));
+
+            switch (operatorKind)
+            {
+                case BinaryOperatorExpression::Kind::Addition: return static_cast<double>(detail::wrap(scalarType, static_cast<std::int64_t>(a + b)));
+                case BinaryOperatorExpression::Kind::Subtraction: return static_cast<double>(detail::wrap(scalarType, static_cast<std::int64_t>(a - b)));
+                case BinaryOperatorExpression::Kind::Multiplication: return static_cast<double>(detail::wrap(scalarType, static_cast<std::int64_t>(a * b)));
+                default: // division by zero results in zero instead of trapping
+                    return (right == 0.0) ? 0.0 :
+                        static_cast<double>(detail::wrap(scalarType, static_cast<std::int64_t>(left) / static_cast<std::int64_t>(right)));
+            }
+        }
+
+        // arithmetic and comparison operators, componentwise with a scalar operand repeated,
+        // except for the products of a matrix with a vector or matrix, which are linear algebra products
+        static Value calculate(BinaryOperatorExpression::Kind operatorKind,
+                               const Value& left, const Value& right, const Type& resultType)
+        {
+            Value value{resultType};
+            const auto scalarType = getScalarType(*left.type);
+            if (!scalarType)
+                throw std::runtime_error{"Invalid operands"};
+
+            switch (operatorKind)
+            {
+                case BinaryOperatorExpression::Kind::LessThan:
+                    value.components[0] = (left.components[0] < right.components[0]) ? 1.0 : 0.0;
+                    return value;
+                case BinaryOperatorExpression::Kind::LessThanEqual:
+                    value.components[0] = (left.components[0] <= right.components[0]) ? 1.0 : 0.0;
+                    return value;
+                case BinaryOperatorExpression::Kind::GreaterThan:
+                    value.components[0] = (left.components[0] > right.components[0]) ? 1.0 : 0.0;
+                    return value;
+                case BinaryOperatorExpression::Kind::GraterThanEqual:
+                    value.components[0] = (left.components[0] >= right.components[0]) ? 1.0 : 0.0;
+                    return value;
+                default:
+                    break;
+            }
+
+            if (operatorKind == BinaryOperatorExpression::Kind::Multiplication &&
+                (left.type->typeKind == Type::Kind::Matrix || right.type->typeKind == Type::Kind::Matrix) &&
+                left.type->typeKind != Type::Kind::Scalar && right.type->typeKind != Type::Kind::Scalar)
+            {
+                // a vector on the left is a row vector and a vector on the right is a column vector
+                const auto leftRows = (left.type->typeKind == Type::Kind::Matrix) ? static_cast<const MatrixType&>(*left.type).rowCount : 1;
+                const auto inner = (right.type->typeKind == Type::Kind::Matrix) ? static_cast<const MatrixType&>(*right.type).rowCount : getComponentCount(*right.type);
+                const auto rightColumns = (right.type->typeKind == Type::Kind::Matrix) ? static_cast<const MatrixType&>(*right.type).rowType.componentCount : 1;
+
+                for (std::size_t row = 0; row < leftRows; ++row)
+                    for (std::size_t column = 0; column < rightColumns; ++column)
+                    {
+                        float sum = 0.0F;
+                        for (std::size_t i = 0; i < inner; ++i)
+                            sum += static_cast<float>(left.components[row * inner + i]) *
+                                static_cast<float>(right.components[i * rightColumns + column]);
+                        value.components[row * rightColumns + column] = static_cast<double>(sum);
+                    }
+
+                return value;
+            }
+
+            const auto leftCount = getComponentCount(*left.type);
+            const auto rightCount = getComponentCount(*right.type);
+            const auto componentCount = getComponentCount(resultType);
+
+            for (std::size_t i = 0; i < componentCount; ++i)
+                value.components[i] = calculate(operatorKind,
+                                                left.components[(leftCount == 1) ? 0 : i],
+                                                right.components[(rightCount == 1) ? 0 : i],
+                                                *scalarType);
+
+            return value;
+        }
+
+        Value evaluateCall(const CallExpression& expression)
+        {
+            auto& declaration = expression.declarationReference.declaration;
+            if (declaration.declarationKind != Declaration::Kind::Callable)
+                throw std::runtime_error{"Invalid call"};
+
+            auto& callableDeclaration = static_cast<const CallableDeclaration&>(declaration);
+
+            if (callableDeclaration.callableDeclarationKind == CallableDeclaration::Kind::Function &&
+                static_cast<const FunctionDeclaration&>(callableDeclaration).isBuiltin)
+                return evaluateBuiltin(expression, callableDeclaration.name);
+
+            const auto definition = static_cast<const CallableDeclaration*>(declaration.definition);
+            if (!definition || !definition->body)
+                throw std::runtime_error{"Function " + declaration.name + " is not defined"};
+
+            if (callDepth >= maxCallDepth)
+                throw std::runtime_error{"Call stack overflow"};
+
+            // the arguments of out and inout parameters are located before the call and written after it
+            std::vector<Value> arguments;
+            std::vector<Location> locations;
+            arguments.reserve(expression.arguments.size());
+
+            for (std::size_t i = 0; i < expression.arguments.size(); ++i)
+            {
+                const Expression& argument = expression.arguments[i];
+                const auto parameterDeclaration = definition->parameterDeclarations[i];
+
+                if (parameterDeclaration->inputModifier == InputModifier::In)
+                    arguments.push_back(convert(evaluate(argument), parameterDeclaration->qualifiedType.type));
+                else
+                {
+                    locations.push_back(locate(argument));
+                    arguments.push_back(parameterDeclaration->inputModifier == InputModifier::Inout ?
+                                        load(locations.back(), argument.qualifiedType.type) :
+                                        Value{parameterDeclaration->qualifiedType.type});
+                }
+            }
+
+            const auto previousFrameStart = frameStart;
+            frameStart = variables.size();
+            ++callDepth;
+
+            for (std::size_t i = 0; i < arguments.size(); ++i)
+                variables.emplace_back(definition->parameterDeclarations[i], std::move(arguments[i]));
+
+            result = (callableDeclaration.callableDeclarationKind == CallableDeclaration::Kind::Function) ?
+                Value{static_cast<const FunctionDeclaration&>(callableDeclaration).resultType.type} : Value{};
+
+            execute(*definition->body);
+
+            auto value = std::move(result);
+
+            std::size_t location = 0;
+            for (std::size_t i = 0; i < arguments.size(); ++i)
+                if (definition->parameterDeclarations[i]->inputModifier != InputModifier::In)
+                    store(locations[location++], variables[frameStart + i].second);
+
+            popVariables(frameStart);
+            frameStart = previousFrameStart;
+            --callDepth;
+
+            return value;
+        }
+
+        Value evaluateBuiltin(const CallExpression& expression, const std::string& name)
+        {
+            if (name == "discard")
+                throw Discard{};
+
+            std::vector<Value> arguments;
+            arguments.reserve(expression.arguments.size());
+            for (const Expression& argument : expression.arguments)
+                arguments.push_back(evaluate(argument));
+
+            Value value{expression.qualifiedType.type};
+
+            if (name == "abs")
+            {
+                const auto scalarType = getScalarType(*arguments[0].type);
+
+                for (std::size_t i = 0; i < getComponentCount(*arguments[0].type); ++i)
+                    value.components[i] = (scalarType->scalarTypeKind == ScalarType::Kind::Integer) ?
+                        static_cast<double>(detail::wrap(*scalarType, static_cast<std::int64_t>(std::abs(arguments[0].components[i])))) :
+                        std::abs(arguments[0].components[i]);
+
+                return value;
+            }
+            else if (name == "sample" || name == "load")
+            {
+                const auto texture = arguments[0].texture;
+                if (!texture)
+                    throw std::runtime_error{"No texture bound"};
+
+                const auto x = arguments[1].components[0];
+                const auto y = arguments[1].components[1];
+
+                // load takes texel coordinates
+                const auto color = (name == "sample") ?
+                    texture->sample(static_cast<float>(x), static_cast<float>(y)) :
+                    texture->load(std::isfinite(x) ? static_cast<std::int64_t>(std::floor(std::min(std::max(x, -1.0), 1e9))) : 0,
+                                  std::isfinite(y) ? static_cast<std::int64_t>(std::floor(std::min(std::max(y, -1.0), 1e9))) : 0);
+
+                for (std::size_t i = 0; i < 4; ++i)
+                    value.components[i] = static_cast<double>(color[i]);
+
+                return value;
+            }
+
+            throw std::runtime_error{"Unsupported builtin function " + name};
+        }
+
+        const FunctionDeclaration* entryPoint = nullptr;
+        std::map<const Declaration*, Value> globals;
+        std::deque<std::pair<const Declaration*, Value>> variables; // references stay valid while the stack grows
+        std::size_t frameStart = 0;
+        std::size_t callDepth = 0;
+        Value result;
+        std::unordered_map<const FieldDeclaration*, std::size_t> fieldIndices;
+    };
+}
+
+#endif // INTERPRETER_HPP
@@ -0,0 +1,319 @@
+//
+//  OSL
+//
+
+#ifndef LAYOUT_HPP
+#define LAYOUT_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Parser.hpp"
+
+namespace ouzel
+{
+    // Places the members of a uniform buffer or of a struct by the rules of a target, so that a runtime
+    // can upload its data with a single copy, a matrix is laid out as an array of its rows
+    class Layout final
+    {
+    public:
+        enum class Rules: std::uint8_t
+        {
+            Packed, // four bytes per scalar without any padding
+            Std140, // GLSL uniform blocks
+            Std430, // GLSL storage blocks
+            HLSL, // HLSL constant buffers, a vector does not cross a 16-byte register
+            Metal // MSL structs in the constant address space
+        };
+
+        struct TypeLayout final
+        {
+            std::uint32_t size = 0;
+            std::uint32_t alignment = 1;
+            std::uint32_t arrayStride = 0; // zero if the type is not an array
+            std::uint32_t matrixStride = 0; // the distance between the rows, zero if the type is not a matrix
+        };
+
+        struct Member final
+        {
+            std::string name;
+            const Type* type = nullptr;
+            const Declaration* declaration = nullptr;
+            std::uint32_t offset = 0;
+            std::uint32_t size = 0;
+            std::uint32_t arrayStride = 0; // the stride of the innermost dimension, so that the elements can be iterated flat
+            std::uint32_t matrixStride = 0;
+        };
+
+        Layout() = default;
+
+        explicit Layout(Rules initRules):
+            rules{initRules}
+        {
+        }
+
+        // the extern variables of the context except the textures, in their declaration order
+        Layout(const Context& context, Rules initRules):
+            rules{initRules}
+        {
+            for (const auto declaration : context.getDeclarations())
+                if (declaration->declarationKind == Declaration::Kind::Variable &&
+                    static_cast<const VariableDeclaration*>(declaration)->storageClass == StorageClass::Extern &&
+                    !isOpaque(static_cast<const VariableDeclaration*>(declaration)->qualifiedType.type))
+                    add(declaration->name, static_cast<const VariableDeclaration*>(declaration)->qualifiedType.type, declaration);
+        }
+
+        // the fields of a struct
+        Layout(const StructType& structType, Rules initRules):
+            rules{initRules}
+        {
+            for (const Declaration& memberDeclaration : structType.memberDeclarations)
+                if (memberDeclaration.declarationKind == Declaration::Kind::Field)
+                    add(memberDeclaration.name, static_cast<const FieldDeclaration&>(memberDeclaration).qualifiedType.type, &memberDeclaration);
+        }
+
+        [[nodiscard]] Rules getRules() const noexcept { return rules; }
+        [[nodiscard]] const std::vector<Member>& getMembers() const noexcept { return members; }
+        [[nodiscard]] bool empty() const noexcept { return members.empty(); }
+
+        // the end of the last member, rounded up to the alignment of the block, so that it can be bound as a buffer
+        [[nodiscard]] std::uint32_t getSize() const noexcept
+        {
+            return alignUp(end, getBlockAlignment());
+        }
+
+        const Member& add(const std::string& name, const Type& type, const Declaration* declaration = nullptr)
+        {
+            const auto typeLayout = getTypeLayout(type, rules);
+
+            auto offset = alignUp(end, typeLayout.alignment);
+
+            // a member of a constant buffer that follows a struct or that would cross a register starts a new one
+            if (rules == Rules::HLSL && (afterStruct || (typeLayout.size > 0 && offset / 16 != (offset + typeLayout.size - 1) / 16)))
+                offset = alignUp(offset, 16);
+
+            Member member;
+            member.name = name;
+            member.type = &type;
+            member.declaration = declaration;
+            member.offset = offset;
+            member.size = typeLayout.size;
+            member.arrayStride = getInnermostArrayStride(type, rules);
+            member.matrixStride = getTypeLayout(getElementType(type), rules).matrixStride;
+            members.push_back(std::move(member));
+
+            end = offset + typeLayout.size;
+            alignment = std::max(alignment, typeLayout.alignment);
+            afterStruct = getElementType(type).typeKind == Type::Kind::Struct;
+
+            return members.back();
+        }
+
+        static TypeLayout getTypeLayout(const Type& type, Rules rules)
+        {
+            TypeLayout result;
+
+            switch (type.typeKind)
+            {
+                case Type::Kind::Scalar:
+                    result.size = result.alignment = getScalarSize(static_cast<const ScalarType&>(type), rules);
+                    break;
+
+                case Type::Kind::Vector:
+                {
+                    auto& vectorType = static_cast<const VectorType&>(type);
+                    const auto scalarSize = getScalarSize(vectorType.componentType, rules);
+                    const auto componentCount = static_cast<std::uint32_t>(vectorType.componentCount);
+
+                    switch (rules)
+                    {
+                        case Rules::Packed:
+                            result.size = scalarSize * componentCount;
+                            result.alignment = 4;
+                            break;
+                        case Rules::Std140:
+                        case Rules::Std430:
+                            result.size = scalarSize * componentCount;
+                            result.alignment = scalarSize * (componentCount == 3 ? 4 : componentCount);
+                            break;
+                        case Rules::HLSL:
+                            result.size = scalarSize * componentCount;
+                            result.alignment = scalarSize;
+                            break;
+                        case Rules::Metal:
+                            result.size = result.alignment = scalarSize * (componentCount == 3 ? 4 : componentCount);
+                            break;
+                    }
+                    break;
+                }
+
+                case Type::Kind::Matrix:
+                {
+                    auto& matrixType = static_cast<const MatrixType&>(type);
+                    const auto rowLayout = getTypeLayout(matrixType.rowType, rules);
+                    const auto rowCount = static_cast<std::uint32_t>(matrixType.rowCount);
+
+                    switch (rules)
+                    {
+                        case Rules::Packed:
+                            result.matrixStride = rowLayout.size;
+                            result.alignment = 4;
+                            break;
+                        case Rules::Std140:
+                        case Rules::HLSL:
+                            result.matrixStride = 16;
+                            result.alignment = 16;
+                            break;
+                        case Rules::Std430:
+                        case Rules::Metal:
+                            result.matrixStride = alignUp(rowLayout.size, rowLayout.alignment);
+                            result.alignment = rowLayout.alignment;
+                            break;
+                    }
+
+                    // the last row of a constant buffer matrix is not padded
+                    result.size = (rules == Rules::HLSL) ?
+                        result.matrixStride * (rowCount - 1) + rowLayout.size :
+                        result.matrixStride * rowCount;
+                    break;
+                }
+
+                case Type::Kind::Array:
+                {
+                    auto& arrayType = static_cast<const ArrayType&>(type);
+                    const auto elementLayout = getTypeLayout(arrayType.elementType.type, rules);
+                    const auto size = static_cast<std::uint32_t>(arrayType.size);
+
+                    switch (rules)
+                    {
+                        case Rules::Packed:
+                        case Rules::Std430:
+                        case Rules::Metal:
+                            result.arrayStride = alignUp(elementLayout.size, elementLayout.alignment);
+                            result.alignment = elementLayout.alignment;
+                            break;
+                        case Rules::Std140:
+                            result.arrayStride = alignUp(alignUp(elementLayout.size, elementLayout.alignment), 16);
+                            result.alignment = std::max(elementLayout.alignment, 16U);
+                            break;
+                        case Rules::HLSL:
+                            result.arrayStride = alignUp(elementLayout.size, 16);
+                            result.alignment = 16;
+                            break;
+                    }
+
+                    // the last element of a constant buffer array is not padded
+                    result.size = (size == 0) ? 0 :
+                        (rules == Rules::HLSL) ? result.arrayStride * (size - 1) + elementLayout.size :
+                        result.arrayStride * size;
+                    break;
+                }
+
+                case Type::Kind::Struct:
+                {
+                    if (isOpaque(type))
+                        throw std::runtime_error{"Type " + type.name + " can not be placed in a buffer"};
+
+                    const Layout structLayout(static_cast<const StructType&>(type), rules);
+                    result.alignment = structLayout.getBlockAlignment();
+                    // a struct in a constant buffer is not padded, but the next member starts a new register
+                    result.size = (rules == Rules::HLSL) ? structLayout.end : structLayout.getSize();
+                    break;
+                }
+
+                default:
+                    throw std::runtime_error{"Type " + type.name + " can not be placed in a buffer"};
+            }
+
+            return result;
+        }
+
+        // textures are bound separately from the buffers
+        static bool isOpaque(const Type& type) noexcept
+        {
+            auto& elementType = getElementType(type);
+            return elementType.typeKind == Type::Kind::Struct &&
+                (elementType.name == "Texture2D" || elementType.name == "Texture2DMS");
+        }
+
+        static std::string toString(Rules rules)
+        {
+            switch (rules)
+            {
+                case Rules::Packed: return "packed";
+                case Rules::Std140: return "std140";
+                case Rules::Std430: return "std430";
+                case Rules::HLSL: return "hlsl";
+                case Rules::Metal: return "metal";
+            }
+
+            throw std::runtime_error{"Unknown layout rules"};
+        }
+
+        static Rules getRules(const std::string& name)
+        {
+            if (name == "packed") return Rules::Packed;
+            else if (name == "std140") return Rules::Std140;
+            else if (name == "std430") return Rules::Std430;
+            else if (name == "hlsl") return Rules::HLSL;
+            else if (name == "metal") return Rules::Metal;
+            else throw std::runtime_error{"Invalid layout rules: " + name};
+        }
+
+    private:
+        static std::uint32_t alignUp(std::uint32_t value, std::uint32_t alignment) noexcept
+        {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+
+        static const Type& getElementType(const Type& type) noexcept
+        {
+            auto result = &type;
+            while (result->typeKind == Type::Kind::Array)
+                result = &static_cast<const ArrayType*>(result)->elementType.type;
+            return *result;
+        }
+
+        static std::uint32_t getInnermostArrayStride(const Type& type, Rules rules)
+        {
+            if (type.typeKind != Type::Kind::Array) return 0;
+
+            auto arrayType = static_cast<const ArrayType*>(&type);
+            while (arrayType->elementType.type.typeKind == Type::Kind::Array)
+                arrayType = static_cast<const ArrayType*>(&arrayType->elementType.type);
+
+            return getTypeLayout(*arrayType, rules).arrayStride;
+        }
+
+        // a Metal bool is a single byte
+        static std::uint32_t getScalarSize(const ScalarType& scalarType, Rules rules) noexcept
+        {
+            return (rules == Rules::Metal && scalarType.scalarTypeKind == ScalarType::Kind::Boolean) ? 1 : 4;
+        }
+
+        std::uint32_t getBlockAlignment() const noexcept
+        {
+            switch (rules)
+            {
+                case Rules::Packed: return 4;
+                case Rules::Std140: return alignUp(alignment, 16);
+                case Rules::HLSL: return 16;
+                case Rules::Std430:
+                case Rules::Metal:
+                    return alignment;
+            }
+
+            return alignment;
+        }
+
+        Rules rules = Rules::Packed;
+        std::vector<Member> members;
+        std::uint32_t end = 0;
+        std::uint32_t alignment = 1;
+        bool afterStruct = false;
+    };
+}
+
+#endif // LAYOUT_HPP
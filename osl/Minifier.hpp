@@ -0,0 +1,442 @@
+//
+//  OSL
+//
+
+#ifndef MINIFIER_HPP
+#define MINIFIER_HPP
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Transformer.hpp"
+
+namespace ouzel
+{
+    // Picks the shortest unique names for the functions, variables, parameters, structs and fields
+    // that are not part of the interface of the shader, the entry points, their parameters,
+    // the structs they use, the externs and the declarations with attributes keep their names,
+    // the most used declarations get the shortest names
+    class Minifier final
+    {
+    public:
+        explicit Minifier(Context& context)
+        {
+            for (const auto& type : context.getTypes())
+                if (type->typeKind != Type::Kind::Struct)
+                    reservedNames.insert(type->name);
+
+            for (const auto declaration : context.getDeclarations())
+                findInterface(*declaration);
+
+            Counter counter{context, *this};
+            for (const auto declaration : context.getDeclarations())
+                counter.count(*declaration);
+
+            nameGlobals(context);
+
+            for (const auto declaration : context.getDeclarations())
+                if (declaration->declarationKind == Declaration::Kind::Callable)
+                    nameLocals(static_cast<const CallableDeclaration&>(*declaration), counter);
+
+            for (const auto declaration : context.getDeclarations())
+                if (declaration->declarationKind == Declaration::Kind::Type)
+                    nameFields(static_cast<const TypeDeclaration&>(*declaration).type);
+        }
+
+        [[nodiscard]]
+        const std::string& getName(const Declaration& declaration) const
+        {
+            const auto i = declarationNames.find(&declaration);
+            return i == declarationNames.end() ? declaration.name : i->second;
+        }
+
+        [[nodiscard]]
+        const std::string& getName(const Type& type) const
+        {
+            const auto i = typeNames.find(&type);
+            return i == typeNames.end() ? type.name : i->second;
+        }
+
+        // one "original renamed" line per renamed declaration, locals and fields are prefixed with their scope
+        [[nodiscard]]
+        std::string getNameMap() const
+        {
+            std::string result;
+            for (const auto& entry : nameMap)
+                result += entry.first + ' ' + entry.second + '\n';
+            return result;
+        }
+
+    private:
+        // Counts how many times the declarations are used and finds the local variables of the functions
+        class Counter final: public Transformer
+        {
+        public:
+            Counter(Context& initContext, Minifier& initMinifier) noexcept:
+                Transformer{initContext},
+                minifier{initMinifier}
+            {
+            }
+
+            void count(const Declaration& declaration)
+            {
+                if (declaration.declarationKind == Declaration::Kind::Callable)
+                {
+                    auto& callableDeclaration = static_cast<const CallableDeclaration&>(declaration);
+                    if (!callableDeclaration.body) return;
+
+                    function = &callableDeclaration;
+                    transformStatement(*callableDeclaration.body);
+                    function = nullptr;
+                }
+                else if (declaration.declarationKind == Declaration::Kind::Variable)
+                    transformDeclaration(declaration);
+            }
+
+            std::map<const Declaration*, std::vector<const Declaration*>> locals;
+            std::map<const Declaration*, std::set<const Declaration*>> references;
+
+        private:
+            const Declaration& transformDeclaration(const Declaration& declaration) override
+            {
+                if (function && declaration.declarationKind == Declaration::Kind::Variable)
+                    locals[function].push_back(&declaration);
+
+                return Transformer::transformDeclaration(declaration);
+            }
+
+            const Expression& transformExpression(const Expression& expression) override
+            {
+                if (expression.expressionKind == Expression::Kind::DeclarationReference)
+                    addUse(static_cast<const DeclarationReferenceExpression&>(expression).declaration);
+                else if (expression.expressionKind == Expression::Kind::Call)
+                    addUse(static_cast<const CallExpression&>(expression).declarationReference.declaration);
+                else if (expression.expressionKind == Expression::Kind::Member)
+                    ++minifier.useCounts[&static_cast<const MemberExpression&>(expression).fieldDeclaration];
+
+                return Transformer::transformExpression(expression);
+            }
+
+            void addUse(const Declaration& declaration)
+            {
+                // built-in functions are not in the list of declarations
+                if (declaration.declarationKind == Declaration::Kind::Callable &&
+                    static_cast<const CallableDeclaration&>(declaration).callableDeclarationKind == CallableDeclaration::Kind::Function &&
+                    static_cast<const FunctionDeclaration&>(declaration).isBuiltin)
+                    minifier.reservedNames.insert(declaration.name);
+
+                ++minifier.useCounts[minifier.getKey(declaration)];
+                if (function) references[function].insert(minifier.getKey(declaration));
+            }
+
+            Minifier& minifier;
+            const CallableDeclaration* function = nullptr;
+        };
+
+        // Generates the names a, b, ..., Z, aa, ab, ... skipping the reserved ones
+        class NameGenerator final
+        {
+        public:
+            explicit NameGenerator(const std::set<std::string>& initReservedNames) noexcept:
+                reservedNames{initReservedNames}
+            {
+            }
+
+            std::string next(const std::set<std::string>& usedNames = {})
+            {
+                for (;;)
+                {
+                    auto result = getName(index++);
+                    if (reservedNames.find(result) == reservedNames.end() &&
+                        usedNames.find(result) == usedNames.end())
+                        return result;
+                }
+            }
+
+        private:
+            static std::string getName(std::size_t index)
+            {
+                constexpr char letters[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+                constexpr std::size_t firstCount = 52; // identifiers can not start with a digit
+                constexpr std::size_t count = 62;
+
+                std::string result(1, letters[index % firstCount]);
+                index /= firstCount;
+
+                while (index > 0)
+                {
+                    --index;
+                    result += letters[index % count];
+                    index /= count;
+                }
+
+                return result;
+            }
+
+            const std::set<std::string>& reservedNames;
+            std::size_t index = 0;
+        };
+
+        // overloads and the declarations of the same function share a name
+        const Declaration* getKey(const Declaration& declaration) const
+        {
+            if (declaration.declarationKind == Declaration::Kind::Callable)
+            {
+                const auto i = functionKeys.find(declaration.name);
+                if (i != functionKeys.end()) return i->second;
+            }
+
+            return &declaration;
+        }
+
+        void findInterface(const Declaration& declaration)
+        {
+            switch (declaration.declarationKind)
+            {
+                case Declaration::Kind::Callable:
+                {
+                    auto& callableDeclaration = static_cast<const CallableDeclaration&>(declaration);
+                    functionKeys.emplace(declaration.name, &declaration);
+
+                    if (callableDeclaration.callableDeclarationKind != CallableDeclaration::Kind::Function)
+                        break;
+
+                    auto& functionDeclaration = static_cast<const FunctionDeclaration&>(callableDeclaration);
+                    if (functionDeclaration.isBuiltin)
+                        reservedNames.insert(declaration.name);
+                    else if (functionDeclaration.qualifier != FunctionDeclaration::Qualifier::None)
+                    {
+                        keep(declaration);
+                        keepType(functionDeclaration.resultType.type);
+
+                        for (const auto parameterDeclaration : functionDeclaration.parameterDeclarations)
+                        {
+                            keep(*parameterDeclaration);
+                            keepType(parameterDeclaration->qualifiedType.type);
+                        }
+                    }
+                    else if (!declaration.attributes.empty())
+                        keep(declaration);
+                    break;
+                }
+
+                case Declaration::Kind::Variable:
+                {
+                    auto& variableDeclaration = static_cast<const VariableDeclaration&>(declaration);
+                    if (variableDeclaration.storageClass == StorageClass::Extern ||
+                        !declaration.attributes.empty())
+                    {
+                        keep(declaration);
+                        keepType(variableDeclaration.qualifiedType.type);
+                    }
+                    break;
+                }
+
+                default:
+                    break;
+            }
+        }
+
+        void keep(const Declaration& declaration)
+        {
+            keptDeclarations.insert(&declaration);
+            reservedNames.insert(declaration.name);
+        }
+
+        void keepType(const Type& type)
+        {
+            if (type.typeKind == Type::Kind::Array)
+                keepType(static_cast<const ArrayType&>(type).elementType.type);
+            else if (type.typeKind == Type::Kind::Struct && keptTypes.insert(&type).second)
+            {
+                reservedNames.insert(type.name);
+
+                for (const Declaration& memberDeclaration : static_cast<const StructType&>(type).memberDeclarations)
+                {
+                    keep(memberDeclaration);
+                    if (memberDeclaration.declarationKind == Declaration::Kind::Field)
+                        keepType(static_cast<const FieldDeclaration&>(memberDeclaration).qualifiedType.type);
+                }
+            }
+        }
+
+        bool isKept(const Declaration& declaration) const
+        {
+            return keptDeclarations.find(getKey(declaration)) != keptDeclarations.end() ||
+                keptDeclarations.find(&declaration) != keptDeclarations.end();
+        }
+
+        std::size_t getUseCount(const void* key) const
+        {
+            const auto i = useCounts.find(key);
+            return i == useCounts.end() ? 0 : i->second;
+        }
+
+        // the names are assigned in the order of use count, so the stable sort keeps the order of declaration
+        template <class T>
+        void sortByUseCount(std::vector<T>& keys) const
+        {
+            std::stable_sort(keys.begin(), keys.end(), [this](const T& first, const T& second) {
+                return getUseCount(first) > getUseCount(second);
+            });
+        }
+
+        void nameGlobals(const Context& context)
+        {
+            std::vector<const void*> keys;
+            std::map<const void*, std::vector<const Declaration*>> declarations;
+
+            for (const auto declaration : context.getDeclarations())
+            {
+                if (isKept(*declaration)) continue;
+
+                switch (declaration->declarationKind)
+                {
+                    case Declaration::Kind::Callable:
+                    case Declaration::Kind::Variable:
+                    {
+                        const auto key = getKey(*declaration);
+                        if (declarations.find(key) == declarations.end()) keys.push_back(key);
+                        declarations[key].push_back(declaration);
+                        break;
+                    }
+
+                    case Declaration::Kind::Type:
+                    {
+                        auto& type = static_cast<const TypeDeclaration*>(declaration)->type;
+                        if (type.typeKind != Type::Kind::Struct || keptTypes.find(&type) != keptTypes.end()) break;
+
+                        if (declarations.find(&type) == declarations.end()) keys.push_back(&type);
+                        declarations[&type].push_back(declaration);
+                        break;
+                    }
+
+                    default:
+                        break;
+                }
+            }
+
+            sortByUseCount(keys);
+
+            NameGenerator nameGenerator{reservedNames};
+            for (const auto key : keys)
+            {
+                const auto name = nameGenerator.next();
+
+                for (const auto declaration : declarations[key])
+                {
+                    declarationNames[declaration] = name;
+                    if (declaration->declarationKind == Declaration::Kind::Type)
+                        typeNames[&static_cast<const TypeDeclaration*>(declaration)->type] = name;
+                }
+
+                nameMap.emplace_back(declarations[key].front()->name, name);
+            }
+        }
+
+        // local names can be reused by other functions, but must not hide the globals that the function uses
+        void nameLocals(const CallableDeclaration& callableDeclaration, const Counter& counter)
+        {
+            auto function = &callableDeclaration;
+            if (!function->body && function->definition)
+                function = static_cast<const CallableDeclaration*>(function->definition);
+
+            std::set<std::string> usedNames{getName(callableDeclaration)};
+            for (const auto& typeName : typeNames)
+                usedNames.insert(typeName.second);
+
+            const auto references = counter.references.find(function);
+            if (references != counter.references.end())
+                for (const auto declaration : references->second)
+                    usedNames.insert(getName(*declaration));
+
+            std::vector<const Declaration*> keys;
+            for (const auto parameterDeclaration : function->parameterDeclarations)
+                if (!isKept(*parameterDeclaration)) keys.push_back(parameterDeclaration);
+
+            const auto locals = counter.locals.find(function);
+            if (locals != counter.locals.end())
+                keys.insert(keys.end(), locals->second.begin(), locals->second.end());
+
+            sortByUseCount(keys);
+
+            // the names depend only on the definition, so all declarations of a function get the same ones
+            NameGenerator nameGenerator{reservedNames};
+            std::map<const Declaration*, std::string> names;
+            for (const auto key : keys)
+                names[key] = nameGenerator.next(usedNames);
+
+            const auto& functionName = callableDeclaration.name;
+            for (std::size_t i = 0; i < callableDeclaration.parameterDeclarations.size() && i < function->parameterDeclarations.size(); ++i)
+            {
+                const auto name = names.find(function->parameterDeclarations[i]);
+                if (name == names.end()) continue;
+
+                declarationNames[callableDeclaration.parameterDeclarations[i]] = name->second;
+                if (function == &callableDeclaration)
+                    nameMap.emplace_back(functionName + "::" + function->parameterDeclarations[i]->name, name->second);
+            }
+
+            if (function == &callableDeclaration && locals != counter.locals.end())
+                for (const auto declaration : locals->second)
+                {
+                    declarationNames[declaration] = names[declaration];
+                    nameMap.emplace_back(functionName + "::" + declaration->name, names[declaration]);
+                }
+        }
+
+        // fields only have to be unique in their struct
+        void nameFields(const Type& type)
+        {
+            if (type.typeKind != Type::Kind::Struct || keptTypes.find(&type) != keptTypes.end()) return;
+
+            auto& structType = static_cast<const StructType&>(type);
+
+            std::vector<const Declaration*> keys;
+            for (const Declaration& memberDeclaration : structType.memberDeclarations)
+                if (!isKept(memberDeclaration)) keys.push_back(&memberDeclaration);
+
+            sortByUseCount(keys);
+
+            NameGenerator nameGenerator{reservedNames};
+            for (const auto key : keys)
+            {
+                declarationNames[key] = nameGenerator.next();
+                nameMap.emplace_back(type.name + "." + key->name, declarationNames[key]);
+            }
+        }
+
+        // keywords and built-in functions of OSL and of the target languages
+        std::set<std::string> reservedNames{
+            "and", "and_eq", "as", "asm", "attribute", "auto", "bitand", "bitor", "bool", "break", "buffer",
+            "case", "cast", "catch", "centroid", "char", "class", "coherent", "common", "compl", "const",
+            "constant", "constexpr", "continue", "default", "delete", "device", "discard", "do", "double",
+            "else", "enum", "explicit", "extern", "external", "false", "filter", "fixed", "flat", "float",
+            "for", "fragment", "friend", "function", "fvec", "goto", "half", "highp", "hvec", "if", "image",
+            "in", "inline", "inout", "input", "int", "interface", "invariant", "kernel", "layout", "long",
+            "lowp", "main", "matrix", "mediump", "metal", "mutable", "namespace", "new", "noinline",
+            "noperspective", "not", "not_eq", "or", "or_eq", "out", "output", "packed", "partition", "patch",
+            "precise", "precision", "private", "protected", "public", "register", "resource", "restrict",
+            "return", "sample", "sampler", "shared", "short", "signed", "sizeof", "smooth", "static",
+            "struct", "subroutine", "superp", "switch", "template", "texture", "this", "thread",
+            "threadgroup", "throw", "true", "try", "typedef", "typename", "uint", "uniform", "union",
+            "unsigned", "using", "var", "varying", "vec", "vector", "vertex", "void", "volatile", "while",
+            "writeonly", "xor", "xor_eq",
+            "abs", "acos", "all", "any", "asin", "atan", "ceil", "clamp", "cos", "cross", "ddx", "ddy",
+            "dFdx", "dFdy", "dot", "exp", "exp2", "floor", "fract", "frac", "fwidth", "length", "lerp", "log",
+            "log2", "max", "min", "mix", "mod", "mul", "pow", "sign", "sin", "sqrt", "step", "tan"
+        };
+        std::set<const Declaration*> keptDeclarations;
+        std::set<const Type*> keptTypes;
+        std::map<std::string, const Declaration*> functionKeys;
+        std::map<const void*, std::size_t> useCounts;
+        std::map<const Declaration*, std::string> declarationNames;
+        std::map<const Type*, std::string> typeNames;
+        std::vector<std::pair<std::string, std::string>> nameMap;
+    };
+}
+
+#endif // MINIFIER_HPP
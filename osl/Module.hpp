@@ -0,0 +1,437 @@
+//
+//  OSL
+//
+
+#ifndef MODULE_HPP
+#define MODULE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+#include "Parser.hpp"
+#include "Tokenizer.hpp"
+
+namespace ouzel
+{
+    // A precompiled library of struct and function declarations that is imported with import "name";
+    // every declaration is stored as its checked tokens, which are decoded only when a shader uses its name,
+    // so a library is preprocessed, tokenized and checked once and a shader parses only the declarations it uses
+    class Module final
+    {
+    public:
+        struct Symbol final
+        {
+            std::string name;
+            Declaration::Kind kind;
+            std::uint32_t tokenCount;
+            std::size_t offset; // of the tokens in the serialized module
+        };
+
+        // returns the module with the name or throws if it can not be found
+        using Loader = std::function<std::shared_ptr<const Module>(const std::string&)>;
+
+        static constexpr std::uint32_t version = 1;
+
+        Module() = default;
+
+        // checks the declarations and exports all of them, the import directives have to come before them,
+        // the imported modules are not copied into the module, but imported again by the code that imports it
+        explicit Module(const std::vector<Token>& tokens, const Loader& loader = nullptr)
+        {
+            const auto directives = findImports(tokens);
+
+            for (std::size_t i = 0; i < directives.size(); ++i)
+            {
+                const auto& token = tokens[directives[i]];
+                if (directives[i] != i * 3)
+                    throw SourceError{"import has to come before the declarations", token.line, token.column};
+                imports.push_back(tokens[directives[i] + 1].value);
+            }
+
+            auto checkedTokens = tokens;
+            import(checkedTokens, loader);
+            const Context context(checkedTokens);
+
+            // the imported declarations come first
+            auto iterator = checkedTokens.cbegin();
+            const auto ownTokens = checkedTokens.cend() - static_cast<std::ptrdiff_t>(tokens.size() - directives.size() * 3);
+            const auto& declarations = context.getDeclarations();
+
+            bytes = {'O', 'S', 'L', 'M'};
+            write(bytes, version);
+            write(bytes, static_cast<std::uint32_t>(imports.size()));
+            for (const auto& name : imports)
+                write(bytes, name);
+
+            std::vector<std::pair<const Declaration*, std::size_t>> exported;
+            for (std::size_t i = 0; i < declarations.size(); ++i)
+            {
+                const auto tokenCount = context.getTokenCount(i);
+                if (iterator >= ownTokens)
+                    exported.emplace_back(declarations[i], tokenCount);
+                iterator += static_cast<std::ptrdiff_t>(tokenCount);
+            }
+
+            write(bytes, static_cast<std::uint32_t>(exported.size()));
+            iterator = ownTokens;
+            for (const auto& declaration : exported)
+            {
+                if (!isExportable(*declaration.first))
+                    throw std::runtime_error{"Only struct and function declarations can be in a module: " + declaration.first->name};
+
+                write(bytes, declaration.first->name);
+                write(bytes, static_cast<std::uint32_t>(declaration.first->declarationKind));
+                write(bytes, static_cast<std::uint32_t>(declaration.second));
+                addSymbol(declaration.first->name, declaration.first->declarationKind,
+                          static_cast<std::uint32_t>(declaration.second), bytes.size());
+
+                for (std::size_t i = 0; i < declaration.second; ++i, ++iterator)
+                {
+                    write(bytes, static_cast<std::uint32_t>(iterator->type));
+                    write(bytes, iterator->value);
+                }
+            }
+        }
+
+        [[nodiscard]] const std::vector<std::string>& getImports() const noexcept { return imports; }
+        [[nodiscard]] const std::vector<Symbol>& getSymbols() const noexcept { return symbols; }
+
+        // the file the module was loaded from
+        [[nodiscard]] const std::string& getPath() const noexcept { return path; }
+
+        [[nodiscard]] const std::vector<std::uint8_t>& serialize() const noexcept { return bytes; }
+
+        // only the names of the symbols are read, their tokens are decoded when they are imported
+        static Module deserialize(const std::vector<std::uint8_t>& data)
+        {
+            if (data.size() < 8 || data[0] != 'O' || data[1] != 'S' || data[2] != 'L' || data[3] != 'M')
+                throw std::runtime_error{"Invalid module"};
+
+            std::size_t position = 4;
+            if (readInteger(data, position) != version)
+                throw std::runtime_error{"Unsupported module version"};
+
+            Module result;
+
+            result.imports.resize(readCount(data, position, 4));
+            for (auto& name : result.imports)
+                name = readString(data, position);
+
+            const auto symbolCount = readCount(data, position, 12);
+            for (std::uint32_t i = 0; i < symbolCount; ++i)
+            {
+                const auto name = readString(data, position);
+                const auto kind = readInteger(data, position);
+                if (kind != static_cast<std::uint32_t>(Declaration::Kind::Type) &&
+                    kind != static_cast<std::uint32_t>(Declaration::Kind::Callable))
+                    throw std::runtime_error{"Invalid module"};
+
+                const auto tokenCount = readCount(data, position, 8);
+                result.addSymbol(name, static_cast<Declaration::Kind>(kind), tokenCount, position);
+
+                for (std::uint32_t t = 0; t < tokenCount; ++t)
+                {
+                    if (readInteger(data, position) > static_cast<std::uint32_t>(Token::Type::Identifier))
+                        throw std::runtime_error{"Invalid module"};
+                    position += readCount(data, position, 1);
+                }
+            }
+
+            result.bytes = data;
+            return result;
+        }
+
+        static Module load(const std::string& filename)
+        {
+            std::ifstream file(filename, std::ios::binary);
+            if (!file)
+                throw std::runtime_error{"Failed to open file " + filename};
+
+            auto result = deserialize(std::vector<std::uint8_t>(std::istreambuf_iterator<char>(file),
+                                                                std::istreambuf_iterator<char>()));
+            result.path = filename;
+            return result;
+        }
+
+        // finds name.oslm in the current directory and then in the directories, the loaded modules are kept
+        // until their files change, the loader can be shared by threads
+        static Loader getFileLoader(const std::vector<std::string>& directories = std::vector<std::string>())
+        {
+            struct Cache final
+            {
+                std::mutex mutex;
+                std::map<std::string, std::pair<std::filesystem::file_time_type, std::shared_ptr<const Module>>> modules;
+            };
+
+            const auto cache = std::make_shared<Cache>();
+
+            return [directories, cache](const std::string& name) {
+                std::vector<std::filesystem::path> candidates{name + ".oslm"};
+                for (const auto& directory : directories)
+                    candidates.push_back(std::filesystem::path(directory) / (name + ".oslm"));
+
+                for (const auto& candidate : candidates)
+                {
+                    std::error_code errorCode;
+                    const auto time = std::filesystem::last_write_time(candidate, errorCode);
+                    if (errorCode) continue;
+
+                    const auto modulePath = candidate.lexically_normal().string();
+
+                    std::lock_guard<std::mutex> lock(cache->mutex);
+                    auto& module = cache->modules[modulePath];
+                    if (!module.second || module.first != time)
+                        module = std::make_pair(time, std::make_shared<const Module>(load(modulePath)));
+                    return module.second;
+                }
+
+                throw std::runtime_error{"Module not found: " + name};
+            };
+        }
+
+        // replaces the import directives with the imported declarations that the tokens use directly or through
+        // other imported declarations, they are put where the first directive was in the order of their modules
+        // and get its position, the modules imported by the imported modules are imported too,
+        // returns the imported modules
+        static std::vector<std::shared_ptr<const Module>> import(std::vector<Token>& tokens, const Loader& loader)
+        {
+            const auto directives = findImports(tokens);
+            if (directives.empty()) return {};
+
+            Imports importedModules;
+            for (const auto directive : directives)
+            {
+                const auto& token = tokens[directive];
+                if (!loader)
+                    throw SourceError{"import is not supported without a module loader", token.line, token.column};
+
+                std::vector<std::string> loading;
+                importedModules.load(tokens[directive + 1].value, loader, token, loading);
+            }
+
+            // the names used by the code and by the imported declarations
+            std::set<std::string> names;
+            std::vector<std::string> pendingNames;
+            for (const auto& token : tokens)
+                if (token.type == Token::Type::Identifier && names.insert(token.value).second)
+                    pendingNames.push_back(token.value);
+
+            std::map<std::pair<std::size_t, std::uint32_t>, std::vector<Token>> importedTokens;
+            while (!pendingNames.empty())
+            {
+                const auto name = std::move(pendingNames.back());
+                pendingNames.pop_back();
+
+                for (std::size_t m = 0; m < importedModules.modules.size(); ++m)
+                {
+                    const auto& module = *importedModules.modules[m];
+                    const auto indices = module.symbolIndices.find(name);
+                    if (indices == module.symbolIndices.end()) continue;
+
+                    for (const auto index : indices->second)
+                    {
+                        auto& symbolTokens = importedTokens[std::make_pair(m, index)];
+                        if (!symbolTokens.empty()) continue;
+
+                        module.decode(index, *importedModules.positions[m], symbolTokens);
+                        for (const auto& token : symbolTokens)
+                            if (token.type == Token::Type::Identifier && names.insert(token.value).second)
+                                pendingNames.push_back(token.value);
+                    }
+                }
+            }
+
+            std::vector<Token> result;
+            result.reserve(tokens.size());
+            result.insert(result.end(), tokens.begin(), tokens.begin() + static_cast<std::ptrdiff_t>(directives.front()));
+
+            // the map is ordered by the module and then by the symbol
+            for (auto& symbolTokens : importedTokens)
+                result.insert(result.end(),
+                              std::make_move_iterator(symbolTokens.second.begin()),
+                              std::make_move_iterator(symbolTokens.second.end()));
+
+            for (std::size_t i = directives.front(); i < tokens.size(); ++i)
+                if (tokens[i].type == Token::Type::Import)
+                    i += 2;
+                else
+                    result.push_back(std::move(tokens[i]));
+
+            tokens.swap(result);
+
+            return importedModules.modules;
+        }
+
+        // lists the imports and the symbols
+        std::string dump() const
+        {
+            std::string result;
+
+            for (const auto& name : imports)
+                result += "import " + name + '\n';
+
+            for (const auto& symbol : symbols)
+                result += (symbol.kind == Declaration::Kind::Type ? "struct " : "function ") + symbol.name +
+                    ": " + std::to_string(symbol.tokenCount) + " tokens\n";
+
+            return result;
+        }
+
+    private:
+        // the modules in the order they have to be imported in, every module comes after the modules it imports
+        struct Imports final
+        {
+            void load(const std::string& name, const Loader& loader, const Token& position,
+                      std::vector<std::string>& loading)
+            {
+                if (std::find(names.begin(), names.end(), name) != names.end()) return;
+
+                if (std::find(loading.begin(), loading.end(), name) != loading.end())
+                    throw SourceError{"Recursive import of " + name, position.line, position.column};
+
+                std::shared_ptr<const Module> module;
+                try
+                {
+                    module = loader(name);
+                }
+                catch (const std::exception& e)
+                {
+                    throw SourceError{e.what(), position.line, position.column};
+                }
+
+                if (!module)
+                    throw SourceError{"Module not found: " + name, position.line, position.column};
+
+                loading.push_back(name);
+                for (const auto& importName : module->imports)
+                    load(importName, loader, position, loading);
+                loading.pop_back();
+
+                names.push_back(name);
+                modules.push_back(module);
+                positions.push_back(&position);
+            }
+
+            std::vector<std::string> names;
+            std::vector<std::shared_ptr<const Module>> modules;
+            std::vector<const Token*> positions;
+        };
+
+        // the indices of the import keywords of the directives
+        static std::vector<std::size_t> findImports(const std::vector<Token>& tokens)
+        {
+            std::vector<std::size_t> result;
+
+            for (std::size_t i = 0; i < tokens.size(); ++i)
+                if (tokens[i].type == Token::Type::Import)
+                {
+                    if (i + 1 >= tokens.size() || tokens[i + 1].type != Token::Type::StringLiteral)
+                        throw SourceError{"Expected a module name after import", tokens[i].line, tokens[i].column};
+                    if (i + 2 >= tokens.size() || tokens[i + 2].type != Token::Type::Semicolon)
+                        throw SourceError{"Expected a semicolon after the module name", tokens[i + 1].line, tokens[i + 1].column};
+
+                    result.push_back(i);
+                    i += 2;
+                }
+
+            return result;
+        }
+
+        static bool isExportable(const Declaration& declaration) noexcept
+        {
+            if (declaration.declarationKind == Declaration::Kind::Type)
+                return true;
+
+            if (declaration.declarationKind != Declaration::Kind::Callable)
+                return false;
+
+            const auto& callableDeclaration = static_cast<const CallableDeclaration&>(declaration);
+            return callableDeclaration.callableDeclarationKind == CallableDeclaration::Kind::Function &&
+                static_cast<const FunctionDeclaration&>(callableDeclaration).qualifier == FunctionDeclaration::Qualifier::None;
+        }
+
+        void addSymbol(const std::string& name, Declaration::Kind kind, std::uint32_t tokenCount, std::size_t offset)
+        {
+            symbolIndices[name].push_back(static_cast<std::uint32_t>(symbols.size()));
+            symbols.push_back(Symbol{name, kind, tokenCount, offset});
+        }
+
+        // the tokens get the position of the import directive
+        void decode(std::uint32_t index, const Token& position, std::vector<Token>& result) const
+        {
+            const auto& symbol = symbols[index];
+            auto offset = symbol.offset;
+
+            result.resize(symbol.tokenCount);
+            for (auto& token : result)
+            {
+                token.type = static_cast<Token::Type>(readInteger(bytes, offset));
+                token.value = readString(bytes, offset);
+                token.line = position.line;
+                token.column = position.column;
+                token.length = position.length;
+            }
+        }
+
+        static void write(std::vector<std::uint8_t>& data, std::uint32_t value)
+        {
+            for (std::size_t i = 0; i < 4; ++i)
+                data.push_back(static_cast<std::uint8_t>(value >> (i * 8)));
+        }
+
+        static void write(std::vector<std::uint8_t>& data, const std::string& value)
+        {
+            write(data, static_cast<std::uint32_t>(value.size()));
+            data.insert(data.end(), value.begin(), value.end());
+        }
+
+        static std::uint32_t readInteger(const std::vector<std::uint8_t>& data, std::size_t& position)
+        {
+            if (data.size() - position < 4)
+                throw std::runtime_error{"Unexpected end of module"};
+
+            std::uint32_t result = 0;
+            for (std::size_t i = 0; i < 4; ++i)
+                result |= static_cast<std::uint32_t>(data[position++]) << (i * 8);
+            return result;
+        }
+
+        // counts are checked against the remaining data before anything is allocated
+        static std::uint32_t readCount(const std::vector<std::uint8_t>& data, std::size_t& position, std::size_t elementSize)
+        {
+            const auto count = readInteger(data, position);
+            if (count > (data.size() - position) / elementSize)
+                throw std::runtime_error{"Unexpected end of module"};
+            return count;
+        }
+
+        static std::string readString(const std::vector<std::uint8_t>& data, std::size_t& position)
+        {
+            const auto size = readCount(data, position, 1);
+            std::string result(data.begin() + static_cast<std::ptrdiff_t>(position),
+                               data.begin() + static_cast<std::ptrdiff_t>(position + size));
+            position += size;
+            return result;
+        }
+
+        std::vector<std::string> imports;
+        std::vector<Symbol> symbols;
+        std::map<std::string, std::vector<std::uint32_t>> symbolIndices;
+        std::vector<std::uint8_t> bytes;
+        std::string path;
+    };
+}
+
+#endif // MODULE_HPP
@@ -5,7 +5,12 @@
 #ifndef OUTPUT_HPP
 #define OUTPUT_HPP
 
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
 #include <string>
+#include "Layout.hpp"
+#include "Minifier.hpp"
 #include "Parser.hpp"
 
 namespace ouzel
@@ -19,17 +24,97 @@ namespace ouzel
     class Output
     {
     public:
-        explicit Output(Program initProgram):
-            program{initProgram}
+        explicit Output(Program initProgram,
+                        const Minifier* initMinifier = nullptr):
+            program{initProgram}, minifier{initMinifier}
         {
         }
 
         virtual ~Output() = default;
 
-        virtual std::string output(const Context& context, bool whitespaces) = 0;
+        // replaces the contents of the result, so that its storage is reused
+        virtual void output(const Context& context, bool whitespaces, std::string& result) = 0;
+
+        [[nodiscard]]
+        std::string output(const Context& context, bool whitespaces)
+        {
+            std::string result;
+            output(context, whitespaces, result);
+            return result;
+        }
+
+    protected:
+        // the minifier replaces the names of the declarations that are not part of the interface
+        const std::string& getName(const Declaration& declaration) const
+        {
+            return minifier ? minifier->getName(declaration) : declaration.name;
+        }
+
+        const std::string& getName(const Type& type) const
+        {
+            return minifier ? minifier->getName(type) : type.name;
+        }
+
+        // the extern variables are printed together as one buffer in place of the first of them,
+        // or after the last struct that they use if it is declared later, npos if there are none
+        static std::size_t getUniformBlockIndex(const Context& context, const Layout& uniformLayout)
+        {
+            if (uniformLayout.empty()) return std::string::npos;
+
+            const auto& declarations = context.getDeclarations();
+            std::size_t result = declarations.size();
+
+            for (std::size_t i = 0; i < declarations.size(); ++i)
+                if (isUniform(*declarations[i], uniformLayout))
+                    result = std::min(result, i);
+                else if (declarations[i]->declarationKind == Declaration::Kind::Type)
+                    for (const auto& member : uniformLayout.getMembers())
+                    {
+                        auto type = member.type;
+                        while (type->typeKind == Type::Kind::Array)
+                            type = &static_cast<const ArrayType*>(type)->elementType.type;
+
+                        if (type == &static_cast<const TypeDeclaration*>(declarations[i])->type && result < i + 1)
+                            result = i + 1;
+                    }
+
+            return result;
+        }
+
+        static bool isUniform(const Declaration& declaration, const Layout& uniformLayout) noexcept
+        {
+            for (const auto& member : uniformLayout.getMembers())
+                if (member.declaration == &declaration) return true;
+
+            return false;
+        }
+
+        // negative values are parenthesized, so that "a - -1" is not printed as "a--1"
+        static std::string formatInteger(std::int64_t value)
+        {
+            return value < 0 ? "(" + std::to_string(value) + ")" : std::to_string(value);
+        }
+
+        // prints the shortest representation that reads back as the same float
+        static std::string formatFloatingPoint(double value)
+        {
+            char buffer[32];
+
+            for (int precision = 1; precision <= 9; ++precision)
+            {
+                std::snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+                if (std::strtof(buffer, nullptr) == static_cast<float>(value)) break;
+            }
+
+            std::string result = buffer;
+            if (result.find_first_of(".e") == std::string::npos) result += ".0";
+
+            return value < 0.0 ? "(" + result + ")" : result;
+        }
 
     private:
         Program program;
+        const Minifier* minifier = nullptr;
     };
 }
 
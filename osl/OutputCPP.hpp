@@ -0,0 +1,1611 @@
+//
+//  OSL
+//
+
+#ifndef OUTPUTCPP_HPP
+#define OUTPUTCPP_HPP
+
+#include <map>
+#include <set>
+#include "Output.hpp"
+
+namespace ouzel
+{
+    // Outputs standalone C++17 for running shaders natively on the CPU,
+    // the vector and matrix types are fixed size arrays with loops over their components,
+    // which the host compiler can unroll and vectorize
+    class OutputCPP final: public Output
+    {
+    public:
+        explicit OutputCPP(Program initProgram,
+                           const std::string& initNamespaceName = "shader",
+                           const Minifier* initMinifier = nullptr):
+            Output{initProgram, initMinifier},
+            qualifier{(initProgram == Program::Fragment) ? FunctionDeclaration::Qualifier::Fragment : FunctionDeclaration::Qualifier::Vertex},
+            namespaceName{initNamespaceName}
+        {
+        }
+
+        using Output::output;
+
+        void output(const Context& context, bool whitespaces, std::string& result) override
+        {
+            result = types;
+
+            entryPoint = nullptr;
+            for (auto declaration : context.getDeclarations())
+                if (declaration->declarationKind == Declaration::Kind::Callable &&
+                    static_cast<const CallableDeclaration*>(declaration)->callableDeclarationKind == CallableDeclaration::Kind::Function &&
+                    static_cast<const FunctionDeclaration*>(declaration)->qualifier == qualifier &&
+                    static_cast<const FunctionDeclaration*>(declaration)->body)
+                    entryPoint = static_cast<const FunctionDeclaration*>(declaration);
+
+            result += "namespace " + namespaceName;
+            result += whitespaces ? "\n{\n" : "{";
+
+            for (auto declaration : context.getDeclarations())
+            {
+                // everything at namespace scope is inline, so that the output can be included in several translation units
+                if (declaration->declarationKind == Declaration::Kind::Callable ||
+                    declaration->declarationKind == Declaration::Kind::Variable)
+                    result += "inline ";
+
+                printConstruct(*declaration, Options(0, whitespaces), result);
+
+                if (declaration->declarationKind != Declaration::Kind::Callable ||
+                    !static_cast<const CallableDeclaration*>(declaration)->body) // function doesn't have a body
+                    result += ";";
+
+                if (whitespaces) result += "\n";
+            }
+
+            if (entryPoint) printRun(*entryPoint, whitespaces, result);
+
+            result += "}";
+            if (whitespaces) result += "\n";
+        }
+
+    private:
+        struct Options final
+        {
+            Options(std::uint32_t initIndentation, bool initWhitespaces, bool initLvalue = false):
+                indentation{initIndentation}, whitespaces{initWhitespaces}, lvalue{initLvalue} {}
+
+            std::uint32_t indentation = 0;
+            bool whitespaces = false;
+            bool lvalue = false; // the expression is written to
+        };
+
+        // appends an underscore to the names that are reserved in C++ or in the output
+        const std::string& getIdentifier(const std::string& name)
+        {
+            static const std::set<std::string> reserved = {
+                "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break",
+                "case", "catch", "char", "char16_t", "char32_t", "class", "compl", "const", "const_cast",
+                "constexpr", "continue", "decltype", "default", "delete", "do", "double", "dynamic_cast",
+                "else", "enum", "explicit", "export", "extern", "false", "float", "for", "friend", "goto",
+                "if", "inline", "int", "long", "mutable", "namespace", "new", "noexcept", "not", "not_eq",
+                "nullptr", "operator", "or", "or_eq", "private", "protected", "public", "register",
+                "reinterpret_cast", "return", "short", "signed", "sizeof", "static", "static_assert",
+                "static_cast", "struct", "switch", "template", "this", "thread_local", "throw", "true",
+                "try", "typedef", "typeid", "typename", "union", "unsigned", "using", "virtual", "void",
+                "volatile", "wchar_t", "while", "xor", "xor_eq", "osl", "std", "run"
+            };
+
+            if (reserved.find(name) == reserved.end() && name != namespaceName)
+                return name;
+
+            return escapedNames.emplace(name, name + "_").first->second;
+        }
+
+        std::string getTypeName(const Type& type)
+        {
+            switch (type.typeKind)
+            {
+                case Type::Kind::Array:
+                {
+                    auto& arrayType = static_cast<const ArrayType&>(type);
+                    return "std::array<" + getTypeName(arrayType.elementType.type) + ", " + std::to_string(arrayType.size) + ">";
+                }
+                case Type::Kind::Scalar:
+                    return (type.name == "uint") ? "osl::uint" : type.name;
+                case Type::Kind::Vector:
+                case Type::Kind::Matrix:
+                    return "osl::" + type.name;
+                case Type::Kind::Struct:
+                    if (type.name == "Texture2D" || type.name == "Texture2DMS")
+                        return "osl::" + type.name;
+                    return getIdentifier(getName(type));
+                case Type::Kind::Void:
+                    return "void";
+            }
+
+            throw std::runtime_error{"Unknown type"};
+        }
+
+        std::string getPrintableTypeName(const QualifiedType& qualifiedType)
+        {
+            std::string result;
+
+            if ((qualifiedType.qualifiers & Type::Qualifiers::Volatile) == Type::Qualifiers::Volatile) result += "volatile ";
+            if ((qualifiedType.qualifiers & Type::Qualifiers::Const) == Type::Qualifiers::Const) result += "const ";
+
+            return result + getTypeName(qualifiedType.type);
+        }
+
+        // integer arithmetic is printed as calls to the helpers that wrap on overflow
+        static bool isInteger(const Type& type) noexcept
+        {
+            return type.typeKind == Type::Kind::Scalar &&
+                static_cast<const ScalarType&>(type).scalarTypeKind == ScalarType::Kind::Integer;
+        }
+
+        // whether the printed expression starts with a plus or a minus, so that "a - -b" is not printed as "a--b"
+        static bool startsWithSign(const Expression& expression) noexcept
+        {
+            switch (expression.expressionKind)
+            {
+                case Expression::Kind::UnaryOperator:
+                {
+                    auto& unaryOperatorExpression = static_cast<const UnaryOperatorExpression&>(expression);
+
+                    if (isInteger(unaryOperatorExpression.qualifiedType.type)) return false;
+
+                    switch (unaryOperatorExpression.operatorKind)
+                    {
+                        case UnaryOperatorExpression::Kind::Positive:
+                        case UnaryOperatorExpression::Kind::Negative:
+                        case UnaryOperatorExpression::Kind::PrefixIncrement:
+                        case UnaryOperatorExpression::Kind::PrefixDecrement:
+                            return true;
+                        case UnaryOperatorExpression::Kind::PostfixIncrement:
+                        case UnaryOperatorExpression::Kind::PostfixDecrement:
+                            return startsWithSign(unaryOperatorExpression.expression);
+                        default:
+                            return false;
+                    }
+                }
+                case Expression::Kind::BinaryOperator:
+                {
+                    auto& binaryOperatorExpression = static_cast<const BinaryOperatorExpression&>(expression);
+                    return !isInteger(binaryOperatorExpression.qualifiedType.type) &&
+                        startsWithSign(binaryOperatorExpression.leftExpression);
+                }
+                case Expression::Kind::TernaryOperator:
+                    return startsWithSign(static_cast<const TernaryOperatorExpression&>(expression).condition);
+                case Expression::Kind::Member:
+                    return startsWithSign(static_cast<const MemberExpression&>(expression).expression);
+                case Expression::Kind::ArraySubscript:
+                    return startsWithSign(static_cast<const ArraySubscriptExpression&>(expression).expression);
+                case Expression::Kind::VectorElement:
+                    return static_cast<const VectorElementExpression&>(expression).positions.size() == 1 &&
+                        startsWithSign(static_cast<const VectorElementExpression&>(expression).expression);
+                default:
+                    return false;
+            }
+        }
+
+        static bool isDiscard(const Expression& expression) noexcept
+        {
+            if (expression.expressionKind != Expression::Kind::Call) return false;
+
+            auto& declaration = static_cast<const CallExpression&>(expression).declarationReference.declaration;
+            return declaration.declarationKind == Declaration::Kind::Callable &&
+                static_cast<const CallableDeclaration&>(declaration).callableDeclarationKind == CallableDeclaration::Kind::Function &&
+                static_cast<const FunctionDeclaration&>(declaration).isBuiltin &&
+                declaration.name == "discard";
+        }
+
+        // prints a function that runs the entry point and returns false if the invocation was discarded
+        void printRun(const FunctionDeclaration& functionDeclaration, bool whitespaces, std::string& code)
+        {
+            const auto hasResult = functionDeclaration.resultType.type.typeKind != Type::Kind::Void;
+
+            code += "inline bool run(";
+
+            std::string arguments;
+            for (auto parameter : functionDeclaration.parameterDeclarations)
+            {
+                if (!arguments.empty())
+                {
+                    code += ",";
+                    if (whitespaces) code += " ";
+                    arguments += ",";
+                    if (whitespaces) arguments += " ";
+                }
+
+                printConstruct(*parameter, Options(0, whitespaces), code);
+                arguments += getIdentifier(getName(*parameter));
+            }
+
+            if (hasResult)
+            {
+                if (!functionDeclaration.parameterDeclarations.empty())
+                {
+                    code += ",";
+                    if (whitespaces) code += " ";
+                }
+
+                code += getPrintableTypeName(functionDeclaration.resultType) + "& result";
+            }
+
+            code += ")";
+            if (whitespaces) code += "\n";
+            code += "{";
+            if (whitespaces) code += "\n    ";
+            code += whitespaces ? "osl::discarded = false;" : "osl::discarded=false;";
+            if (whitespaces) code += "\n    ";
+            code += "try";
+            if (whitespaces) code += "\n    ";
+            code += "{";
+            if (whitespaces) code += "\n        ";
+            if (hasResult) code += whitespaces ? "result = " : "result=";
+            code += getIdentifier(getName(functionDeclaration)) + "(" + arguments + ");";
+            if (whitespaces) code += "\n    ";
+            code += "}";
+            if (whitespaces) code += "\n    ";
+            code += "catch";
+            if (whitespaces) code += " ";
+            code += "(const osl::Discard&)";
+            if (whitespaces) code += "\n    ";
+            code += "{";
+            if (whitespaces) code += "\n        ";
+            code += "return false;";
+            if (whitespaces) code += "\n    ";
+            code += "}";
+            if (whitespaces) code += "\n    ";
+            code += "return !osl::discarded;";
+            if (whitespaces) code += "\n";
+            code += "}";
+            if (whitespaces) code += "\n";
+        }
+
+        void printArguments(const std::vector<ExpressionRef>& arguments, Options options, std::string& code)
+        {
+            bool firstParameter = true;
+
+            for (auto& argument : arguments)
+            {
+                if (!firstParameter)
+                {
+                    code += ",";
+                    if (options.whitespaces) code += " ";
+                }
+
+                firstParameter = false;
+
+                printConstruct(argument, Options(0, options.whitespaces), code);
+            }
+        }
+
+        void printDeclaration(const Declaration& declaration, Options options, std::string& code)
+        {
+            switch (declaration.declarationKind)
+            {
+                case Declaration::Kind::Type:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& typeDeclaration = static_cast<const TypeDeclaration&>(declaration);
+                    auto& type = typeDeclaration.type;
+
+                    if (type.typeKind != Type::Kind::Struct)
+                        throw std::runtime_error{"Type declaration must be a struct"};
+
+                    auto& structType = static_cast<const StructType&>(type);
+                    code += "struct " + getTypeName(structType);
+
+                    if (options.whitespaces) code += "\n";
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+                    code += "{";
+                    if (options.whitespaces) code += "\n";
+
+                    for (auto& memberDeclaration : structType.memberDeclarations)
+                    {
+                        printConstruct(memberDeclaration, Options(options.indentation + 4, options.whitespaces), code);
+
+                        code += ";";
+                        if (options.whitespaces) code += "\n";
+                    }
+
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+                    code += "}";
+
+                    break;
+                }
+
+                case Declaration::Kind::Field:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& fieldDeclaration = static_cast<const FieldDeclaration&>(declaration);
+
+                    // the fields are zero initialized like in the interpreter
+                    code += getPrintableTypeName(fieldDeclaration.qualifiedType) + " " + getIdentifier(getName(fieldDeclaration)) + "{}";
+
+                    break;
+                }
+
+                case Declaration::Kind::Callable:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& callableDeclaration = static_cast<const CallableDeclaration&>(declaration);
+
+                    if (callableDeclaration.callableDeclarationKind == CallableDeclaration::Kind::Function)
+                    {
+                        auto& functionDeclaration = static_cast<const FunctionDeclaration&>(callableDeclaration);
+
+                        code += getPrintableTypeName(functionDeclaration.resultType) + " " + getIdentifier(getName(functionDeclaration)) + "(";
+
+                        bool firstParameter = true;
+
+                        for (auto parameter : functionDeclaration.parameterDeclarations)
+                        {
+                            if (!firstParameter)
+                            {
+                                code += ",";
+                                if (options.whitespaces) code += " ";
+                            }
+
+                            firstParameter = false;
+
+                            printConstruct(*parameter, Options(0, options.whitespaces), code);
+                        }
+
+                        code += ")";
+
+                        if (functionDeclaration.body)
+                        {
+                            if (options.whitespaces) code += "\n";
+
+                            const auto previousFunction = currentFunction;
+                            currentFunction = &functionDeclaration;
+                            printFunctionBody(functionDeclaration, options, code);
+                            currentFunction = previousFunction;
+                        }
+                    }
+
+                    break;
+                }
+
+                case Declaration::Kind::Variable:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& variableDeclaration = static_cast<const VariableDeclaration&>(declaration);
+
+                    code += getPrintableTypeName(variableDeclaration.qualifiedType) + " " + getIdentifier(getName(variableDeclaration));
+
+                    if (variableDeclaration.initialization)
+                    {
+                        if (options.whitespaces) code += " ";
+                        code += "=";
+                        if (options.whitespaces) code += " ";
+                        printConstruct(*variableDeclaration.initialization, Options(0, options.whitespaces), code);
+                    }
+                    else
+                        code += "{}";
+
+                    break;
+                }
+
+                case Declaration::Kind::Parameter:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& parameterDeclaration = static_cast<const ParameterDeclaration&>(declaration);
+
+                    // out and inout parameters are references to the arguments
+                    code += getPrintableTypeName(parameterDeclaration.qualifiedType);
+                    if (parameterDeclaration.inputModifier != InputModifier::In) code += "&";
+                    code += " " + getIdentifier(getName(parameterDeclaration));
+                    break;
+                }
+            }
+        }
+
+        // out parameters start as zero like in the interpreter
+        void printFunctionBody(const FunctionDeclaration& functionDeclaration, Options options, std::string& code)
+        {
+            if (functionDeclaration.body->statementKind != Statement::Kind::Compound)
+            {
+                printConstruct(*functionDeclaration.body, options, code);
+                return;
+            }
+
+            auto& compoundStatement = static_cast<const CompoundStatement&>(*functionDeclaration.body);
+
+            if (options.whitespaces) code.append(options.indentation, ' ');
+            code += "{";
+            if (options.whitespaces) code += "\n";
+
+            for (auto parameter : functionDeclaration.parameterDeclarations)
+                if (parameter->inputModifier == InputModifier::Out)
+                {
+                    if (options.whitespaces) code.append(options.indentation + 4, ' ');
+                    code += getIdentifier(getName(*parameter));
+                    code += options.whitespaces ? " = " : "=";
+                    code += getTypeName(parameter->qualifiedType.type) + "{};";
+                    if (options.whitespaces) code += "\n";
+                }
+
+            for (auto& subStatement : compoundStatement.statements)
+            {
+                printConstruct(subStatement, Options(options.indentation + 4, options.whitespaces), code);
+                if (options.whitespaces) code += "\n";
+            }
+
+            if (options.whitespaces) code.append(options.indentation, ' ');
+            code += "}";
+        }
+
+        bool endsWithJump(const Statement& statement) const
+        {
+            switch (statement.statementKind)
+            {
+                case Statement::Kind::Break:
+                case Statement::Kind::Continue:
+                case Statement::Kind::Return:
+                    return true;
+                case Statement::Kind::Expression:
+                    return currentFunction && currentFunction == entryPoint &&
+                        isDiscard(static_cast<const ExpressionStatement&>(statement).expression);
+                case Statement::Kind::Compound:
+                {
+                    auto& statements = static_cast<const CompoundStatement&>(statement).statements;
+                    return !statements.empty() && endsWithJump(statements.back());
+                }
+                case Statement::Kind::Case:
+                    return endsWithJump(static_cast<const CaseStatement&>(statement).body);
+                case Statement::Kind::Default:
+                    return endsWithJump(static_cast<const DefaultStatement&>(statement).body);
+                default:
+                    return false;
+            }
+        }
+
+        void printStatement(const Statement& statement, Options options, std::string& code)
+        {
+            switch (statement.statementKind)
+            {
+                case Statement::Kind::Empty:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+                    code += ";";
+                    break;
+                }
+
+                case Statement::Kind::Expression:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& expressionStatement = static_cast<const ExpressionStatement&>(statement);
+
+                    // a discard in the entry point returns instead of throwing
+                    if (currentFunction && currentFunction == entryPoint && isDiscard(expressionStatement.expression))
+                    {
+                        code += "{";
+                        if (options.whitespaces) code += " ";
+                        code += options.whitespaces ? "osl::discarded = true;" : "osl::discarded=true;";
+                        if (options.whitespaces) code += " ";
+                        code += (currentFunction->resultType.type.typeKind == Type::Kind::Void) ? "return;" : "return {};";
+                        if (options.whitespaces) code += " ";
+                        code += "}";
+                        break;
+                    }
+
+                    printConstruct(expressionStatement.expression, Options(0, options.whitespaces), code);
+
+                    code += ";";
+                    break;
+                }
+
+                case Statement::Kind::Declaration:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& declarationStatement = static_cast<const DeclarationStatement&>(statement);
+                    printConstruct(declarationStatement.declaration, Options(0, options.whitespaces), code);
+
+                    code += ";";
+                    break;
+                }
+
+                case Statement::Kind::Compound:
+                {
+                    auto& compoundStatement = static_cast<const CompoundStatement&>(statement);
+
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+                    code += "{";
+                    if (options.whitespaces) code += "\n";
+
+                    const Statement* previousStatement = nullptr;
+                    for (const Statement& subStatement : compoundStatement.statements)
+                    {
+                        // a case that does not end with a jump falls through to the next label on purpose
+                        if ((subStatement.statementKind == Statement::Kind::Case ||
+                             subStatement.statementKind == Statement::Kind::Default) &&
+                            previousStatement && !endsWithJump(*previousStatement))
+                        {
+                            if (options.whitespaces) code.append(options.indentation + 4, ' ');
+                            code += "[[fallthrough]];";
+                            if (options.whitespaces) code += "\n";
+                        }
+
+                        printConstruct(subStatement, Options(options.indentation + 4, options.whitespaces), code);
+                        if (options.whitespaces) code += "\n";
+
+                        previousStatement = &subStatement;
+                    }
+
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+                    code += "}";
+                    break;
+                }
+
+                case Statement::Kind::If:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& ifStatement = static_cast<const IfStatement&>(statement);
+                    code += "if";
+                    if (options.whitespaces) code += " ";
+                    code += "(";
+
+                    printConstruct(ifStatement.condition, Options(0, options.whitespaces), code);
+
+                    code += ")";
+                    if (options.whitespaces) code += "\n";
+
+                    if (ifStatement.body.statementKind == Statement::Kind::Compound)
+                        printConstruct(ifStatement.body, options, code);
+                    else
+                        printConstruct(ifStatement.body, Options(options.indentation + 4, options.whitespaces), code);
+
+                    if (ifStatement.elseBody)
+                    {
+                        if (options.whitespaces) code += "\n";
+                        if (options.whitespaces) code.append(options.indentation, ' ');
+                        code += "else";
+                        code += options.whitespaces ? "\n" : " ";
+
+                        if (ifStatement.elseBody->statementKind == Statement::Kind::Compound)
+                            printConstruct(*ifStatement.elseBody, options, code);
+                        else
+                            printConstruct(*ifStatement.elseBody, Options(options.indentation + 4, options.whitespaces), code);
+                    }
+                    break;
+                }
+
+                case Statement::Kind::For:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& forStatement = static_cast<const ForStatement&>(statement);
+                    code += "for";
+                    if (options.whitespaces) code += " ";
+                    code += "(";
+
+                    if (forStatement.initialization)
+                        printConstruct(*forStatement.initialization, Options(0, options.whitespaces), code);
+
+                    code += ";";
+                    if (options.whitespaces) code += " ";
+
+                    if (forStatement.condition)
+                        printConstruct(*forStatement.condition, Options(0, options.whitespaces), code);
+
+                    code += ";";
+                    if (options.whitespaces) code += " ";
+
+                    if (forStatement.increment)
+                        printConstruct(*forStatement.increment, Options(0, options.whitespaces), code);
+
+                    code += ")";
+                    if (options.whitespaces) code += "\n";
+
+                    if (forStatement.body.statementKind == Statement::Kind::Compound)
+                        printConstruct(forStatement.body, options, code);
+                    else
+                        printConstruct(forStatement.body, Options(options.indentation + 4, options.whitespaces), code);
+                    break;
+                }
+
+                case Statement::Kind::Switch:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& switchStatement = static_cast<const SwitchStatement&>(statement);
+                    code += "switch";
+                    if (options.whitespaces) code += " ";
+                    code += "(";
+
+                    printConstruct(switchStatement.condition, Options(0, options.whitespaces), code);
+
+                    code += ")";
+                    if (options.whitespaces) code += "\n";
+
+                    if (switchStatement.body.statementKind == Statement::Kind::Compound)
+                        printConstruct(switchStatement.body, options, code);
+                    else
+                        printConstruct(switchStatement.body, Options(options.indentation + 4, options.whitespaces), code);
+
+                    break;
+                }
+
+                case Statement::Kind::Case:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& caseStatement = static_cast<const CaseStatement&>(statement);
+                    code += "case ";
+
+                    printConstruct(caseStatement.condition, Options(0, options.whitespaces), code);
+
+                    code += ":";
+                    if (options.whitespaces) code += "\n";
+
+                    if (caseStatement.body.statementKind == Statement::Kind::Compound)
+                        printConstruct(caseStatement.body, options, code);
+                    else
+                        printConstruct(caseStatement.body, Options(options.indentation + 4, options.whitespaces), code);
+
+                    break;
+                }
+
+                case Statement::Kind::Default:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& defaultStatement = static_cast<const DefaultStatement&>(statement);
+                    code += "default:";
+                    if (options.whitespaces) code += "\n";
+
+                    if (defaultStatement.body.statementKind == Statement::Kind::Compound)
+                        printConstruct(defaultStatement.body, options, code);
+                    else
+                        printConstruct(defaultStatement.body, Options(options.indentation + 4, options.whitespaces), code);
+
+                    break;
+                }
+
+                case Statement::Kind::While:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& whileStatement = static_cast<const WhileStatement&>(statement);
+                    code += "while";
+                    if (options.whitespaces) code += " ";
+                    code += "(";
+
+                    printConstruct(whileStatement.condition, Options(0, options.whitespaces), code);
+
+                    code += ")";
+                    if (options.whitespaces) code += "\n";
+
+                    if (whileStatement.body.statementKind == Statement::Kind::Compound)
+                        printConstruct(whileStatement.body, options, code);
+                    else
+                        printConstruct(whileStatement.body, Options(options.indentation + 4, options.whitespaces), code);
+                    break;
+                }
+
+                case Statement::Kind::Do:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& doStatement = static_cast<const DoStatement&>(statement);
+                    code += "do";
+                    if (options.whitespaces) code += "\n";
+
+                    if (doStatement.body.statementKind == Statement::Kind::Compound)
+                        printConstruct(doStatement.body, options, code);
+                    else
+                    {
+                        if (!options.whitespaces) code += " ";
+                        printConstruct(doStatement.body, Options(options.indentation + 4, options.whitespaces), code);
+                    }
+
+                    if (options.whitespaces) code += "\n";
+
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+                    code += "while";
+                    if (options.whitespaces) code += " ";
+                    code += "(";
+
+                    printConstruct(doStatement.condition, Options(0, options.whitespaces), code);
+
+                    code += ");";
+
+                    break;
+                }
+
+                case Statement::Kind::Break:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+                    code += "break;";
+                    break;
+                }
+
+                case Statement::Kind::Continue:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+                    code += "continue;";
+                    break;
+                }
+
+                case Statement::Kind::Return:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& returnStatement = static_cast<const ReturnStatement&>(statement);
+                    code += "return";
+
+                    if (returnStatement.result)
+                    {
+                        code += " ";
+                        printConstruct(*returnStatement.result, Options(0, options.whitespaces), code);
+                    }
+
+                    code += ";";
+                    break;
+                }
+            }
+        }
+
+        void printExpression(const Expression& expression, Options options, std::string& code)
+        {
+            switch (expression.expressionKind)
+            {
+                case Expression::Kind::Call:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& callExpression = static_cast<const CallExpression&>(expression);
+                    auto& declaration = callExpression.declarationReference.declaration;
+
+                    if (declaration.declarationKind != Declaration::Kind::Callable)
+                        throw std::runtime_error{"Invalid call"};
+
+                    auto& callableDeclaration = static_cast<const CallableDeclaration&>(declaration);
+
+                    if (callableDeclaration.callableDeclarationKind == CallableDeclaration::Kind::Function &&
+                        static_cast<const FunctionDeclaration&>(callableDeclaration).isBuiltin)
+                    {
+                        code += "osl::" + declaration.name + "(";
+                        printArguments(callExpression.arguments, options, code);
+                        code += ")";
+                        break;
+                    }
+
+                    printConstruct(callExpression.declarationReference, Options(0, options.whitespaces), code);
+
+                    code += "(";
+
+                    // the arguments of out and inout parameters are bound to references
+                    auto definition = static_cast<const CallableDeclaration*>(declaration.definition);
+                    if (!definition) definition = &callableDeclaration;
+
+                    for (std::size_t i = 0; i < callExpression.arguments.size(); ++i)
+                    {
+                        if (i > 0)
+                        {
+                            code += ",";
+                            if (options.whitespaces) code += " ";
+                        }
+
+                        const Expression& argument = callExpression.arguments[i];
+                        const auto reference = i < definition->parameterDeclarations.size() &&
+                            definition->parameterDeclarations[i]->inputModifier != InputModifier::In;
+
+                        if (reference &&
+                            argument.expressionKind == Expression::Kind::VectorElement &&
+                            static_cast<const VectorElementExpression&>(argument).positions.size() > 1)
+                            throw std::runtime_error{"Swizzle with several components can not be passed to an out parameter"};
+
+                        printConstruct(argument, Options(0, options.whitespaces, reference), code);
+                    }
+
+                    code += ")";
+                    break;
+                }
+
+                case Expression::Kind::Literal:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& literalExpression = static_cast<const LiteralExpression&>(expression);
+
+                    switch (literalExpression.literalKind)
+                    {
+                        case LiteralExpression::Kind::Boolean:
+                        {
+                            auto& booleanLiteralExpression = static_cast<const BooleanLiteralExpression&>(literalExpression);
+                            code += (booleanLiteralExpression.value ? "true" : "false");
+                            break;
+                        }
+                        case LiteralExpression::Kind::Integer:
+                        {
+                            auto& integerLiteralExpression = static_cast<const IntegerLiteralExpression&>(literalExpression);
+                            code += formatInteger(integerLiteralExpression.value);
+                            break;
+                        }
+                        case LiteralExpression::Kind::FloatingPoint:
+                        {
+                            // single precision literals, the negative ones are parenthesized
+                            auto& floatingPointLiteralExpression = static_cast<const FloatingPointLiteralExpression&>(literalExpression);
+                            auto value = formatFloatingPoint(floatingPointLiteralExpression.value);
+                            value.insert(value.back() == ')' ? value.size() - 1 : value.size(), 1, 'f');
+                            code += value;
+                            break;
+                        }
+                        case LiteralExpression::Kind::String:
+                        {
+                            auto& stringLiteralExpression = static_cast<const StringLiteralExpression&>(literalExpression);
+                            code += stringLiteralExpression.value;
+                            break;
+                        }
+                    }
+                    break;
+                }
+
+                case Expression::Kind::DeclarationReference:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& declarationReferenceExpression = static_cast<const DeclarationReferenceExpression&>(expression);
+                    auto& declaration = declarationReferenceExpression.declaration;
+
+                    switch (declaration.declarationKind)
+                    {
+                        case Declaration::Kind::Callable:
+                        case Declaration::Kind::Variable:
+                        case Declaration::Kind::Parameter:
+                            code += getIdentifier(getName(declaration));
+                            break;
+                        default:
+                            throw std::runtime_error{"Unknown declaration type"};
+                    }
+
+                    break;
+                }
+
+                case Expression::Kind::Paren:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& parenExpression = static_cast<const ParenExpression&>(expression);
+                    code += "(";
+
+                    printConstruct(parenExpression.expression, Options(0, options.whitespaces, options.lvalue), code);
+
+                    code += ")";
+                    break;
+                }
+
+                case Expression::Kind::Member:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& memberExpression = static_cast<const MemberExpression&>(expression);
+
+                    printConstruct(memberExpression.expression, Options(0, options.whitespaces), code);
+
+                    code += ".";
+
+                    code += getIdentifier(getName(memberExpression.fieldDeclaration));
+
+                    break;
+                }
+
+                case Expression::Kind::ArraySubscript:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& arraySubscriptExpression = static_cast<const ArraySubscriptExpression&>(expression);
+
+                    printConstruct(arraySubscriptExpression.expression, Options(0, options.whitespaces), code);
+
+                    code += "[";
+
+                    printConstruct(arraySubscriptExpression.subscript, Options(0, options.whitespaces), code);
+
+                    code += "]";
+
+                    break;
+                }
+
+                case Expression::Kind::UnaryOperator:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& unaryOperatorExpression = static_cast<const UnaryOperatorExpression&>(expression);
+
+                    if (isInteger(unaryOperatorExpression.qualifiedType.type))
+                    {
+                        switch (unaryOperatorExpression.operatorKind)
+                        {
+                            case UnaryOperatorExpression::Kind::Negative: code += "osl::negate("; break;
+                            case UnaryOperatorExpression::Kind::PrefixIncrement: code += "osl::preIncrement("; break;
+                            case UnaryOperatorExpression::Kind::PrefixDecrement: code += "osl::preDecrement("; break;
+                            case UnaryOperatorExpression::Kind::PostfixIncrement: code += "osl::postIncrement("; break;
+                            case UnaryOperatorExpression::Kind::PostfixDecrement: code += "osl::postDecrement("; break;
+                            default: code += "("; break;
+                        }
+
+                        if (unaryOperatorExpression.operatorKind == UnaryOperatorExpression::Kind::Negation) code += "!";
+                        printConstruct(unaryOperatorExpression.expression, Options(0, options.whitespaces, true), code);
+                        code += ")";
+                        break;
+                    }
+
+                    switch (unaryOperatorExpression.operatorKind)
+                    {
+                        case UnaryOperatorExpression::Kind::Negation: code += "!"; break;
+                        case UnaryOperatorExpression::Kind::Positive: code += "+"; break;
+                        case UnaryOperatorExpression::Kind::Negative: code += "-"; break;
+                        case UnaryOperatorExpression::Kind::PrefixIncrement: code += "++"; break;
+                        case UnaryOperatorExpression::Kind::PrefixDecrement: code += "--"; break;
+                        case UnaryOperatorExpression::Kind::PostfixIncrement: break;
+                        case UnaryOperatorExpression::Kind::PostfixDecrement: break;
+                        default:
+                            throw std::runtime_error{"Unknown operator"};
+                    }
+
+                    if ((unaryOperatorExpression.operatorKind == UnaryOperatorExpression::Kind::Positive ||
+                         unaryOperatorExpression.operatorKind == UnaryOperatorExpression::Kind::Negative) &&
+                        startsWithSign(unaryOperatorExpression.expression))
+                        code += " ";
+
+                    printConstruct(unaryOperatorExpression.expression,
+                                   Options(0, options.whitespaces,
+                                           unaryOperatorExpression.operatorKind != UnaryOperatorExpression::Kind::Negation &&
+                                           unaryOperatorExpression.operatorKind != UnaryOperatorExpression::Kind::Positive &&
+                                           unaryOperatorExpression.operatorKind != UnaryOperatorExpression::Kind::Negative), code);
+
+                    if (unaryOperatorExpression.operatorKind == UnaryOperatorExpression::Kind::PostfixIncrement)
+                        code += "++";
+                    else if (unaryOperatorExpression.operatorKind == UnaryOperatorExpression::Kind::PostfixDecrement)
+                        code += "--";
+                    break;
+                }
+
+                case Expression::Kind::BinaryOperator:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& binaryOperatorExpression = static_cast<const BinaryOperatorExpression&>(expression);
+
+                    if (isInteger(binaryOperatorExpression.qualifiedType.type) &&
+                        printIntegerOperator(binaryOperatorExpression, options, code))
+                        break;
+
+                    if (binaryOperatorExpression.operatorKind == BinaryOperatorExpression::Kind::Subscript)
+                    {
+                        printConstruct(binaryOperatorExpression.leftExpression, Options(0, options.whitespaces, options.lvalue), code);
+                        code += "[";
+                        printConstruct(binaryOperatorExpression.rightExpression, Options(0, options.whitespaces), code);
+                        code += "]";
+                        break;
+                    }
+
+                    const auto assignment =
+                        binaryOperatorExpression.operatorKind == BinaryOperatorExpression::Kind::Assignment ||
+                        binaryOperatorExpression.operatorKind == BinaryOperatorExpression::Kind::AdditionAssignment ||
+                        binaryOperatorExpression.operatorKind == BinaryOperatorExpression::Kind::SubtractAssignment ||
+                        binaryOperatorExpression.operatorKind == BinaryOperatorExpression::Kind::MultiplicationAssignment ||
+                        binaryOperatorExpression.operatorKind == BinaryOperatorExpression::Kind::DivisionAssignment;
+
+                    printConstruct(binaryOperatorExpression.leftExpression, Options(0, options.whitespaces, assignment), code);
+
+                    if (options.whitespaces &&
+                        binaryOperatorExpression.operatorKind != BinaryOperatorExpression::Kind::Comma) code += " ";
+
+                    switch (binaryOperatorExpression.operatorKind)
+                    {
+                        case BinaryOperatorExpression::Kind::Addition: code += "+"; break;
+                        case BinaryOperatorExpression::Kind::Subtraction: code += "-"; break;
+                        case BinaryOperatorExpression::Kind::Multiplication: code += "*"; break;
+                        case BinaryOperatorExpression::Kind::Division: code += "/"; break;
+                        case BinaryOperatorExpression::Kind::AdditionAssignment: code += "+="; break;
+                        case BinaryOperatorExpression::Kind::SubtractAssignment: code += "-="; break;
+                        case BinaryOperatorExpression::Kind::MultiplicationAssignment: code += "*="; break;
+                        case BinaryOperatorExpression::Kind::DivisionAssignment: code += "/="; break;
+                        case BinaryOperatorExpression::Kind::LessThan: code += "<"; break;
+                        case BinaryOperatorExpression::Kind::LessThanEqual: code += "<="; break;
+                        case BinaryOperatorExpression::Kind::GreaterThan: code += ">"; break;
+                        case BinaryOperatorExpression::Kind::GraterThanEqual: code += ">="; break;
+                        case BinaryOperatorExpression::Kind::Equality: code += "=="; break;
+                        case BinaryOperatorExpression::Kind::Inequality: code += "!="; break;
+                        case BinaryOperatorExpression::Kind::Assignment: code += "="; break;
+                        case BinaryOperatorExpression::Kind::Or: code += "||"; break;
+                        case BinaryOperatorExpression::Kind::And: code += "&&"; break;
+                        case BinaryOperatorExpression::Kind::Comma: code += ","; break;
+                        default:
+                            throw std::runtime_error{"Unknown operator"};
+                    }
+
+                    if (options.whitespaces ||
+                        ((binaryOperatorExpression.operatorKind == BinaryOperatorExpression::Kind::Addition ||
+                          binaryOperatorExpression.operatorKind == BinaryOperatorExpression::Kind::Subtraction) &&
+                         startsWithSign(binaryOperatorExpression.rightExpression)))
+                        code += " ";
+
+                    printConstruct(binaryOperatorExpression.rightExpression,
+                                   Options(0, options.whitespaces,
+                                           options.lvalue && binaryOperatorExpression.operatorKind == BinaryOperatorExpression::Kind::Comma), code);
+                    break;
+                }
+
+                case Expression::Kind::TernaryOperator:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& ternaryOperatorExpression = static_cast<const TernaryOperatorExpression&>(expression);
+
+                    printConstruct(ternaryOperatorExpression.condition, Options(0, options.whitespaces), code);
+
+                    if (options.whitespaces) code += " ";
+                    code += "?";
+                    if (options.whitespaces) code += " ";
+
+                    printConstruct(ternaryOperatorExpression.leftExpression, Options(0, options.whitespaces, options.lvalue), code);
+
+                    if (options.whitespaces) code += " ";
+                    code += ":";
+                    if (options.whitespaces) code += " ";
+
+                    printConstruct(ternaryOperatorExpression.rightExpression, Options(0, options.whitespaces, options.lvalue), code);
+                    break;
+                }
+
+                case Expression::Kind::TemporaryObject:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& temporaryObjectExpression = static_cast<const TemporaryObjectExpression&>(expression);
+
+                    auto& type = temporaryObjectExpression.qualifiedType.type;
+
+                    if (type.typeKind != Type::Kind::Struct)
+                        throw std::runtime_error{"Temporary object must be a struct"};
+
+                    // the parameters initialize the fields in order
+                    code += getTypeName(type) + "{";
+                    printArguments(temporaryObjectExpression.parameters, options, code);
+                    code += "}";
+
+                    break;
+                }
+
+                case Expression::Kind::InitializerList:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& initializerListExpression = static_cast<const InitializerListExpression&>(expression);
+
+                    code += "{";
+                    printArguments(initializerListExpression.expressions, options, code);
+                    code += "}";
+
+                    break;
+                }
+
+                case Expression::Kind::Cast:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& castExpression = static_cast<const CastExpression&>(expression);
+                    auto& type = castExpression.qualifiedType.type;
+
+                    // scalar conversions follow the rules of the interpreter instead of the ones of C++
+                    if (type.typeKind == Type::Kind::Scalar)
+                        code += "osl::convert<" + getTypeName(type) + ">(";
+                    else
+                        code += getTypeName(type) + "(";
+
+                    printConstruct(castExpression.expression, Options(0, options.whitespaces), code);
+                    code += ")";
+
+                    break;
+                }
+                case Expression::Kind::VectorInitialize:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& vectorInitializeExpression = static_cast<const VectorInitializeExpression&>(expression);
+
+                    code += getTypeName(vectorInitializeExpression.qualifiedType.type) + "(";
+                    printArguments(vectorInitializeExpression.parameters, options, code);
+                    code += ")";
+
+                    break;
+                }
+                case Expression::Kind::VectorElement:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& vectorElementExpression = static_cast<const VectorElementExpression&>(expression);
+
+                    // a single component is a subscript, several ones are a copy or,
+                    // when written to, a reference to the components
+                    if (vectorElementExpression.positions.size() == 1)
+                    {
+                        printConstruct(vectorElementExpression.expression, Options(0, options.whitespaces, options.lvalue), code);
+                        code += "[" + std::to_string(vectorElementExpression.positions[0]) + "]";
+                        break;
+                    }
+
+                    code += options.lvalue ? "osl::swizzleReference<" : "osl::swizzle<";
+
+                    for (std::size_t i = 0; i < vectorElementExpression.positions.size(); ++i)
+                    {
+                        if (i > 0) code += ",";
+                        code += std::to_string(vectorElementExpression.positions[i]);
+                    }
+
+                    code += ">(";
+                    printConstruct(vectorElementExpression.expression, Options(0, options.whitespaces, options.lvalue), code);
+                    code += ")";
+
+                    break;
+                }
+                case Expression::Kind::MatrixInitialize:
+                {
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& matrixInitializeExpression = static_cast<const MatrixInitializeExpression&>(expression);
+
+                    code += getTypeName(matrixInitializeExpression.qualifiedType.type) + "(";
+                    printArguments(matrixInitializeExpression.parameters, options, code);
+                    code += ")";
+
+                    break;
+                }
+            }
+        }
+
+        // prints the integer arithmetic as calls to the helpers that wrap instead of overflowing
+        // and return zero when dividing by zero, returns false for the other operators
+        bool printIntegerOperator(const BinaryOperatorExpression& binaryOperatorExpression, Options options, std::string& code)
+        {
+            std::string function;
+
+            switch (binaryOperatorExpression.operatorKind)
+            {
+                case BinaryOperatorExpression::Kind::Addition: function = "add"; break;
+                case BinaryOperatorExpression::Kind::Subtraction: function = "subtract"; break;
+                case BinaryOperatorExpression::Kind::Multiplication: function = "multiply"; break;
+                case BinaryOperatorExpression::Kind::Division: function = "divide"; break;
+                case BinaryOperatorExpression::Kind::AdditionAssignment: function = "addAssign"; break;
+                case BinaryOperatorExpression::Kind::SubtractAssignment: function = "subtractAssign"; break;
+                case BinaryOperatorExpression::Kind::MultiplicationAssignment: function = "multiplyAssign"; break;
+                case BinaryOperatorExpression::Kind::DivisionAssignment: function = "divideAssign"; break;
+                default: return false;
+            }
+
+            const auto assignment = function.size() > 6 && function.compare(function.size() - 6, 6, "Assign") == 0;
+
+            code += "osl::" + function;
+            if (!assignment) code += "<" + getTypeName(binaryOperatorExpression.qualifiedType.type) + ">";
+            code += "(";
+            printConstruct(binaryOperatorExpression.leftExpression, Options(0, options.whitespaces, assignment), code);
+            code += ",";
+            if (options.whitespaces) code += " ";
+            printConstruct(binaryOperatorExpression.rightExpression, Options(0, options.whitespaces), code);
+            code += ")";
+
+            return true;
+        }
+
+        void printConstruct(const Construct& construct, Options options, std::string& code)
+        {
+            switch (construct.kind)
+            {
+                case Construct::Kind::Declaration:
+                {
+                    auto& declaration = static_cast<const Declaration&>(construct);
+                    printDeclaration(declaration, options, code);
+                    break;
+                }
+
+                case Construct::Kind::Statement:
+                {
+                    auto& statement = static_cast<const Statement&>(construct);
+                    printStatement(statement, options, code);
+                    break;
+                }
+
+                case Construct::Kind::Expression:
+                {
+                    auto& expression = static_cast<const Expression&>(construct);
+                    printExpression(expression, options, code);
+                    break;
+                }
+
+                case Construct::Kind::Attribute:
+                    break;
+            }
+        }
+
+        // the vector, matrix and texture types and the builtin functions,
+        // guarded so that several shaders can be included in one translation unit
+        static constexpr const char* types = R"CPP(#ifndef OSL_CPP_TYPES
+#define OSL_CPP_TYPES
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+namespace osl
+{
+    using uint = std::uint32_t;
+
+    template <std::size_t N> struct Vector;
+
+    namespace detail
+    {
+        template <std::size_t N, class T>
+        inline void append(float (&components)[N], std::size_t& count, const T& value) noexcept
+        {
+            if (count < N) components[count++] = static_cast<float>(value);
+        }
+
+        template <std::size_t N, std::size_t M>
+        inline void append(float (&components)[N], std::size_t& count, const Vector<M>& value) noexcept
+        {
+            for (std::size_t i = 0; i < M && count < N; ++i) components[count++] = value.v[i];
+        }
+    }
+
+    // a single scalar initializes all the components, several arguments are flattened into the components
+    template <std::size_t N>
+    struct Vector final
+    {
+        Vector() noexcept = default;
+
+        Vector(float value) noexcept
+        {
+            for (std::size_t i = 0; i < N; ++i) v[i] = value;
+        }
+
+        template <std::size_t M, std::enable_if_t<(M != N), int> = 0>
+        explicit Vector(const Vector<M>& value) noexcept
+        {
+            std::size_t count = 0;
+            detail::append(v, count, value);
+        }
+
+        template <class... Args, std::enable_if_t<(sizeof...(Args) > 1), int> = 0>
+        explicit Vector(const Args&... args) noexcept
+        {
+            std::size_t count = 0;
+            (detail::append(v, count, args), ...);
+        }
+
+        float& operator[](std::size_t i) noexcept { return v[i]; }
+        const float& operator[](std::size_t i) const noexcept { return v[i]; }
+
+        float v[N]{};
+    };
+
+    // rows of N components, a vector on the left of a product is a row vector and on the right a column vector
+    template <std::size_t N>
+    struct Matrix final
+    {
+        Matrix() noexcept = default;
+
+        Matrix(float value) noexcept
+        {
+            for (std::size_t i = 0; i < N; ++i) rows[i] = Vector<N>(value);
+        }
+
+        template <class... Args, std::enable_if_t<(sizeof...(Args) > 1), int> = 0>
+        explicit Matrix(const Args&... args) noexcept
+        {
+            float components[N * N]{};
+            std::size_t count = 0;
+            (detail::append(components, count, args), ...);
+
+            for (std::size_t i = 0; i < N; ++i)
+                for (std::size_t j = 0; j < N; ++j)
+                    rows[i].v[j] = components[i * N + j];
+        }
+
+        Vector<N>& operator[](std::size_t i) noexcept { return rows[i]; }
+        const Vector<N>& operator[](std::size_t i) const noexcept { return rows[i]; }
+
+        Vector<N> rows[N]{};
+    };
+
+    using float2 = Vector<2>;
+    using float3 = Vector<3>;
+    using float4 = Vector<4>;
+    using float2x2 = Matrix<2>;
+    using float3x3 = Matrix<3>;
+    using float4x4 = Matrix<4>;
+
+#define OSL_VECTOR_OPERATOR(op) \
+    template <std::size_t N> inline Vector<N> operator op(const Vector<N>& a, const Vector<N>& b) noexcept \
+    { Vector<N> r; for (std::size_t i = 0; i < N; ++i) r.v[i] = a.v[i] op b.v[i]; return r; } \
+    template <std::size_t N> inline Vector<N> operator op(const Vector<N>& a, float b) noexcept \
+    { Vector<N> r; for (std::size_t i = 0; i < N; ++i) r.v[i] = a.v[i] op b; return r; } \
+    template <std::size_t N> inline Vector<N> operator op(float a, const Vector<N>& b) noexcept \
+    { Vector<N> r; for (std::size_t i = 0; i < N; ++i) r.v[i] = a op b.v[i]; return r; } \
+    template <std::size_t N, class T> inline Vector<N>& operator op##=(Vector<N>& a, const T& b) noexcept \
+    { return a = a op b; }
+
+    OSL_VECTOR_OPERATOR(+)
+    OSL_VECTOR_OPERATOR(-)
+    OSL_VECTOR_OPERATOR(*)
+    OSL_VECTOR_OPERATOR(/)
+#undef OSL_VECTOR_OPERATOR
+
+#define OSL_MATRIX_OPERATOR(op) \
+    template <std::size_t N> inline Matrix<N> operator op(const Matrix<N>& a, float b) noexcept \
+    { Matrix<N> r; for (std::size_t i = 0; i < N; ++i) r.rows[i] = a.rows[i] op b; return r; } \
+    template <std::size_t N> inline Matrix<N> operator op(float a, const Matrix<N>& b) noexcept \
+    { Matrix<N> r; for (std::size_t i = 0; i < N; ++i) r.rows[i] = a op b.rows[i]; return r; } \
+    template <std::size_t N, class T> inline Matrix<N>& operator op##=(Matrix<N>& a, const T& b) noexcept \
+    { return a = a op b; }
+
+    OSL_MATRIX_OPERATOR(+)
+    OSL_MATRIX_OPERATOR(-)
+    OSL_MATRIX_OPERATOR(*)
+    OSL_MATRIX_OPERATOR(/)
+#undef OSL_MATRIX_OPERATOR
+
+    template <std::size_t N> inline Matrix<N> operator+(const Matrix<N>& a, const Matrix<N>& b) noexcept
+    { Matrix<N> r; for (std::size_t i = 0; i < N; ++i) r.rows[i] = a.rows[i] + b.rows[i]; return r; }
+    template <std::size_t N> inline Matrix<N> operator-(const Matrix<N>& a, const Matrix<N>& b) noexcept
+    { Matrix<N> r; for (std::size_t i = 0; i < N; ++i) r.rows[i] = a.rows[i] - b.rows[i]; return r; }
+    template <std::size_t N> inline Matrix<N> operator/(const Matrix<N>& a, const Matrix<N>& b) noexcept
+    { Matrix<N> r; for (std::size_t i = 0; i < N; ++i) r.rows[i] = a.rows[i] / b.rows[i]; return r; }
+
+    // the products accumulate in the same order as the interpreter, so that the results are identical
+    template <std::size_t N> inline Vector<N> operator*(const Vector<N>& a, const Matrix<N>& b) noexcept
+    {
+        Vector<N> r(0.0F);
+        for (std::size_t i = 0; i < N; ++i) r = r + a.v[i] * b.rows[i];
+        return r;
+    }
+
+    template <std::size_t N> inline Vector<N> operator*(const Matrix<N>& a, const Vector<N>& b) noexcept
+    {
+        Vector<N> r;
+        for (std::size_t row = 0; row < N; ++row)
+        {
+            float sum = 0.0F;
+            for (std::size_t i = 0; i < N; ++i) sum += a.rows[row].v[i] * b.v[i];
+            r.v[row] = sum;
+        }
+        return r;
+    }
+
+    template <std::size_t N> inline Matrix<N> operator*(const Matrix<N>& a, const Matrix<N>& b) noexcept
+    {
+        Matrix<N> r;
+        for (std::size_t row = 0; row < N; ++row) r.rows[row] = a.rows[row] * b;
+        return r;
+    }
+
+    template <std::size_t N> inline Vector<N> operator+(const Vector<N>& a) noexcept { return a; }
+    template <std::size_t N> inline Vector<N> operator-(const Vector<N>& a) noexcept
+    { Vector<N> r; for (std::size_t i = 0; i < N; ++i) r.v[i] = -a.v[i]; return r; }
+    template <std::size_t N> inline Matrix<N> operator+(const Matrix<N>& a) noexcept { return a; }
+    template <std::size_t N> inline Matrix<N> operator-(const Matrix<N>& a) noexcept
+    { Matrix<N> r; for (std::size_t i = 0; i < N; ++i) r.rows[i] = -a.rows[i]; return r; }
+
+    template <std::size_t N> inline bool operator==(const Vector<N>& a, const Vector<N>& b) noexcept
+    {
+        bool result = true;
+        for (std::size_t i = 0; i < N; ++i) result &= (a.v[i] == b.v[i]);
+        return result;
+    }
+
+    template <std::size_t N> inline bool operator!=(const Vector<N>& a, const Vector<N>& b) noexcept { return !(a == b); }
+
+    template <std::size_t N> inline bool operator==(const Matrix<N>& a, const Matrix<N>& b) noexcept
+    {
+        bool result = true;
+        for (std::size_t i = 0; i < N; ++i) result &= (a.rows[i] == b.rows[i]);
+        return result;
+    }
+
+    template <std::size_t N> inline bool operator!=(const Matrix<N>& a, const Matrix<N>& b) noexcept { return !(a == b); }
+
+    template <std::size_t... I, class V> inline Vector<sizeof...(I)> swizzle(const V& vector) noexcept
+    {
+        return Vector<sizeof...(I)>(vector[I]...);
+    }
+
+    // components of a vector that are written to
+    template <class V, std::size_t... I>
+    struct SwizzleReference final
+    {
+        using Value = Vector<sizeof...(I)>;
+
+        float& operator[](std::size_t i) const noexcept
+        {
+            constexpr std::size_t indices[] = {I...};
+            return vector[indices[i]];
+        }
+
+        operator Value() const noexcept { return Value(vector[I]...); }
+
+        Value operator=(const Value& value) const noexcept
+        {
+            std::size_t i = 0;
+            ((vector[I] = value.v[i++]), ...);
+            return value;
+        }
+
+        template <class T> Value operator+=(const T& value) const noexcept { return *this = static_cast<Value>(*this) + value; }
+        template <class T> Value operator-=(const T& value) const noexcept { return *this = static_cast<Value>(*this) - value; }
+        template <class T> Value operator*=(const T& value) const noexcept { return *this = static_cast<Value>(*this) * value; }
+        template <class T> Value operator/=(const T& value) const noexcept { return *this = static_cast<Value>(*this) / value; }
+
+        V vector;
+    };
+
+    template <std::size_t... I, class V> inline SwizzleReference<V, I...> swizzleReference(V&& vector) noexcept
+    {
+        return SwizzleReference<V, I...>{std::forward<V>(vector)};
+    }
+
+    // int and uint arithmetic wraps around and division by zero results in zero,
+    // the operations are constexpr, so that they can be used in case labels
+    template <class T> constexpr T add(T a, T b) noexcept { return static_cast<T>(static_cast<uint>(a) + static_cast<uint>(b)); }
+    template <class T> constexpr T subtract(T a, T b) noexcept { return static_cast<T>(static_cast<uint>(a) - static_cast<uint>(b)); }
+    template <class T> constexpr T multiply(T a, T b) noexcept { return static_cast<T>(static_cast<uint>(a) * static_cast<uint>(b)); }
+
+    template <class T> constexpr T divide(T a, T b) noexcept
+    {
+        if (b == 0) return 0;
+        if constexpr (std::is_signed<T>::value)
+            if (b == -1) return subtract<T>(0, a);
+        return a / b;
+    }
+
+    template <class T> constexpr T negate(T a) noexcept { return subtract<T>(0, a); }
+
+    template <class T, class U> inline T& addAssign(T& a, U b) noexcept { return a = add<T>(a, static_cast<T>(b)); }
+    template <class T, class U> inline T& subtractAssign(T& a, U b) noexcept { return a = subtract<T>(a, static_cast<T>(b)); }
+    template <class T, class U> inline T& multiplyAssign(T& a, U b) noexcept { return a = multiply<T>(a, static_cast<T>(b)); }
+    template <class T, class U> inline T& divideAssign(T& a, U b) noexcept { return a = divide<T>(a, static_cast<T>(b)); }
+
+    template <class T> inline T& preIncrement(T& a) noexcept { return a = add<T>(a, 1); }
+    template <class T> inline T& preDecrement(T& a) noexcept { return a = subtract<T>(a, 1); }
+    template <class T> inline T postIncrement(T& a) noexcept { const T result = a; a = add<T>(a, 1); return result; }
+    template <class T> inline T postDecrement(T& a) noexcept { const T result = a; a = subtract<T>(a, 1); return result; }
+
+    // floats out of the range of the integers are converted to zero
+    template <class T, class S> constexpr T convert(S value) noexcept
+    {
+        if constexpr (std::is_same<T, bool>::value)
+            return value != 0;
+        else if constexpr (std::is_floating_point<T>::value)
+            return static_cast<T>(value);
+        else
+        {
+            if constexpr (std::is_floating_point<S>::value)
+                if (!(value > -9.2e18F && value < 9.2e18F)) return 0;
+            return static_cast<T>(static_cast<uint>(static_cast<std::int64_t>(value)));
+        }
+    }
+
+    inline bool abs(bool value) noexcept { return value; }
+    inline int abs(int value) noexcept { return (value < 0) ? negate(value) : value; }
+    inline uint abs(uint value) noexcept { return value; }
+    inline float abs(float value) noexcept { return std::fabs(value); }
+
+    template <std::size_t N> inline Vector<N> abs(const Vector<N>& value) noexcept
+    {
+        Vector<N> r;
+        for (std::size_t i = 0; i < N; ++i) r.v[i] = std::fabs(value.v[i]);
+        return r;
+    }
+
+    template <std::size_t N> inline Matrix<N> abs(const Matrix<N>& value) noexcept
+    {
+        Matrix<N> r;
+        for (std::size_t i = 0; i < N; ++i) r.rows[i] = abs(value.rows[i]);
+        return r;
+    }
+
+    // RGBA texture with float components owned by the caller, an unbound texture reads as zero
+    struct Texture2D
+    {
+        const float* pixels = nullptr;
+        std::size_t width = 0;
+        std::size_t height = 0;
+    };
+
+    struct Texture2DMS: Texture2D {};
+
+    namespace detail
+    {
+        // clamps the coordinates to the edge of the texture
+        inline float4 texel(const Texture2D& texture, std::int64_t x, std::int64_t y) noexcept
+        {
+            const auto width = static_cast<std::int64_t>(texture.width);
+            const auto height = static_cast<std::int64_t>(texture.height);
+            x = (x < 0) ? 0 : (x >= width) ? width - 1 : x;
+            y = (y < 0) ? 0 : (y >= height) ? height - 1 : y;
+
+            const auto pixel = texture.pixels + (y * width + x) * 4;
+            return float4(pixel[0], pixel[1], pixel[2], pixel[3]);
+        }
+
+        inline std::int64_t wrap(std::int64_t coordinate, std::size_t size) noexcept
+        {
+            const auto result = coordinate % static_cast<std::int64_t>(size);
+            return (result < 0) ? result + static_cast<std::int64_t>(size) : result;
+        }
+    }
+
+    // bilinear filtering with repeating texture coordinates
+    inline float4 sample(const Texture2D& texture, const float2& coordinates) noexcept
+    {
+        const auto u = coordinates.v[0];
+        const auto v = coordinates.v[1];
+        if (!texture.pixels || !std::isfinite(u) || !std::isfinite(v)) return float4{};
+
+        const auto x = (u - std::floor(u)) * static_cast<float>(texture.width) - 0.5F;
+        const auto y = (v - std::floor(v)) * static_cast<float>(texture.height) - 0.5F;
+        const auto x0 = std::floor(x);
+        const auto y0 = std::floor(y);
+        const auto fractionX = x - x0;
+        const auto fractionY = y - y0;
+
+        const auto left = detail::wrap(static_cast<std::int64_t>(x0), texture.width);
+        const auto right = detail::wrap(static_cast<std::int64_t>(x0) + 1, texture.width);
+        const auto top = detail::wrap(static_cast<std::int64_t>(y0), texture.height);
+        const auto bottom = detail::wrap(static_cast<std::int64_t>(y0) + 1, texture.height);
+
+        const auto topLeft = detail::texel(texture, left, top);
+        const auto topRight = detail::texel(texture, right, top);
+        const auto bottomLeft = detail::texel(texture, left, bottom);
+        const auto bottomRight = detail::texel(texture, right, bottom);
+
+        const auto topValue = topLeft + (topRight - topLeft) * fractionX;
+        const auto bottomValue = bottomLeft + (bottomRight - bottomLeft) * fractionX;
+        return topValue + (bottomValue - topValue) * fractionY;
+    }
+
+    // takes texel coordinates
+    inline float4 load(const Texture2DMS& texture, const float2& coordinates) noexcept
+    {
+        if (!texture.pixels) return float4{};
+
+        const auto x = coordinates.v[0];
+        const auto y = coordinates.v[1];
+        return detail::texel(texture,
+                             std::isfinite(x) ? static_cast<std::int64_t>(std::floor(std::fmin(std::fmax(x, -1.0F), 1e9F))) : 0,
+                             std::isfinite(y) ? static_cast<std::int64_t>(std::floor(std::fmin(std::fmax(y, -1.0F), 1e9F))) : 0);
+    }
+
+    struct Discard final {};
+
+    // set by a discard in the entry point, which returns instead of throwing
+    inline thread_local bool discarded = false;
+
+    [[noreturn]] inline void discard() { throw Discard{}; }
+}
+
+#endif
+)CPP";
+
+        FunctionDeclaration::Qualifier qualifier;
+        std::string namespaceName;
+        const FunctionDeclaration* entryPoint = nullptr;
+        const FunctionDeclaration* currentFunction = nullptr;
+        std::map<std::string, std::string> escapedNames;
+    };
+}
+
+#endif // OUTPUTCPP_HPP
@@ -12,17 +12,34 @@ namespace ouzel
     class OutputHLSL final: public Output
     {
     public:
-        explicit OutputHLSL(Program initProgram):
-            Output{initProgram}
+        explicit OutputHLSL(Program initProgram,
+                           const Minifier* initMinifier = nullptr):
+            Output{initProgram, initMinifier}
         {
         }
 
-        virtual std::string output(const Context& context, bool whitespaces)
+        using Output::output;
+
+        void output(const Context& context, bool whitespaces, std::string& result) override
         {
-            std::string result;
+            result.clear();
+
+            const Layout uniformLayout(context, Layout::Rules::HLSL);
+            const auto uniformBlockIndex = getUniformBlockIndex(context, uniformLayout);
+            const auto& declarations = context.getDeclarations();
 
-            for (auto declaration : context.getDeclarations())
+            for (std::size_t i = 0; i < declarations.size(); ++i)
             {
+                if (i == uniformBlockIndex)
+                {
+                    printUniformBlock(uniformLayout, Options(0, whitespaces), result);
+                    result += ";";
+                    if (whitespaces) result += "\n";
+                }
+
+                const auto declaration = declarations[i];
+                if (isUniform(*declaration, uniformLayout)) continue;
+
                 printConstruct(*declaration, Options(0, whitespaces), result);
 
                 if (declaration->declarationKind != Declaration::Kind::Callable ||
@@ -31,8 +48,6 @@ namespace ouzel
 
                 if (whitespaces) result += "\n";
             }
-
-            return result;
         }
 
     private:
@@ -45,7 +60,29 @@ namespace ouzel
             bool whitespaces = false;
         };
 
-        static std::pair<std::string, std::string> getPrintableTypeName(const QualifiedType& qualifiedType)
+        // the externs are placed in a constant buffer with explicit offsets, so that they match the reflection
+        void printUniformBlock(const Layout& uniformLayout, Options options, std::string& code)
+        {
+            code += "cbuffer Uniforms";
+            if (options.whitespaces) code += "\n";
+            code += "{";
+            if (options.whitespaces) code += "\n";
+
+            for (const auto& member : uniformLayout.getMembers())
+            {
+                printDeclaration(*member.declaration, Options(options.indentation + 4, options.whitespaces), code);
+
+                code += options.whitespaces ? " : " : ":";
+                code += "packoffset(c" + std::to_string(member.offset / 16);
+                if (member.offset % 16) code += std::string(".") + "xyzw"[member.offset % 16 / 4];
+                code += ");";
+                if (options.whitespaces) code += "\n";
+            }
+
+            code += "}";
+        }
+
+        std::pair<std::string, std::string> getPrintableTypeName(const QualifiedType& qualifiedType)
         {
             std::pair<std::string, std::string> result;
 
@@ -62,7 +99,7 @@ namespace ouzel
                 type = &arrayType->elementType.type;
             }
 
-            result.first = type->name;
+            result.first = getName(*type);
 
             return result;
         }
@@ -82,7 +119,7 @@ namespace ouzel
                         throw std::runtime_error{"Type declaration must be a struct"};
 
                     auto& structType = static_cast<const StructType&>(type);
-                    code += "struct " + type.name;
+                    code += "struct " + getName(type);
 
                     if (options.whitespaces) code.append(options.indentation, ' ');
                     if (options.whitespaces) code += "\n";
@@ -111,7 +148,7 @@ namespace ouzel
 
                     std::pair<std::string, std::string> printableTypeName = getPrintableTypeName(fieldDeclaration.qualifiedType);
 
-                    code += printableTypeName.first + " " + fieldDeclaration.name + printableTypeName.second;
+                    code += printableTypeName.first + " " + getName(fieldDeclaration) + printableTypeName.second;
 
                     // TODO: print semantics
 
@@ -130,7 +167,7 @@ namespace ouzel
 
                         std::pair<std::string, std::string> printableTypeName = getPrintableTypeName(functionDeclaration.resultType);
 
-                        code += printableTypeName.first + " " + functionDeclaration.name + "(";
+                        code += printableTypeName.first + " " + getName(functionDeclaration) + "(";
 
                         bool firstParameter = true;
 
@@ -140,9 +177,10 @@ namespace ouzel
                             {
                                 code += ",";
                                 if (options.whitespaces) code += " ";
-                                firstParameter = false;
                             }
 
+                            firstParameter = false;
+
                             printConstruct(*parameter, Options(0, options.whitespaces), code);
                         }
 
@@ -166,7 +204,7 @@ namespace ouzel
 
                     std::pair<std::string, std::string> printableTypeName = getPrintableTypeName(variableDeclaration.qualifiedType);
 
-                    code += printableTypeName.first + " " + variableDeclaration.name + printableTypeName.second;
+                    code += printableTypeName.first + " " + getName(variableDeclaration) + printableTypeName.second;
 
                     if (variableDeclaration.initialization)
                     {
@@ -187,7 +225,7 @@ namespace ouzel
 
                     std::pair<std::string, std::string> printableTypeName = getPrintableTypeName(parameterDeclaration.qualifiedType);
 
-                    code += printableTypeName.first + " " + parameterDeclaration.name + printableTypeName.second;
+                    code += printableTypeName.first + " " + getName(parameterDeclaration) + printableTypeName.second;
                     break;
                 }
             }
@@ -478,9 +516,10 @@ namespace ouzel
                         {
                             code += ",";
                             if (options.whitespaces) code += " ";
-                            firstParameter = false;
                         }
 
+                        firstParameter = false;
+
                         printConstruct(argument, Options(0, options.whitespaces), code);
                     }
 
@@ -505,13 +544,13 @@ namespace ouzel
                         case LiteralExpression::Kind::Integer:
                         {
                             auto& integerLiteralExpression = static_cast<const IntegerLiteralExpression&>(literalExpression);
-                            code += std::to_string(integerLiteralExpression.value);
+                            code += formatInteger(integerLiteralExpression.value);
                             break;
                         }
                         case LiteralExpression::Kind::FloatingPoint:
                         {
                             auto& floatingPointLiteralExpression = static_cast<const FloatingPointLiteralExpression&>(literalExpression);
-                            code += std::to_string(floatingPointLiteralExpression.value);
+                            code += formatFloatingPoint(floatingPointLiteralExpression.value);
                             break;
                         }
                         case LiteralExpression::Kind::String:
@@ -540,20 +579,20 @@ namespace ouzel
                             if (callableDeclaration.callableDeclarationKind == CallableDeclaration::Kind::Function)
                             {
                                 auto& functionDeclaration = static_cast<const FunctionDeclaration&>(callableDeclaration);
-                                code += functionDeclaration.name;
+                                code += getName(functionDeclaration);
                             }
                             break;
                         }
                         case Declaration::Kind::Variable:
                         {
                             auto& variableDeclaration = static_cast<const VariableDeclaration&>(declaration);
-                            code += variableDeclaration.name;
+                            code += getName(variableDeclaration);
                             break;
                         }
                         case Declaration::Kind::Parameter:
                         {
                             auto& parameterDeclaration = static_cast<const ParameterDeclaration&>(declaration);
-                            code += parameterDeclaration.name;
+                            code += getName(parameterDeclaration);
                             break;
                         }
                         default:
@@ -586,7 +625,7 @@ namespace ouzel
 
                     code += ".";
 
-                    code += memberExpression.fieldDeclaration.name;
+                    code += getName(memberExpression.fieldDeclaration);
 
                     break;
                 }
@@ -619,11 +658,20 @@ namespace ouzel
                         case UnaryOperatorExpression::Kind::Negation: code += "!"; break;
                         case UnaryOperatorExpression::Kind::Positive: code += "+"; break;
                         case UnaryOperatorExpression::Kind::Negative: code += "-"; break;
+                        case UnaryOperatorExpression::Kind::PrefixIncrement: code += "++"; break;
+                        case UnaryOperatorExpression::Kind::PrefixDecrement: code += "--"; break;
+                        case UnaryOperatorExpression::Kind::PostfixIncrement: break;
+                        case UnaryOperatorExpression::Kind::PostfixDecrement: break;
                         default:
                             throw std::runtime_error{"Unknown operator"};
                     }
 
                     printConstruct(unaryOperatorExpression.expression, Options(0, options.whitespaces), code);
+
+                    if (unaryOperatorExpression.operatorKind == UnaryOperatorExpression::Kind::PostfixIncrement)
+                        code += "++";
+                    else if (unaryOperatorExpression.operatorKind == UnaryOperatorExpression::Kind::PostfixDecrement)
+                        code += "--";
                     break;
                 }
 
@@ -702,7 +750,7 @@ namespace ouzel
 
                     auto& structType = static_cast<const StructType&>(type);
 
-                    code += structType.name + "(";
+                    code += getName(structType) + "(";
 
                     bool firstParameter = true;
 
@@ -712,9 +760,10 @@ namespace ouzel
                         {
                             code += ",";
                             if (options.whitespaces) code += " ";
-                            firstParameter = false;
                         }
 
+                        firstParameter = false;
+
                         printConstruct(parameter, Options(0, options.whitespaces), code);
                     }
 
@@ -739,9 +788,10 @@ namespace ouzel
                         {
                             code += ",";
                             if (options.whitespaces) code += " ";
-                            firstExpression = false;
                         }
 
+                        firstExpression = false;
+
                         printConstruct(subExpression, Options(0, options.whitespaces), code);
                     }
 
@@ -756,7 +806,7 @@ namespace ouzel
 
                     auto& castExpression = static_cast<const CastExpression&>(expression);
 
-                    code += castExpression.qualifiedType.type.name + "(";
+                    code += getName(castExpression.qualifiedType.type) + "(";
                     printConstruct(castExpression.expression, Options(0, options.whitespaces), code);
                     code += ")";
 
@@ -764,17 +814,72 @@ namespace ouzel
                 }
                 case Expression::Kind::VectorInitialize:
                 {
-                    // TODO: implement
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& vectorInitializeExpression = static_cast<const VectorInitializeExpression&>(expression);
+
+                    code += vectorInitializeExpression.qualifiedType.type.name + "(";
+
+                    bool firstParameter = true;
+
+                    for (auto& parameter : vectorInitializeExpression.parameters)
+                    {
+                        if (!firstParameter)
+                        {
+                            code += ",";
+                            if (options.whitespaces) code += " ";
+                        }
+
+                        firstParameter = false;
+
+                        printConstruct(parameter, Options(0, options.whitespaces), code);
+                    }
+
+                    code += ")";
+
                     break;
                 }
                 case Expression::Kind::VectorElement:
                 {
-                    // TODO: implement
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& vectorElementExpression = static_cast<const VectorElementExpression&>(expression);
+
+                    printConstruct(vectorElementExpression.expression, Options(0, options.whitespaces), code);
+
+                    code += ".";
+
+                    constexpr char components[4] = {'x', 'y', 'z', 'w'};
+                    for (const auto position : vectorElementExpression.positions)
+                        code += components[position];
+
                     break;
                 }
                 case Expression::Kind::MatrixInitialize:
                 {
-                    // TODO: implement
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& matrixInitializeExpression = static_cast<const MatrixInitializeExpression&>(expression);
+
+                    code += matrixInitializeExpression.qualifiedType.type.name + "(";
+
+                    bool firstParameter = true;
+
+                    for (auto& parameter : matrixInitializeExpression.parameters)
+                    {
+                        if (!firstParameter)
+                        {
+                            code += ",";
+                            if (options.whitespaces) code += " ";
+                        }
+
+                        firstParameter = false;
+
+                        printConstruct(parameter, Options(0, options.whitespaces), code);
+                    }
+
+                    code += ")";
+
                     break;
                 }
             }
@@ -14,14 +14,17 @@ namespace ouzel
     class OutputMSL final: public Output
     {
     public:
-        explicit OutputMSL(Program initProgram):
-            Output{initProgram}
+        explicit OutputMSL(Program initProgram,
+                          const Minifier* initMinifier = nullptr):
+            Output{initProgram, initMinifier}
         {
         }
 
-        virtual std::string output(const Context& context, bool whitespaces)
+        using Output::output;
+
+        void output(const Context& context, bool whitespaces, std::string& result) override
         {
-            std::string result;
+            result.clear();
 
             for (auto declaration : context.getDeclarations())
             {
@@ -33,8 +36,6 @@ namespace ouzel
 
                 if (whitespaces) result += "\n";
             }
-
-            return result;
         }
 
     private:
@@ -47,7 +48,7 @@ namespace ouzel
             bool whitespaces = false;
         };
 
-        static std::pair<std::string, std::string> getPrintableTypeName(const QualifiedType& qualifiedType)
+        std::pair<std::string, std::string> getPrintableTypeName(const QualifiedType& qualifiedType)
         {
             std::pair<std::string, std::string> result;
 
@@ -65,7 +66,7 @@ namespace ouzel
                 type = &arrayType->elementType.type;
             }
 
-            result.first = type->name;
+            result.first = getName(*type);
 
             return result;
         }
@@ -85,7 +86,7 @@ namespace ouzel
                         throw std::runtime_error{"Type declaration must be a struct"};
 
                     auto& structType = static_cast<const StructType&>(type);
-                    code += "struct " + structType.name;
+                    code += "struct " + getName(structType);
 
                     if (options.whitespaces) code.append(options.indentation, ' ');
                     if (options.whitespaces) code += "\n";
@@ -114,7 +115,7 @@ namespace ouzel
 
                     std::pair<std::string, std::string> printableTypeName = getPrintableTypeName(fieldDeclaration.qualifiedType);
 
-                    code += printableTypeName.first + " " + fieldDeclaration.name + printableTypeName.second;
+                    code += printableTypeName.first + " " + getName(fieldDeclaration) + printableTypeName.second;
 
                     // TODO: print semantics
 
@@ -133,7 +134,7 @@ namespace ouzel
 
                         std::pair<std::string, std::string> printableTypeName = getPrintableTypeName(functionDeclaration.resultType);
 
-                        code += printableTypeName.first + " " + functionDeclaration.name + "(";
+                        code += printableTypeName.first + " " + getName(functionDeclaration) + "(";
 
                         bool firstParameter = true;
 
@@ -143,9 +144,10 @@ namespace ouzel
                             {
                                 code += ",";
                                 if (options.whitespaces) code += " ";
-                                firstParameter = false;
                             }
 
+                            firstParameter = false;
+
                             printConstruct(*parameter, Options(0, options.whitespaces), code);
                         }
 
@@ -169,7 +171,7 @@ namespace ouzel
 
                     std::pair<std::string, std::string> printableTypeName = getPrintableTypeName(variableDeclaration.qualifiedType);
 
-                    code += printableTypeName.first + " " + variableDeclaration.name + printableTypeName.second;
+                    code += printableTypeName.first + " " + getName(variableDeclaration) + printableTypeName.second;
 
                     if (variableDeclaration.initialization)
                     {
@@ -190,7 +192,7 @@ namespace ouzel
 
                     std::pair<std::string, std::string> printableTypeName = getPrintableTypeName(parameterDeclaration.qualifiedType);
 
-                    code += printableTypeName.first + " " + parameterDeclaration.name + printableTypeName.second;
+                    code += printableTypeName.first + " " + getName(parameterDeclaration) + printableTypeName.second;
                     break;
                 }
             }
@@ -480,9 +482,10 @@ namespace ouzel
                         {
                             code += ",";
                             if (options.whitespaces) code += " ";
-                            firstParameter = false;
                         }
 
+                        firstParameter = false;
+
                         printConstruct(argument, Options(0, options.whitespaces), code);
                     }
 
@@ -507,13 +510,13 @@ namespace ouzel
                         case LiteralExpression::Kind::Integer:
                         {
                             auto& integerLiteralExpression = static_cast<const IntegerLiteralExpression&>(literalExpression);
-                            code += std::to_string(integerLiteralExpression.value);
+                            code += formatInteger(integerLiteralExpression.value);
                             break;
                         }
                         case LiteralExpression::Kind::FloatingPoint:
                         {
                             auto& floatingPointLiteralExpression = static_cast<const FloatingPointLiteralExpression&>(literalExpression);
-                            code += std::to_string(floatingPointLiteralExpression.value);
+                            code += formatFloatingPoint(floatingPointLiteralExpression.value);
                             break;
                         }
                         case LiteralExpression::Kind::String:
@@ -542,20 +545,20 @@ namespace ouzel
                             if (callableDeclaration.callableDeclarationKind == CallableDeclaration::Kind::Function)
                             {
                                 auto& functionDeclaration = static_cast<const FunctionDeclaration&>(callableDeclaration);
-                                code += functionDeclaration.name;
+                                code += getName(functionDeclaration);
                             }
                             break;
                         }
                         case Declaration::Kind::Variable:
                         {
                             auto& variableDeclaration = static_cast<const VariableDeclaration&>(declaration);
-                            code += variableDeclaration.name;
+                            code += getName(variableDeclaration);
                             break;
                         }
                         case Declaration::Kind::Parameter:
                         {
                             auto& parameterDeclaration = static_cast<const ParameterDeclaration&>(declaration);
-                            code += parameterDeclaration.name;
+                            code += getName(parameterDeclaration);
                             break;
                         }
                         default:
@@ -588,7 +591,7 @@ namespace ouzel
 
                     code += ".";
 
-                    code += memberExpression.fieldDeclaration.name;
+                    code += getName(memberExpression.fieldDeclaration);
 
                     break;
                 }
@@ -621,11 +624,20 @@ namespace ouzel
                         case UnaryOperatorExpression::Kind::Negation: code += "!"; break;
                         case UnaryOperatorExpression::Kind::Positive: code += "+"; break;
                         case UnaryOperatorExpression::Kind::Negative: code += "-"; break;
+                        case UnaryOperatorExpression::Kind::PrefixIncrement: code += "++"; break;
+                        case UnaryOperatorExpression::Kind::PrefixDecrement: code += "--"; break;
+                        case UnaryOperatorExpression::Kind::PostfixIncrement: break;
+                        case UnaryOperatorExpression::Kind::PostfixDecrement: break;
                         default:
                             throw std::runtime_error{"Unknown operator"};
                     }
 
                     printConstruct(unaryOperatorExpression.expression, Options(0, options.whitespaces), code);
+
+                    if (unaryOperatorExpression.operatorKind == UnaryOperatorExpression::Kind::PostfixIncrement)
+                        code += "++";
+                    else if (unaryOperatorExpression.operatorKind == UnaryOperatorExpression::Kind::PostfixDecrement)
+                        code += "--";
                     break;
                 }
 
@@ -704,7 +716,7 @@ namespace ouzel
 
                     auto& structType = static_cast<const StructType&>(type);
 
-                    code += structType.name + "(";
+                    code += getName(structType) + "(";
 
                     bool firstParameter = true;
 
@@ -713,10 +725,11 @@ namespace ouzel
                         if (!firstParameter)
                         {
                             code += ",";
-                            if (options.whitespaces) code += "\n";
-                            firstParameter = false;
+                            if (options.whitespaces) code += " ";
                         }
 
+                        firstParameter = false;
+
                         printConstruct(parameter, Options(0, options.whitespaces), code);
                     }
 
@@ -741,9 +754,10 @@ namespace ouzel
                         {
                             code += ",";
                             if (options.whitespaces) code += " ";
-                            firstExpression = false;
                         }
 
+                        firstExpression = false;
+
                         printConstruct(subExpression, Options(0, options.whitespaces), code);
                     }
 
@@ -758,7 +772,7 @@ namespace ouzel
 
                     auto& castExpression = static_cast<const CastExpression&>(expression);
 
-                    code += castExpression.qualifiedType.type.name + "(";
+                    code += getName(castExpression.qualifiedType.type) + "(";
                     printConstruct(castExpression.expression, Options(0, options.whitespaces), code);
                     code += ")";
 
@@ -766,17 +780,72 @@ namespace ouzel
                 }
                 case Expression::Kind::VectorInitialize:
                 {
-                    // TODO: implement
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& vectorInitializeExpression = static_cast<const VectorInitializeExpression&>(expression);
+
+                    code += vectorInitializeExpression.qualifiedType.type.name + "(";
+
+                    bool firstParameter = true;
+
+                    for (auto& parameter : vectorInitializeExpression.parameters)
+                    {
+                        if (!firstParameter)
+                        {
+                            code += ",";
+                            if (options.whitespaces) code += " ";
+                        }
+
+                        firstParameter = false;
+
+                        printConstruct(parameter, Options(0, options.whitespaces), code);
+                    }
+
+                    code += ")";
+
                     break;
                 }
                 case Expression::Kind::VectorElement:
                 {
-                    // TODO: implement
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& vectorElementExpression = static_cast<const VectorElementExpression&>(expression);
+
+                    printConstruct(vectorElementExpression.expression, Options(0, options.whitespaces), code);
+
+                    code += ".";
+
+                    constexpr char components[4] = {'x', 'y', 'z', 'w'};
+                    for (const auto position : vectorElementExpression.positions)
+                        code += components[position];
+
                     break;
                 }
                 case Expression::Kind::MatrixInitialize:
                 {
-                    // TODO: implement
+                    if (options.whitespaces) code.append(options.indentation, ' ');
+
+                    auto& matrixInitializeExpression = static_cast<const MatrixInitializeExpression&>(expression);
+
+                    code += matrixInitializeExpression.qualifiedType.type.name + "(";
+
+                    bool firstParameter = true;
+
+                    for (auto& parameter : matrixInitializeExpression.parameters)
+                    {
+                        if (!firstParameter)
+                        {
+                            code += ",";
+                            if (options.whitespaces) code += " ";
+                        }
+
+                        firstParameter = false;
+
+                        printConstruct(parameter, Options(0, options.whitespaces), code);
+                    }
+
+                    code += ")";
+
                     break;
                 }
             }
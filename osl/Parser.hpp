@@ -5,16 +5,25 @@
 #ifndef PARSER_HPP
 #define PARSER_HPP
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <thread>
 #include <type_traits>
 #include <vector>
 #include "Tokenizer.hpp"
+#include "ConstantEvaluator.hpp"
 #include "Declarations.hpp"
 #include "Expressions.hpp"
 #include "Statements.hpp"
+#include "Trace.hpp"
 #include "Utils.hpp"
 
 namespace ouzel
@@ -63,19 +72,125 @@ namespace ouzel
         InvalidInitializerType,
         NoConstructorFound,
         InvalidMember,
-        UnexpectedDeclaration
+        UnexpectedDeclaration,
+        InvalidToken,
+        InvalidDirective,
+        InvalidImport
     };
 
+    [[nodiscard]]
+    inline std::string toString(ErrorCode errorCode)
+    {
+        switch (errorCode)
+        {
+            case ErrorCode::NoError: return "NoError";
+            case ErrorCode::UnexpectedEndOfFile: return "UnexpectedEndOfFile";
+            case ErrorCode::InvalidIndex: return "InvalidIndex";
+            case ErrorCode::InvalidSubscript: return "InvalidSubscript";
+            case ErrorCode::NoMatchingFunction: return "NoMatchingFunction";
+            case ErrorCode::AmbiguousCall: return "AmbiguousCall";
+            case ErrorCode::UnsupportedFeature: return "UnsupportedFeature";
+            case ErrorCode::InvalidAttribute: return "InvalidAttribute";
+            case ErrorCode::SymbolRedefinition: return "SymbolRedefinition";
+            case ErrorCode::SymbolRedeclaration: return "SymbolRedeclaration";
+            case ErrorCode::FunctionRedeclarationWithDifferentReturnType: return "FunctionRedeclarationWithDifferentReturnType";
+            case ErrorCode::MissingType: return "MissingType";
+            case ErrorCode::IllegalVoidType: return "IllegalVoidType";
+            case ErrorCode::ConditionNotBoolean: return "ConditionNotBoolean";
+            case ErrorCode::MissingInitializer: return "MissingInitializer";
+            case ErrorCode::InvalidDeclarationReference: return "InvalidDeclarationReference";
+            case ErrorCode::DeclarationExpected: return "DeclarationExpected";
+            case ErrorCode::StatementExpected: return "StatementExpected";
+            case ErrorCode::FunctionDeclarationExpected: return "FunctionDeclarationExpected";
+            case ErrorCode::VariableDeclarationExpected: return "VariableDeclarationExpected";
+            case ErrorCode::ExpressionExpected: return "ExpressionExpected";
+            case ErrorCode::IntegerTypeExpected: return "IntegerTypeExpected";
+            case ErrorCode::NumberTypeExpected: return "NumberTypeExpected";
+            case ErrorCode::StructTypeExpected: return "StructTypeExpected";
+            case ErrorCode::ArrayTypeExpected: return "ArrayTypeExpected";
+            case ErrorCode::UnexpectedToken: return "UnexpectedToken";
+            case ErrorCode::InvalidType: return "InvalidType";
+            case ErrorCode::WrongTypeInReturn: return "WrongTypeInReturn";
+            case ErrorCode::ExpressionNotConst: return "ExpressionNotConst";
+            case ErrorCode::ConflictingTypesInInitializerList: return "ConflictingTypesInInitializerList";
+            case ErrorCode::InvalidVectorInitialization: return "InvalidVectorInitialization";
+            case ErrorCode::InvalidMatrixInitialization: return "InvalidMatrixInitialization";
+            case ErrorCode::EmptyVectorInitializer: return "EmptyVectorInitializer";
+            case ErrorCode::EmptyMatrixInitializer: return "EmptyMatrixInitializer";
+            case ErrorCode::InvalidCast: return "InvalidCast";
+            case ErrorCode::InvalidSwizzle: return "InvalidSwizzle";
+            case ErrorCode::ExpressionNotAssignable: return "ExpressionNotAssignable";
+            case ErrorCode::IncompatibleOperands: return "IncompatibleOperands";
+            case ErrorCode::NoOperator: return "NoOperator";
+            case ErrorCode::InvalidInitializerType: return "InvalidInitializerType";
+            case ErrorCode::NoConstructorFound: return "NoConstructorFound";
+            case ErrorCode::InvalidMember: return "InvalidMember";
+            case ErrorCode::UnexpectedDeclaration: return "UnexpectedDeclaration";
+            case ErrorCode::InvalidToken: return "InvalidToken";
+            case ErrorCode::InvalidDirective: return "InvalidDirective";
+            case ErrorCode::InvalidImport: return "InvalidImport";
+        }
+
+        throw std::runtime_error{"Unknown error code"};
+    }
+
+    // the error is reported at the range of the tokens it was found in,
+    // an error without tokens is reported at the token the parser stopped at
     class ParseError final: public std::logic_error
     {
     public:
         explicit ParseError(ErrorCode code, const std::string& str): std::logic_error(str), errorCode{code} {}
         explicit ParseError(ErrorCode code, const char* str): std::logic_error(str), errorCode{code} {}
 
+        ParseError(ErrorCode code, const std::string& str, const Token& token):
+            std::logic_error(str), errorCode{code},
+            line{token.line}, column{token.column},
+            endLine{token.line}, endColumn{token.column + std::max(token.length, std::uint32_t(1))},
+            file{token.file}
+        {
+        }
+
+        // the tokens from the first one up to the last one, which is not included
+        ParseError(ErrorCode code, const std::string& str,
+                   std::vector<Token>::const_iterator first, std::vector<Token>::const_iterator last):
+            ParseError{code, str, *first}
+        {
+            const auto& lastToken = *(last - 1);
+            if (last - first > 1 && lastToken.file == file)
+            {
+                endLine = lastToken.line;
+                endColumn = lastToken.column + std::max(lastToken.length, std::uint32_t(1));
+            }
+        }
+
         ErrorCode getErrorCode() const noexcept { return errorCode; }
 
+        [[nodiscard]] bool hasPosition() const noexcept { return line != 0; }
+        [[nodiscard]] std::uint32_t getLine() const noexcept { return line; }
+        [[nodiscard]] std::uint32_t getColumn() const noexcept { return column; }
+        [[nodiscard]] std::uint32_t getEndLine() const noexcept { return endLine; }
+        [[nodiscard]] std::uint32_t getEndColumn() const noexcept { return endColumn; }
+        [[nodiscard]] std::uint32_t getFile() const noexcept { return file; }
+
     private:
         ErrorCode errorCode;
+        std::uint32_t line = 0;
+        std::uint32_t column = 0;
+        std::uint32_t endLine = 0;
+        std::uint32_t endColumn = 0;
+        std::uint32_t file = 0;
+    };
+
+    // an error and the range of the source it was found in, the end column is one past the last character
+    struct Diagnostic final
+    {
+        ErrorCode errorCode;
+        std::string message;
+        std::uint32_t line;
+        std::uint32_t column;
+        std::uint32_t endLine;
+        std::uint32_t endColumn;
+        std::uint32_t file = 0; // zero for the main source, otherwise the index of the included file plus one
     };
 
     class Context final
@@ -84,8 +199,28 @@ namespace ouzel
         using TokenIterator = std::vector<Token>::const_iterator;
         using DeclarationScope = std::vector<Declaration*>;
         using DeclarationScopes = std::vector<DeclarationScope>;
+        // the return statements of a function body with their first tokens, where a wrong type is reported
+        using ReturnStatements = std::vector<std::pair<ReturnStatement*, TokenIterator>>;
+
+        // with a thread count the function bodies are parsed on that many threads after the other declarations
+        explicit Context(const std::vector<Token>& tokens, Tracer* initTracer = nullptr, std::size_t threadCount = 0):
+            Context{tokens, nullptr, initTracer, threadCount}
+        {
+        }
+
+        // the parse errors are added to the diagnostics instead of being thrown, the parser skips to the next
+        // statement or declaration after an error, so the context has the declarations that could be parsed
+        Context(const std::vector<Token>& tokens, std::vector<Diagnostic>& initDiagnostics,
+                Tracer* initTracer = nullptr, std::size_t threadCount = 0):
+            Context{tokens, &initDiagnostics, initTracer, threadCount}
+        {
+        }
 
-        explicit Context(const std::vector<Token>& tokens):
+    private:
+        Context(const std::vector<Token>& tokens, std::vector<Diagnostic>* initDiagnostics,
+                Tracer* initTracer, std::size_t threadCount):
+            diagnostics{initDiagnostics},
+            tracer{initTracer},
             voidType{create<Type>(Type::Kind::Void, "void")},
             boolType{addScalarType("bool", ScalarType::Kind::Boolean, false)},
             intType{addScalarType("int", ScalarType::Kind::Integer, false)},
@@ -127,13 +262,18 @@ namespace ouzel
             const auto& texture2DMSType = addStructType("Texture2DMS");
             addBuiltinFunctionDeclaration("load", float4Type, {&texture2DMSType, &float2Type}, declarationScopes);
 
-            for (auto iterator = tokens.begin(); iterator != tokens.end();)
-            {
-                auto& declaration = parseTopLevelDeclaration(iterator, tokens.end(), declarationScopes);
-                declarations.push_back(&declaration);
-            }
+            builtinDeclarations = declarationScopes.back();
+            builtinConstructCount = constructs.size();
+
+            if (threadCount > 0)
+                parseInParallel(tokens, declarationScopes, threadCount);
+            else
+                for (auto iterator = tokens.begin(); iterator != tokens.end();)
+                    parseRecoveringDeclaration(iterator, tokens.end(), declarationScopes);
         }
 
+    public:
+
         void dump() const
         {
             for (const auto declaration : declarations)
@@ -146,6 +286,194 @@ namespace ouzel
             return declarations;
         }
 
+        [[nodiscard]]
+        const std::vector<std::unique_ptr<Construct>>& getConstructs() const noexcept
+        {
+            return constructs;
+        }
+
+        [[nodiscard]]
+        const std::vector<std::unique_ptr<Type>>& getTypes() const noexcept
+        {
+            return types;
+        }
+
+        // the number of tokens the top-level declaration with the index was parsed from
+        [[nodiscard]]
+        std::size_t getTokenCount(std::size_t declarationIndex) const
+        {
+            return sources.at(declarationIndex).tokenCount;
+        }
+
+        // removes the top-level declarations for which the predicate returns true,
+        // returns the number of removed declarations
+        template <class Predicate>
+        std::size_t removeDeclarations(Predicate predicate)
+        {
+            const auto i = std::remove_if(declarations.begin(), declarations.end(), predicate);
+            const auto count = static_cast<std::size_t>(std::distance(i, declarations.end()));
+            declarations.erase(i, declarations.end());
+            return count;
+        }
+
+        // parses the top-level declarations whose tokens differ from the ones the context was parsed from
+        // and the declarations that use a name declared by them, the other declarations are kept,
+        // returns the number of parsed and removed declarations, the output has to be updated only if it is not zero,
+        // the context is left unchanged if a parse error is thrown
+        std::size_t update(const std::vector<Token>& tokens)
+        {
+            std::size_t sourceConstructCount = builtinConstructCount;
+            for (const auto& source : sources)
+                sourceConstructCount += source.constructCount;
+
+            if (sources.size() != declarations.size() || sourceConstructCount != constructs.size())
+                throw std::runtime_error{"Transformed context can not be updated"};
+
+            // the previous declarations are restored if the tokens fail to parse
+            const auto oldDeclarations = declarations;
+            const auto oldSources = sources;
+            const auto oldConstructCount = constructs.size();
+            const auto oldTypeCount = types.size();
+            std::vector<Declaration*> oldDefinitions;
+            for (const auto declaration : oldDeclarations)
+                oldDefinitions.push_back(declaration->definition);
+
+            std::size_t changedCount = 0;
+
+            try
+            {
+                declarations.clear();
+                sources.clear();
+
+                DeclarationScopes declarationScopes;
+                declarationScopes.push_back(builtinDeclarations);
+
+                // the declarations that use a name of a removed or a parsed declaration are parsed again
+                std::set<std::string> changedNames;
+
+                const auto isUnchanged = [&oldSources, &tokens](std::size_t index, const TokenIterator iterator) {
+                    const auto tokenCount = oldSources[index].tokenCount;
+                    return tokenCount <= static_cast<std::size_t>(tokens.end() - iterator) &&
+                        hashTokens(iterator, iterator + static_cast<std::ptrdiff_t>(tokenCount)) == oldSources[index].hash;
+                };
+
+                std::size_t oldIndex = 0;
+                for (auto iterator = tokens.begin(); iterator != tokens.end();)
+                {
+                    if (oldIndex < oldDeclarations.size() && isUnchanged(oldIndex, iterator))
+                    {
+                        const auto declarationEnd = iterator + static_cast<std::ptrdiff_t>(oldSources[oldIndex].tokenCount);
+
+                        if (std::any_of(iterator, declarationEnd, [&changedNames](const Token& token) {
+                            return token.type == Token::Type::Identifier && changedNames.find(token.value) != changedNames.end();
+                        }))
+                        {
+                            changedNames.insert(oldDeclarations[oldIndex]->name);
+                            changedNames.insert(parseSourceDeclaration(iterator, tokens.end(), declarationScopes).name);
+                            ++changedCount;
+                        }
+                        else
+                        {
+                            relinkDeclaration(*oldDeclarations[oldIndex]);
+                            declarationScopes.back().push_back(oldDeclarations[oldIndex]);
+                            declarations.push_back(oldDeclarations[oldIndex]);
+                            sources.push_back(oldSources[oldIndex]);
+                            iterator = declarationEnd;
+                        }
+
+                        ++oldIndex;
+                    }
+                    else if (oldIndex + 1 < oldDeclarations.size() && isUnchanged(oldIndex + 1, iterator))
+                    {
+                        // the declaration was removed
+                        changedNames.insert(oldDeclarations[oldIndex++]->name);
+                        ++changedCount;
+                    }
+                    else
+                    {
+                        changedNames.insert(parseSourceDeclaration(iterator, tokens.end(), declarationScopes).name);
+                        ++changedCount;
+
+                        // the declaration was changed unless it follows the parsed one
+                        if (oldIndex < oldDeclarations.size() && !isUnchanged(oldIndex, iterator))
+                            changedNames.insert(oldDeclarations[oldIndex++]->name);
+                    }
+                }
+
+                changedCount += oldDeclarations.size() - oldIndex;
+            }
+            catch (...)
+            {
+                declarations = oldDeclarations;
+                sources = oldSources;
+
+                for (std::size_t i = 0; i < oldDeclarations.size(); ++i)
+                    oldDeclarations[i]->definition = oldDefinitions[i];
+
+                constructs.resize(oldConstructCount);
+
+                std::set<const Type*> newTypes;
+                for (auto i = oldTypeCount; i < types.size(); ++i)
+                    newTypes.insert(types[i].get());
+                removeTypes(newTypes);
+
+                throw;
+            }
+
+            // the struct types of the removed declarations and the arrays of them are removed with the constructs
+            const std::set<const Declaration*> keptDeclarations(declarations.begin(), declarations.end());
+            std::set<const Type*> removedTypes;
+            for (const auto declaration : oldDeclarations)
+                if (declaration->declarationKind == Declaration::Kind::Type && !keptDeclarations.count(declaration))
+                    removedTypes.insert(&static_cast<const TypeDeclaration*>(declaration)->type);
+
+            for (const auto& type : types)
+                if (type->typeKind == Type::Kind::Array &&
+                    removedTypes.count(&static_cast<const ArrayType&>(*type).elementType.type))
+                    removedTypes.insert(type.get());
+
+            // the constructs are kept in the order of the declarations
+            std::vector<std::unique_ptr<Construct>> oldConstructs;
+            oldConstructs.swap(constructs);
+            constructs.reserve(oldConstructs.size());
+
+            for (std::size_t i = 0; i < builtinConstructCount; ++i)
+                constructs.push_back(std::move(oldConstructs[i]));
+
+            for (auto& source : sources)
+            {
+                const auto constructOffset = constructs.size();
+
+                for (std::size_t i = 0; i < source.constructCount; ++i)
+                    constructs.push_back(std::move(oldConstructs[source.constructOffset + i]));
+
+                source.constructOffset = constructOffset;
+            }
+
+            oldConstructs.clear();
+            removeTypes(removedTypes);
+
+            return changedCount;
+        }
+
+        // the context owns every type and construct, including the ones created by the transformations
+        template <class T, class ...Args, typename std::enable_if<std::is_base_of<Type, T>::value>::type* = nullptr>
+        T& create(Args&&... args)
+        {
+            T* result;
+            types.push_back(std::unique_ptr<Type>(result = new T(std::forward<Args>(args)...)));
+            return *result;
+        }
+
+        template <class T, class ...Args, typename std::enable_if<std::is_base_of<Construct, T>::value>::type* = nullptr>
+        T& create(Args&&... args)
+        {
+            T* result;
+            auto& arena = constructArena ? *constructArena : constructs;
+            arena.push_back(std::unique_ptr<Construct>(result = new T(std::forward<Args>(args)...)));
+            return *result;
+        }
+
     private:
         [[nodiscard]]
         static bool isToken(Token::Type tokenType,
@@ -191,7 +519,7 @@ namespace ouzel
             if (iterator == end)
                 throw ParseError{ErrorCode::UnexpectedEndOfFile, "Unexpected end of file"};
             if (iterator->type != tokenType)
-                throw ParseError{ErrorCode::UnexpectedToken, "Expected " + toString(tokenType)};
+                throw ParseError{ErrorCode::UnexpectedToken, "Expected " + toString(tokenType), *iterator};
 
             return *iterator++;
         }
@@ -226,9 +554,10 @@ namespace ouzel
 
             if (skipToken(Token::Type::LeftParenthesis, iterator, end))
             {
-                const int index = std::stoi(expectToken(Token::Type::IntLiteral, iterator, end).value);
+                const auto& indexToken = expectToken(Token::Type::IntLiteral, iterator, end);
+                const int index = std::stoi(indexToken.value);
                 if (index < 0)
-                    throw ParseError{ErrorCode::InvalidIndex, "Index must be positive"};
+                    throw ParseError{ErrorCode::InvalidIndex, "Index must be positive", indexToken};
 
                 result = static_cast<std::size_t>(index);
 
@@ -329,10 +658,12 @@ namespace ouzel
         }
 
         [[nodiscard]]
-        static const FunctionDeclaration* resolveFunctionDeclaration(const std::string& name,
+        static const FunctionDeclaration* resolveFunctionDeclaration(const Token& nameToken,
                                                                      const DeclarationScopes& declarationScopes,
                                                                      const std::vector<QualifiedType>& arguments)
         {
+            const auto& name = nameToken.value;
+
             std::vector<const FunctionDeclaration*> candidateFunctionDeclarations;
 
             for (auto scopeIterator = declarationScopes.rbegin(); scopeIterator != declarationScopes.rend(); ++scopeIterator)
@@ -366,13 +697,13 @@ namespace ouzel
                     viableFunctionDeclarations.push_back(functionDeclaration);
 
             if (viableFunctionDeclarations.empty())
-                throw ParseError{ErrorCode::NoMatchingFunction, "No matching function to call " + name + " found"};
+                throw ParseError{ErrorCode::NoMatchingFunction, "No matching function to call " + name + " found", nameToken};
             else if (viableFunctionDeclarations.size() == 1)
                 return *viableFunctionDeclarations.begin();
             else
             {
                 if (arguments.empty()) // two or more functions with zero parameters
-                    throw ParseError{ErrorCode::AmbiguousCall, "Ambiguous call to " + name};
+                    throw ParseError{ErrorCode::AmbiguousCall, "Ambiguous call to " + name, nameToken};
 
                 const FunctionDeclaration* result = nullptr;
 
@@ -395,7 +726,7 @@ namespace ouzel
                         if (valid)
                         {
                             if (result)
-                                throw ParseError{ErrorCode::AmbiguousCall, "Ambiguous call to " + name};
+                                throw ParseError{ErrorCode::AmbiguousCall, "Ambiguous call to " + name, nameToken};
                             else
                                 result = viableFunctionDeclaration;
                         }
@@ -447,13 +778,21 @@ namespace ouzel
         {
             const QualifiedType qualifiedType{type};
 
+            std::lock_guard lock{arrayTypeMutex};
+
             const auto i = arrayTypes.find(std::make_pair(qualifiedType, count));
 
             if (i == arrayTypes.end())
             {
-                const auto& result = create<ArrayType>(qualifiedType, count);
-                arrayTypes[std::make_pair(qualifiedType, count)] = &result;
-                return result;
+                // the types are not changed while the function bodies are parsed in parallel
+                ArrayType* result;
+                if (constructArena)
+                    bodyTypes.push_back(std::unique_ptr<Type>(result = new ArrayType(qualifiedType, count)));
+                else
+                    result = &create<ArrayType>(qualifiedType, count);
+
+                arrayTypes[std::make_pair(qualifiedType, count)] = result;
+                return *result;
             }
             else
                 return *i->second;
@@ -490,22 +829,23 @@ namespace ouzel
                 case Token::Type::Int: result = &intType; break;
                 case Token::Type::Float: result = &floatType; break;
                 case Token::Type::Double:
-                    throw ParseError{ErrorCode::UnsupportedFeature, "Double precision floating point numbers are not supported"};
+                    throw ParseError{ErrorCode::UnsupportedFeature, "Double precision floating point numbers are not supported", token};
                 case Token::Type::Identifier:
                 {
                     if (!(result = findType(token.value, declarationScopes)))
-                        throw ParseError{ErrorCode::InvalidType, "Invalid type \"" + token.value + "\""};
+                        throw ParseError{ErrorCode::InvalidType, "Invalid type \"" + token.value + "\"", token};
                     break;
                 }
-                default: throw ParseError{ErrorCode::DeclarationExpected, "Expected a type name"};
+                default: throw ParseError{ErrorCode::DeclarationExpected, "Expected a type name", token};
             }
 
             while (skipToken(Token::Type::LeftBracket, iterator, end))
             {
-                const int size = std::stoi(expectToken(Token::Type::IntLiteral, iterator, end).value);
+                const auto& sizeToken = expectToken(Token::Type::IntLiteral, iterator, end);
+                const int size = std::stoi(sizeToken.value);
 
                 if (size <= 0)
-                    throw ParseError{ErrorCode::InvalidIndex, "Array size must be positive"};
+                    throw ParseError{ErrorCode::InvalidIndex, "Array size must be positive", sizeToken};
 
                 result = &getArrayType(*result, static_cast<std::size_t>(size));
 
@@ -521,7 +861,8 @@ namespace ouzel
             if (iterator == end)
                 throw ParseError{ErrorCode::UnexpectedEndOfFile, "Unexpected end of file"};
 
-            const auto& name = expectToken(Token::Type::Identifier, iterator, end).value;
+            const auto& nameToken = expectToken(Token::Type::Identifier, iterator, end);
+            const auto& name = nameToken.value;
 
             if (name == "Binormal")
                 return create<BinormalAttribute>(parseIndex(iterator, end));
@@ -550,7 +891,7 @@ namespace ouzel
             else if (name == "TextureCoordinates")
                 return create<TextureCoordinatesAttribute>(parseIndex(iterator, end));
             else
-                throw ParseError{ErrorCode::InvalidAttribute, "Invalid attribute"};
+                throw ParseError{ErrorCode::InvalidAttribute, "Invalid attribute", nameToken};
         }
 
         [[nodiscard]]
@@ -564,6 +905,140 @@ namespace ouzel
                 Token::Type::Var}, iterator, end);
         }
 
+        // the hash of the tokens of a top-level declaration, which is used to find the changed declarations
+        [[nodiscard]]
+        static std::uint64_t hashTokens(const TokenIterator begin, const TokenIterator end) noexcept
+        {
+            std::uint64_t result = 14695981039346656037ULL;
+
+            const auto hash = [&result](std::uint64_t value) noexcept {
+                result = (result ^ value) * 1099511628211ULL;
+            };
+
+            for (auto iterator = begin; iterator != end; ++iterator)
+            {
+                hash(static_cast<std::uint64_t>(iterator->type));
+                for (const auto c : iterator->value)
+                    hash(static_cast<unsigned char>(c));
+                hash(iterator->value.size());
+            }
+
+            return result;
+        }
+
+        // parses a top-level declaration and records its tokens and constructs
+        Declaration& parseSourceDeclaration(TokenIterator& iterator, const TokenIterator end,
+                                            DeclarationScopes& declarationScopes)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            const auto begin = iterator;
+            const auto constructOffset = constructs.size();
+
+            auto& declaration = parseTopLevelDeclaration(iterator, end, declarationScopes);
+            declarations.push_back(&declaration);
+            sources.push_back(Source{
+                static_cast<std::size_t>(iterator - begin),
+                hashTokens(begin, iterator),
+                constructOffset,
+                constructs.size() - constructOffset
+            });
+
+            if (tracer)
+                tracer->addEvent(declaration.name, "parse", start, std::chrono::steady_clock::now());
+
+            return declaration;
+        }
+
+        // parses a top-level declaration, if the errors are collected, an error is added to the diagnostics
+        // and the tokens are skipped until the next top-level declaration
+        void parseRecoveringDeclaration(TokenIterator& iterator, const TokenIterator end,
+                                        DeclarationScopes& declarationScopes)
+        {
+            const auto start = iterator;
+
+            try
+            {
+                parseSourceDeclaration(iterator, end, declarationScopes);
+            }
+            catch (const ParseError& error)
+            {
+                if (!diagnostics) throw;
+
+                addDiagnostic(error, iterator, end);
+                declarationScopes.resize(1);
+
+                if (iterator == start) ++iterator;
+
+                for (std::size_t depth = 0; iterator != end; ++iterator)
+                    if (depth == 0 && isToken({Token::Type::Struct,
+                        Token::Type::Inline,
+                        Token::Type::Function,
+                        Token::Type::Fragment,
+                        Token::Type::Vertex,
+                        Token::Type::Const,
+                        Token::Type::Extern,
+                        Token::Type::Var}, iterator, end))
+                        break;
+                    else if (iterator->type == Token::Type::LeftBrace)
+                        ++depth;
+                    else if (iterator->type == Token::Type::RightBrace && depth > 0)
+                        --depth;
+                    else if (iterator->type == Token::Type::Semicolon && depth == 0)
+                    {
+                        ++iterator;
+                        break;
+                    }
+            }
+        }
+
+        void addDiagnostic(const ParseError& error, const TokenIterator iterator, const TokenIterator end)
+        {
+            auto& result = diagnosticArena ? *diagnosticArena : *diagnostics;
+
+            if (error.hasPosition())
+            {
+                result.push_back(Diagnostic{error.getErrorCode(), error.what(),
+                    error.getLine(), error.getColumn(),
+                    error.getEndLine(), error.getEndColumn(),
+                    error.getFile()});
+                return;
+            }
+
+            // the errors at the end of the file are reported at the last token
+            const auto& token = (iterator != end) ? *iterator : *(iterator - 1);
+            result.push_back(Diagnostic{error.getErrorCode(), error.what(),
+                token.line, token.column,
+                token.line, token.column + std::max(token.length, std::uint32_t(1)),
+                token.file});
+        }
+
+        // sets the definition of a kept declaration as if it was parsed again after the declarations before it
+        static void relinkDeclaration(Declaration& declaration)
+        {
+            if (declaration.declarationKind == Declaration::Kind::Type ||
+                (declaration.declarationKind == Declaration::Kind::Callable &&
+                 static_cast<const CallableDeclaration&>(declaration).body))
+            {
+                for (auto previousDeclaration = &declaration; previousDeclaration; previousDeclaration = previousDeclaration->previousDeclaration)
+                    previousDeclaration->definition = &declaration;
+            }
+            else if (declaration.declarationKind == Declaration::Kind::Callable)
+                declaration.definition = declaration.previousDeclaration ? declaration.previousDeclaration->definition : nullptr;
+        }
+
+        void removeTypes(const std::set<const Type*>& removedTypes)
+        {
+            for (auto i = arrayTypes.begin(); i != arrayTypes.end();)
+                if (removedTypes.count(i->second))
+                    i = arrayTypes.erase(i);
+                else
+                    ++i;
+
+            types.erase(std::remove_if(types.begin(), types.end(), [&removedTypes](const std::unique_ptr<Type>& type) {
+                return removedTypes.count(type.get()) != 0;
+            }), types.end());
+        }
+
         [[nodiscard]]
         Declaration& parseTopLevelDeclaration(TokenIterator& iterator, const TokenIterator end,
                                               DeclarationScopes& declarationScopes)
@@ -575,7 +1050,7 @@ namespace ouzel
                 auto& callableDeclaration = static_cast<const CallableDeclaration&>(declaration);
 
                 // semicolon is not needed after a function definition
-                if (!callableDeclaration.body)
+                if (callableDeclaration.definition != &callableDeclaration)
                     expectToken(Token::Type::Semicolon, iterator, end);
             }
             else if (declaration.declarationKind == Declaration::Kind::Type)
@@ -594,7 +1069,7 @@ namespace ouzel
         {
             if (isToken(Token::Type::Struct, iterator, end))
                 return parseStructTypeDeclaration(iterator, end, declarationScopes);
-            else if (isToken({Token::Type::Function, Token::Type::Fragment, Token::Type::Vertex}, iterator, end))
+            else if (isToken({Token::Type::Inline, Token::Type::Function, Token::Type::Fragment, Token::Type::Vertex}, iterator, end))
                 return parseFunctionDeclaration(iterator, end, declarationScopes);
             else if (isToken({Token::Type::Const, Token::Type::Extern, Token::Type::Var}, iterator, end))
                 return parseVariableDeclaration(iterator, end, declarationScopes);
@@ -608,8 +1083,13 @@ namespace ouzel
         {
             FunctionDeclaration::Qualifier qualifier = FunctionDeclaration::Qualifier::None;
 
+            // only functions that are called can be inlined, so entry points can not be marked inline
+            const bool isInline = skipToken(Token::Type::Inline, iterator, end);
+
             if (skipToken(Token::Type::Function, iterator, end))
                 qualifier = FunctionDeclaration::Qualifier::None;
+            else if (isInline)
+                throw ParseError{ErrorCode::FunctionDeclarationExpected, "Expected a function declaration"};
             else if (skipToken(Token::Type::Fragment, iterator, end))
                 qualifier = FunctionDeclaration::Qualifier::Fragment;
             else if (skipToken(Token::Type::Vertex, iterator, end))
@@ -617,27 +1097,33 @@ namespace ouzel
             else
                 throw ParseError{ErrorCode::FunctionDeclarationExpected, "Expected a function declaration"};
 
-            const auto& name = expectToken(Token::Type::Identifier, iterator, end).value;
+            const auto& nameToken = expectToken(Token::Type::Identifier, iterator, end);
+            const auto& name = nameToken.value;
 
             const auto previousDeclarationInScope = findDeclaration(name, declarationScopes.back());
             if (previousDeclarationInScope &&
                 previousDeclarationInScope->declarationKind != Declaration::Kind::Callable)
-                throw ParseError{ErrorCode::SymbolRedeclaration, "Redeclaration of " + name};
+                throw ParseError{ErrorCode::SymbolRedeclaration, "Redeclaration of " + name, nameToken};
 
             expectToken(Token::Type::LeftParenthesis, iterator, end);
 
             std::vector<QualifiedType> parameterTypes;
             std::vector<ParameterDeclaration*> parameterDeclarations;
-            std::set<std::string> parameterNames;
 
             if (!isToken(Token::Type::RightParenthesis, iterator, end))
             {
                 for (;;)
                 {
+                    const auto parameterBegin = iterator;
                     auto& parameterDeclaration = parseParameterDeclaration(iterator, end, declarationScopes);
 
-                    if (!parameterNames.insert(parameterDeclaration.name).second)
-                        throw ParseError{ErrorCode::SymbolRedefinition, "Redefinition of parameter " + parameterDeclaration.name};
+                    // functions have few parameters, so a linear search is cheaper than a set
+                    if (std::find_if(parameterDeclarations.begin(), parameterDeclarations.end(),
+                                     [&parameterDeclaration](const ParameterDeclaration* previousParameterDeclaration) {
+                                         return previousParameterDeclaration->name == parameterDeclaration.name;
+                                     }) != parameterDeclarations.end())
+                        throw ParseError{ErrorCode::SymbolRedefinition, "Redefinition of parameter " + parameterDeclaration.name,
+                                         parameterBegin, iterator};
 
                     parameterDeclarations.push_back(&parameterDeclaration);
                     parameterTypes.push_back(parameterDeclaration.qualifiedType);
@@ -657,7 +1143,7 @@ namespace ouzel
 
             if (previousDeclaration &&
                 &previousDeclaration->resultType.type != &type)
-                throw ParseError{ErrorCode::FunctionRedeclarationWithDifferentReturnType, "Redeclaring function with different return type"};
+                throw ParseError{ErrorCode::FunctionRedeclarationWithDifferentReturnType, "Redeclaring function with different return type", nameToken};
 
             std::vector<AttributeRef> attributes;
             if (skipToken(Token::Type::Arrow, iterator, end))
@@ -666,7 +1152,7 @@ namespace ouzel
 
             auto& result = create<FunctionDeclaration>(name, QualifiedType{type}, StorageClass::Auto,
                                                        std::move(attributes), std::move(parameterDeclarations),
-                                                       qualifier);
+                                                       qualifier, false, isInline);
 
             if (previousDeclaration)
             {
@@ -683,25 +1169,16 @@ namespace ouzel
             {
                 // check if only one definition exists
                 if (result.definition)
-                    throw ParseError{ErrorCode::SymbolRedefinition, "Redefinition of " + result.name};
-
-                declarationScopes.push_back(DeclarationScope()); // add scope for parameters
+                    throw ParseError{ErrorCode::SymbolRedefinition, "Redefinition of " + result.name, nameToken};
 
-                for (const auto parameterDeclaration : result.parameterDeclarations)
-                    declarationScopes.back().push_back(parameterDeclaration);
-
-                std::vector<ReturnStatement*> returnStatements;
-                // parse body
-                const auto& body = parseCompoundStatement(iterator, end, declarationScopes, returnStatements);
-                result.body = &body;
-
-                if (!returnStatements.empty())
-                    for (const auto returnStatement : returnStatements)
-                    {
-                        const auto& returnType = returnStatement->result ? returnStatement->result->qualifiedType.type : voidType;
-                        if (&result.resultType.type != &returnType)
-                            throw ParseError{ErrorCode::WrongTypeInReturn, "Wrong type in return statement"};
-                    }
+                // the bodies of the top-level functions can be parsed later, because they see only the declarations before them
+                if (pendingBodies && declarationScopes.size() == 1)
+                {
+                    pendingBodies->push_back(PendingBody{&result, iterator, declarationScopes.back().size(), declarations.size()});
+                    skipBody(iterator, end);
+                }
+                else
+                    parseFunctionBody(result, iterator, end, declarationScopes);
 
                 // set the definition pointer of all previous declarations and check the result type
                 auto declaration = &result;
@@ -709,16 +1186,193 @@ namespace ouzel
                 {
                     declaration->definition = &result;
                     if (&declaration->resultType.type != &result.resultType.type)
-                        throw ParseError{ErrorCode::SymbolRedeclaration, "Redeclaring function with a different return type"};
+                        throw ParseError{ErrorCode::SymbolRedeclaration, "Redeclaring function with a different return type", nameToken};
                     declaration = static_cast<FunctionDeclaration*>(declaration->previousDeclaration);
                 }
-
-                declarationScopes.pop_back();
             }
 
             return result;
         }
 
+        void parseFunctionBody(FunctionDeclaration& result, TokenIterator& iterator, const TokenIterator end,
+                               DeclarationScopes& declarationScopes)
+        {
+            declarationScopes.push_back(DeclarationScope()); // add scope for parameters
+
+            for (const auto parameterDeclaration : result.parameterDeclarations)
+                declarationScopes.back().push_back(parameterDeclaration);
+
+            ReturnStatements returnStatements;
+            // parse body
+            const auto& body = parseCompoundStatement(iterator, end, declarationScopes, returnStatements);
+            result.body = &body;
+
+            if (!returnStatements.empty())
+                for (const auto& [returnStatement, returnToken] : returnStatements)
+                {
+                    const auto& returnType = returnStatement->result ? returnStatement->result->qualifiedType.type : voidType;
+                    if (&result.resultType.type != &returnType)
+                        throw ParseError{ErrorCode::WrongTypeInReturn, "Wrong type in return statement", *returnToken};
+                }
+
+            declarationScopes.pop_back();
+        }
+
+        static void skipBody(TokenIterator& iterator, const TokenIterator end)
+        {
+            std::size_t depth = 0;
+
+            do
+            {
+                const auto& token = getToken(iterator, end);
+                if (token.type == Token::Type::LeftBrace) ++depth;
+                else if (token.type == Token::Type::RightBrace) --depth;
+            }
+            while (depth > 0);
+        }
+
+        // parses the declarations with the function bodies skipped and then the bodies on the threads,
+        // each body is parsed into its own arena, so that the constructs are in the same order for any number of threads
+        void parseInParallel(const std::vector<Token>& tokens, DeclarationScopes& declarationScopes, std::size_t threadCount)
+        {
+            std::vector<PendingBody> bodies;
+            std::exception_ptr declarationError;
+
+            pendingBodies = &bodies;
+            try
+            {
+                for (auto iterator = tokens.begin(); iterator != tokens.end();)
+                    parseRecoveringDeclaration(iterator, tokens.end(), declarationScopes);
+            }
+            catch (...)
+            {
+                declarationError = std::current_exception();
+            }
+            pendingBodies = nullptr;
+
+            std::vector<std::vector<std::unique_ptr<Construct>>> arenas(bodies.size());
+            std::vector<std::vector<Diagnostic>> bodyDiagnostics(bodies.size());
+            std::vector<std::exception_ptr> bodyErrors(bodies.size());
+            std::atomic<std::size_t> nextBody{0};
+
+            const auto parseBodies = [&]() {
+                for (std::size_t i; (i = nextBody++) < bodies.size();)
+                {
+                    const auto start = std::chrono::steady_clock::now();
+                    const auto& body = bodies[i];
+
+                    constructArena = &arenas[i];
+                    diagnosticArena = &bodyDiagnostics[i];
+                    auto iterator = body.start;
+                    try
+                    {
+                        DeclarationScopes bodyScopes;
+                        bodyScopes.emplace_back(declarationScopes.front().begin(),
+                                                declarationScopes.front().begin() + static_cast<std::ptrdiff_t>(body.scopeSize));
+                        parseFunctionBody(*body.declaration, iterator, tokens.end(), bodyScopes);
+                    }
+                    catch (const ParseError& error)
+                    {
+                        if (diagnostics)
+                            addDiagnostic(error, iterator, tokens.end());
+                        else
+                            bodyErrors[i] = std::current_exception();
+                    }
+                    catch (...)
+                    {
+                        bodyErrors[i] = std::current_exception();
+                    }
+                    constructArena = nullptr;
+                    diagnosticArena = nullptr;
+
+                    if (tracer)
+                        tracer->addEvent(body.declaration->name, "parse body", start, std::chrono::steady_clock::now());
+                }
+            };
+
+            std::vector<std::thread> threads;
+            try
+            {
+                while (threads.size() + 1 < std::min(threadCount, bodies.size()))
+                    threads.emplace_back(parseBodies);
+            }
+            catch (...)
+            {
+                // the bodies are parsed by the threads that could be started
+            }
+
+            parseBodies();
+
+            for (auto& thread : threads)
+                thread.join();
+
+            // the bodies come before the declaration that failed to parse, so their errors are reported first
+            for (const auto& bodyError : bodyErrors)
+                if (bodyError) std::rethrow_exception(bodyError);
+
+            if (declarationError)
+                std::rethrow_exception(declarationError);
+
+            if (diagnostics)
+            {
+                for (const auto& diagnostic : bodyDiagnostics)
+                    diagnostics->insert(diagnostics->end(), diagnostic.begin(), diagnostic.end());
+
+                std::stable_sort(diagnostics->begin(), diagnostics->end(), [](const Diagnostic& a, const Diagnostic& b) {
+                    return a.line < b.line || (a.line == b.line && a.column < b.column);
+                });
+            }
+
+            for (auto& type : bodyTypes)
+                types.push_back(std::move(type));
+            bodyTypes.clear();
+
+            // the constructs of each body follow the constructs of its declaration
+            std::vector<std::unique_ptr<Construct>> declarationConstructs;
+            declarationConstructs.swap(constructs);
+
+            for (std::size_t i = 0; i < builtinConstructCount; ++i)
+                constructs.push_back(std::move(declarationConstructs[i]));
+
+            // the constructs of the declarations that failed to parse are kept between the sources,
+            // because the scopes of the later declarations and bodies can still point to them
+            const auto moveConstructs = [this, &declarationConstructs](std::size_t first, std::size_t last) {
+                for (auto c = first; c < last; ++c)
+                    constructs.push_back(std::move(declarationConstructs[c]));
+            };
+
+            const auto moveBody = [this, &bodies, &arenas](std::vector<PendingBody>::const_iterator body) {
+                for (auto& construct : arenas[static_cast<std::size_t>(body - bodies.cbegin())])
+                    constructs.push_back(std::move(construct));
+            };
+
+            auto nextConstruct = builtinConstructCount;
+            auto body = bodies.cbegin();
+            for (std::size_t i = 0; i < sources.size(); ++i)
+            {
+                auto& source = sources[i];
+                moveConstructs(nextConstruct, source.constructOffset);
+                nextConstruct = source.constructOffset + source.constructCount;
+
+                // the body of a function whose declaration failed after the body was skipped
+                for (; body != bodies.cend() && body->declarationIndex == i && body->declaration != declarations[i]; ++body)
+                    moveBody(body);
+
+                const auto constructOffset = constructs.size();
+                moveConstructs(source.constructOffset, nextConstruct);
+
+                if (body != bodies.cend() && body->declarationIndex == i)
+                    moveBody(body++);
+
+                source.constructOffset = constructOffset;
+                source.constructCount = constructs.size() - constructOffset;
+            }
+
+            moveConstructs(nextConstruct, declarationConstructs.size());
+            for (; body != bodies.cend(); ++body)
+                moveBody(body);
+        }
+
         [[nodiscard]]
         VariableDeclaration& parseVariableDeclaration(TokenIterator& iterator, const TokenIterator end,
                                                       DeclarationScopes& declarationScopes)
@@ -735,38 +1389,55 @@ namespace ouzel
             else
                 throw ParseError{ErrorCode::VariableDeclarationExpected, "Expected a variable declaration"};
 
-            const auto& name = expectToken(Token::Type::Identifier, iterator, end).value;
+            const auto& nameToken = expectToken(Token::Type::Identifier, iterator, end);
+            const auto& name = nameToken.value;
 
             const auto previousDeclarationInScope = findDeclaration(name, declarationScopes.back());
             if (previousDeclarationInScope)
-                throw ParseError{ErrorCode::SymbolRedeclaration, "Redeclaration of " + name};
+                throw ParseError{ErrorCode::SymbolRedeclaration, "Redeclaration of " + name, nameToken};
 
             const Type* type = nullptr;
             if (skipToken(Token::Type::Colon, iterator, end))
             {
+                const auto typeBegin = iterator;
                 type = &parseType(iterator, end, declarationScopes);
 
                 if (type->typeKind == Type::Kind::Void)
-                    throw ParseError{ErrorCode::IllegalVoidType, "Variable can not have the type \"void\""};
+                    throw ParseError{ErrorCode::IllegalVoidType, "Variable can not have the type \"void\"", typeBegin, iterator};
             }
 
-            const Expression* initialization;
+            const Expression* initialization = nullptr;
+            auto initializationBegin = iterator;
 
             if (skipToken(Token::Type::Assignment, iterator, end))
             {
+                initializationBegin = iterator;
                 initialization = &parseMultiplicationAssignmentExpression(iterator, end, declarationScopes);
 
                 if (initialization->qualifiedType.type.typeKind == Type::Kind::Void)
-                    throw ParseError{ErrorCode::IllegalVoidType, "Initialization with the type \"void\""};
+                    throw ParseError{ErrorCode::IllegalVoidType, "Initialization with the type \"void\"", initializationBegin, iterator};
 
                 if (!type)
                     type = &initialization->qualifiedType.type;
                 else if (type != &initialization->qualifiedType.type)
-                    throw ParseError{ErrorCode::InvalidInitializerType, "Initializer type does not match the variable type"};
+                    throw ParseError{ErrorCode::InvalidInitializerType, "Initializer type does not match the variable type",
+                                     initializationBegin, iterator};
             }
 
             if (!type)
-                throw ParseError{ErrorCode::MissingType, "Missing type for the variable"};
+                throw ParseError{ErrorCode::MissingType, "Missing type for the variable", nameToken};
+
+            // scalar and vector constants at the top level must be known at compile time
+            if (declarationScopes.size() == 1 &&
+                qualifiers == Type::Qualifiers::Const &&
+                Constant::getScalarType(*type))
+            {
+                if (!initialization)
+                    throw ParseError{ErrorCode::MissingInitializer, "Constant must have an initializer", nameToken};
+
+                if (!evaluate(*initialization))
+                    throw ParseError{ErrorCode::ExpressionNotConst, "Expression must be constant", initializationBegin, iterator};
+            }
 
             auto& result = create<VariableDeclaration>(name, QualifiedType{*type, qualifiers}, storageClass, initialization);
             declarationScopes.back().push_back(&result);
@@ -779,7 +1450,8 @@ namespace ouzel
         {
             expectToken(Token::Type::Struct, iterator, end);
 
-            const auto& name = expectToken(Token::Type::Identifier, iterator, end).value;
+            const auto& nameToken = expectToken(Token::Type::Identifier, iterator, end);
+            const auto& name = nameToken.value;
 
             // TODO: check if different kind of symbol with the same name does not exist
             auto previousDeclaration = findDeclaration(name, declarationScopes);
@@ -790,12 +1462,12 @@ namespace ouzel
             if (previousDeclaration)
             {
                 if (previousDeclaration->declarationKind != Declaration::Kind::Type)
-                    throw ParseError{ErrorCode::SymbolRedeclaration, "Redeclaration of " + name};
+                    throw ParseError{ErrorCode::SymbolRedeclaration, "Redeclaration of " + name, nameToken};
 
                 auto typeDeclaration = static_cast<TypeDeclaration*>(previousDeclaration);
 
                 if (typeDeclaration->type.typeKind != Type::Kind::Struct)
-                    throw ParseError{ErrorCode::SymbolRedeclaration, "Redeclaration of " + name};
+                    throw ParseError{ErrorCode::SymbolRedeclaration, "Redeclaration of " + name, nameToken};
 
                 firstDeclaration = typeDeclaration->firstDeclaration;
                 definition = typeDeclaration->definition;
@@ -811,10 +1483,12 @@ namespace ouzel
                     break;
                 else
                 {
+                    const auto memberBegin = iterator;
                     const auto& memberDeclaration = parseMemberDeclaration(iterator, end, declarationScopes);
 
                     if (!memberNames.insert(memberDeclaration.name).second)
-                        throw ParseError{ErrorCode::SymbolRedefinition, "Redefinition of member " + memberDeclaration.name};
+                        throw ParseError{ErrorCode::SymbolRedefinition, "Redefinition of member " + memberDeclaration.name,
+                                         memberBegin, iterator};
 
                     expectToken(Token::Type::Semicolon, iterator, end);
 
@@ -851,10 +1525,11 @@ namespace ouzel
 
             expectToken(Token::Type::Colon, iterator, end);
 
+            const auto typeBegin = iterator;
             const auto& type = parseType(iterator, end, declarationScopes);
 
             if (type.typeKind == Type::Kind::Void)
-                throw ParseError{ErrorCode::IllegalVoidType, "Member cannot have the type \"void\""};
+                throw ParseError{ErrorCode::IllegalVoidType, "Member cannot have the type \"void\"", typeBegin, iterator};
 
             std::vector<AttributeRef> attributes;
             if (skipToken(Token::Type::Arrow, iterator, end))
@@ -892,10 +1567,11 @@ namespace ouzel
 
             expectToken(Token::Type::Colon, iterator, end);
 
+            const auto typeBegin = iterator;
             const auto& type = parseType(iterator, end, declarationScopes);
 
             if (type.typeKind == Type::Kind::Void)
-                throw ParseError{ErrorCode::IllegalVoidType, "Parameter cannot have the type \"void\""};
+                throw ParseError{ErrorCode::IllegalVoidType, "Parameter cannot have the type \"void\"", typeBegin, iterator};
 
             std::vector<AttributeRef> attributes;
             if (skipToken(Token::Type::Arrow, iterator, end))
@@ -908,7 +1584,7 @@ namespace ouzel
         [[nodiscard]]
         Statement& parseStatement(TokenIterator& iterator, const TokenIterator end,
                                   DeclarationScopes& declarationScopes,
-                                  std::vector<ReturnStatement*>& returnStatements)
+                                  ReturnStatements& returnStatements)
         {
             if (isToken(Token::Type::LeftBrace, iterator, end))
                 return parseCompoundStatement(iterator, end, declarationScopes, returnStatements);
@@ -936,13 +1612,15 @@ namespace ouzel
                 expectToken(Token::Type::Semicolon, iterator, end);
                 return create<ContinueStatement>();
             }
-            else if (skipToken(Token::Type::Return, iterator, end))
+            else if (isToken(Token::Type::Return, iterator, end))
             {
+                const auto returnToken = iterator++;
+
                 auto& result = isToken(Token::Type::Semicolon, iterator, end) ?
                     create<ReturnStatement>() :
                     create<ReturnStatement>(&parseExpression(iterator, end, declarationScopes));
 
-                returnStatements.push_back(&result);
+                returnStatements.emplace_back(&result, returnToken);
 
                 expectToken(Token::Type::Semicolon, iterator, end);
 
@@ -960,12 +1638,13 @@ namespace ouzel
                 throw ParseError{ErrorCode::StatementExpected, "Expected a statement"};
             else if (isDeclaration(iterator, end))
             {
+                const auto declarationBegin = iterator;
                 const auto& declaration = parseDeclaration(iterator, end, declarationScopes);
 
                 if (declaration.declarationKind == Declaration::Kind::Variable)
                     expectToken(Token::Type::Semicolon, iterator, end);
                 else if (declaration.declarationKind != Declaration::Kind::Type)
-                    throw ParseError{ErrorCode::UnexpectedDeclaration, "Unexpected declaration"};
+                    throw ParseError{ErrorCode::UnexpectedDeclaration, "Unexpected declaration", declarationBegin, iterator};
 
                 return create<DeclarationStatement>(declaration);
             }
@@ -980,7 +1659,7 @@ namespace ouzel
         [[nodiscard]]
         CompoundStatement& parseCompoundStatement(TokenIterator& iterator, const TokenIterator end,
                                                   DeclarationScopes& declarationScopes,
-                                                  std::vector<ReturnStatement*>& returnStatements)
+                                                  ReturnStatements& returnStatements)
         {
             expectToken(Token::Type::LeftBrace, iterator, end);
 
@@ -991,8 +1670,44 @@ namespace ouzel
             for (;;)
                 if (skipToken(Token::Type::RightBrace, iterator, end))
                     break;
-                else
+                else if (!diagnostics)
                     statements.push_back(parseStatement(iterator, end, declarationScopes, returnStatements));
+                else
+                {
+                    const auto scopeCount = declarationScopes.size();
+
+                    try
+                    {
+                        statements.push_back(parseStatement(iterator, end, declarationScopes, returnStatements));
+                    }
+                    catch (const ParseError& error)
+                    {
+                        // the end of the file is reported by the top-level declaration
+                        if (iterator == end) throw;
+
+                        addDiagnostic(error, iterator, end);
+                        declarationScopes.resize(scopeCount);
+
+                        // skip to the end of the statement or of the block that contains it
+                        for (std::size_t depth = 0; iterator != end; ++iterator)
+                            if (iterator->type == Token::Type::LeftBrace)
+                                ++depth;
+                            else if (iterator->type == Token::Type::RightBrace)
+                            {
+                                if (depth == 0) break;
+                                if (--depth == 0)
+                                {
+                                    ++iterator;
+                                    break;
+                                }
+                            }
+                            else if (iterator->type == Token::Type::Semicolon && depth == 0)
+                            {
+                                ++iterator;
+                                break;
+                            }
+                    }
+                }
 
             declarationScopes.pop_back();
 
@@ -1001,19 +1716,20 @@ namespace ouzel
 
         IfStatement& parseIfStatement(TokenIterator& iterator, const TokenIterator end,
                                       DeclarationScopes& declarationScopes,
-                                      std::vector<ReturnStatement*>& returnStatements)
+                                      ReturnStatements& returnStatements)
         {
             expectToken(Token::Type::If, iterator, end);
             expectToken(Token::Type::LeftParenthesis, iterator, end);
 
             const Construct* condition = nullptr;
+            const auto conditionBegin = iterator;
 
             if (isDeclaration(iterator, end))
             {
                 const auto& declaration = parseVariableDeclaration(iterator, end, declarationScopes);
 
                 if (!isBooleanType(declaration.qualifiedType.type))
-                    throw ParseError{ErrorCode::ConditionNotBoolean, "Condition is not of the type \"bool\""};
+                    throw ParseError{ErrorCode::ConditionNotBoolean, "Condition is not of the type \"bool\"", conditionBegin, iterator};
 
                 condition = &declaration;
             }
@@ -1022,7 +1738,7 @@ namespace ouzel
                 const auto& expression = parseExpression(iterator, end, declarationScopes);
 
                 if (!isBooleanType(expression.qualifiedType.type))
-                    throw ParseError{ErrorCode::ConditionNotBoolean, "Condition is not of the type \"bool\""};
+                    throw ParseError{ErrorCode::ConditionNotBoolean, "Condition is not of the type \"bool\"", conditionBegin, iterator};
 
                 condition = &expression;
             }
@@ -1039,7 +1755,7 @@ namespace ouzel
 
         ForStatement& parseForStatement(TokenIterator& iterator, const TokenIterator end,
                                         DeclarationScopes& declarationScopes,
-                                        std::vector<ReturnStatement*>& returnStatements)
+                                        ReturnStatements& returnStatements)
         {
             expectToken(Token::Type::For, iterator, end);
             expectToken(Token::Type::LeftParenthesis, iterator, end);
@@ -1063,16 +1779,17 @@ namespace ouzel
             }
 
             const Construct* condition = nullptr;
+            const auto conditionBegin = iterator;
 
             if (isDeclaration(iterator, end))
             {
                 const auto& declaration = parseVariableDeclaration(iterator, end, declarationScopes);
 
                 if (!declaration.initialization)
-                    throw ParseError{ErrorCode::MissingInitializer, "Condition must have an initializer"};
+                    throw ParseError{ErrorCode::MissingInitializer, "Condition must have an initializer", conditionBegin, iterator};
 
                 if (!isBooleanType(declaration.qualifiedType.type))
-                    throw ParseError{ErrorCode::ConditionNotBoolean, "Condition is not of the type \"bool\""};
+                    throw ParseError{ErrorCode::ConditionNotBoolean, "Condition is not of the type \"bool\"", conditionBegin, iterator};
 
                 condition = &declaration;
 
@@ -1085,7 +1802,7 @@ namespace ouzel
                 auto& expression = parseExpression(iterator, end, declarationScopes);
 
                 if (!isBooleanType(expression.qualifiedType.type))
-                    throw ParseError{ErrorCode::ConditionNotBoolean, "Condition is not of the type \"bool\""};
+                    throw ParseError{ErrorCode::ConditionNotBoolean, "Condition is not of the type \"bool\"", conditionBegin, iterator};
 
                 condition = &expression;
 
@@ -1109,19 +1826,20 @@ namespace ouzel
 
         SwitchStatement& parseSwitchStatement(TokenIterator& iterator, const TokenIterator end,
                                               DeclarationScopes& declarationScopes,
-                                              std::vector<ReturnStatement*>& returnStatements)
+                                              ReturnStatements& returnStatements)
         {
             expectToken(Token::Type::Switch, iterator, end);
             expectToken(Token::Type::LeftParenthesis, iterator, end);
 
             const Construct* condition = nullptr;
+            const auto conditionBegin = iterator;
 
             if (isDeclaration(iterator, end))
             {
                 const auto& declaration = parseVariableDeclaration(iterator, end, declarationScopes);
 
                 if (!isIntegerType(declaration.qualifiedType.type))
-                    throw ParseError{ErrorCode::IntegerTypeExpected, "Statement requires expression of integer type"};
+                    throw ParseError{ErrorCode::IntegerTypeExpected, "Statement requires expression of integer type", conditionBegin, iterator};
 
                 condition = &declaration;
             }
@@ -1130,7 +1848,7 @@ namespace ouzel
                 const auto& expression = parseExpression(iterator, end, declarationScopes);
 
                 if (!isIntegerType(expression.qualifiedType.type))
-                    throw ParseError{ErrorCode::IntegerTypeExpected, "Statement requires expression of integer type"};
+                    throw ParseError{ErrorCode::IntegerTypeExpected, "Statement requires expression of integer type", conditionBegin, iterator};
 
                 condition = &expression;
             }
@@ -1144,17 +1862,18 @@ namespace ouzel
 
         CaseStatement& parseCaseStatement(TokenIterator& iterator, const TokenIterator end,
                                           DeclarationScopes& declarationScopes,
-                                          std::vector<ReturnStatement*>& returnStatements)
+                                          ReturnStatements& returnStatements)
         {
             expectToken(Token::Type::Case, iterator, end);
 
+            const auto conditionBegin = iterator;
             const auto& condition = parseExpression(iterator, end, declarationScopes);
 
             if (!isIntegerType(condition.qualifiedType.type))
-                throw ParseError{ErrorCode::IntegerTypeExpected, "Statement requires expression of integer type"};
+                throw ParseError{ErrorCode::IntegerTypeExpected, "Statement requires expression of integer type", conditionBegin, iterator};
 
-            if ((condition.qualifiedType.qualifiers & Type::Qualifiers::Const) != Type::Qualifiers::Const)
-                throw ParseError{ErrorCode::ExpressionNotConst, "Expression must be constant"};
+            if (!evaluate(condition))
+                throw ParseError{ErrorCode::ExpressionNotConst, "Expression must be constant", conditionBegin, iterator};
 
             expectToken(Token::Type::Colon, iterator, end);
 
@@ -1165,7 +1884,7 @@ namespace ouzel
 
         DefaultStatement& parseDefaultStatement(TokenIterator& iterator, const TokenIterator end,
                                                 DeclarationScopes& declarationScopes,
-                                                std::vector<ReturnStatement*>& returnStatements)
+                                                ReturnStatements& returnStatements)
         {
             expectToken(Token::Type::Default, iterator, end);
             expectToken(Token::Type::Colon, iterator, end);
@@ -1175,19 +1894,20 @@ namespace ouzel
 
         WhileStatement& parseWhileStatement(TokenIterator& iterator, const TokenIterator end,
                                             DeclarationScopes& declarationScopes,
-                                            std::vector<ReturnStatement*>& returnStatements)
+                                            ReturnStatements& returnStatements)
         {
             expectToken(Token::Type::While, iterator, end);
             expectToken(Token::Type::LeftParenthesis, iterator, end);
 
             const Construct* condition = nullptr;
+            const auto conditionBegin = iterator;
 
             if (isDeclaration(iterator, end))
             {
                 const auto& declaration = parseVariableDeclaration(iterator, end, declarationScopes);
 
                 if (!isBooleanType(declaration.qualifiedType.type))
-                    throw ParseError{ErrorCode::ConditionNotBoolean, "Condition is not of the type \"bool\""};
+                    throw ParseError{ErrorCode::ConditionNotBoolean, "Condition is not of the type \"bool\"", conditionBegin, iterator};
 
                 condition = &declaration;
             }
@@ -1196,7 +1916,7 @@ namespace ouzel
                 const auto& expression = parseExpression(iterator, end, declarationScopes);
 
                 if (!isBooleanType(expression.qualifiedType.type))
-                    throw ParseError{ErrorCode::ConditionNotBoolean, "Condition is not of the type \"bool\""};
+                    throw ParseError{ErrorCode::ConditionNotBoolean, "Condition is not of the type \"bool\"", conditionBegin, iterator};
 
                 condition = &expression;
             }
@@ -1210,7 +1930,7 @@ namespace ouzel
 
         DoStatement& parseDoStatement(TokenIterator& iterator, const TokenIterator end,
                                       DeclarationScopes& declarationScopes,
-                                      std::vector<ReturnStatement*>& returnStatements)
+                                      ReturnStatements& returnStatements)
         {
             expectToken(Token::Type::Do, iterator, end);
 
@@ -1219,10 +1939,11 @@ namespace ouzel
             expectToken(Token::Type::While, iterator, end);
             expectToken(Token::Type::LeftParenthesis, iterator, end);
 
+            const auto conditionBegin = iterator;
             const auto& condition = parseExpression(iterator, end, declarationScopes);
 
             if (!isBooleanType(condition.qualifiedType.type))
-                throw ParseError{ErrorCode::ConditionNotBoolean, "Condition is not of the type \"bool\""};
+                throw ParseError{ErrorCode::ConditionNotBoolean, "Condition is not of the type \"bool\"", conditionBegin, iterator};
 
             expectToken(Token::Type::RightParenthesis, iterator, end);
             expectToken(Token::Type::Semicolon, iterator, end);
@@ -1265,13 +1986,14 @@ namespace ouzel
             }
             else if (isToken({Token::Type::Bool, Token::Type::Int, Token::Type::Float, Token::Type::Double}, iterator, end))
             {
+                const auto& typeToken = *iterator;
                 const Type* type = nullptr;
 
                 if (skipToken(Token::Type::Bool, iterator, end)) type = &boolType;
                 else if(skipToken(Token::Type::Int, iterator, end)) type = &intType;
                 else if(skipToken(Token::Type::Float, iterator, end)) type = &floatType;
                 else if(skipToken(Token::Type::Double, iterator, end))
-                    throw ParseError{ErrorCode::UnsupportedFeature, "Double precision floating point numbers are not supported"};
+                    throw ParseError{ErrorCode::UnsupportedFeature, "Double precision floating point numbers are not supported", typeToken};
 
                 expectToken(Token::Type::LeftParenthesis, iterator, end);
 
@@ -1286,12 +2008,14 @@ namespace ouzel
 
                 for (;;)
                 {
+                    const auto expressionBegin = iterator;
                     const auto& expression = parseMultiplicationAssignmentExpression(iterator, end, declarationScopes);
 
                     if (!type)
                         type = &expression.qualifiedType.type;
                     else if (type != &expression.qualifiedType.type)
-                        throw ParseError{ErrorCode::ConflictingTypesInInitializerList, "Conflicting types in initializer list"};
+                        throw ParseError{ErrorCode::ConflictingTypesInInitializerList, "Conflicting types in initializer list",
+                                         expressionBegin, iterator};
 
                     expressions.push_back(expression);
 
@@ -1306,8 +2030,8 @@ namespace ouzel
             }
             else if (isToken(Token::Type::Identifier, iterator, end))
             {
-                const std::string name = iterator->value;
-                ++iterator;
+                const auto nameToken = iterator++;
+                const std::string name = nameToken->value;
 
                 if (skipToken(Token::Type::LeftParenthesis, iterator, end))
                 {
@@ -1341,14 +2065,14 @@ namespace ouzel
                                 const auto constructorDeclaration = findConstructorDeclaration(*structType, parameterTypes);
 
                                 if (!constructorDeclaration)
-                                    throw ParseError{ErrorCode::NoConstructorFound, "No matching constructor found"};
+                                    throw ParseError{ErrorCode::NoConstructorFound, "No matching constructor found", nameToken, iterator};
 
                                 return create<TemporaryObjectExpression>(*structType, *constructorDeclaration, std::move(parameters));
                             }
                             case Type::Kind::Vector:
                             {
                                 if (parameters.empty())
-                                    throw ParseError{ErrorCode::EmptyVectorInitializer, "Vector cannot not have an empty initializer"};
+                                    throw ParseError{ErrorCode::EmptyVectorInitializer, "Vector cannot not have an empty initializer", nameToken, iterator};
 
                                 const auto vectorType = static_cast<const VectorType*>(type);
 
@@ -1360,7 +2084,7 @@ namespace ouzel
                                     if (parameterType.typeKind == Type::Kind::Scalar)
                                     {
                                         if (&parameterType != &vectorType->componentType)
-                                            throw ParseError{ErrorCode::InvalidVectorInitialization, "Invalid vector initialization"};
+                                            throw ParseError{ErrorCode::InvalidVectorInitialization, "Invalid vector initialization", nameToken, iterator};
 
                                         ++componentCount;
                                     }
@@ -1368,21 +2092,21 @@ namespace ouzel
                                     {
                                         const auto& vectorParameterType = static_cast<const VectorType&>(parameterType);
                                         if (&vectorParameterType.componentType != &vectorType->componentType)
-                                            throw ParseError{ErrorCode::InvalidVectorInitialization, "Invalid vector initialization"};
+                                            throw ParseError{ErrorCode::InvalidVectorInitialization, "Invalid vector initialization", nameToken, iterator};
 
                                         componentCount += vectorParameterType.componentCount;
                                     }
                                 }
 
                                 if (componentCount != vectorType->componentCount)
-                                    throw ParseError{ErrorCode::InvalidVectorInitialization, "Invalid vector initialization"};
+                                    throw ParseError{ErrorCode::InvalidVectorInitialization, "Invalid vector initialization", nameToken, iterator};
 
                                 return create<VectorInitializeExpression>(*vectorType, std::move(parameters));
                             }
                             case Type::Kind::Matrix:
                             {
                                 if (parameters.empty())
-                                    throw ParseError{ErrorCode::EmptyMatrixInitializer, "Matrix cannot not have an empty initializer"};
+                                    throw ParseError{ErrorCode::EmptyMatrixInitializer, "Matrix cannot not have an empty initializer", nameToken, iterator};
 
                                 const auto matrixType = static_cast<const MatrixType*>(type);
 
@@ -1396,7 +2120,7 @@ namespace ouzel
                                         const auto& vectorParameterType = static_cast<const VectorType&>(parameterType);
 
                                         if (&vectorParameterType != &matrixType->rowType)
-                                            throw ParseError{ErrorCode::InvalidMatrixInitialization, "Invalid matrix initialization"};
+                                            throw ParseError{ErrorCode::InvalidMatrixInitialization, "Invalid matrix initialization", nameToken, iterator};
 
                                         ++rowCount;
                                     }
@@ -1406,7 +2130,7 @@ namespace ouzel
 
                                         if (&matrixParameterType.rowType != &matrixType->rowType ||
                                             matrixParameterType.rowCount != matrixType->rowCount)
-                                            throw ParseError{ErrorCode::InvalidMatrixInitialization, "Invalid matrix initialization"};
+                                            throw ParseError{ErrorCode::InvalidMatrixInitialization, "Invalid matrix initialization", nameToken, iterator};
 
                                         rowCount += matrixParameterType.rowCount;
                                     }
@@ -1414,12 +2138,12 @@ namespace ouzel
                                 }
 
                                 if (rowCount != matrixType->rowCount)
-                                    throw ParseError{ErrorCode::InvalidMatrixInitialization, "Invalid matrix initialization"};
+                                    throw ParseError{ErrorCode::InvalidMatrixInitialization, "Invalid matrix initialization", nameToken, iterator};
 
                                 return create<MatrixInitializeExpression>(*matrixType, std::move(parameters));
                             }
                             default:
-                                throw ParseError{ErrorCode::StructTypeExpected, "Expected a struct type"};
+                                throw ParseError{ErrorCode::StructTypeExpected, "Expected a struct type", nameToken, iterator};
                         }
                     }
                     else
@@ -1443,9 +2167,14 @@ namespace ouzel
                             expectToken(Token::Type::RightParenthesis, iterator, end);
                         }
 
-                        const auto functionDeclaration = resolveFunctionDeclaration(name, declarationScopes, argumentTypes);
+                        const FunctionDeclaration* functionDeclaration;
+                        {
+                            TraceScope traceScope{tracer, name, "resolve"};
+                            functionDeclaration = resolveFunctionDeclaration(*nameToken, declarationScopes, argumentTypes);
+                        }
+
                         if (!functionDeclaration)
-                            throw ParseError{ErrorCode::InvalidDeclarationReference, "Invalid function reference \"" + name + "\""};
+                            throw ParseError{ErrorCode::InvalidDeclarationReference, "Invalid function reference \"" + name + "\"", *nameToken};
 
                         const auto& declRefExpression = create<DeclarationReferenceExpression>(functionDeclaration->resultType,
                                                                                                *functionDeclaration,
@@ -1458,10 +2187,17 @@ namespace ouzel
                 {
                     const auto declaration = findDeclaration(name, declarationScopes);
                     if (!declaration)
-                        throw ParseError{ErrorCode::InvalidDeclarationReference, "Invalid declaration reference \"" + name + "\""};
+                        throw ParseError{ErrorCode::InvalidDeclarationReference, "Invalid declaration reference \"" + name + "\"", *nameToken};
+
+                    if (declaration->declarationKind == Declaration::Kind::Parameter)
+                    {
+                        const auto parameterDeclaration = static_cast<ParameterDeclaration*>(declaration);
+
+                        return create<DeclarationReferenceExpression>(parameterDeclaration->qualifiedType, *declaration, Expression::Category::Lvalue);
+                    }
 
                     if (declaration->declarationKind != Declaration::Kind::Variable)
-                        throw ParseError{ErrorCode::VariableDeclarationExpected, "Expected a variable declaration"};
+                        throw ParseError{ErrorCode::VariableDeclarationExpected, "Expected a variable declaration", *nameToken};
 
                     const auto variableDeclaration = static_cast<VariableDeclaration*>(declaration);
 
@@ -1470,7 +2206,9 @@ namespace ouzel
             }
             else if (skipToken(Token::Type::LeftParenthesis, iterator, end))
             {
-                if (isType(iterator, end, declarationScopes))
+                // a type followed by a parenthesis is a constructor call, not a cast
+                if (isType(iterator, end, declarationScopes) &&
+                    !isToken(Token::Type::LeftParenthesis, std::next(iterator), end))
                 {
                     const auto& type = parseType(iterator, end, declarationScopes);
 
@@ -1518,27 +2256,30 @@ namespace ouzel
         Expression& parsePostfixExpression(TokenIterator& iterator, const TokenIterator end,
                                            DeclarationScopes& declarationScopes)
         {
+            const auto expressionBegin = iterator;
             auto result = &parsePrimaryExpression(iterator, end, declarationScopes);
 
             while (isToken({Token::Type::Increment, Token::Type::Decrement}, iterator, end))
             {
                 if (result->category != Expression::Category::Lvalue)
-                    throw ParseError{ErrorCode::ExpressionNotAssignable, "Expression is not assignable"};
+                    throw ParseError{ErrorCode::ExpressionNotAssignable, "Expression is not assignable", expressionBegin, iterator};
 
                 if ((result->qualifiedType.qualifiers & Type::Qualifiers::Const) == Type::Qualifiers::Const)
-                    throw ParseError{ErrorCode::ExpressionNotAssignable, "Cannot assign to const variable"};
+                    throw ParseError{ErrorCode::ExpressionNotAssignable, "Cannot assign to const variable", expressionBegin, iterator};
 
                 if (result->qualifiedType.type.typeKind != Type::Kind::Scalar)
-                    throw ParseError{ErrorCode::NumberTypeExpected, "Parameter of the postfix operator must be a number"};
+                    throw ParseError{ErrorCode::NumberTypeExpected, "Parameter of the postfix operator must be a number",
+                                     expressionBegin, iterator};
 
                 const auto operatorKind = (iterator->type == Token::Type::Increment) ?
                     UnaryOperatorExpression::Kind::PostfixIncrement :
                     UnaryOperatorExpression::Kind::PostfixDecrement;
 
-                ++iterator;
+                const auto operatorToken = iterator++;
 
                 const auto& unaryOperator = getUnaryOperator(operatorKind,
-                                                             result->qualifiedType.type);
+                                                             result->qualifiedType.type,
+                                                             *operatorToken);
 
                 result = &create<UnaryOperatorExpression>(operatorKind, unaryOperator.resultType, Expression::Category::Lvalue, *result);
             }
@@ -1549,15 +2290,18 @@ namespace ouzel
         Expression& parseSubscriptExpression(TokenIterator& iterator, const TokenIterator end,
                                              DeclarationScopes& declarationScopes)
         {
+            const auto expressionBegin = iterator;
             auto result = &parsePostfixExpression(iterator, end, declarationScopes);
 
-            while (skipToken(Token::Type::LeftBracket, iterator, end))
+            while (isToken(Token::Type::LeftBracket, iterator, end))
             {
+                const auto bracketToken = iterator++;
+
                 if (result->qualifiedType.type.typeKind == Type::Kind::Array)
                 {
                     const auto& subscript = parseExpression(iterator, end, declarationScopes);
                     if (!isIntegerType(subscript.qualifiedType.type))
-                        throw ParseError{ErrorCode::InvalidSubscript, "Subscript is not an integer"};
+                        throw ParseError{ErrorCode::InvalidSubscript, "Subscript is not an integer", std::next(bracketToken), iterator};
 
                     expectToken(Token::Type::RightBracket, iterator, end);
 
@@ -1571,7 +2315,7 @@ namespace ouzel
 
                     const auto& rightExpression = parseExpression(iterator, end, declarationScopes);
                     if (!isIntegerType(rightExpression.qualifiedType.type))
-                        throw ParseError{ErrorCode::InvalidSubscript, "Subscript is not an integer"};
+                        throw ParseError{ErrorCode::InvalidSubscript, "Subscript is not an integer", std::next(bracketToken), iterator};
 
                     expectToken(Token::Type::RightBracket, iterator, end);
 
@@ -1592,24 +2336,25 @@ namespace ouzel
                     result = &create<BinaryOperatorExpression>(operatorKind, *type, result->category, *result, rightExpression);
                 }
                 else
-                    throw ParseError{ErrorCode::ArrayTypeExpected, "Subscript value is not an array"};
+                    throw ParseError{ErrorCode::ArrayTypeExpected, "Subscript value is not an array", expressionBegin, bracketToken};
             }
 
             return *result;
         }
 
-        static constexpr std::uint8_t charToComponent(char c)
+        static std::uint8_t charToComponent(char c, const Token& token)
         {
             return (c == 'x' || c == 'r') ? 0 :
                 (c == 'y' || c == 'g') ? 1 :
                 (c == 'z' || c == 'b') ? 2 :
                 (c == 'w' || c == 'a') ? 3 :
-                throw ParseError{ErrorCode::InvalidSwizzle, "Invalid component"};
+                throw ParseError{ErrorCode::InvalidSwizzle, "Invalid component", token};
         }
 
         Expression& parseMemberExpression(TokenIterator& iterator, const TokenIterator end,
                                           DeclarationScopes& declarationScopes)
         {
+            const auto expressionBegin = iterator;
             auto result = &parseSubscriptExpression(iterator, end, declarationScopes);
 
             while (isToken({Token::Type::Dot, Token::Type::Arrow}, iterator, end))
@@ -1617,62 +2362,71 @@ namespace ouzel
                 if (isToken(Token::Type::Arrow, iterator, end))
                     throw ParseError{ErrorCode::UnsupportedFeature, "Pointer member access is not supported"};
 
-                ++iterator;
+                const auto operatorToken = iterator++;
 
                 if (result->qualifiedType.type.typeKind == Type::Kind::Void)
-                    throw ParseError{ErrorCode::IllegalVoidType, "Expression has a void type"};
+                    throw ParseError{ErrorCode::IllegalVoidType, "Expression has a void type", expressionBegin, operatorToken};
 
                 if (result->qualifiedType.type.typeKind == Type::Kind::Struct)
                 {
                     const auto& structType = static_cast<const StructType&>(result->qualifiedType.type);
 
-                    const auto& name = expectToken(Token::Type::Identifier, iterator, end).value;
+                    const auto& nameToken = expectToken(Token::Type::Identifier, iterator, end);
+                    const auto& name = nameToken.value;
 
                     const auto memberDeclaration = findMemberDeclaration(structType, name);
                     if (!memberDeclaration)
-                        throw ParseError{ErrorCode::InvalidMember, "Structure \"" + structType.name +  "\" has no member \"" + name + "\""};
+                        throw ParseError{ErrorCode::InvalidMember, "Structure \"" + structType.name +  "\" has no member \"" + name + "\"", nameToken};
 
                     if (memberDeclaration->declarationKind != Declaration::Kind::Field)
-                        throw ParseError{ErrorCode::InvalidMember, "\"" + iterator->value + "\" is not a field"};
+                        throw ParseError{ErrorCode::InvalidMember, "\"" + name + "\" is not a field", nameToken};
 
                     result = &create<MemberExpression>(*result, *static_cast<const FieldDeclaration*>(memberDeclaration));
                 }
                 else if (result->qualifiedType.type.typeKind == Type::Kind::Vector)
                 {
                     std::vector<std::uint8_t> components;
-                    std::set<std::uint8_t> componentSet;
+                    std::uint8_t componentMask = 0;
 
                     Expression::Category category = result->category;
                     Type::Qualifiers qualifiers = Type::Qualifiers::None;
 
                     const auto& token = expectToken(Token::Type::Identifier, iterator, end);
 
+                    components.reserve(token.value.size());
+
                     for (const auto c : token.value)
                     {
-                        const auto component = charToComponent(c);
-                        if (!componentSet.insert(component).second) // has component repeated
+                        const auto component = charToComponent(c, token);
+                        if (componentMask & (1U << component)) // has component repeated
                         {
                             category = Expression::Category::Rvalue;
                             qualifiers |= Type::Qualifiers::Const;
                         }
 
+                        componentMask |= static_cast<std::uint8_t>(1U << component);
+
                         components.push_back(component);
                     }
 
                     const auto& vectorType = static_cast<const VectorType&>(result->qualifiedType.type);
 
-                    const auto resultType = findVectorType(vectorType.componentType, components.size());
+                    // a single component selects a scalar
+                    const Type* resultType = (components.size() == 1) ?
+                        static_cast<const Type*>(&vectorType.componentType) :
+                        findVectorType(vectorType.componentType, components.size());
                     if (!resultType)
-                        throw ParseError{ErrorCode::InvalidSwizzle, "Invalid swizzle"};
+                        throw ParseError{ErrorCode::InvalidSwizzle, "Invalid swizzle", token};
 
                     for (const auto component : components)
                         if (component >= vectorType.componentCount)
-                            throw ParseError{ErrorCode::InvalidSwizzle, "Invalid swizzle"};
+                            throw ParseError{ErrorCode::InvalidSwizzle, "Invalid swizzle", token};
 
-                    result = &create<VectorElementExpression>(*resultType, qualifiers, category, std::move(components));
+                    result = &create<VectorElementExpression>(*result, *resultType, qualifiers, category, std::move(components));
                 }
                 else
-                    throw ParseError{ErrorCode::StructTypeExpected, "\"" + result->qualifiedType.type.name + "\" is not a structure"};
+                    throw ParseError{ErrorCode::StructTypeExpected, "\"" + result->qualifiedType.type.name + "\" is not a structure",
+                                     expressionBegin, operatorToken};
             }
 
             return *result;
@@ -1687,18 +2441,19 @@ namespace ouzel
                     UnaryOperatorExpression::Kind::PrefixIncrement :
                     UnaryOperatorExpression::Kind::PrefixDecrement;
 
-                ++iterator;
+                const auto operatorToken = iterator++;
 
                 const auto& expression = parseMemberExpression(iterator, end, declarationScopes);
 
                 if (expression.category != Expression::Category::Lvalue)
-                    throw ParseError{ErrorCode::ExpressionNotAssignable, "Expression is not assignable"};
+                    throw ParseError{ErrorCode::ExpressionNotAssignable, "Expression is not assignable", std::next(operatorToken), iterator};
 
                 if ((expression.qualifiedType.qualifiers & Type::Qualifiers::Const) == Type::Qualifiers::Const)
-                    throw ParseError{ErrorCode::ExpressionNotAssignable, "Cannot assign to const variable"};
+                    throw ParseError{ErrorCode::ExpressionNotAssignable, "Cannot assign to const variable", std::next(operatorToken), iterator};
 
                 const auto& unaryOperator = getUnaryOperator(operatorKind,
-                                                             expression.qualifiedType.type);
+                                                             expression.qualifiedType.type,
+                                                             *operatorToken);
 
                 return create<UnaryOperatorExpression>(operatorKind, unaryOperator.resultType, Expression::Category::Rvalue, expression);
             }
@@ -1715,12 +2470,13 @@ namespace ouzel
                     UnaryOperatorExpression::Kind::Positive :
                     UnaryOperatorExpression::Kind::Negative;
 
-                ++iterator;
+                const auto operatorToken = iterator++;
 
                 const auto& expression = parsePrefixExpression(iterator, end, declarationScopes);
 
                 const auto& unaryOperator = getUnaryOperator(operatorKind,
-                                                             expression.qualifiedType.type);
+                                                             expression.qualifiedType.type,
+                                                             *operatorToken);
 
                 return create<UnaryOperatorExpression>(operatorKind, unaryOperator.resultType, Expression::Category::Rvalue, expression);
             }
@@ -1731,14 +2487,16 @@ namespace ouzel
         Expression& parseNotExpression(TokenIterator& iterator, const TokenIterator end,
                                        DeclarationScopes& declarationScopes)
         {
-            if (skipToken(Token::Type::Not, iterator, end))
+            if (isToken(Token::Type::Not, iterator, end))
             {
+                const auto operatorToken = iterator++;
                 const auto operatorKind = UnaryOperatorExpression::Kind::Negation;
 
                 const auto& expression = parseExpression(iterator, end, declarationScopes);
 
                 const auto& unaryOperator = getUnaryOperator(operatorKind,
-                                                             expression.qualifiedType.type);
+                                                             expression.qualifiedType.type,
+                                                             *operatorToken);
 
                 return create<UnaryOperatorExpression>(operatorKind, unaryOperator.resultType, Expression::Category::Rvalue, expression);
             }
@@ -1757,13 +2515,14 @@ namespace ouzel
                     BinaryOperatorExpression::Kind::Multiplication :
                     BinaryOperatorExpression::Kind::Division;
 
-                ++iterator;
+                const auto operatorToken = iterator++;
 
                 const auto& rightExpression = parseNotExpression(iterator, end, declarationScopes);
 
                 const auto& binaryOperator = getBinaryOperator(operatorKind,
                                                                result->qualifiedType.type,
-                                                               rightExpression.qualifiedType.type);
+                                                               rightExpression.qualifiedType.type,
+                                                               *operatorToken);
 
                 result = &create<BinaryOperatorExpression>(operatorKind, binaryOperator.resultType, Expression::Category::Rvalue, *result, rightExpression);
             }
@@ -1782,13 +2541,14 @@ namespace ouzel
                     BinaryOperatorExpression::Kind::Addition :
                     BinaryOperatorExpression::Kind::Subtraction;
 
-                ++iterator;
+                const auto operatorToken = iterator++;
 
                 const auto& rightExpression = parseMultiplicationExpression(iterator, end, declarationScopes);
 
                 const auto& binaryOperator = getBinaryOperator(operatorKind,
                                                                result->qualifiedType.type,
-                                                               rightExpression.qualifiedType.type);
+                                                               rightExpression.qualifiedType.type,
+                                                               *operatorToken);
 
                 result = &create<BinaryOperatorExpression>(operatorKind, binaryOperator.resultType, Expression::Category::Rvalue, *result, rightExpression);
             }
@@ -1807,13 +2567,14 @@ namespace ouzel
                     BinaryOperatorExpression::Kind::LessThan :
                     BinaryOperatorExpression::Kind::LessThanEqual;
 
-                ++iterator;
+                const auto operatorToken = iterator++;
 
                 const auto& rightExpression = parseAdditionExpression(iterator, end, declarationScopes);
 
                 const auto& binaryOperator = getBinaryOperator(operatorKind,
                                                                result->qualifiedType.type,
-                                                               rightExpression.qualifiedType.type);
+                                                               rightExpression.qualifiedType.type,
+                                                               *operatorToken);
 
                 result = &create<BinaryOperatorExpression>(operatorKind, binaryOperator.resultType, Expression::Category::Rvalue, *result, rightExpression);
             }
@@ -1832,13 +2593,14 @@ namespace ouzel
                     BinaryOperatorExpression::Kind::GreaterThan :
                     BinaryOperatorExpression::Kind::GraterThanEqual;
 
-                ++iterator;
+                const auto operatorToken = iterator++;
 
                 const auto& rightExpression = parseLessThanExpression(iterator, end, declarationScopes);
 
                 const auto& binaryOperator = getBinaryOperator(operatorKind,
                                                                result->qualifiedType.type,
-                                                               rightExpression.qualifiedType.type);
+                                                               rightExpression.qualifiedType.type,
+                                                               *operatorToken);
 
                 result = &create<BinaryOperatorExpression>(operatorKind, binaryOperator.resultType, Expression::Category::Rvalue, *result, rightExpression);
             }
@@ -1857,13 +2619,14 @@ namespace ouzel
                     BinaryOperatorExpression::Kind::Equality :
                     BinaryOperatorExpression::Kind::Inequality;
 
-                ++iterator;
+                const auto operatorToken = iterator++;
 
                 const auto& rightExpression = parseGreaterThanExpression(iterator, end, declarationScopes);
 
                 const auto& binaryOperator = getBinaryOperator(operatorKind,
                                                                result->qualifiedType.type,
-                                                               rightExpression.qualifiedType.type);
+                                                               rightExpression.qualifiedType.type,
+                                                               *operatorToken);
 
                 result = &create<BinaryOperatorExpression>(operatorKind, binaryOperator.resultType, Expression::Category::Rvalue, *result, rightExpression);
             }
@@ -1876,15 +2639,17 @@ namespace ouzel
         {
             auto result = &parseEqualityExpression(iterator, end, declarationScopes);
 
-            while (skipToken(Token::Type::And, iterator, end))
+            while (isToken(Token::Type::And, iterator, end))
             {
+                const auto operatorToken = iterator++;
                 const auto operatorKind = BinaryOperatorExpression::Kind::And;
 
                 const auto& rightExpression = parseEqualityExpression(iterator, end, declarationScopes);
 
                 const auto& binaryOperator = getBinaryOperator(operatorKind,
                                                                result->qualifiedType.type,
-                                                               rightExpression.qualifiedType.type);
+                                                               rightExpression.qualifiedType.type,
+                                                               *operatorToken);
 
                 result = &create<BinaryOperatorExpression>(operatorKind, binaryOperator.resultType, Expression::Category::Rvalue, *result, rightExpression);
             }
@@ -1897,15 +2662,17 @@ namespace ouzel
         {
             auto result = &parseLogicalAndExpression(iterator, end, declarationScopes);
 
-            while (skipToken(Token::Type::Or, iterator, end))
+            while (isToken(Token::Type::Or, iterator, end))
             {
+                const auto operatorToken = iterator++;
                 const auto operatorKind = BinaryOperatorExpression::Kind::Or;
 
                 const auto& rightExpression = parseLogicalAndExpression(iterator, end, declarationScopes);
 
                 const auto& binaryOperator = getBinaryOperator(operatorKind,
                                                                result->qualifiedType.type,
-                                                               rightExpression.qualifiedType.type);
+                                                               rightExpression.qualifiedType.type,
+                                                               *operatorToken);
 
                 result = &create<BinaryOperatorExpression>(operatorKind, binaryOperator.resultType, Expression::Category::Rvalue, *result, rightExpression);
             }
@@ -1916,12 +2683,14 @@ namespace ouzel
         Expression& parseTernaryExpression(TokenIterator& iterator, const TokenIterator end,
                                            DeclarationScopes& declarationScopes)
         {
+            const auto expressionBegin = iterator;
             auto result = &parseLogicalOrExpression(iterator, end, declarationScopes);
 
-            while (skipToken(Token::Type::Conditional, iterator, end))
+            while (isToken(Token::Type::Conditional, iterator, end))
             {
+                const auto operatorToken = iterator++;
                 if (!isBooleanType(result->qualifiedType.type))
-                    throw ParseError{ErrorCode::ConditionNotBoolean, "Condition is not of the type \"bool\""};
+                    throw ParseError{ErrorCode::ConditionNotBoolean, "Condition is not of the type \"bool\"", expressionBegin, operatorToken};
 
                 const auto& leftExpression = parseTernaryExpression(iterator, end, declarationScopes);
 
@@ -1930,7 +2699,7 @@ namespace ouzel
                 const auto& rightExpression = parseTernaryExpression(iterator, end, declarationScopes);
 
                 if (&leftExpression.qualifiedType.type != &rightExpression.qualifiedType.type)
-                    throw ParseError{ErrorCode::IncompatibleOperands, "Incompatible operand types"};
+                    throw ParseError{ErrorCode::IncompatibleOperands, "Incompatible operand types", std::next(operatorToken), iterator};
 
                 result = &create<TernaryOperatorExpression>(*result, leftExpression, rightExpression);
             }
@@ -1941,23 +2710,26 @@ namespace ouzel
         Expression& parseAssignmentExpression(TokenIterator& iterator, const TokenIterator end,
                                               DeclarationScopes& declarationScopes)
         {
+            const auto expressionBegin = iterator;
             auto result = &parseTernaryExpression(iterator, end, declarationScopes);
 
-            while (skipToken(Token::Type::Assignment, iterator, end))
+            while (isToken(Token::Type::Assignment, iterator, end))
             {
+                const auto operatorToken = iterator++;
                 const auto operatorKind = BinaryOperatorExpression::Kind::Assignment;
 
                 if (result->category != Expression::Category::Lvalue)
-                    throw ParseError{ErrorCode::ExpressionNotAssignable, "Expression is not assignable"};
+                    throw ParseError{ErrorCode::ExpressionNotAssignable, "Expression is not assignable", expressionBegin, operatorToken};
 
                 if ((result->qualifiedType.qualifiers & Type::Qualifiers::Const) == Type::Qualifiers::Const)
-                    throw ParseError{ErrorCode::ExpressionNotAssignable, "Cannot assign to const variable"};
+                    throw ParseError{ErrorCode::ExpressionNotAssignable, "Cannot assign to const variable", expressionBegin, operatorToken};
 
                 const auto& rightExpression = parseTernaryExpression(iterator, end, declarationScopes);
 
                 const auto& binaryOperator = getBinaryOperator(operatorKind,
                                                                result->qualifiedType.type,
-                                                               rightExpression.qualifiedType.type);
+                                                               rightExpression.qualifiedType.type,
+                                                               *operatorToken);
 
                 result = &create<BinaryOperatorExpression>(operatorKind, binaryOperator.resultType, Expression::Category::Rvalue, *result, rightExpression);
             }
@@ -1968,6 +2740,7 @@ namespace ouzel
         Expression& parseAdditionAssignmentExpression(TokenIterator& iterator, const TokenIterator end,
                                                       DeclarationScopes& declarationScopes)
         {
+            const auto expressionBegin = iterator;
             auto result = &parseAssignmentExpression(iterator, end, declarationScopes);
 
             while (isToken({Token::Type::PlusAssignment, Token::Type::MinusAssignment}, iterator, end))
@@ -1976,19 +2749,20 @@ namespace ouzel
                     BinaryOperatorExpression::Kind::AdditionAssignment :
                     BinaryOperatorExpression::Kind::SubtractAssignment;
 
-                ++iterator;
+                const auto operatorToken = iterator++;
 
                 if (result->category != Expression::Category::Lvalue)
-                    throw ParseError{ErrorCode::ExpressionNotAssignable, "Expression is not assignable"};
+                    throw ParseError{ErrorCode::ExpressionNotAssignable, "Expression is not assignable", expressionBegin, operatorToken};
 
                 if ((result->qualifiedType.qualifiers & Type::Qualifiers::Const) == Type::Qualifiers::Const)
-                    throw ParseError{ErrorCode::ExpressionNotAssignable, "Cannot assign to const variable"};
+                    throw ParseError{ErrorCode::ExpressionNotAssignable, "Cannot assign to const variable", expressionBegin, operatorToken};
 
                 const auto& rightExpression = parseAssignmentExpression(iterator, end, declarationScopes);
 
                 const auto& binaryOperator = getBinaryOperator(operatorKind,
                                                                result->qualifiedType.type,
-                                                               rightExpression.qualifiedType.type);
+                                                               rightExpression.qualifiedType.type,
+                                                               *operatorToken);
 
                 result = &create<BinaryOperatorExpression>(operatorKind, binaryOperator.resultType, Expression::Category::Lvalue, *result, rightExpression);
             }
@@ -1999,6 +2773,7 @@ namespace ouzel
         Expression& parseMultiplicationAssignmentExpression(TokenIterator& iterator, const TokenIterator end,
                                                             DeclarationScopes& declarationScopes)
         {
+            const auto expressionBegin = iterator;
             auto result = &parseAdditionAssignmentExpression(iterator, end, declarationScopes);
 
             while (isToken({Token::Type::MultiplyAssignment, Token::Type::DivideAssignment}, iterator, end))
@@ -2007,19 +2782,20 @@ namespace ouzel
                     BinaryOperatorExpression::Kind::MultiplicationAssignment :
                     BinaryOperatorExpression::Kind::DivisionAssignment;
 
-                ++iterator;
+                const auto operatorToken = iterator++;
 
                 if (result->category != Expression::Category::Lvalue)
-                    throw ParseError{ErrorCode::ExpressionNotAssignable, "Expression is not assignable"};
+                    throw ParseError{ErrorCode::ExpressionNotAssignable, "Expression is not assignable", expressionBegin, operatorToken};
 
                 if ((result->qualifiedType.qualifiers & Type::Qualifiers::Const) == Type::Qualifiers::Const)
-                    throw ParseError{ErrorCode::ExpressionNotAssignable, "Cannot assign to const variable"};
+                    throw ParseError{ErrorCode::ExpressionNotAssignable, "Cannot assign to const variable", expressionBegin, operatorToken};
 
                 const auto& rightExpression = parseAdditionAssignmentExpression(iterator, end, declarationScopes);
 
                 const auto& binaryOperator = getBinaryOperator(operatorKind,
                                                                result->qualifiedType.type,
-                                                               rightExpression.qualifiedType.type);
+                                                               rightExpression.qualifiedType.type,
+                                                               *operatorToken);
 
                 result = &create<BinaryOperatorExpression>(operatorKind, binaryOperator.resultType, Expression::Category::Lvalue, *result, rightExpression);
             }
@@ -2030,20 +2806,23 @@ namespace ouzel
         Expression& parseCommaExpression(TokenIterator& iterator, const TokenIterator end,
                                          DeclarationScopes& declarationScopes)
         {
+            const auto expressionBegin = iterator;
             auto result = &parseMultiplicationAssignmentExpression(iterator, end, declarationScopes);
 
-            while (skipToken(Token::Type::Comma, iterator, end))
+            while (isToken(Token::Type::Comma, iterator, end))
             {
+                const auto operatorToken = iterator++;
                 const auto operatorKind = BinaryOperatorExpression::Kind::Comma;
 
                 const auto& rightExpression = parseAdditionAssignmentExpression(iterator, end, declarationScopes);
 
                 const auto& binaryOperator = getBinaryOperator(operatorKind,
                                                                result->qualifiedType.type,
-                                                               rightExpression.qualifiedType.type);
+                                                               rightExpression.qualifiedType.type,
+                                                               *operatorToken);
 
                 if (&result->qualifiedType.type != &rightExpression.qualifiedType.type)
-                    throw ParseError{ErrorCode::IncompatibleOperands, "Incompatible operand types"};
+                    throw ParseError{ErrorCode::IncompatibleOperands, "Incompatible operand types", expressionBegin, iterator};
 
                 result = &create<BinaryOperatorExpression>(operatorKind, binaryOperator.resultType, rightExpression.category, *result, rightExpression);
             }
@@ -2197,6 +2976,7 @@ namespace ouzel
                                                                     std::vector<AttributeRef>{},
                                                                     std::move(parameterDeclarations),
                                                                     FunctionDeclaration::Qualifier::None, true);
+            functionDeclaration.firstDeclaration = &functionDeclaration;
 
             declarationScopes.back().push_back(&functionDeclaration);
 
@@ -2218,14 +2998,15 @@ namespace ouzel
         };
 
         const UnaryOperator& getUnaryOperator(UnaryOperatorExpression::Kind unaryOperatorKind,
-                                              const Type& parameterType) const
+                                              const Type& parameterType,
+                                              const Token& operatorToken) const
         {
             for (const auto& unaryOperator : unaryOperators)
                 if (unaryOperator.unaryOperatorKind == unaryOperatorKind &&
                     &unaryOperator.parameterType == &parameterType)
                     return unaryOperator;
 
-            throw ParseError{ErrorCode::NoOperator, "No unary operator defined for this type"};
+            throw ParseError{ErrorCode::NoOperator, "No unary operator defined for this type", operatorToken};
         }
 
         struct BinaryOperator final
@@ -2247,7 +3028,8 @@ namespace ouzel
 
         const BinaryOperator& getBinaryOperator(BinaryOperatorExpression::Kind binaryOperatorKind,
                                                 const Type& firstParameterType,
-                                                const Type& secondParameterType) const
+                                                const Type& secondParameterType,
+                                                const Token& operatorToken) const
         {
             for (const auto& binaryOperator : binaryOperators)
                 if (binaryOperator.binaryOperatorKind == binaryOperatorKind &&
@@ -2255,28 +3037,43 @@ namespace ouzel
                     &binaryOperator.secondParameterType == &secondParameterType)
                     return binaryOperator;
 
-            throw ParseError{ErrorCode::NoOperator, "No binary operator defined for these types"};
+            throw ParseError{ErrorCode::NoOperator, "No binary operator defined for these types", operatorToken};
         }
 
-        template <class T, class ...Args, typename std::enable_if<std::is_base_of<Type, T>::value>::type* = nullptr>
-        T& create(Args&&... args)
+        std::vector<std::unique_ptr<Type>> types;
+        std::vector<Declaration*> declarations;
+        std::vector<std::unique_ptr<Construct>> constructs;
+
+        // the tokens and the constructs of each top-level declaration
+        struct Source final
         {
-            T* result;
-            types.push_back(std::unique_ptr<Type>(result = new T(std::forward<Args>(args)...)));
-            return *result;
-        }
+            std::size_t tokenCount;
+            std::uint64_t hash;
+            std::size_t constructOffset;
+            std::size_t constructCount;
+        };
 
-        template <class T, class ...Args, typename std::enable_if<std::is_base_of<Construct, T>::value>::type* = nullptr>
-        T& create(Args&&... args)
+        std::vector<Source> sources;
+        std::vector<Declaration*> builtinDeclarations;
+        std::size_t builtinConstructCount = 0;
+
+        // a function body that is parsed after the declarations
+        struct PendingBody final
         {
-            T* result;
-            constructs.push_back(std::unique_ptr<Construct>(result = new T(std::forward<Args>(args)...)));
-            return *result;
-        }
+            FunctionDeclaration* declaration;
+            TokenIterator start;
+            std::size_t scopeSize;
+            std::size_t declarationIndex;
+        };
 
-        std::vector<std::unique_ptr<Type>> types;
-        std::vector<Declaration*> declarations;
-        std::vector<std::unique_ptr<Construct>> constructs;
+        std::vector<PendingBody>* pendingBodies = nullptr;
+        std::vector<Diagnostic>* diagnostics = nullptr;
+        std::vector<std::unique_ptr<Type>> bodyTypes;
+        std::mutex arrayTypeMutex;
+
+        // the constructs of the function body that is parsed on this thread
+        static inline thread_local std::vector<std::unique_ptr<Construct>>* constructArena = nullptr;
+        static inline thread_local std::vector<Diagnostic>* diagnosticArena = nullptr;
 
         std::vector<UnaryOperator> unaryOperators;
         std::vector<BinaryOperator> binaryOperators;
@@ -2284,6 +3081,8 @@ namespace ouzel
         std::map<std::pair<const Type*, std::size_t>, const VectorType*> vectorTypes;
         std::map<std::pair<QualifiedType, std::size_t>, const ArrayType*> arrayTypes;
 
+        Tracer* tracer = nullptr;
+
         const Type& voidType;
         const ScalarType& boolType;
         const ScalarType& intType;
@@ -5,17 +5,138 @@
 #ifndef PREPROCESSOR_HPP
 #define PREPROCESSOR_HPP
 
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <set>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "Tokenizer.hpp"
 
 namespace ouzel
 {
     class Preprocessor final
     {
     public:
-        std::string preprocess(const std::string& code)
+        // gets the name in an #include directive and the path of the including file,
+        // returns the path and the code of the included file or throws if it can not be found
+        using IncludeHandler = std::function<std::pair<std::string, std::string>(const std::string&, const std::string&)>;
+
+        Preprocessor() = default;
+
+        explicit Preprocessor(const std::map<std::string, std::string>& initDefines):
+            defines{initDefines}
+        {
+        }
+
+        void define(const std::string& name, const std::string& value = std::string())
+        {
+            defines[name] = value;
+        }
+
+        void undefine(const std::string& name)
+        {
+            defines.erase(name);
+        }
+
+        [[nodiscard]]
+        const std::map<std::string, std::string>& getDefines() const noexcept
+        {
+            return defines;
+        }
+
+        // #include is an error without an include handler
+        void setIncludeHandler(const IncludeHandler& handler)
+        {
+            includeHandler = handler;
+        }
+
+        // finds the included files next to the including file and then in the include directories
+        static IncludeHandler getFileIncludeHandler(const std::vector<std::string>& includeDirectories = std::vector<std::string>())
+        {
+            return [includeDirectories](const std::string& name, const std::string& includingPath) {
+                std::vector<std::filesystem::path> candidates{std::filesystem::path(includingPath).parent_path() / name};
+                for (const auto& includeDirectory : includeDirectories)
+                    candidates.push_back(std::filesystem::path(includeDirectory) / name);
+
+                for (const auto& candidate : candidates)
+                {
+                    std::ifstream file(candidate, std::ios::binary);
+                    if (file)
+                        return std::make_pair(candidate.lexically_normal().string(),
+                                              std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()));
+                }
+
+                throw std::runtime_error{"File not found: " + name};
+            };
+        }
+
+        // the paths of the files included by the last processed code in the order they were first included
+        [[nodiscard]]
+        const std::vector<std::string>& getIncludes() const noexcept
+        {
+            return includes;
+        }
+
+        // the path of the code is where the files it includes are looked up from
+        std::string preprocess(const std::string& code, const std::string& path = std::string())
+        {
+            const auto source = removeComments(code);
+
+            std::string result;
+            result.reserve(source.size());
+
+            process(source, [&result](std::size_t line, std::string_view text, bool) {
+                if (line > 0) result.push_back('\n');
+                result.append(text.data(), text.size());
+            }, path);
+
+            return result;
+        }
+
+        // the preprocessed code without the "#line" markers of the included files,
+        // which is a single source that can be preprocessed again
+        [[nodiscard]]
+        static std::string removeLineMarkers(const std::string& code)
         {
             std::string result;
+            result.reserve(code.size());
+
+            for (std::size_t lineStart = 0; lineStart < code.size();)
+            {
+                const auto newline = code.find('\n', lineStart);
+                const auto lineEnd = (newline == std::string::npos) ? code.size() : newline + 1;
+
+                if (code.compare(lineStart, 6, "#line ") != 0)
+                    result.append(code, lineStart, lineEnd - lineStart);
+
+                lineStart = lineEnd;
+            }
+
+            // a marker on the last line leaves the newline that ended the line before it
+            if (!result.empty() && result.back() == '\n' && code.back() != '\n')
+                result.pop_back();
+
+            return result;
+        }
+
+        // joins the lines ending with a backslash and replaces the comments with spaces,
+        // the newlines are kept and the joined ones are added after the logical line, so that the tokens keep their line numbers
+        static std::string removeComments(const std::string& code)
+        {
+            std::string result;
+            result.reserve(code.size());
+
+            std::uint32_t line = 1;
+            auto lineStart = code.begin();
+            std::size_t joinedLines = 0;
 
             for (auto i = code.begin(); i != code.end();)
             {
@@ -23,46 +144,322 @@ namespace ouzel
                 {
                     ++i; // skip the backslash
                     ++i; // skip the newline
+                    ++line;
+                    ++joinedLines;
+                    lineStart = i;
                 }
                 else if (*i == '/' && (i + 1) != code.end() && *(i + 1) == '/') // single-line comment
                 {
-                    ++i; // skip the forward slash
-                    ++i; // skip the forward slash
-                    while (++i != code.end())
-                        if (*i == '\n')
-                        {
-                            ++i; // skip the newline
-                            break;
-                        }
+                    // the comments are replaced by spaces, so that the tokens after them keep their columns
+                    for (; i != code.end() && *i != '\n'; ++i)
+                        result.push_back(' ');
                 }
                 else if (*i == '/' && (i + 1) != code.end() && *(i + 1) == '*') // multi-line comment
                 {
-                    ++i; // skip the forward slash
-                    ++i; // skip the star
+                    const auto commentLine = line;
+                    const auto commentColumn = static_cast<std::uint32_t>(i - lineStart) + 1;
+                    i += 2; // skip the forward slash and the star
+                    result.append(2, ' ');
 
                     bool terminated = false;
-                    while (++i != code.end()) // TODO: insert #line directives
-                        if (*i == '*' && ++i != code.end() && *i == '/')
+                    while (i != code.end())
+                        if (*i == '*' && (i + 1) != code.end() && *(i + 1) == '/')
                         {
                             terminated = true;
-                            ++i; // skip the star
-                            ++i; // skip the forward slash
+                            i += 2; // skip the star and the forward slash
+                            result.append(2, ' ');
                             break;
                         }
+                        else if (*i++ == '\n')
+                        {
+                            result.push_back('\n');
+                            ++line;
+                            lineStart = i;
+                        }
+                        else
+                            result.push_back(' ');
 
                     if (!terminated)
-                        throw std::runtime_error{"Unterminated block comment"};
+                        throw SourceError{"Unterminated block comment", commentLine, commentColumn};
                 }
                 else
                 {
                     result.push_back(*i);
+
+                    if (*i == '\n')
+                    {
+                        ++line;
+                        lineStart = i + 1;
+                        result.append(joinedLines, '\n');
+                        joinedLines = 0;
+                    }
+
                     ++i;
                 }
             }
 
-            // TODO: preprocess the code
+            result.append(joinedLines, '\n');
+
+            return result;
+        }
+
+        // evaluates the directives of code without comments line by line and calls the callback
+        // with the index of each line and its text, which is empty for the directives and the excluded lines,
+        // the last argument tells whether the text differs from the line, because a define was expanded in it
+        // or because it is an #include, whose line is replaced by the lines of the included file between
+        // "#line <line> <file>" markers, the file is the index of the path in the includes plus one or zero for the code,
+        // the tokenizer honours the markers, so that the tokens keep the file and the line they came from
+        template <class Callback>
+        void process(const std::string& code, Callback callback, const std::string& path = std::string())
+        {
+            paths.assign(1, path);
+            includes.clear();
+            processLines(code, callback);
+        }
+
+    private:
+        template <class Callback>
+        void processLines(const std::string& code, Callback& callback)
+        {
+            // whether the code of the enclosing conditional blocks is included and whether an #else was seen
+            struct Condition final
+            {
+                bool included;
+                bool parentIncluded;
+                bool hasElse;
+                std::size_t lineIndex;
+            };
+
+            std::vector<Condition> conditions;
+            std::string expanded;
+            std::string includedCode;
+            std::size_t lineIndex = 0;
+
+            for (std::size_t lineStart = 0; lineStart <= code.size(); ++lineIndex)
+            {
+                auto lineEnd = code.find('\n', lineStart);
+                if (lineEnd == std::string::npos) lineEnd = code.size();
+
+                const std::string_view line(code.data() + lineStart, lineEnd - lineStart);
+                const auto included = conditions.empty() || conditions.back().included;
+
+                auto first = line.find_first_not_of(" \t\r");
+                if (first != std::string_view::npos && line[first] == '#')
+                {
+                    const auto error = [lineIndex, first](const std::string& message) {
+                        return SourceError{message, static_cast<std::uint32_t>(lineIndex + 1), static_cast<std::uint32_t>(first + 1)};
+                    };
+
+                    std::size_t position = first + 1;
+                    const auto directive = readWord(line, position);
+                    const auto name = readWord(line, position);
+
+                    if (directive == "ifdef" || directive == "ifndef")
+                    {
+                        if (name.empty())
+                            throw error("Missing macro name in #" + directive);
+
+                        const auto defined = defines.find(name) != defines.end();
+                        conditions.push_back(Condition{included && (defined == (directive == "ifdef")), included, false, lineIndex});
+                    }
+                    else if (directive == "else")
+                    {
+                        if (conditions.empty() || conditions.back().hasElse)
+                            throw error("Unexpected #else");
+
+                        conditions.back().included = conditions.back().parentIncluded && !conditions.back().included;
+                        conditions.back().hasElse = true;
+                    }
+                    else if (directive == "endif")
+                    {
+                        if (conditions.empty())
+                            throw error("Unexpected #endif");
+
+                        conditions.pop_back();
+                    }
+                    else if (!included) // the other directives of the excluded code are ignored
+                        ;
+                    else if (directive == "define")
+                    {
+                        if (name.empty())
+                            throw error("Missing macro name in #define");
+
+                        const auto valueStart = line.find_first_not_of(" \t", position);
+                        const auto valueEnd = line.find_last_not_of(" \t\r");
+                        defines[name] = (valueStart == std::string_view::npos || valueStart > valueEnd) ? std::string() :
+                            std::string(line.substr(valueStart, valueEnd - valueStart + 1));
+                    }
+                    else if (directive == "undef")
+                        defines.erase(name);
+                    else if (directive == "include")
+                    {
+                        const auto nameStart = line.find_first_not_of(" \t", position);
+                        const auto nameEnd = (nameStart == std::string_view::npos || line[nameStart] != '"') ?
+                            std::string_view::npos : line.find('"', nameStart + 1);
+                        if (nameEnd == std::string_view::npos || nameEnd == nameStart + 1)
+                            throw error("Missing file name in #include");
+
+                        includedCode = includeFile(std::string(line.substr(nameStart + 1, nameEnd - nameStart - 1)),
+                                                   static_cast<std::uint32_t>(lineIndex + 1), static_cast<std::uint32_t>(first + 1));
+                    }
+                    else
+                        throw error("Unknown directive #" + directive);
+
+                    callback(lineIndex, std::string_view(includedCode), !includedCode.empty());
+                    includedCode.clear();
+                }
+                else if (!included)
+                    callback(lineIndex, std::string_view(), false);
+                else if (!defines.empty() && expand(line, expanded))
+                    callback(lineIndex, std::string_view(expanded), true);
+                else
+                    callback(lineIndex, line, false);
+
+                lineStart = lineEnd + 1;
+            }
+
+            if (!conditions.empty())
+                throw SourceError{"Missing #endif", static_cast<std::uint32_t>(conditions.back().lineIndex + 1), 1};
+        }
+
+        // not a template, so that the included files do not instantiate processLines with new callbacks
+        std::string includeFile(const std::string& name, std::uint32_t line, std::uint32_t column)
+        {
+            if (!includeHandler)
+                throw SourceError{"#include is not supported without an include handler", line, column};
+
+            std::pair<std::string, std::string> file;
+            try
+            {
+                file = includeHandler(name, paths.back());
+            }
+            catch (const std::exception& e)
+            {
+                throw SourceError{e.what(), line, column};
+            }
+
+            if (std::find(paths.begin(), paths.end(), file.first) != paths.end())
+                throw SourceError{"Recursive #include of " + file.first, line, column};
+
+            if (std::find(includes.begin(), includes.end(), file.first) == includes.end())
+                includes.push_back(file.first);
+
+            std::string result = "#line 1 " + std::to_string(getFileIndex(file.first)) + "\n";
+            auto callback = [&result](std::size_t lineIndex, std::string_view text, bool) {
+                if (lineIndex > 0) result.push_back('\n');
+                result.append(text.data(), text.size());
+            };
+
+            // the errors in the included file are reported at the #include with the position in the file
+            paths.push_back(file.first);
+            try
+            {
+                processLines(removeComments(file.second), callback);
+            }
+            catch (const SourceError& e)
+            {
+                paths.pop_back();
+                throw SourceError{file.first + ":" + std::to_string(e.getLine()) + ":" + std::to_string(e.getColumn()) + ": " + e.what(),
+                                  line, column};
+            }
+            paths.pop_back();
+
+            // the lines after the #include continue in the including file
+            result += "\n#line " + std::to_string(line + 1) + " " + std::to_string(getFileIndex(paths.back()));
+
             return result;
         }
+
+        std::uint32_t getFileIndex(const std::string& path) const
+        {
+            if (paths.size() == 1 && path == paths.front()) return 0;
+
+            const auto include = std::find(includes.begin(), includes.end(), path);
+            return static_cast<std::uint32_t>(include - includes.begin()) + 1;
+        }
+
+        static bool isIdentifierStart(char c) noexcept
+        {
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+        }
+
+        static bool isIdentifierCharacter(char c) noexcept
+        {
+            return isIdentifierStart(c) || (c >= '0' && c <= '9');
+        }
+
+        static std::string readWord(std::string_view line, std::size_t& position)
+        {
+            while (position < line.size() && (line[position] == ' ' || line[position] == '\t')) ++position;
+
+            const auto start = position;
+            while (position < line.size() && isIdentifierCharacter(line[position])) ++position;
+
+            return std::string(line.substr(start, position - start));
+        }
+
+        // replaces the defined identifiers outside of the literals with their values,
+        // returns false if nothing was replaced
+        bool expand(std::string_view text, std::string& result)
+        {
+            std::set<std::string> expanding;
+            result.clear();
+            return expand(text, result, expanding);
+        }
+
+        bool expand(std::string_view text, std::string& result, std::set<std::string>& expanding)
+        {
+            bool replaced = false;
+
+            for (std::size_t i = 0; i < text.size();)
+            {
+                if (isIdentifierStart(text[i]))
+                {
+                    const auto start = i;
+                    while (i < text.size() && isIdentifierCharacter(text[i])) ++i;
+
+                    const std::string name(text.substr(start, i - start));
+                    const auto define = defines.find(name);
+
+                    // a define is not expanded in its own value
+                    if (define != defines.end() && expanding.insert(name).second)
+                    {
+                        expand(define->second, result, expanding);
+                        expanding.erase(name);
+                        replaced = true;
+                    }
+                    else
+                        result += name;
+                }
+                else if (text[i] >= '0' && text[i] <= '9') // numbers with their suffixes
+                {
+                    while (i < text.size() && (isIdentifierCharacter(text[i]) || text[i] == '.')) result.push_back(text[i++]);
+                }
+                else if (text[i] == '"' || text[i] == '\'') // literals
+                {
+                    const auto quote = text[i];
+                    result.push_back(text[i++]);
+
+                    while (i < text.size() && text[i] != quote)
+                    {
+                        if (text[i] == '\\' && i + 1 < text.size()) result.push_back(text[i++]);
+                        result.push_back(text[i++]);
+                    }
+
+                    if (i < text.size()) result.push_back(text[i++]);
+                }
+                else
+                    result.push_back(text[i++]);
+            }
+
+            return replaced;
+        }
+
+        std::map<std::string, std::string> defines;
+        IncludeHandler includeHandler;
+        // the paths of the files being processed, the innermost is the last
+        std::vector<std::string> paths;
+        std::vector<std::string> includes;
     };
 }
 
@@ -0,0 +1,558 @@
+//
+//  OSL
+//
+
+#ifndef REFLECTION_HPP
+#define REFLECTION_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Layout.hpp"
+#include "Output.hpp"
+#include "Parser.hpp"
+#include "Trace.hpp"
+
+namespace ouzel
+{
+    // The interface of a program, so that a runtime can set up its pipeline without parsing the output:
+    // the inputs and outputs of the entry point with their semantics, the extern variables and their textures
+    // and the structs, the inputs and the outputs are packed in their declaration order with four bytes per scalar,
+    // the uniforms and the struct members are placed by the layout rules of the target
+    class Reflection final
+    {
+    public:
+        enum class DataType: std::uint8_t
+        {
+            Bool,
+            Int,
+            Uint,
+            Float,
+            Struct,
+            Texture2D,
+            Texture2DMS
+        };
+
+        static constexpr std::uint8_t noSemantic = 0xFF;
+
+        struct Variable final
+        {
+            std::string name;
+            std::string typeName; // the scalar, vector, matrix or struct type of an element
+            DataType dataType = DataType::Float;
+            std::uint8_t rows = 1;
+            std::uint8_t columns = 1;
+            std::uint8_t semantic = noSemantic; // an Attribute::Kind
+            std::uint8_t semanticIndex = 0;
+            std::uint32_t arraySize = 0; // zero if the variable is not an array
+            std::uint32_t offset = 0;
+            std::uint32_t size = 0;
+            std::uint32_t arrayStride = 0; // the distance between the elements, zero if the variable is not an array
+            std::uint32_t matrixStride = 0; // the distance between the rows, zero if the variable is not a matrix
+        };
+
+        struct Texture final
+        {
+            std::string name;
+            DataType dataType = DataType::Texture2D;
+            std::uint32_t arraySize = 0;
+            std::uint32_t binding = 0;
+        };
+
+        struct Struct final
+        {
+            std::string name;
+            std::uint32_t size = 0;
+            std::vector<Variable> members;
+        };
+
+        static constexpr std::uint32_t version = 2;
+
+        Reflection() = default;
+
+        Reflection(const Context& context, Program initProgram,
+                   Layout::Rules initLayoutRules = Layout::Rules::Packed):
+            program{initProgram}, layoutRules{initLayoutRules}
+        {
+            Layout uniformLayout(layoutRules);
+
+            const auto qualifier = (program == Program::Fragment) ?
+                FunctionDeclaration::Qualifier::Fragment :
+                FunctionDeclaration::Qualifier::Vertex;
+
+            const FunctionDeclaration* entryPoint = nullptr;
+
+            for (const auto declaration : context.getDeclarations())
+                if (declaration->declarationKind == Declaration::Kind::Callable &&
+                    static_cast<const CallableDeclaration*>(declaration)->callableDeclarationKind == CallableDeclaration::Kind::Function &&
+                    static_cast<const FunctionDeclaration*>(declaration)->qualifier == qualifier &&
+                    static_cast<const FunctionDeclaration*>(declaration)->body)
+                    entryPoint = static_cast<const FunctionDeclaration*>(declaration);
+                else if (declaration->declarationKind == Declaration::Kind::Variable &&
+                         static_cast<const VariableDeclaration*>(declaration)->storageClass == StorageClass::Extern)
+                {
+                    const auto variable = getVariable(declaration->name,
+                                                      static_cast<const VariableDeclaration*>(declaration)->qualifiedType.type,
+                                                      declaration->attributes);
+
+                    if (variable.dataType == DataType::Texture2D || variable.dataType == DataType::Texture2DMS)
+                    {
+                        const auto binding = textures.empty() ? 0 : textures.back().binding + std::max(textures.back().arraySize, 1U);
+                        textures.push_back(Texture{variable.name, variable.dataType, variable.arraySize, binding});
+                    }
+                    else
+                        uniforms.push_back(place(variable, uniformLayout.add(declaration->name,
+                                                                             static_cast<const VariableDeclaration*>(declaration)->qualifiedType.type,
+                                                                             declaration)));
+                }
+                else if (declaration->declarationKind == Declaration::Kind::Type &&
+                         static_cast<const TypeDeclaration*>(declaration)->type.typeKind == Type::Kind::Struct)
+                {
+                    const Layout structLayout(static_cast<const StructType&>(static_cast<const TypeDeclaration*>(declaration)->type), layoutRules);
+
+                    Struct result;
+                    result.name = declaration->name;
+                    result.size = structLayout.getSize();
+
+                    for (const auto& member : structLayout.getMembers())
+                        result.members.push_back(place(getVariable(member.name, *member.type, member.declaration->attributes), member));
+
+                    structs.push_back(std::move(result));
+                }
+
+            if (!entryPoint)
+                throw std::runtime_error{"No entry point found"};
+
+            uniformSize = uniformLayout.getSize();
+            entryPointName = entryPoint->name;
+
+            for (const auto parameterDeclaration : entryPoint->parameterDeclarations)
+            {
+                if (parameterDeclaration->inputModifier != InputModifier::Out)
+                    addFields(inputs, parameterDeclaration->name, parameterDeclaration->qualifiedType.type, parameterDeclaration->attributes);
+                if (parameterDeclaration->inputModifier != InputModifier::In)
+                    addFields(outputs, parameterDeclaration->name, parameterDeclaration->qualifiedType.type, parameterDeclaration->attributes);
+            }
+
+            // the fields of a struct result are not prefixed, because the result has no name
+            if (entryPoint->resultType.type.typeKind != Type::Kind::Void)
+                addFields(outputs, isFieldStruct(entryPoint->resultType.type) ? std::string() : "result",
+                          entryPoint->resultType.type, entryPoint->attributes);
+        }
+
+        [[nodiscard]] Program getProgram() const noexcept { return program; }
+        [[nodiscard]] Layout::Rules getLayoutRules() const noexcept { return layoutRules; }
+        [[nodiscard]] const std::string& getEntryPoint() const noexcept { return entryPointName; }
+        [[nodiscard]] const std::vector<Variable>& getInputs() const noexcept { return inputs; }
+        [[nodiscard]] const std::vector<Variable>& getOutputs() const noexcept { return outputs; }
+        [[nodiscard]] const std::vector<Variable>& getUniforms() const noexcept { return uniforms; }
+        [[nodiscard]] std::uint32_t getUniformSize() const noexcept { return uniformSize; }
+        [[nodiscard]] const std::vector<Texture>& getTextures() const noexcept { return textures; }
+        [[nodiscard]] const std::vector<Struct>& getStructs() const noexcept { return structs; }
+
+        std::vector<std::uint8_t> serialize() const
+        {
+            std::vector<std::uint8_t> data = {'O', 'S', 'L', 'R'};
+            write(data, version);
+            write(data, static_cast<std::uint8_t>(program));
+            write(data, static_cast<std::uint8_t>(layoutRules));
+            write(data, entryPointName);
+            write(data, uniformSize);
+
+            for (const auto list : {&inputs, &outputs, &uniforms})
+                write(data, *list);
+
+            write(data, static_cast<std::uint32_t>(textures.size()));
+            for (const auto& texture : textures)
+            {
+                write(data, texture.name);
+                write(data, static_cast<std::uint8_t>(texture.dataType));
+                write(data, texture.arraySize);
+                write(data, texture.binding);
+            }
+
+            write(data, static_cast<std::uint32_t>(structs.size()));
+            for (const auto& structReflection : structs)
+            {
+                write(data, structReflection.name);
+                write(data, structReflection.size);
+                write(data, structReflection.members);
+            }
+
+            return data;
+        }
+
+        static Reflection deserialize(const std::vector<std::uint8_t>& data)
+        {
+            if (data.size() < 8 || data[0] != 'O' || data[1] != 'S' || data[2] != 'L' || data[3] != 'R')
+                throw std::runtime_error{"Invalid reflection"};
+
+            std::size_t position = 4;
+            if (readInteger(data, position) != version)
+                throw std::runtime_error{"Unsupported reflection version"};
+
+            Reflection result;
+
+            const auto programValue = readByte(data, position);
+            if (programValue > static_cast<std::uint8_t>(Program::Vertex))
+                throw std::runtime_error{"Invalid reflection"};
+            result.program = static_cast<Program>(programValue);
+
+            const auto layoutRulesValue = readByte(data, position);
+            if (layoutRulesValue > static_cast<std::uint8_t>(Layout::Rules::Metal))
+                throw std::runtime_error{"Invalid reflection"};
+            result.layoutRules = static_cast<Layout::Rules>(layoutRulesValue);
+
+            result.entryPointName = readString(data, position);
+            result.uniformSize = readInteger(data, position);
+
+            for (const auto list : {&result.inputs, &result.outputs, &result.uniforms})
+                read(data, position, *list);
+
+            result.textures.resize(readCount(data, position, 13));
+            for (auto& texture : result.textures)
+            {
+                texture.name = readString(data, position);
+                texture.dataType = readDataType(data, position);
+                texture.arraySize = readInteger(data, position);
+                texture.binding = readInteger(data, position);
+            }
+
+            result.structs.resize(readCount(data, position, 12));
+            for (auto& structReflection : result.structs)
+            {
+                structReflection.name = readString(data, position);
+                structReflection.size = readInteger(data, position);
+                read(data, position, structReflection.members);
+            }
+
+            return result;
+        }
+
+        std::string getJson() const
+        {
+            std::string result = "{\"program\":\"" + std::string(program == Program::Fragment ? "fragment" : "vertex") +
+                "\",\"entryPoint\":\"" + escapeJson(entryPointName) + "\"";
+
+            result += ",\"inputs\":" + getJson(inputs);
+            result += ",\"outputs\":" + getJson(outputs);
+            result += ",\"uniforms\":{\"layout\":\"" + Layout::toString(layoutRules) +
+                "\",\"size\":" + std::to_string(uniformSize) + ",\"variables\":" + getJson(uniforms) + "}";
+
+            result += ",\"textures\":[";
+            for (std::size_t i = 0; i < textures.size(); ++i)
+            {
+                if (i > 0) result += ",";
+                result += "{\"name\":\"" + escapeJson(textures[i].name) +
+                    "\",\"type\":\"" + toString(textures[i].dataType) +
+                    "\",\"arraySize\":" + std::to_string(textures[i].arraySize) +
+                    ",\"binding\":" + std::to_string(textures[i].binding) + "}";
+            }
+
+            result += "],\"structs\":[";
+            for (std::size_t i = 0; i < structs.size(); ++i)
+            {
+                if (i > 0) result += ",";
+                result += "{\"name\":\"" + escapeJson(structs[i].name) +
+                    "\",\"size\":" + std::to_string(structs[i].size) +
+                    ",\"members\":" + getJson(structs[i].members) + "}";
+            }
+
+            result += "]}";
+
+            return result;
+        }
+
+        static std::string toString(DataType dataType)
+        {
+            switch (dataType)
+            {
+                case DataType::Bool: return "Bool";
+                case DataType::Int: return "Int";
+                case DataType::Uint: return "Uint";
+                case DataType::Float: return "Float";
+                case DataType::Struct: return "Struct";
+                case DataType::Texture2D: return "Texture2D";
+                case DataType::Texture2DMS: return "Texture2DMS";
+            }
+
+            throw std::runtime_error{"Unknown data type"};
+        }
+
+    private:
+        static bool isFieldStruct(const Type& type) noexcept
+        {
+            if (type.typeKind != Type::Kind::Struct) return false;
+
+            for (const Declaration& memberDeclaration : static_cast<const StructType&>(type).memberDeclarations)
+                if (memberDeclaration.declarationKind == Declaration::Kind::Field) return true;
+
+            return false;
+        }
+
+        static std::uint8_t getAttributeIndex(const Attribute& attribute) noexcept
+        {
+            std::size_t index = 0;
+
+            switch (attribute.attributeKind)
+            {
+                case Attribute::Kind::Binormal: index = static_cast<const BinormalAttribute&>(attribute).n; break;
+                case Attribute::Kind::BlendIndices: index = static_cast<const BlendIndicesAttribute&>(attribute).n; break;
+                case Attribute::Kind::BlendWeight: index = static_cast<const BlendWeightAttribute&>(attribute).n; break;
+                case Attribute::Kind::Color: index = static_cast<const ColorAttribute&>(attribute).n; break;
+                case Attribute::Kind::Depth: index = static_cast<const DepthAttribute&>(attribute).n; break;
+                case Attribute::Kind::Normal: index = static_cast<const NormalAttribute&>(attribute).n; break;
+                case Attribute::Kind::Position: index = static_cast<const PositionAttribute&>(attribute).n; break;
+                case Attribute::Kind::PointSize: index = static_cast<const PointSizeAttribute&>(attribute).n; break;
+                case Attribute::Kind::Tangent: index = static_cast<const TangentAttribute&>(attribute).n; break;
+                case Attribute::Kind::TesselationFactor: index = static_cast<const TesselationFactorAttribute&>(attribute).n; break;
+                case Attribute::Kind::TextureCoordinates: index = static_cast<const TextureCoordinatesAttribute&>(attribute).n; break;
+                case Attribute::Kind::Fog:
+                case Attribute::Kind::PositionTransformed:
+                    break;
+            }
+
+            return static_cast<std::uint8_t>(std::min(index, std::size_t(0xFF)));
+        }
+
+        static Variable getVariable(const std::string& name, const Type& type, const std::vector<AttributeRef>& attributes)
+        {
+            Variable result;
+            result.name = name;
+
+            auto elementType = &type;
+            for (; elementType->typeKind == Type::Kind::Array; elementType = &static_cast<const ArrayType*>(elementType)->elementType.type)
+                result.arraySize = std::max(result.arraySize, 1U) * static_cast<std::uint32_t>(static_cast<const ArrayType*>(elementType)->size);
+
+            result.typeName = elementType->name;
+
+            const ScalarType* scalarType = nullptr;
+            switch (elementType->typeKind)
+            {
+                case Type::Kind::Scalar:
+                    scalarType = static_cast<const ScalarType*>(elementType);
+                    break;
+                case Type::Kind::Vector:
+                    scalarType = &static_cast<const VectorType*>(elementType)->componentType;
+                    result.columns = static_cast<std::uint8_t>(static_cast<const VectorType*>(elementType)->componentCount);
+                    break;
+                case Type::Kind::Matrix:
+                {
+                    auto& matrixType = static_cast<const MatrixType&>(*elementType);
+                    scalarType = &matrixType.rowType.componentType;
+                    result.rows = static_cast<std::uint8_t>(matrixType.rowCount);
+                    result.columns = static_cast<std::uint8_t>(matrixType.rowType.componentCount);
+                    break;
+                }
+                case Type::Kind::Struct:
+                    result.dataType = (elementType->name == "Texture2D") ? DataType::Texture2D :
+                        (elementType->name == "Texture2DMS") ? DataType::Texture2DMS :
+                        DataType::Struct;
+                    break;
+                default:
+                    throw std::runtime_error{"Invalid type " + elementType->name};
+            }
+
+            if (scalarType)
+                result.dataType = (scalarType->scalarTypeKind == ScalarType::Kind::Boolean) ? DataType::Bool :
+                    (scalarType->scalarTypeKind == ScalarType::Kind::FloatingPoint) ? DataType::Float :
+                    scalarType->isUnsigned ? DataType::Uint : DataType::Int;
+
+            if (!attributes.empty())
+            {
+                result.semantic = static_cast<std::uint8_t>(attributes.front().get().attributeKind);
+                result.semanticIndex = getAttributeIndex(attributes.front());
+            }
+
+            if (!Layout::isOpaque(type))
+                result = place(result, Layout(Layout::Rules::Packed).add(name, type));
+
+            return result;
+        }
+
+        static Variable place(Variable variable, const Layout::Member& member) noexcept
+        {
+            variable.offset = member.offset;
+            variable.size = member.size;
+            variable.arrayStride = member.arrayStride;
+            variable.matrixStride = member.matrixStride;
+            return variable;
+        }
+
+        static std::uint32_t getSize(const std::vector<Variable>& variables) noexcept
+        {
+            return variables.empty() ? 0 : variables.back().offset + variables.back().size;
+        }
+
+        static void add(std::vector<Variable>& variables, Variable variable)
+        {
+            variable.offset = getSize(variables);
+            variables.push_back(std::move(variable));
+        }
+
+        // the fields of a struct are added as separate variables, because each of them has its own semantic
+        static void addFields(std::vector<Variable>& variables, const std::string& name,
+                              const Type& type, const std::vector<AttributeRef>& attributes)
+        {
+            if (!isFieldStruct(type))
+                return add(variables, getVariable(name, type, attributes));
+
+            for (const Declaration& memberDeclaration : static_cast<const StructType&>(type).memberDeclarations)
+                if (memberDeclaration.declarationKind == Declaration::Kind::Field)
+                    addFields(variables, name.empty() ? memberDeclaration.name : name + "." + memberDeclaration.name,
+                              static_cast<const FieldDeclaration&>(memberDeclaration).qualifiedType.type,
+                              memberDeclaration.attributes);
+        }
+
+        static std::string getJson(const std::vector<Variable>& variables)
+        {
+            std::string result = "[";
+
+            for (std::size_t i = 0; i < variables.size(); ++i)
+            {
+                const auto& variable = variables[i];
+
+                if (i > 0) result += ",";
+                result += "{\"name\":\"" + escapeJson(variable.name) +
+                    "\",\"type\":\"" + escapeJson(variable.typeName) +
+                    "\",\"dataType\":\"" + toString(variable.dataType) +
+                    "\",\"rows\":" + std::to_string(variable.rows) +
+                    ",\"columns\":" + std::to_string(variable.columns) +
+                    ",\"arraySize\":" + std::to_string(variable.arraySize) +
+                    ",\"offset\":" + std::to_string(variable.offset) +
+                    ",\"size\":" + std::to_string(variable.size) +
+                    ",\"arrayStride\":" + std::to_string(variable.arrayStride) +
+                    ",\"matrixStride\":" + std::to_string(variable.matrixStride);
+
+                if (variable.semantic != noSemantic)
+                    result += ",\"semantic\":\"" + ouzel::toString(static_cast<Attribute::Kind>(variable.semantic)) +
+                        "\",\"semanticIndex\":" + std::to_string(variable.semanticIndex);
+
+                result += "}";
+            }
+
+            result += "]";
+
+            return result;
+        }
+
+        static void write(std::vector<std::uint8_t>& data, std::uint8_t value)
+        {
+            data.push_back(value);
+        }
+
+        static void write(std::vector<std::uint8_t>& data, std::uint32_t value)
+        {
+            for (std::size_t i = 0; i < 4; ++i)
+                data.push_back(static_cast<std::uint8_t>(value >> (i * 8)));
+        }
+
+        static void write(std::vector<std::uint8_t>& data, const std::string& value)
+        {
+            write(data, static_cast<std::uint32_t>(value.size()));
+            data.insert(data.end(), value.begin(), value.end());
+        }
+
+        static void write(std::vector<std::uint8_t>& data, const std::vector<Variable>& variables)
+        {
+            write(data, static_cast<std::uint32_t>(variables.size()));
+            for (const auto& variable : variables)
+            {
+                write(data, variable.name);
+                write(data, variable.typeName);
+                write(data, static_cast<std::uint8_t>(variable.dataType));
+                write(data, variable.rows);
+                write(data, variable.columns);
+                write(data, variable.semantic);
+                write(data, variable.semanticIndex);
+                write(data, variable.arraySize);
+                write(data, variable.offset);
+                write(data, variable.size);
+                write(data, variable.arrayStride);
+                write(data, variable.matrixStride);
+            }
+        }
+
+        static std::uint8_t readByte(const std::vector<std::uint8_t>& data, std::size_t& position)
+        {
+            if (data.size() - position < 1)
+                throw std::runtime_error{"Unexpected end of reflection"};
+
+            return data[position++];
+        }
+
+        static std::uint32_t readInteger(const std::vector<std::uint8_t>& data, std::size_t& position)
+        {
+            if (data.size() - position < 4)
+                throw std::runtime_error{"Unexpected end of reflection"};
+
+            std::uint32_t result = 0;
+            for (std::size_t i = 0; i < 4; ++i)
+                result |= static_cast<std::uint32_t>(data[position++]) << (i * 8);
+            return result;
+        }
+
+        // counts are checked against the remaining data before anything is allocated
+        static std::uint32_t readCount(const std::vector<std::uint8_t>& data, std::size_t& position, std::size_t elementSize)
+        {
+            const auto count = readInteger(data, position);
+            if (count > (data.size() - position) / elementSize)
+                throw std::runtime_error{"Unexpected end of reflection"};
+            return count;
+        }
+
+        static std::string readString(const std::vector<std::uint8_t>& data, std::size_t& position)
+        {
+            const auto size = readCount(data, position, 1);
+            std::string result(data.begin() + static_cast<std::ptrdiff_t>(position),
+                               data.begin() + static_cast<std::ptrdiff_t>(position + size));
+            position += size;
+            return result;
+        }
+
+        static DataType readDataType(const std::vector<std::uint8_t>& data, std::size_t& position)
+        {
+            const auto dataType = readByte(data, position);
+            if (dataType > static_cast<std::uint8_t>(DataType::Texture2DMS))
+                throw std::runtime_error{"Invalid reflection"};
+            return static_cast<DataType>(dataType);
+        }
+
+        static void read(const std::vector<std::uint8_t>& data, std::size_t& position, std::vector<Variable>& variables)
+        {
+            variables.resize(readCount(data, position, 32));
+            for (auto& variable : variables)
+            {
+                variable.name = readString(data, position);
+                variable.typeName = readString(data, position);
+                variable.dataType = readDataType(data, position);
+                variable.rows = readByte(data, position);
+                variable.columns = readByte(data, position);
+                variable.semantic = readByte(data, position);
+                if (variable.semantic != noSemantic &&
+                    variable.semantic > static_cast<std::uint8_t>(Attribute::Kind::TextureCoordinates))
+                    throw std::runtime_error{"Invalid reflection"};
+                variable.semanticIndex = readByte(data, position);
+                variable.arraySize = readInteger(data, position);
+                variable.offset = readInteger(data, position);
+                variable.size = readInteger(data, position);
+                variable.arrayStride = readInteger(data, position);
+                variable.matrixStride = readInteger(data, position);
+            }
+        }
+
+        Program program = Program::Fragment;
+        Layout::Rules layoutRules = Layout::Rules::Packed;
+        std::string entryPointName;
+        std::uint32_t uniformSize = 0;
+        std::vector<Variable> inputs;
+        std::vector<Variable> outputs;
+        std::vector<Variable> uniforms;
+        std::vector<Texture> textures;
+        std::vector<Struct> structs;
+    };
+}
+
+#endif // REFLECTION_HPP
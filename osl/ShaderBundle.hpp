@@ -0,0 +1,191 @@
+//
+//  OSL
+//
+
+#ifndef SHADERBUNDLE_HPP
+#define SHADERBUNDLE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace ouzel
+{
+    // Outputs of the variants of a shader indexed by their defines,
+    // variants with identical outputs share one copy of it
+    class ShaderBundle final
+    {
+    public:
+        struct Variant final
+        {
+            std::string key;
+            std::uint32_t output = 0;
+        };
+
+        static constexpr std::uint32_t version = 1;
+
+        // the defines sorted by name and separated by commas, the values follow an equals sign
+        static std::string getKey(const std::map<std::string, std::string>& defines)
+        {
+            std::string result;
+
+            for (const auto& define : defines)
+            {
+                if (!result.empty()) result += ",";
+                result += define.first;
+                if (!define.second.empty()) result += "=" + define.second;
+            }
+
+            return result;
+        }
+
+        // adds a variant, returns false if there already is a variant with the same key
+        bool add(const std::string& key, const std::string& output)
+        {
+            const auto variant = std::lower_bound(variants.begin(), variants.end(), key,
+                                                  [](const Variant& a, const std::string& b) { return a.key < b; });
+            if (variant != variants.end() && variant->key == key)
+                return false;
+
+            auto outputIterator = outputIndices.find(output);
+            if (outputIterator == outputIndices.end())
+            {
+                outputIterator = outputIndices.emplace(output, static_cast<std::uint32_t>(outputs.size())).first;
+                outputs.push_back(output);
+            }
+
+            variants.insert(variant, Variant{key, outputIterator->second});
+            return true;
+        }
+
+        // returns the output of the variant with the key or null if there is none
+        [[nodiscard]]
+        const std::string* find(const std::string& key) const
+        {
+            const auto variant = std::lower_bound(variants.begin(), variants.end(), key,
+                                                  [](const Variant& a, const std::string& b) { return a.key < b; });
+
+            return (variant != variants.end() && variant->key == key) ? &outputs[variant->output] : nullptr;
+        }
+
+        // sorted by key
+        [[nodiscard]] const std::vector<Variant>& getVariants() const noexcept { return variants; }
+        [[nodiscard]] const std::vector<std::string>& getOutputs() const noexcept { return outputs; }
+
+        std::vector<std::uint8_t> serialize() const
+        {
+            std::vector<std::uint8_t> data = {'O', 'S', 'L', 'V'};
+            write(data, version);
+
+            write(data, static_cast<std::uint32_t>(variants.size()));
+            for (const auto& variant : variants)
+            {
+                write(data, variant.key);
+                write(data, variant.output);
+            }
+
+            write(data, static_cast<std::uint32_t>(outputs.size()));
+            for (const auto& output : outputs)
+                write(data, output);
+
+            return data;
+        }
+
+        static ShaderBundle deserialize(const std::vector<std::uint8_t>& data)
+        {
+            if (data.size() < 8 || data[0] != 'O' || data[1] != 'S' || data[2] != 'L' || data[3] != 'V')
+                throw std::runtime_error{"Invalid shader bundle"};
+
+            std::size_t position = 4;
+            if (readInteger(data, position) != version)
+                throw std::runtime_error{"Unsupported shader bundle version"};
+
+            ShaderBundle result;
+
+            result.variants.resize(readCount(data, position, 8));
+            for (auto& variant : result.variants)
+            {
+                variant.key = readString(data, position);
+                variant.output = readInteger(data, position);
+            }
+
+            result.outputs.resize(readCount(data, position, 4));
+            for (std::size_t i = 0; i < result.outputs.size(); ++i)
+            {
+                result.outputs[i] = readString(data, position);
+                result.outputIndices.emplace(result.outputs[i], static_cast<std::uint32_t>(i));
+            }
+
+            for (std::size_t i = 0; i < result.variants.size(); ++i)
+                if (result.variants[i].output >= result.outputs.size() ||
+                    (i > 0 && !(result.variants[i - 1].key < result.variants[i].key)))
+                    throw std::runtime_error{"Invalid shader bundle"};
+
+            return result;
+        }
+
+        // lists the variants and the sizes of their outputs
+        std::string dump() const
+        {
+            std::string result;
+
+            for (const auto& variant : variants)
+                result += (variant.key.empty() ? std::string("(no defines)") : variant.key) +
+                    ": output " + std::to_string(variant.output) +
+                    ", " + std::to_string(outputs[variant.output].size()) + " bytes\n";
+
+            return result;
+        }
+
+    private:
+        static void write(std::vector<std::uint8_t>& data, std::uint32_t value)
+        {
+            for (std::size_t i = 0; i < 4; ++i)
+                data.push_back(static_cast<std::uint8_t>(value >> (i * 8)));
+        }
+
+        static void write(std::vector<std::uint8_t>& data, const std::string& value)
+        {
+            write(data, static_cast<std::uint32_t>(value.size()));
+            data.insert(data.end(), value.begin(), value.end());
+        }
+
+        static std::uint32_t readInteger(const std::vector<std::uint8_t>& data, std::size_t& position)
+        {
+            if (data.size() - position < 4)
+                throw std::runtime_error{"Unexpected end of shader bundle"};
+
+            std::uint32_t result = 0;
+            for (std::size_t i = 0; i < 4; ++i)
+                result |= static_cast<std::uint32_t>(data[position++]) << (i * 8);
+            return result;
+        }
+
+        // counts are checked against the remaining data before anything is allocated
+        static std::uint32_t readCount(const std::vector<std::uint8_t>& data, std::size_t& position, std::size_t elementSize)
+        {
+            const auto count = readInteger(data, position);
+            if (count > (data.size() - position) / elementSize)
+                throw std::runtime_error{"Unexpected end of shader bundle"};
+            return count;
+        }
+
+        static std::string readString(const std::vector<std::uint8_t>& data, std::size_t& position)
+        {
+            const auto size = readCount(data, position, 1);
+            std::string result(data.begin() + static_cast<std::ptrdiff_t>(position),
+                               data.begin() + static_cast<std::ptrdiff_t>(position + size));
+            position += size;
+            return result;
+        }
+
+        std::vector<Variant> variants;
+        std::vector<std::string> outputs;
+        std::map<std::string, std::uint32_t> outputIndices;
+    };
+}
+
+#endif // SHADERBUNDLE_HPP
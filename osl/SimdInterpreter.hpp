@@ -0,0 +1,1511 @@
+//
+//  OSL
+//
+
+#ifndef SIMDINTERPRETER_HPP
+#define SIMDINTERPRETER_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Interpreter.hpp"
+
+namespace ouzel
+{
+    // Executes the entry point of a program for laneCount invocations at once in the style of SPMD,
+    // every value holds one element per lane, so the operations are loops over the lanes
+    // that the compiler turns into SIMD instructions,
+    // divergent control flow is executed under a mask of the active lanes
+    template <std::size_t laneCount>
+    class SimdInterpreter final
+    {
+        static_assert(laneCount > 0 && laneCount <= 64, "Invalid lane count");
+
+    public:
+        // the bits of a float, int, uint or bool (0 or 1) per lane
+        using Lanes = std::array<std::uint32_t, laneCount>;
+        using Mask = std::array<bool, laneCount>;
+
+        class Value final
+        {
+        public:
+            Value() = default;
+
+            explicit Value(const Type& initType):
+                type{&initType}
+            {
+                if (initType.typeKind == Type::Kind::Array)
+                {
+                    auto& arrayType = static_cast<const ArrayType&>(initType);
+                    elements.assign(arrayType.size, Value{arrayType.elementType.type});
+                }
+                else if (initType.typeKind == Type::Kind::Struct)
+                    for (const Declaration& memberDeclaration : static_cast<const StructType&>(initType).memberDeclarations)
+                        if (memberDeclaration.declarationKind == Declaration::Kind::Field)
+                            elements.emplace_back(static_cast<const FieldDeclaration&>(memberDeclaration).qualifiedType.type);
+            }
+
+            [[nodiscard]]
+            float getFloat(std::size_t component, std::size_t lane) const noexcept
+            {
+                float result;
+                std::memcpy(&result, &components[component][lane], sizeof(result));
+                return result;
+            }
+
+            void setFloat(std::size_t component, std::size_t lane, float value) noexcept
+            {
+                std::memcpy(&components[component][lane], &value, sizeof(value));
+            }
+
+            [[nodiscard]]
+            std::int32_t getInteger(std::size_t component, std::size_t lane) const noexcept
+            {
+                return static_cast<std::int32_t>(components[component][lane]);
+            }
+
+            void setInteger(std::size_t component, std::size_t lane, std::int64_t value) noexcept
+            {
+                components[component][lane] = static_cast<std::uint32_t>(value);
+            }
+
+            // scalars, vectors and matrices (row by row) are kept in components,
+            // arrays and structs (in the order of their fields) in elements
+            const Type* type = nullptr;
+            std::array<Lanes, 16> components{};
+            std::vector<Value> elements;
+            const Texture* texture = nullptr;
+        };
+
+        SimdInterpreter(const Context& context, Program program)
+        {
+            const auto qualifier = (program == Program::Fragment) ?
+                FunctionDeclaration::Qualifier::Fragment :
+                FunctionDeclaration::Qualifier::Vertex;
+
+            for (const auto declaration : context.getDeclarations())
+                if (declaration->declarationKind == Declaration::Kind::Callable &&
+                    static_cast<const CallableDeclaration*>(declaration)->callableDeclarationKind == CallableDeclaration::Kind::Function &&
+                    static_cast<const FunctionDeclaration*>(declaration)->qualifier == qualifier &&
+                    static_cast<const FunctionDeclaration*>(declaration)->body)
+                    entryPoint = static_cast<const FunctionDeclaration*>(declaration);
+
+            if (!entryPoint)
+                throw std::runtime_error{"No entry point found"};
+
+            active.fill(true);
+
+            for (const auto declaration : context.getDeclarations())
+                if (declaration->declarationKind == Declaration::Kind::Variable)
+                {
+                    auto& variableDeclaration = static_cast<const VariableDeclaration&>(*declaration);
+                    globals.emplace(declaration, variableDeclaration.initialization ?
+                                    evaluate(*variableDeclaration.initialization) :
+                                    Value{variableDeclaration.qualifiedType.type});
+                }
+        }
+
+        [[nodiscard]]
+        const FunctionDeclaration& getEntryPoint() const noexcept
+        {
+            return *entryPoint;
+        }
+
+        // the lanes of a global are usually all set to the same value
+        [[nodiscard]]
+        Value& getGlobal(const std::string& name)
+        {
+            for (auto& global : globals)
+                if (global.first->name == name) return global.second;
+
+            throw std::runtime_error{"Global variable " + name + " not found"};
+        }
+
+        // binds the texture to a Texture2D or Texture2DMS global, the texture must outlive the interpreter
+        void setTexture(const std::string& name, const Texture& texture)
+        {
+            getGlobal(name).texture = &texture;
+        }
+
+        // runs the entry point on the lanes in the mask with one argument per parameter,
+        // returns the mask of the lanes that were not discarded
+        Mask run(const std::vector<Value>& arguments, Value& output, const Mask& mask)
+        {
+            if (arguments.size() != entryPoint->parameterDeclarations.size())
+                throw std::runtime_error{"Invalid number of arguments"};
+
+            variables.clear();
+            scopes.clear();
+            frameStart = 0;
+            scopeStart = 0;
+            callDepth = 0;
+            active = mask;
+            discarded = Mask{};
+            returned = Mask{};
+
+            for (std::size_t i = 0; i < arguments.size(); ++i)
+                variables.emplace_back(entryPoint->parameterDeclarations[i], arguments[i]);
+
+            result = Value{entryPoint->resultType.type};
+            execute(*entryPoint->body);
+            output = std::move(result);
+
+            Mask finished;
+            for (std::size_t lane = 0; lane < laneCount; ++lane)
+                finished[lane] = mask[lane] && !discarded[lane];
+            return finished;
+        }
+
+        Mask run(const std::vector<Value>& arguments, Value& output)
+        {
+            Mask mask;
+            mask.fill(true);
+            return run(arguments, output, mask);
+        }
+
+        // runs the entry point once per pixel of the tile, laneCount pixels at a time,
+        // setArguments fills the lane of the arguments for the pixel at x and y,
+        // the entry point must return a float4 that is written to the RGBA colors row by row,
+        // the colors of the discarded pixels are left unchanged
+        void runTile(std::size_t width, std::size_t height,
+                     const std::function<void(std::size_t x, std::size_t y, std::size_t lane, std::vector<Value>& arguments)>& setArguments,
+                     std::vector<float>& colors)
+        {
+            auto& resultType = entryPoint->resultType.type;
+            if (resultType.typeKind != Type::Kind::Vector ||
+                static_cast<const VectorType&>(resultType).componentCount != 4 ||
+                static_cast<const VectorType&>(resultType).componentType.scalarTypeKind != ScalarType::Kind::FloatingPoint)
+                throw std::runtime_error{"Entry point must return a float4"};
+
+            if (colors.size() != width * height * 4)
+                throw std::runtime_error{"Invalid color buffer size"};
+
+            std::vector<Value> arguments;
+            for (const auto parameterDeclaration : entryPoint->parameterDeclarations)
+                arguments.emplace_back(parameterDeclaration->qualifiedType.type);
+
+            Value output;
+            const auto pixelCount = width * height;
+
+            for (std::size_t first = 0; first < pixelCount; first += laneCount)
+            {
+                Mask mask{};
+                for (std::size_t lane = 0; lane < laneCount && first + lane < pixelCount; ++lane)
+                {
+                    mask[lane] = true;
+                    setArguments((first + lane) % width, (first + lane) / width, lane, arguments);
+                }
+
+                const auto finished = run(arguments, output, mask);
+
+                for (std::size_t lane = 0; lane < laneCount; ++lane)
+                    if (finished[lane])
+                        for (std::size_t component = 0; component < 4; ++component)
+                            colors[(first + lane) * 4 + component] = output.getFloat(component, lane);
+            }
+        }
+
+    private:
+        // targets of break and continue statements
+        struct Scope final
+        {
+            bool loop = false;
+            Mask broken{};
+            Mask continued{};
+        };
+
+        // component indices of an lvalue, whole values (arrays, structs and textures) have no components
+        struct Location final
+        {
+            Value* value = nullptr;
+            bool whole = true;
+            std::size_t componentCount = 0;
+            std::array<std::uint8_t, 16> components{};
+        };
+
+        static constexpr std::size_t maxCallDepth = 256;
+
+        static const ScalarType* getScalarType(const Type& type) noexcept
+        {
+            switch (type.typeKind)
+            {
+                case Type::Kind::Scalar: return &static_cast<const ScalarType&>(type);
+                case Type::Kind::Vector: return &static_cast<const VectorType&>(type).componentType;
+                case Type::Kind::Matrix: return &static_cast<const MatrixType&>(type).rowType.componentType;
+                default: return nullptr;
+            }
+        }
+
+        static std::size_t getComponentCount(const Type& type) noexcept
+        {
+            switch (type.typeKind)
+            {
+                case Type::Kind::Scalar: return 1;
+                case Type::Kind::Vector: return static_cast<const VectorType&>(type).componentCount;
+                case Type::Kind::Matrix:
+                {
+                    auto& matrixType = static_cast<const MatrixType&>(type);
+                    return matrixType.rowCount * matrixType.rowType.componentCount;
+                }
+                default: return 0;
+            }
+        }
+
+        static bool any(const Mask& mask) noexcept
+        {
+            for (const auto lane : mask)
+                if (lane) return true;
+            return false;
+        }
+
+        static float toFloat(std::uint32_t bits) noexcept
+        {
+            float result;
+            std::memcpy(&result, &bits, sizeof(result));
+            return result;
+        }
+
+        static std::uint32_t fromFloat(float value) noexcept
+        {
+            std::uint32_t result;
+            std::memcpy(&result, &value, sizeof(result));
+            return result;
+        }
+
+        // the lane converted to double, which holds every float, int and uint exactly
+        static double toDouble(std::uint32_t bits, const ScalarType& scalarType) noexcept
+        {
+            switch (scalarType.scalarTypeKind)
+            {
+                case ScalarType::Kind::FloatingPoint: return static_cast<double>(toFloat(bits));
+                case ScalarType::Kind::Integer:
+                    return scalarType.isUnsigned ? static_cast<double>(bits) : static_cast<double>(static_cast<std::int32_t>(bits));
+                case ScalarType::Kind::Boolean: return (bits != 0) ? 1.0 : 0.0;
+            }
+
+            return 0.0;
+        }
+
+        // same conversions as the scalar interpreter
+        static std::uint32_t convert(std::uint32_t bits, const ScalarType& source, const ScalarType& target) noexcept
+        {
+            if (source.scalarTypeKind == target.scalarTypeKind)
+                return bits;
+
+            switch (target.scalarTypeKind)
+            {
+                case ScalarType::Kind::Boolean:
+                    return (source.scalarTypeKind == ScalarType::Kind::FloatingPoint) ?
+                        (toFloat(bits) != 0.0F ? 1U : 0U) : (bits != 0 ? 1U : 0U);
+                case ScalarType::Kind::FloatingPoint:
+                    return fromFloat(static_cast<float>(toDouble(bits, source)));
+                case ScalarType::Kind::Integer:
+                {
+                    const auto value = toDouble(bits, source);
+                    if (!(value > -9.2e18 && value < 9.2e18)) return 0;
+                    return static_cast<std::uint32_t>(static_cast<std::int64_t>(value));
+                }
+            }
+
+            return bits;
+        }
+
+        Mask getExited() const noexcept
+        {
+            Mask exited;
+            for (std::size_t lane = 0; lane < laneCount; ++lane)
+                exited[lane] = discarded[lane] || returned[lane];
+
+            for (std::size_t i = scopeStart; i < scopes.size(); ++i)
+                for (std::size_t lane = 0; lane < laneCount; ++lane)
+                    exited[lane] = exited[lane] || scopes[i].broken[lane] || scopes[i].continued[lane];
+
+            return exited;
+        }
+
+        // lanes of the mask that have not left the construct by a break, continue, return or discard
+        void restore(const Mask& mask) noexcept
+        {
+            const auto exited = getExited();
+            for (std::size_t lane = 0; lane < laneCount; ++lane)
+                active[lane] = mask[lane] && !exited[lane];
+        }
+
+        Value& getVariable(const Declaration& declaration)
+        {
+            for (auto i = variables.size(); i > frameStart; --i)
+                if (variables[i - 1].first == &declaration) return variables[i - 1].second;
+
+            const auto global = globals.find(&declaration);
+            if (global == globals.end())
+                throw std::runtime_error{"Variable " + declaration.name + " not found"};
+
+            return global->second;
+        }
+
+        std::size_t getFieldIndex(const FieldDeclaration& fieldDeclaration, const StructType& structType)
+        {
+            const auto iterator = fieldIndices.find(&fieldDeclaration);
+            if (iterator != fieldIndices.end()) return iterator->second;
+
+            std::size_t index = 0;
+            for (const Declaration& memberDeclaration : structType.memberDeclarations)
+                if (&memberDeclaration == &fieldDeclaration)
+                    return fieldIndices[&fieldDeclaration] = index;
+                else if (memberDeclaration.declarationKind == Declaration::Kind::Field)
+                    ++index;
+
+            throw std::runtime_error{"Field " + fieldDeclaration.name + " not found"};
+        }
+
+        // arrays, vectors and matrices can only be indexed by the same value in all active lanes
+        std::size_t getUniformIndex(const Value& index, std::size_t size) const
+        {
+            auto& scalarType = static_cast<const ScalarType&>(*index.type);
+
+            std::optional<double> uniformIndex;
+            for (std::size_t lane = 0; lane < laneCount; ++lane)
+                if (active[lane])
+                {
+                    const auto value = toDouble(index.components[0][lane], scalarType);
+                    if (uniformIndex && *uniformIndex != value)
+                        throw std::runtime_error{"Subscripts that differ between lanes are not supported"};
+                    uniformIndex = value;
+                }
+
+            if (!uniformIndex) return 0;
+
+            if (*uniformIndex < 0.0 || *uniformIndex >= static_cast<double>(size))
+                throw std::runtime_error{"Subscript out of range"};
+
+            return static_cast<std::size_t>(*uniformIndex);
+        }
+
+        void popVariables(std::size_t count)
+        {
+            while (variables.size() > count) variables.pop_back();
+        }
+
+        void declare(const Declaration& declaration)
+        {
+            if (declaration.declarationKind != Declaration::Kind::Variable) return;
+
+            auto& variableDeclaration = static_cast<const VariableDeclaration&>(declaration);
+            auto value = variableDeclaration.initialization ?
+                evaluate(*variableDeclaration.initialization) :
+                Value{variableDeclaration.qualifiedType.type};
+
+            variables.emplace_back(&declaration, std::move(value));
+        }
+
+        Mask evaluateCondition(const Construct& condition)
+        {
+            const auto value = (condition.kind == Construct::Kind::Declaration) ?
+                (declare(static_cast<const Declaration&>(condition)), getVariable(static_cast<const Declaration&>(condition))) :
+                evaluate(static_cast<const Expression&>(condition));
+
+            Mask mask;
+            for (std::size_t lane = 0; lane < laneCount; ++lane)
+                mask[lane] = active[lane] && value.components[0][lane] != 0;
+            return mask;
+        }
+
+        void execute(const Statement& statement)
+        {
+            switch (statement.statementKind)
+            {
+                case Statement::Kind::Empty:
+                    return;
+
+                case Statement::Kind::Expression:
+                    evaluate(static_cast<const ExpressionStatement&>(statement).expression);
+                    return;
+
+                case Statement::Kind::Declaration:
+                    declare(static_cast<const DeclarationStatement&>(statement).declaration);
+                    return;
+
+                case Statement::Kind::Compound:
+                {
+                    const auto variableCount = variables.size();
+
+                    for (const Statement& child : static_cast<const CompoundStatement&>(statement).statements)
+                    {
+                        if (!any(active)) break;
+                        execute(child);
+                    }
+
+                    popVariables(variableCount);
+                    return;
+                }
+
+                case Statement::Kind::If:
+                {
+                    auto& ifStatement = static_cast<const IfStatement&>(statement);
+                    const auto variableCount = variables.size();
+                    const auto entry = active;
+
+                    const auto condition = evaluateCondition(ifStatement.condition);
+
+                    active = condition;
+                    if (any(active)) execute(ifStatement.body);
+
+                    if (ifStatement.elseBody)
+                    {
+                        const auto exited = getExited();
+                        for (std::size_t lane = 0; lane < laneCount; ++lane)
+                            active[lane] = entry[lane] && !condition[lane] && !exited[lane];
+
+                        if (any(active)) execute(*ifStatement.elseBody);
+                    }
+
+                    restore(entry);
+                    popVariables(variableCount);
+                    return;
+                }
+
+                case Statement::Kind::For:
+                {
+                    auto& forStatement = static_cast<const ForStatement&>(statement);
+                    const auto variableCount = variables.size();
+                    const auto entry = active;
+
+                    if (forStatement.initialization)
+                    {
+                        if (forStatement.initialization->kind == Construct::Kind::Declaration)
+                            declare(static_cast<const Declaration&>(*forStatement.initialization));
+                        else if (forStatement.initialization->kind == Construct::Kind::Expression)
+                            evaluate(static_cast<const Expression&>(*forStatement.initialization));
+                    }
+
+                    executeLoop(forStatement.condition, forStatement.body, forStatement.increment, false);
+
+                    scopes.pop_back();
+                    restore(entry);
+                    popVariables(variableCount);
+                    return;
+                }
+
+                case Statement::Kind::While:
+                {
+                    auto& whileStatement = static_cast<const WhileStatement&>(statement);
+                    const auto entry = active;
+
+                    executeLoop(&whileStatement.condition, whileStatement.body, nullptr, false);
+
+                    scopes.pop_back();
+                    restore(entry);
+                    return;
+                }
+
+                case Statement::Kind::Do:
+                {
+                    auto& doStatement = static_cast<const DoStatement&>(statement);
+                    const auto entry = active;
+
+                    executeLoop(&doStatement.condition, doStatement.body, nullptr, true);
+
+                    scopes.pop_back();
+                    restore(entry);
+                    return;
+                }
+
+                case Statement::Kind::Switch:
+                    executeSwitch(static_cast<const SwitchStatement&>(statement));
+                    return;
+
+                case Statement::Kind::Case:
+                    execute(static_cast<const CaseStatement&>(statement).body);
+                    return;
+
+                case Statement::Kind::Default:
+                    execute(static_cast<const DefaultStatement&>(statement).body);
+                    return;
+
+                case Statement::Kind::Break:
+                {
+                    auto& scope = scopes.back();
+                    for (std::size_t lane = 0; lane < laneCount; ++lane)
+                        if (active[lane]) scope.broken[lane] = true;
+                    active = Mask{};
+                    return;
+                }
+
+                case Statement::Kind::Continue:
+                {
+                    auto scope = scopes.rbegin();
+                    while (!scope->loop) ++scope;
+
+                    for (std::size_t lane = 0; lane < laneCount; ++lane)
+                        if (active[lane]) scope->continued[lane] = true;
+                    active = Mask{};
+                    return;
+                }
+
+                case Statement::Kind::Return:
+                {
+                    auto& returnStatement = static_cast<const ReturnStatement&>(statement);
+                    if (returnStatement.result)
+                    {
+                        const auto value = evaluate(*returnStatement.result);
+                        blend(result, value, active);
+                    }
+
+                    for (std::size_t lane = 0; lane < laneCount; ++lane)
+                        if (active[lane]) returned[lane] = true;
+                    active = Mask{};
+                    return;
+                }
+            }
+
+            throw std::runtime_error{"Unknown statement"};
+        }
+
+        // iterates until no lane is left in the loop, pushes the scope of the loop
+        void executeLoop(const Construct* condition, const Statement& body,
+                         const Expression* increment, bool testAfterBody)
+        {
+            scopes.emplace_back();
+            scopes.back().loop = true;
+
+            for (bool first = true;; first = false)
+            {
+                const auto iterationVariableCount = variables.size();
+
+                if (condition && !(testAfterBody && first))
+                    active = evaluateCondition(*condition);
+
+                popVariables(iterationVariableCount);
+                if (!any(active)) break;
+
+                execute(body);
+                popVariables(iterationVariableCount);
+
+                // the lanes that continued run the next iteration
+                auto& scope = scopes.back();
+                for (std::size_t lane = 0; lane < laneCount; ++lane)
+                {
+                    active[lane] = active[lane] || scope.continued[lane];
+                    scope.continued[lane] = false;
+                }
+
+                if (increment && any(active)) evaluate(*increment);
+            }
+        }
+
+        // the lanes enter at their matching label and fall through the following ones
+        void executeSwitch(const SwitchStatement& switchStatement)
+        {
+            const auto variableCount = variables.size();
+            const auto entry = active;
+
+            const auto condition = (switchStatement.condition.kind == Construct::Kind::Declaration) ?
+                (declare(static_cast<const Declaration&>(switchStatement.condition)),
+                 getVariable(static_cast<const Declaration&>(switchStatement.condition))) :
+                evaluate(static_cast<const Expression&>(switchStatement.condition));
+
+            std::vector<StatementRef> statements;
+            if (switchStatement.body.statementKind == Statement::Kind::Compound)
+                statements = static_cast<const CompoundStatement&>(switchStatement.body).statements;
+            else
+                statements.push_back(switchStatement.body);
+
+            // the lanes that match a case do not enter at the default label
+            std::vector<Mask> caseMasks(statements.size());
+            Mask matched{};
+
+            for (std::size_t i = 0; i < statements.size(); ++i)
+                if (statements[i].get().statementKind == Statement::Kind::Case)
+                {
+                    const auto value = evaluate(static_cast<const CaseStatement&>(statements[i].get()).condition);
+                    for (std::size_t lane = 0; lane < laneCount; ++lane)
+                        if (entry[lane] && !matched[lane] && value.components[0][lane] == condition.components[0][lane])
+                            caseMasks[i][lane] = matched[lane] = true;
+                }
+
+            for (std::size_t i = 0; i < statements.size(); ++i)
+                if (statements[i].get().statementKind == Statement::Kind::Default)
+                    for (std::size_t lane = 0; lane < laneCount; ++lane)
+                        caseMasks[i][lane] = entry[lane] && !matched[lane];
+
+            scopes.emplace_back();
+            const auto bodyVariableCount = variables.size();
+            active = Mask{};
+
+            for (std::size_t i = 0; i < statements.size(); ++i)
+            {
+                const Statement& child = statements[i];
+
+                if (child.statementKind == Statement::Kind::Case ||
+                    child.statementKind == Statement::Kind::Default)
+                {
+                    const auto exited = getExited();
+                    for (std::size_t lane = 0; lane < laneCount; ++lane)
+                        active[lane] = (active[lane] || caseMasks[i][lane]) && !exited[lane];
+                }
+
+                // declarations are in scope after the following labels
+                if (child.statementKind == Statement::Kind::Declaration && !any(active))
+                {
+                    auto& declaration = static_cast<const DeclarationStatement&>(child).declaration;
+                    if (declaration.declarationKind == Declaration::Kind::Variable)
+                        variables.emplace_back(&declaration, Value{static_cast<const VariableDeclaration&>(declaration).qualifiedType.type});
+                }
+                else if (any(active))
+                    execute(child);
+            }
+
+            popVariables(bodyVariableCount);
+            scopes.pop_back();
+            restore(entry);
+            popVariables(variableCount);
+        }
+
+        Location locate(const Expression& expression)
+        {
+            switch (expression.expressionKind)
+            {
+                case Expression::Kind::DeclarationReference:
+                {
+                    Location location;
+                    location.value = &getVariable(static_cast<const DeclarationReferenceExpression&>(expression).declaration);
+                    return makeWhole(location);
+                }
+
+                case Expression::Kind::Paren:
+                    return locate(static_cast<const ParenExpression&>(expression).expression);
+
+                case Expression::Kind::Member:
+                {
+                    auto& memberExpression = static_cast<const MemberExpression&>(expression);
+                    auto location = locate(memberExpression.expression);
+                    auto& structType = static_cast<const StructType&>(*location.value->type);
+
+                    location.value = &location.value->elements[getFieldIndex(memberExpression.fieldDeclaration, structType)];
+                    return makeWhole(location);
+                }
+
+                case Expression::Kind::ArraySubscript:
+                {
+                    auto& arraySubscriptExpression = static_cast<const ArraySubscriptExpression&>(expression);
+                    const auto subscript = evaluate(arraySubscriptExpression.subscript);
+                    auto location = locate(arraySubscriptExpression.expression);
+
+                    location.value = &location.value->elements[getUniformIndex(subscript, location.value->elements.size())];
+                    return makeWhole(location);
+                }
+
+                case Expression::Kind::BinaryOperator:
+                {
+                    auto& binaryOperatorExpression = static_cast<const BinaryOperatorExpression&>(expression);
+
+                    if (binaryOperatorExpression.operatorKind == BinaryOperatorExpression::Kind::Subscript)
+                    {
+                        const auto subscript = evaluate(binaryOperatorExpression.rightExpression);
+                        auto location = locate(binaryOperatorExpression.leftExpression);
+                        auto& type = binaryOperatorExpression.leftExpression.qualifiedType.type;
+
+                        // a subscript of a vector is a component and a subscript of a matrix is a row
+                        const auto rowCount = (type.typeKind == Type::Kind::Matrix) ?
+                            static_cast<const MatrixType&>(type).rowCount : getComponentCount(type);
+                        const auto stride = (type.typeKind == Type::Kind::Matrix) ?
+                            static_cast<const MatrixType&>(type).rowType.componentCount : 1;
+
+                        const auto first = getUniformIndex(subscript, rowCount) * stride;
+                        for (std::size_t i = 0; i < stride; ++i)
+                            location.components[i] = location.components[first + i];
+                        location.componentCount = stride;
+                        return location;
+                    }
+                    else if (binaryOperatorExpression.operatorKind == BinaryOperatorExpression::Kind::Comma)
+                    {
+                        evaluate(binaryOperatorExpression.leftExpression);
+                        return locate(binaryOperatorExpression.rightExpression);
+                    }
+                    else if (binaryOperatorExpression.category == Expression::Category::Lvalue)
+                    {
+                        // assignments return their left operand
+                        evaluate(binaryOperatorExpression);
+                        return locate(binaryOperatorExpression.leftExpression);
+                    }
+
+                    break;
+                }
+
+                case Expression::Kind::UnaryOperator:
+                {
+                    auto& unaryOperatorExpression = static_cast<const UnaryOperatorExpression&>(expression);
+                    if (unaryOperatorExpression.operatorKind != UnaryOperatorExpression::Kind::PrefixIncrement &&
+                        unaryOperatorExpression.operatorKind != UnaryOperatorExpression::Kind::PrefixDecrement)
+                        break;
+
+                    evaluate(unaryOperatorExpression);
+                    return locate(unaryOperatorExpression.expression);
+                }
+
+                case Expression::Kind::VectorElement:
+                {
+                    auto& vectorElementExpression = static_cast<const VectorElementExpression&>(expression);
+                    auto location = locate(vectorElementExpression.expression);
+                    const auto components = location.components;
+
+                    for (std::size_t i = 0; i < vectorElementExpression.positions.size(); ++i)
+                        location.components[i] = components[vectorElementExpression.positions[i]];
+                    location.componentCount = vectorElementExpression.positions.size();
+                    return location;
+                }
+
+                case Expression::Kind::TernaryOperator:
+                {
+                    // the condition must select the same operand in all active lanes
+                    auto& ternaryOperatorExpression = static_cast<const TernaryOperatorExpression&>(expression);
+                    const auto condition = evaluate(ternaryOperatorExpression.condition);
+
+                    std::optional<bool> selected;
+                    for (std::size_t lane = 0; lane < laneCount; ++lane)
+                        if (active[lane])
+                        {
+                            if (selected && *selected != (condition.components[0][lane] != 0))
+                                throw std::runtime_error{"Assignments to a ternary operator that differs between lanes are not supported"};
+                            selected = condition.components[0][lane] != 0;
+                        }
+
+                    return locate((!selected || *selected) ?
+                                  ternaryOperatorExpression.leftExpression :
+                                  ternaryOperatorExpression.rightExpression);
+                }
+
+                default:
+                    break;
+            }
+
+            throw std::runtime_error{"Expression is not assignable"};
+        }
+
+        static Location& makeWhole(Location& location) noexcept
+        {
+            location.componentCount = getComponentCount(*location.value->type);
+            location.whole = location.componentCount == 0;
+
+            for (std::size_t i = 0; i < location.componentCount; ++i)
+                location.components[i] = static_cast<std::uint8_t>(i);
+
+            return location;
+        }
+
+        static Value load(const Location& location, const Type& type)
+        {
+            if (location.whole) return *location.value;
+
+            Value value{type};
+            for (std::size_t i = 0; i < location.componentCount; ++i)
+                value.components[i] = location.value->components[location.components[i]];
+            return value;
+        }
+
+        // writes only the lanes in the mask
+        static void blend(Value& target, const Value& source, const Mask& mask) noexcept
+        {
+            for (std::size_t i = 0; i < getComponentCount(*target.type); ++i)
+                for (std::size_t lane = 0; lane < laneCount; ++lane)
+                    if (mask[lane]) target.components[i][lane] = source.components[i][lane];
+
+            for (std::size_t i = 0; i < target.elements.size() && i < source.elements.size(); ++i)
+                blend(target.elements[i], source.elements[i], mask);
+
+            if (any(mask) && source.texture) target.texture = source.texture;
+        }
+
+        void store(const Location& location, const Value& value) const noexcept
+        {
+            if (location.whole)
+                blend(*location.value, value, active);
+            else
+                for (std::size_t i = 0; i < location.componentCount; ++i)
+                    for (std::size_t lane = 0; lane < laneCount; ++lane)
+                        if (active[lane])
+                            location.value->components[location.components[i]][lane] = value.components[i][lane];
+        }
+
+        Value evaluate(const Expression& expression)
+        {
+            switch (expression.expressionKind)
+            {
+                case Expression::Kind::Call:
+                    return evaluateCall(static_cast<const CallExpression&>(expression));
+
+                case Expression::Kind::Literal:
+                {
+                    auto& literalExpression = static_cast<const LiteralExpression&>(expression);
+                    Value value{expression.qualifiedType.type};
+                    std::uint32_t bits = 0;
+
+                    switch (literalExpression.literalKind)
+                    {
+                        case LiteralExpression::Kind::Boolean:
+                            bits = static_cast<const BooleanLiteralExpression&>(literalExpression).value ? 1U : 0U;
+                            break;
+                        case LiteralExpression::Kind::Integer:
+                            bits = static_cast<std::uint32_t>(static_cast<const IntegerLiteralExpression&>(literalExpression).value);
+                            break;
+                        case LiteralExpression::Kind::FloatingPoint:
+                            bits = fromFloat(static_cast<float>(static_cast<const FloatingPointLiteralExpression&>(literalExpression).value));
+                            break;
+                        case LiteralExpression::Kind::String:
+                            throw std::runtime_error{"String literals are not supported"};
+                    }
+
+                    value.components[0].fill(bits);
+                    return value;
+                }
+
+                case Expression::Kind::DeclarationReference:
+                    return getVariable(static_cast<const DeclarationReferenceExpression&>(expression).declaration);
+
+                case Expression::Kind::Paren:
+                    return evaluate(static_cast<const ParenExpression&>(expression).expression);
+
+                case Expression::Kind::Member:
+                {
+                    auto& memberExpression = static_cast<const MemberExpression&>(expression);
+                    auto value = evaluate(memberExpression.expression);
+                    auto& structType = static_cast<const StructType&>(*value.type);
+                    return std::move(value.elements[getFieldIndex(memberExpression.fieldDeclaration, structType)]);
+                }
+
+                case Expression::Kind::ArraySubscript:
+                {
+                    auto& arraySubscriptExpression = static_cast<const ArraySubscriptExpression&>(expression);
+                    auto value = evaluate(arraySubscriptExpression.expression);
+                    const auto subscript = evaluate(arraySubscriptExpression.subscript);
+                    return std::move(value.elements[getUniformIndex(subscript, value.elements.size())]);
+                }
+
+                case Expression::Kind::UnaryOperator:
+                    return evaluateUnary(static_cast<const UnaryOperatorExpression&>(expression));
+
+                case Expression::Kind::BinaryOperator:
+                    return evaluateBinary(static_cast<const BinaryOperatorExpression&>(expression));
+
+                case Expression::Kind::TernaryOperator:
+                {
+                    // each operand is evaluated only for the lanes that select it
+                    auto& ternaryOperatorExpression = static_cast<const TernaryOperatorExpression&>(expression);
+                    const auto entry = active;
+                    const auto condition = evaluate(ternaryOperatorExpression.condition);
+
+                    Mask leftMask;
+                    Mask rightMask;
+                    for (std::size_t lane = 0; lane < laneCount; ++lane)
+                    {
+                        leftMask[lane] = entry[lane] && condition.components[0][lane] != 0;
+                        rightMask[lane] = entry[lane] && condition.components[0][lane] == 0;
+                    }
+
+                    Value value{expression.qualifiedType.type};
+
+                    if (any(leftMask))
+                    {
+                        active = leftMask;
+                        blend(value, evaluate(ternaryOperatorExpression.leftExpression), leftMask);
+                    }
+
+                    if (any(rightMask))
+                    {
+                        active = rightMask;
+                        blend(value, evaluate(ternaryOperatorExpression.rightExpression), rightMask);
+                    }
+
+                    active = entry;
+                    for (std::size_t lane = 0; lane < laneCount; ++lane)
+                        if (discarded[lane]) active[lane] = false;
+
+                    return value;
+                }
+
+                case Expression::Kind::TemporaryObject:
+                {
+                    // the parameters initialize the fields in order
+                    auto& temporaryObjectExpression = static_cast<const TemporaryObjectExpression&>(expression);
+                    Value value{expression.qualifiedType.type};
+
+                    for (std::size_t i = 0; i < temporaryObjectExpression.parameters.size() && i < value.elements.size(); ++i)
+                    {
+                        const auto type = value.elements[i].type;
+                        value.elements[i] = evaluate(temporaryObjectExpression.parameters[i]);
+                        value.elements[i].type = type;
+                    }
+
+                    return value;
+                }
+
+                case Expression::Kind::InitializerList:
+                {
+                    auto& initializerListExpression = static_cast<const InitializerListExpression&>(expression);
+                    Value value{expression.qualifiedType.type};
+
+                    for (std::size_t i = 0; i < initializerListExpression.expressions.size() && i < value.elements.size(); ++i)
+                        value.elements[i] = convert(evaluate(initializerListExpression.expressions[i]), *value.elements[i].type);
+
+                    return value;
+                }
+
+                case Expression::Kind::Cast:
+                    return convert(evaluate(static_cast<const CastExpression&>(expression).expression),
+                                   expression.qualifiedType.type);
+
+                case Expression::Kind::VectorInitialize:
+                case Expression::Kind::MatrixInitialize:
+                {
+                    auto& parameters = (expression.expressionKind == Expression::Kind::VectorInitialize) ?
+                        static_cast<const VectorInitializeExpression&>(expression).parameters :
+                        static_cast<const MatrixInitializeExpression&>(expression).parameters;
+
+                    Value value{expression.qualifiedType.type};
+                    const auto scalarType = getScalarType(expression.qualifiedType.type);
+                    const auto componentCount = getComponentCount(expression.qualifiedType.type);
+                    std::size_t component = 0;
+
+                    for (const Expression& parameter : parameters)
+                    {
+                        const auto parameterValue = evaluate(parameter);
+                        const auto parameterScalarType = getScalarType(*parameterValue.type);
+                        if (!parameterScalarType)
+                            throw std::runtime_error{"Invalid initializer"};
+
+                        for (std::size_t i = 0; i < getComponentCount(*parameterValue.type) && component < componentCount; ++i, ++component)
+                            for (std::size_t lane = 0; lane < laneCount; ++lane)
+                                value.components[component][lane] = convert(parameterValue.components[i][lane], *parameterScalarType, *scalarType);
+                    }
+
+                    // a single scalar initializes all components
+                    if (component == 1)
+                        for (std::size_t i = 1; i < componentCount; ++i)
+                            value.components[i] = value.components[0];
+
+                    return value;
+                }
+
+                case Expression::Kind::VectorElement:
+                {
+                    auto& vectorElementExpression = static_cast<const VectorElementExpression&>(expression);
+                    const auto vector = evaluate(vectorElementExpression.expression);
+
+                    Value value{expression.qualifiedType.type};
+                    for (std::size_t i = 0; i < vectorElementExpression.positions.size(); ++i)
+                        value.components[i] = vector.components[vectorElementExpression.positions[i]];
+
+                    return value;
+                }
+            }
+
+            throw std::runtime_error{"Unknown expression"};
+        }
+
+        // converts between scalar types, vectors with the same number of components
+        // and from a scalar to a vector by repeating it
+        static Value convert(const Value& value, const Type& type)
+        {
+            if (value.type == &type) return value;
+
+            const auto sourceScalarType = getScalarType(*value.type);
+            const auto targetScalarType = getScalarType(type);
+
+            if (!sourceScalarType || !targetScalarType)
+            {
+                if (value.type->typeKind != type.typeKind)
+                    throw std::runtime_error{"Invalid conversion from " + value.type->name + " to " + type.name};
+
+                return value;
+            }
+
+            const auto sourceCount = getComponentCount(*value.type);
+            const auto targetCount = getComponentCount(type);
+
+            if (sourceCount != targetCount && sourceCount != 1)
+                throw std::runtime_error{"Invalid conversion from " + value.type->name + " to " + type.name};
+
+            Value result{type};
+            for (std::size_t i = 0; i < targetCount; ++i)
+                for (std::size_t lane = 0; lane < laneCount; ++lane)
+                    result.components[i][lane] = convert(value.components[(sourceCount == 1) ? 0 : i][lane],
+                                                         *sourceScalarType, *targetScalarType);
+
+            return result;
+        }
+
+        Value evaluateUnary(const UnaryOperatorExpression& expression)
+        {
+            auto& type = expression.qualifiedType.type;
+            const auto scalarType = getScalarType(type);
+            const auto componentCount = getComponentCount(type);
+
+            switch (expression.operatorKind)
+            {
+                case UnaryOperatorExpression::Kind::Negation:
+                {
+                    auto value = evaluate(expression.expression);
+                    for (auto& lane : value.components[0]) lane = (lane != 0) ? 0U : 1U;
+                    return value;
+                }
+
+                case UnaryOperatorExpression::Kind::Positive:
+                    return evaluate(expression.expression);
+
+                case UnaryOperatorExpression::Kind::Negative:
+                {
+                    auto value = evaluate(expression.expression);
+                    for (std::size_t i = 0; i < componentCount; ++i)
+                        for (auto& lane : value.components[i])
+                            lane = (scalarType->scalarTypeKind == ScalarType::Kind::FloatingPoint) ?
+                                lane ^ 0x80000000U : 0U - lane;
+                    return value;
+                }
+
+                case UnaryOperatorExpression::Kind::PrefixIncrement:
+                case UnaryOperatorExpression::Kind::PrefixDecrement:
+                case UnaryOperatorExpression::Kind::PostfixIncrement:
+                case UnaryOperatorExpression::Kind::PostfixDecrement:
+                {
+                    const auto location = locate(expression.expression);
+                    const auto previous = load(location, expression.expression.qualifiedType.type);
+
+                    auto value = previous;
+                    const auto step = (expression.operatorKind == UnaryOperatorExpression::Kind::PrefixIncrement ||
+                                       expression.operatorKind == UnaryOperatorExpression::Kind::PostfixIncrement) ? 1 : -1;
+
+                    for (std::size_t i = 0; i < componentCount; ++i)
+                        for (auto& lane : value.components[i])
+                            lane = (scalarType->scalarTypeKind == ScalarType::Kind::FloatingPoint) ?
+                                fromFloat(toFloat(lane) + static_cast<float>(step)) :
+                                lane + static_cast<std::uint32_t>(step);
+
+                    store(location, value);
+
+                    return (expression.operatorKind == UnaryOperatorExpression::Kind::PrefixIncrement ||
+                            expression.operatorKind == UnaryOperatorExpression::Kind::PrefixDecrement) ? value : previous;
+                }
+            }
+
+            throw std::runtime_error{"Unknown operator"};
+        }
+
+        Value evaluateBinary(const BinaryOperatorExpression& expression)
+        {
+            switch (expression.operatorKind)
+            {
+                case BinaryOperatorExpression::Kind::Assignment:
+                {
+                    auto value = convert(evaluate(expression.rightExpression), expression.leftExpression.qualifiedType.type);
+                    store(locate(expression.leftExpression), value);
+                    return value;
+                }
+
+                case BinaryOperatorExpression::Kind::AdditionAssignment:
+                case BinaryOperatorExpression::Kind::SubtractAssignment:
+                case BinaryOperatorExpression::Kind::MultiplicationAssignment:
+                case BinaryOperatorExpression::Kind::DivisionAssignment:
+                {
+                    const auto right = evaluate(expression.rightExpression);
+                    const auto location = locate(expression.leftExpression);
+                    auto& type = expression.leftExpression.qualifiedType.type;
+
+                    const auto operatorKind =
+                        (expression.operatorKind == BinaryOperatorExpression::Kind::AdditionAssignment) ? BinaryOperatorExpression::Kind::Addition :
+                        (expression.operatorKind == BinaryOperatorExpression::Kind::SubtractAssignment) ? BinaryOperatorExpression::Kind::Subtraction :
+                        (expression.operatorKind == BinaryOperatorExpression::Kind::MultiplicationAssignment) ? BinaryOperatorExpression::Kind::Multiplication :
+                        BinaryOperatorExpression::Kind::Division;
+
+                    const auto value = calculate(operatorKind, load(location, type), right, type);
+                    store(location, value);
+                    return value;
+                }
+
+                case BinaryOperatorExpression::Kind::Or:
+                case BinaryOperatorExpression::Kind::And:
+                {
+                    // the right operand is evaluated only for the lanes that need it
+                    auto value = evaluate(expression.leftExpression);
+                    const auto entry = active;
+                    const auto isAnd = expression.operatorKind == BinaryOperatorExpression::Kind::And;
+
+                    Mask rightMask;
+                    for (std::size_t lane = 0; lane < laneCount; ++lane)
+                        rightMask[lane] = entry[lane] && (value.components[0][lane] != 0) == isAnd;
+
+                    if (any(rightMask))
+                    {
+                        active = rightMask;
+                        const auto right = evaluate(expression.rightExpression);
+                        for (std::size_t lane = 0; lane < laneCount; ++lane)
+                            if (rightMask[lane]) value.components[0][lane] = (right.components[0][lane] != 0) ? 1U : 0U;
+
+                        active = entry;
+                        for (std::size_t lane = 0; lane < laneCount; ++lane)
+                            if (discarded[lane]) active[lane] = false;
+                    }
+
+                    return value;
+                }
+
+                case BinaryOperatorExpression::Kind::Comma:
+                    evaluate(expression.leftExpression);
+                    return evaluate(expression.rightExpression);
+
+                case BinaryOperatorExpression::Kind::Subscript:
+                {
+                    const auto left = evaluate(expression.leftExpression);
+                    const auto subscript = evaluate(expression.rightExpression);
+                    Value value{expression.qualifiedType.type};
+
+                    const auto count = getComponentCount(expression.qualifiedType.type);
+                    const auto first = getUniformIndex(subscript, getComponentCount(*left.type) / count) * count;
+
+                    for (std::size_t i = 0; i < count; ++i)
+                        value.components[i] = left.components[first + i];
+
+                    return value;
+                }
+
+                case BinaryOperatorExpression::Kind::Equality:
+                case BinaryOperatorExpression::Kind::Inequality:
+                {
+                    Mask equal;
+                    equal.fill(true);
+                    compare(evaluate(expression.leftExpression), evaluate(expression.rightExpression), equal);
+
+                    Value value{expression.qualifiedType.type};
+                    const auto isEquality = expression.operatorKind == BinaryOperatorExpression::Kind::Equality;
+                    for (std::size_t lane = 0; lane < laneCount; ++lane)
+                        value.components[0][lane] = (equal[lane] == isEquality) ? 1U : 0U;
+                    return value;
+                }
+
+                default:
+                    return calculate(expression.operatorKind,
+                                     evaluate(expression.leftExpression),
+                                     evaluate(expression.rightExpression),
+                                     expression.qualifiedType.type);
+            }
+        }
+
+        // clears the lanes in which the values differ, floats are compared by value
+        static void compare(const Value& left, const Value& right, Mask& equal) noexcept
+        {
+            const auto scalarType = getScalarType(*left.type);
+
+            for (std::size_t i = 0; i < getComponentCount(*left.type); ++i)
+                for (std::size_t lane = 0; lane < laneCount; ++lane)
+                    if ((scalarType->scalarTypeKind == ScalarType::Kind::FloatingPoint) ?
+                        toFloat(left.components[i][lane]) != toFloat(right.components[i][lane]) :
+                        left.components[i][lane] != right.components[i][lane])
+                        equal[lane] = false;
+
+            for (std::size_t i = 0; i < left.elements.size() && i < right.elements.size(); ++i)
+                compare(left.elements[i], right.elements[i], equal);
+        }
+
+        static void calculate(BinaryOperatorExpression::Kind operatorKind,
+                              const Lanes& left, const Lanes& right, const ScalarType& scalarType,
+                              Lanes& result) noexcept
+        {
+            if (scalarType.scalarTypeKind == ScalarType::Kind::FloatingPoint)
+            {
+                std::array<float, laneCount> a;
+                std::array<float, laneCount> b;
+                std::array<float, laneCount> c;
+                std::memcpy(a.data(), left.data(), sizeof(a));
+                std::memcpy(b.data(), right.data(), sizeof(b));
+
+                switch (operatorKind)
+                {
+                    case BinaryOperatorExpression::Kind::Addition:
+                        for (std::size_t lane = 0; lane < laneCount; ++lane) c[lane] = a[lane] + b[lane];
+                        break;
+                    case BinaryOperatorExpression::Kind::Subtraction:
+                        for (std::size_t lane = 0; lane < laneCount; ++lane) c[lane] = a[lane] - b[lane];
+                        break;
+                    case BinaryOperatorExpression::Kind::Multiplication:
+                        for (std::size_t lane = 0; lane < laneCount; ++lane) c[lane] = a[lane] * b[lane];
+                        break;
+                    default:
+                        for (std::size_t lane = 0; lane < laneCount; ++lane) c[lane] = a[lane] / b[lane];
+                        break;
+                }
+
+                std::memcpy(result.data(), c.data(), sizeof(c));
+                return;
+            }
+
+            // unsigned arithmetic wraps in the same way for int and uint
+            switch (operatorKind)
+            {
+                case BinaryOperatorExpression::Kind::Addition:
+                    for (std::size_t lane = 0; lane < laneCount; ++lane) result[lane] = left[lane] + right[lane];
+                    break;
+                case BinaryOperatorExpression::Kind::Subtraction:
+                    for (std::size_t lane = 0; lane < laneCount; ++lane) result[lane] = left[lane] - right[lane];
+                    break;
+                case BinaryOperatorExpression::Kind::Multiplication:
+                    for (std::size_t lane = 0; lane < laneCount; ++lane) result[lane] = left[lane] * right[lane];
+                    break;
+                default: // division by zero results in zero instead of trapping
+                    for (std::size_t lane = 0; lane < laneCount; ++lane)
+                        if (right[lane] == 0)
+                            result[lane] = 0;
+                        else if (scalarType.isUnsigned)
+                            result[lane] = left[lane] / right[lane];
+                        else
+                            result[lane] = static_cast<std::uint32_t>(static_cast<std::int64_t>(static_cast<std::int32_t>(left[lane])) /
+                                                                      static_cast<std::int32_t>(right[lane]));
+                    break;
+            }
+
+            if (scalarType.scalarTypeKind == ScalarType::Kind::Boolean)
+                for (auto& lane : result) lane = (lane != 0) ? 1U : 0U;
+        }
+
+        // arithmetic and comparison operators, componentwise with a scalar operand repeated,
+        // except for the products of a matrix with a vector or matrix, which are linear algebra products
+        static Value calculate(BinaryOperatorExpression::Kind operatorKind,
+                               const Value& left, const Value& right, const Type& resultType)
+        {
+            Value value{resultType};
+            const auto scalarType = getScalarType(*left.type);
+            if (!scalarType)
+                throw std::runtime_error{"Invalid operands"};
+
+            switch (operatorKind)
+            {
+                case BinaryOperatorExpression::Kind::LessThan:
+                case BinaryOperatorExpression::Kind::LessThanEqual:
+                case BinaryOperatorExpression::Kind::GreaterThan:
+                case BinaryOperatorExpression::Kind::GraterThanEqual:
+                    for (std::size_t lane = 0; lane < laneCount; ++lane)
+                    {
+                        const auto a = toDouble(left.components[0][lane], *scalarType);
+                        const auto b = toDouble(right.components[0][lane], *scalarType);
+
+                        bool comparison;
+                        switch (operatorKind)
+                        {
+                            case BinaryOperatorExpression::Kind::LessThan: comparison = a < b; break;
+                            case BinaryOperatorExpression::Kind::LessThanEqual: comparison = a <= b; break;
+                            case BinaryOperatorExpression::Kind::GreaterThan: comparison = a > b; break;
+                            default: comparison = a >= b; break;
+                        }
+
+                        value.components[0][lane] = comparison ? 1U : 0U;
+                    }
+                    return value;
+
+                default:
+                    break;
+            }
+
+            if (operatorKind == BinaryOperatorExpression::Kind::Multiplication &&
+                (left.type->typeKind == Type::Kind::Matrix || right.type->typeKind == Type::Kind::Matrix) &&
+                left.type->typeKind != Type::Kind::Scalar && right.type->typeKind != Type::Kind::Scalar)
+            {
+                // a vector on the left is a row vector and a vector on the right is a column vector
+                const auto leftRows = (left.type->typeKind == Type::Kind::Matrix) ? static_cast<const MatrixType&>(*left.type).rowCount : 1;
+                const auto inner = (right.type->typeKind == Type::Kind::Matrix) ? static_cast<const MatrixType&>(*right.type).rowCount : getComponentCount(*right.type);
+                const auto rightColumns = (right.type->typeKind == Type::Kind::Matrix) ? static_cast<const MatrixType&>(*right.type).rowType.componentCount : 1;
+
+                for (std::size_t row = 0; row < leftRows; ++row)
+                    for (std::size_t column = 0; column < rightColumns; ++column)
+                    {
+                        std::array<float, laneCount> sum{};
+                        for (std::size_t i = 0; i < inner; ++i)
+                            for (std::size_t lane = 0; lane < laneCount; ++lane)
+                                sum[lane] += toFloat(left.components[row * inner + i][lane]) *
+                                    toFloat(right.components[i * rightColumns + column][lane]);
+
+                        std::memcpy(value.components[row * rightColumns + column].data(), sum.data(), sizeof(sum));
+                    }
+
+                return value;
+            }
+
+            const auto leftCount = getComponentCount(*left.type);
+            const auto rightCount = getComponentCount(*right.type);
+
+            for (std::size_t i = 0; i < getComponentCount(resultType); ++i)
+                calculate(operatorKind,
+                          left.components[(leftCount == 1) ? 0 : i],
+                          right.components[(rightCount == 1) ? 0 : i],
+                          *scalarType, value.components[i]);
+
+            return value;
+        }
+
+        Value evaluateCall(const CallExpression& expression)
+        {
+            auto& declaration = expression.declarationReference.declaration;
+            if (declaration.declarationKind != Declaration::Kind::Callable)
+                throw std::runtime_error{"Invalid call"};
+
+            auto& callableDeclaration = static_cast<const CallableDeclaration&>(declaration);
+
+            if (callableDeclaration.callableDeclarationKind == CallableDeclaration::Kind::Function &&
+                static_cast<const FunctionDeclaration&>(callableDeclaration).isBuiltin)
+                return evaluateBuiltin(expression, callableDeclaration.name);
+
+            const auto definition = static_cast<const CallableDeclaration*>(declaration.definition);
+            if (!definition || !definition->body)
+                throw std::runtime_error{"Function " + declaration.name + " is not defined"};
+
+            if (callDepth >= maxCallDepth)
+                throw std::runtime_error{"Call stack overflow"};
+
+            // the arguments of out and inout parameters are located before the call and written after it
+            std::vector<Value> arguments;
+            std::vector<Location> locations;
+            arguments.reserve(expression.arguments.size());
+
+            for (std::size_t i = 0; i < expression.arguments.size(); ++i)
+            {
+                const Expression& argument = expression.arguments[i];
+                const auto parameterDeclaration = definition->parameterDeclarations[i];
+
+                if (parameterDeclaration->inputModifier == InputModifier::In)
+                    arguments.push_back(convert(evaluate(argument), parameterDeclaration->qualifiedType.type));
+                else
+                {
+                    locations.push_back(locate(argument));
+                    arguments.push_back(parameterDeclaration->inputModifier == InputModifier::Inout ?
+                                        load(locations.back(), argument.qualifiedType.type) :
+                                        Value{parameterDeclaration->qualifiedType.type});
+                }
+            }
+
+            // every call has its own returned lanes and break targets
+            const auto entry = active;
+            const auto previousFrameStart = frameStart;
+            const auto previousScopeStart = scopeStart;
+            const auto previousReturned = returned;
+            auto previousResult = std::move(result);
+
+            frameStart = variables.size();
+            scopeStart = scopes.size();
+            returned = Mask{};
+            ++callDepth;
+
+            for (std::size_t i = 0; i < arguments.size(); ++i)
+                variables.emplace_back(definition->parameterDeclarations[i], std::move(arguments[i]));
+
+            result = (callableDeclaration.callableDeclarationKind == CallableDeclaration::Kind::Function) ?
+                Value{static_cast<const FunctionDeclaration&>(callableDeclaration).resultType.type} : Value{};
+
+            execute(*definition->body);
+
+            auto value = std::move(result);
+            result = std::move(previousResult);
+
+            for (std::size_t lane = 0; lane < laneCount; ++lane)
+                active[lane] = entry[lane] && !discarded[lane];
+
+            std::size_t location = 0;
+            for (std::size_t i = 0; i < arguments.size(); ++i)
+                if (definition->parameterDeclarations[i]->inputModifier != InputModifier::In)
+                    store(locations[location++], variables[frameStart + i].second);
+
+            popVariables(frameStart);
+            frameStart = previousFrameStart;
+            scopeStart = previousScopeStart;
+            returned = previousReturned;
+            --callDepth;
+
+            return value;
+        }
+
+        Value evaluateBuiltin(const CallExpression& expression, const std::string& name)
+        {
+            Value value{expression.qualifiedType.type};
+
+            if (name == "discard")
+            {
+                for (std::size_t lane = 0; lane < laneCount; ++lane)
+                    if (active[lane]) discarded[lane] = true;
+                active = Mask{};
+                return value;
+            }
+
+            std::vector<Value> arguments;
+            arguments.reserve(expression.arguments.size());
+            for (const Expression& argument : expression.arguments)
+                arguments.push_back(evaluate(argument));
+
+            if (name == "abs")
+            {
+                const auto scalarType = getScalarType(*arguments[0].type);
+
+                for (std::size_t i = 0; i < getComponentCount(*arguments[0].type); ++i)
+                    for (std::size_t lane = 0; lane < laneCount; ++lane)
+                    {
+                        const auto bits = arguments[0].components[i][lane];
+                        value.components[i][lane] =
+                            (scalarType->scalarTypeKind == ScalarType::Kind::FloatingPoint) ? bits & 0x7FFFFFFFU :
+                            (scalarType->scalarTypeKind == ScalarType::Kind::Integer && !scalarType->isUnsigned &&
+                             static_cast<std::int32_t>(bits) < 0) ? 0U - bits :
+                            bits;
+                    }
+
+                return value;
+            }
+            else if (name == "sample" || name == "load")
+            {
+                const auto texture = arguments[0].texture;
+                if (!texture)
+                    throw std::runtime_error{"No texture bound"};
+
+                for (std::size_t lane = 0; lane < laneCount; ++lane)
+                {
+                    if (!active[lane]) continue;
+
+                    const auto x = toFloat(arguments[1].components[0][lane]);
+                    const auto y = toFloat(arguments[1].components[1][lane]);
+
+                    // load takes texel coordinates
+                    const auto color = (name == "sample") ?
+                        texture->sample(x, y) :
+                        texture->load(std::isfinite(x) ? static_cast<std::int64_t>(std::floor(std::min(std::max(x, -1.0F), 1e9F))) : 0,
+                                      std::isfinite(y) ? static_cast<std::int64_t>(std::floor(std::min(std::max(y, -1.0F), 1e9F))) : 0);
+
+                    for (std::size_t i = 0; i < 4; ++i)
+                        value.components[i][lane] = fromFloat(color[i]);
+                }
+
+                return value;
+            }
+
+            throw std::runtime_error{"Unsupported builtin function " + name};
+        }
+
+        const FunctionDeclaration* entryPoint = nullptr;
+        std::map<const Declaration*, Value> globals;
+        std::deque<std::pair<const Declaration*, Value>> variables; // references stay valid while the stack grows
+        std::vector<Scope> scopes;
+        std::size_t frameStart = 0;
+        std::size_t scopeStart = 0;
+        std::size_t callDepth = 0;
+        Mask active{};
+        Mask discarded{};
+        Mask returned{};
+        Value result;
+        std::unordered_map<const FieldDeclaration*, std::size_t> fieldIndices;
+    };
+}
+
+#endif // SIMDINTERPRETER_HPP
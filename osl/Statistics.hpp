@@ -0,0 +1,199 @@
+//
+//  OSL
+//
+
+#ifndef STATISTICS_HPP
+#define STATISTICS_HPP
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "Parser.hpp"
+
+namespace ouzel
+{
+    class Statistics final
+    {
+    public:
+        struct Phase final
+        {
+            Phase(const std::string& initName,
+                  std::chrono::steady_clock::duration initDuration,
+                  std::size_t initAllocationCount,
+                  std::size_t initAllocatedBytes):
+                name{initName},
+                duration{initDuration},
+                allocationCount{initAllocationCount},
+                allocatedBytes{initAllocatedBytes}
+            {
+            }
+
+            std::string name;
+            std::chrono::steady_clock::duration duration;
+            std::size_t allocationCount = 0;
+            std::size_t allocatedBytes = 0;
+        };
+
+        void addPhase(const std::string& name, std::chrono::steady_clock::duration duration,
+                      std::size_t allocationCount = 0, std::size_t allocatedBytes = 0)
+        {
+            for (auto& phase : phases)
+                if (phase.name == name)
+                {
+                    phase.duration += duration;
+                    phase.allocationCount += allocationCount;
+                    phase.allocatedBytes += allocatedBytes;
+                    return;
+                }
+
+            phases.emplace_back(name, duration, allocationCount, allocatedBytes);
+        }
+
+        [[nodiscard]]
+        std::size_t getAllocationCount() const noexcept
+        {
+            std::size_t result = 0;
+            for (const auto& phase : phases) result += phase.allocationCount;
+            return result;
+        }
+
+        void addContext(const Context& context)
+        {
+            for (const auto& construct : context.getConstructs())
+                ++constructCounts[static_cast<std::size_t>(construct->kind)];
+
+            typeCount += context.getTypes().size();
+        }
+
+        [[nodiscard]]
+        const std::vector<Phase>& getPhases() const noexcept { return phases; }
+
+        [[nodiscard]]
+        std::size_t getConstructCount(Construct::Kind kind) const noexcept
+        {
+            return constructCounts[static_cast<std::size_t>(kind)];
+        }
+
+        [[nodiscard]]
+        std::size_t getConstructCount() const noexcept
+        {
+            std::size_t result = 0;
+            for (const auto count : constructCounts) result += count;
+            return result;
+        }
+
+        [[nodiscard]]
+        std::string getPhasesText() const
+        {
+            std::string result;
+
+            std::chrono::steady_clock::duration total{};
+            for (const auto& phase : phases)
+            {
+                result += formatLine(phase.name, toMilliseconds(phase.duration) + " ms");
+                total += phase.duration;
+            }
+
+            result += formatLine("total", toMilliseconds(total) + " ms");
+
+            return result;
+        }
+
+        [[nodiscard]]
+        std::string getText() const
+        {
+            std::string result = getPhasesText();
+
+            result += formatLine("tokens", std::to_string(tokenCount));
+            result += formatLine("constructs", std::to_string(getConstructCount()));
+
+            for (const auto kind : constructKinds)
+                result += formatLine("  " + toString(kind), std::to_string(getConstructCount(kind)));
+
+            result += formatLine("types", std::to_string(typeCount));
+            result += formatLine("allocations", std::to_string(getAllocationCount()));
+
+            for (const auto& phase : phases)
+                result += formatLine("  " + phase.name, std::to_string(phase.allocationCount) + " (" +
+                                     std::to_string(phase.allocatedBytes) + " bytes)");
+
+            result += formatLine("peak allocation", std::to_string(peakAllocationBytes) + " bytes");
+            result += formatLine("output size", std::to_string(outputSize) + " bytes");
+
+            return result;
+        }
+
+        [[nodiscard]]
+        std::string getJson() const
+        {
+            std::string result = "{\"phases\":[";
+
+            bool firstPhase = true;
+            for (const auto& phase : phases)
+            {
+                if (!firstPhase) result += ",";
+                firstPhase = false;
+
+                result += "{\"name\":\"" + phase.name + "\",\"milliseconds\":" + toMilliseconds(phase.duration) +
+                    ",\"allocations\":" + std::to_string(phase.allocationCount) +
+                    ",\"allocatedBytes\":" + std::to_string(phase.allocatedBytes) + "}";
+            }
+
+            result += "],\"tokens\":" + std::to_string(tokenCount);
+            result += ",\"constructs\":{";
+
+            bool firstKind = true;
+            for (const auto kind : constructKinds)
+            {
+                if (!firstKind) result += ",";
+                firstKind = false;
+
+                result += "\"" + toString(kind) + "\":" + std::to_string(getConstructCount(kind));
+            }
+
+            result += "},\"types\":" + std::to_string(typeCount);
+            result += ",\"allocations\":" + std::to_string(getAllocationCount());
+            result += ",\"peakAllocationBytes\":" + std::to_string(peakAllocationBytes);
+            result += ",\"outputSize\":" + std::to_string(outputSize);
+            result += "}";
+
+            return result;
+        }
+
+        std::size_t tokenCount = 0;
+        std::size_t typeCount = 0;
+        std::size_t peakAllocationBytes = 0;
+        std::size_t outputSize = 0;
+
+    private:
+        static constexpr Construct::Kind constructKinds[] = {
+            Construct::Kind::Declaration,
+            Construct::Kind::Statement,
+            Construct::Kind::Expression,
+            Construct::Kind::Attribute
+        };
+
+        static std::string toMilliseconds(std::chrono::steady_clock::duration duration)
+        {
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.3f",
+                          std::chrono::duration<double, std::milli>(duration).count());
+            return buffer;
+        }
+
+        static std::string formatLine(const std::string& name, const std::string& value)
+        {
+            std::string result = name + ":";
+            if (result.size() < 20) result.append(20 - result.size(), ' ');
+            return result + value + "\n";
+        }
+
+        std::vector<Phase> phases;
+        std::array<std::size_t, std::size(constructKinds)> constructCounts{};
+    };
+}
+
+#endif // STATISTICS_HPP
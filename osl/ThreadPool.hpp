@@ -0,0 +1,153 @@
+//
+//  OSL
+//
+
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ouzel
+{
+    // Runs tasks on a fixed number of threads, each thread has its own queue and takes tasks from the back of it,
+    // a thread without work steals from the front of the other queues
+    class ThreadPool final
+    {
+    public:
+        // the task gets the index of the thread that runs it
+        using Task = std::function<void(std::size_t)>;
+
+        // zero threads means one per hardware thread
+        explicit ThreadPool(std::size_t threadCount = 0)
+        {
+            if (threadCount == 0)
+                threadCount = std::max(std::thread::hardware_concurrency(), 1U);
+
+            for (std::size_t i = 0; i < threadCount; ++i)
+                queues.emplace_back(new Queue());
+
+            for (std::size_t i = 0; i < threadCount; ++i)
+                threads.emplace_back(&ThreadPool::run, this, i);
+        }
+
+        // runs the remaining tasks before joining the threads
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+
+            condition.notify_all();
+
+            for (auto& thread : threads)
+                thread.join();
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        [[nodiscard]] std::size_t getThreadCount() const noexcept { return threads.size(); }
+
+        // the tasks submitted from a thread of the pool go to its own queue, the others are spread over the queues,
+        // the tasks must not throw
+        void submit(Task task)
+        {
+            const auto index = (currentPool == this) ? currentIndex :
+                nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+
+            {
+                std::lock_guard<std::mutex> lock(queues[index]->mutex);
+                queues[index]->tasks.push_back(std::move(task));
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++pendingCount;
+            }
+
+            condition.notify_one();
+        }
+
+    private:
+        struct Queue final
+        {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        bool take(std::size_t index, Task& task)
+        {
+            {
+                auto& queue = *queues[index];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if (!queue.tasks.empty())
+                {
+                    task = std::move(queue.tasks.back());
+                    queue.tasks.pop_back();
+                    return true;
+                }
+            }
+
+            for (std::size_t i = 1; i < queues.size(); ++i)
+            {
+                auto& queue = *queues[(index + i) % queues.size()];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if (!queue.tasks.empty())
+                {
+                    task = std::move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        void run(std::size_t index)
+        {
+            currentPool = this;
+            currentIndex = index;
+
+            for (;;)
+            {
+                Task task;
+                if (take(index, task))
+                {
+                    pendingCount.fetch_sub(1, std::memory_order_relaxed);
+                    task(index);
+                    continue;
+                }
+
+                // the pending count is increased under the lock, so that a wakeup is not missed,
+                // it can be above zero for a moment after another thread has taken the task
+                std::unique_lock<std::mutex> lock(mutex);
+                if (stopping && pendingCount == 0) break;
+                condition.wait(lock, [this]() { return stopping || pendingCount > 0; });
+            }
+
+            currentPool = nullptr;
+        }
+
+        static inline thread_local ThreadPool* currentPool = nullptr;
+        static inline thread_local std::size_t currentIndex = 0;
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> threads;
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::atomic<std::size_t> pendingCount{0};
+        std::atomic<std::size_t> nextQueue{0};
+        bool stopping = false;
+    };
+}
+
+#endif // THREADPOOL_HPP
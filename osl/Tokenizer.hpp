@@ -5,7 +5,9 @@
 #ifndef TOKENIZER_HPP
 #define TOKENIZER_HPP
 
+#include <cstdint>
 #include <map>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -51,6 +53,7 @@ namespace ouzel
             Function, // function
             Goto, // goto
             If, // if
+            Import, // import
             In, // in
             Inline, // inline
             Inout, // inout
@@ -148,12 +151,35 @@ namespace ouzel
         std::string value;
         std::uint32_t line = 0;
         std::uint32_t column = 0;
+        std::uint32_t length = 0; // number of characters in the source
+        std::uint32_t file = 0; // zero for the main source, otherwise the index of the included file plus one
     };
 
-    [[nodiscard]]
-    inline std::vector<Token> tokenize(const std::string& code)
+    // an error in the source code with the line and column where it was found
+    class SourceError final: public std::runtime_error
     {
-        const std::map<std::string, Token::Type> keywordMap = {
+    public:
+        SourceError(const std::string& str, std::uint32_t initLine, std::uint32_t initColumn,
+                    std::uint32_t initFile = 0):
+            std::runtime_error(str), line{initLine}, column{initColumn}, file{initFile}
+        {
+        }
+
+        [[nodiscard]] std::uint32_t getLine() const noexcept { return line; }
+        [[nodiscard]] std::uint32_t getColumn() const noexcept { return column; }
+        [[nodiscard]] std::uint32_t getFile() const noexcept { return file; }
+
+    private:
+        std::uint32_t line;
+        std::uint32_t column;
+        std::uint32_t file;
+    };
+
+    // appends the tokens of the code to the vector, so that its storage can be reused,
+    // a "#line <line> <file>" marker of the preprocessor sets the line and the file of the tokens on the following lines
+    inline void tokenize(const std::string& code, std::vector<Token>& tokens, std::uint32_t firstLine = 1)
+    {
+        static const std::map<std::string, Token::Type> keywordMap = {
             {"and", Token::Type::And},
             {"and_eq", Token::Type::BitwiseAndAssignment},
             {"asm", Token::Type::Asm},
@@ -187,6 +213,7 @@ namespace ouzel
             {"function", Token::Type::Function},
             {"goto", Token::Type::Goto},
             {"if", Token::Type::If},
+            {"import", Token::Type::Import},
             {"in", Token::Type::In},
             {"inline", Token::Type::Inline},
             {"inout", Token::Type::Inout},
@@ -239,8 +266,8 @@ namespace ouzel
             {"xor_eq", Token::Type::BitwiseXorAssignment}
         };
 
-        std::vector<Token> tokens;
-        std::uint32_t line = 1;
+        std::uint32_t line = firstLine;
+        std::uint32_t file = 0;
         auto lineStart = code.begin();
 
         for (auto i = code.begin(); i != code.end();)
@@ -248,6 +275,30 @@ namespace ouzel
             Token token;
             token.line = line;
             token.column = static_cast<std::uint32_t>(i - lineStart) + 1;
+            token.file = file;
+
+            if (*i == '#' && i == lineStart && code.compare(static_cast<std::size_t>(i - code.begin()), 6, "#line ") == 0)
+            {
+                i += 6;
+
+                std::uint32_t values[2] = {0, 0};
+                for (auto& value : values)
+                {
+                    while (i != code.end() && *i == ' ') ++i;
+                    if (i == code.end() || *i < '0' || *i > '9')
+                        throw SourceError{"Invalid line marker", token.line, token.column, token.file};
+                    for (; i != code.end() && *i >= '0' && *i <= '9'; ++i)
+                        value = value * 10 + static_cast<std::uint32_t>(*i - '0');
+                }
+
+                while (i != code.end() && *i != '\n') ++i;
+                if (i != code.end()) ++i;
+
+                line = values[0];
+                file = values[1];
+                lineStart = i;
+                continue;
+            }
 
             if (*i == '(' || *i == ')' ||
                 *i == '{' || *i == '}' ||
@@ -292,13 +343,13 @@ namespace ouzel
 
                     token.value.push_back(*i);
                     if (++i == code.end())
-                        throw std::runtime_error{"Invalid exponent"};
+                        throw SourceError{"Invalid exponent", token.line, token.column, token.file};
 
                     if (*i == '+' || *i == '-')
                         token.value.push_back(*i++);
 
                     if (i == code.end() || *i < '0' || *i > '9')
-                        throw std::runtime_error{"Invalid exponent"};
+                        throw SourceError{"Invalid exponent", token.line, token.column, token.file};
 
                     while (i != code.end() && *i >= '0' && *i <= '9')
                         token.value.push_back(*i++);
@@ -316,10 +367,10 @@ namespace ouzel
                 }
                 else if (suffix == "f" || suffix == "F")
                 {
-                    if (integer) throw std::runtime_error{"Invalid integer constant"};
+                    if (integer) throw SourceError{"Invalid integer constant", token.line, token.column, token.file};
                     else token.type = Token::Type::FloatLiteral;
                 }
-                else throw std::runtime_error{"Invalid suffix " + suffix};
+                else throw SourceError{"Invalid suffix " + suffix, token.line, token.column, token.file};
             }
             else if (*i == '"') // string literal
             {
@@ -328,7 +379,7 @@ namespace ouzel
                 for (;;)
                 {
                     if (++i == code.end())
-                        throw std::runtime_error{"Unterminated string literal"};
+                        throw SourceError{"Unterminated string literal", token.line, token.column, token.file};
 
                     if (*i == '"')
                     {
@@ -338,7 +389,7 @@ namespace ouzel
                     else if (*i == '\\')
                     {
                         if (++i == code.end())
-                            throw std::runtime_error{"Unterminated string literal"};
+                            throw SourceError{"Unterminated string literal", token.line, token.column, token.file};
 
                         if (*i == 'a') token.value.push_back('\a');
                         else if (*i == 'b') token.value.push_back('\b');
@@ -351,11 +402,11 @@ namespace ouzel
                         else if (*i == '\?') token.value.push_back('\?');
                         else if (*i == '\\') token.value.push_back('\\');
                         else
-                            throw std::runtime_error{"Unrecognized escape character"};
+                            throw SourceError{"Unrecognized escape character", token.line, token.column, token.file};
                         // TODO: handle numeric character references
                     }
                     else if (*i == '\n')
-                        throw std::runtime_error{"Unterminated string literal"};
+                        throw SourceError{"Unterminated string literal", token.line, token.column, token.file};
                     else
                         token.value.push_back(*i);
                 }
@@ -365,12 +416,12 @@ namespace ouzel
                 token.type = Token::Type::CharLiteral;
 
                 if (++i == code.end()) // reached end of file
-                    throw std::runtime_error{"Unterminated char literal"};
+                    throw SourceError{"Unterminated char literal", token.line, token.column, token.file};
 
                 if (*i == '\\')
                 {
                     if (++i == code.end())
-                        throw std::runtime_error{"Unterminated char literal"};
+                        throw SourceError{"Unterminated char literal", token.line, token.column, token.file};
 
                     if (*i == 'a') token.value.push_back('\a');
                     else if (*i == 'b') token.value.push_back('\b');
@@ -383,17 +434,17 @@ namespace ouzel
                     else if (*i == '\?') token.value.push_back('\?');
                     else if (*i == '\\') token.value.push_back('\\');
                     else
-                        throw std::runtime_error{"Unrecognized escape character"};
+                        throw SourceError{"Unrecognized escape character", token.line, token.column, token.file};
                     // TODO: handle numeric character references
                 }
                 else
                     token.value.push_back(*i);
 
                 if (++i == code.end()) // reached end of file
-                    throw std::runtime_error{"Unterminated char literal"};
+                    throw SourceError{"Unterminated char literal", token.line, token.column, token.file};
 
                 if (*i++ != '\'')
-                    throw std::runtime_error{"Invalid char literal"};
+                    throw SourceError{"Invalid char literal", token.line, token.column, token.file};
             }
             else if ((*i >= 'a' && *i <= 'z') ||
                      (*i >= 'A' && *i <= 'Z') ||
@@ -474,7 +525,7 @@ namespace ouzel
                     {
                         if (*i == '=') // *=
                         {
-                            token.type = Token::Type::Multiply;
+                            token.type = Token::Type::MultiplyAssignment;
                             token.value.push_back(*i++);
                         }
                     }
@@ -488,7 +539,7 @@ namespace ouzel
                     {
                         if (*i == '=') // /=
                         {
-                            token.type = Token::Type::Multiply;
+                            token.type = Token::Type::DivideAssignment;
                             token.value.push_back(*i++);
                         }
                     }
@@ -690,11 +741,18 @@ namespace ouzel
                 continue;
             }
             else
-                throw std::runtime_error{"Unknown character"};
+                throw SourceError{"Unknown character", token.line, token.column, token.file};
 
+            token.length = static_cast<std::uint32_t>(i - lineStart) + 1 - token.column;
             tokens.push_back(token);
         }
+    }
 
+    [[nodiscard]]
+    inline std::vector<Token> tokenize(const std::string& code)
+    {
+        std::vector<Token> tokens;
+        tokenize(code, tokens);
         return tokens;
     }
 
@@ -739,6 +797,7 @@ namespace ouzel
             case Token::Type::Function: return "Function";
             case Token::Type::Goto: return "Goto";
             case Token::Type::If: return "If";
+            case Token::Type::Import: return "Import";
             case Token::Type::In: return "In";
             case Token::Type::Inline: return "Inline";
             case Token::Type::Inout: return "Inout";
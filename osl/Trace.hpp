@@ -0,0 +1,174 @@
+//
+//  OSL
+//
+
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ouzel
+{
+    // escapes a string for a JSON string literal
+    [[nodiscard]]
+    inline std::string escapeJson(const std::string& str)
+    {
+        std::string result;
+
+        for (const auto c : str)
+            if (c == '"' || c == '\\')
+            {
+                result += '\\';
+                result += c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20)
+            {
+                char buffer[8];
+                std::snprintf(buffer, sizeof(buffer), "\\u%04X", static_cast<unsigned int>(c));
+                result += buffer;
+            }
+            else
+                result += c;
+
+        return result;
+    }
+
+    // Collects spans in the Chrome trace-event format, safe to use from multiple threads
+    class Tracer final
+    {
+    public:
+        struct Event final
+        {
+            Event(const std::string& initName,
+                  const std::string& initCategory,
+                  std::chrono::steady_clock::time_point initStart,
+                  std::chrono::steady_clock::duration initDuration,
+                  std::uint32_t initThreadId):
+                name{initName},
+                category{initCategory},
+                start{initStart},
+                duration{initDuration},
+                threadId{initThreadId}
+            {
+            }
+
+            std::string name;
+            std::string category;
+            std::chrono::steady_clock::time_point start;
+            std::chrono::steady_clock::duration duration;
+            std::uint32_t threadId;
+        };
+
+        void addEvent(const std::string& name,
+                      const std::string& category,
+                      std::chrono::steady_clock::time_point start,
+                      std::chrono::steady_clock::time_point end)
+        {
+            std::lock_guard lock{mutex};
+            events.emplace_back(name, category, start, end - start, getThreadId());
+        }
+
+        [[nodiscard]]
+        std::vector<Event> getEvents() const
+        {
+            std::lock_guard lock{mutex};
+            return events;
+        }
+
+        [[nodiscard]]
+        std::string getJson() const
+        {
+            std::lock_guard lock{mutex};
+
+            std::string result = "{\"traceEvents\":[";
+
+            bool first = true;
+            for (const auto& thread : threadIds)
+            {
+                if (!first) result += ",";
+                first = false;
+
+                result += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + std::to_string(thread.second) +
+                    ",\"args\":{\"name\":\"" + (thread.second == 0 ? std::string("main") : "worker " + std::to_string(thread.second)) + "\"}}";
+            }
+
+            for (const auto& event : events)
+            {
+                if (!first) result += ",";
+                first = false;
+
+                result += "{\"name\":\"" + escapeJson(event.name) +
+                    "\",\"cat\":\"" + escapeJson(event.category) +
+                    "\",\"ph\":\"X\",\"ts\":" + toMicroseconds(event.start - startTime) +
+                    ",\"dur\":" + toMicroseconds(event.duration) +
+                    ",\"pid\":1,\"tid\":" + std::to_string(event.threadId) + "}";
+            }
+
+            result += "],\"displayTimeUnit\":\"ms\"}";
+
+            return result;
+        }
+
+    private:
+        // the first thread that records an event gets id 0, the rest are numbered in order of appearance
+        std::uint32_t getThreadId()
+        {
+            const auto result = threadIds.insert(std::make_pair(std::this_thread::get_id(),
+                                                                static_cast<std::uint32_t>(threadIds.size())));
+            return result.first->second;
+        }
+
+        static std::string toMicroseconds(std::chrono::steady_clock::duration duration)
+        {
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.3f",
+                          std::chrono::duration<double, std::micro>(duration).count());
+            return buffer;
+        }
+
+        mutable std::mutex mutex;
+        const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+        std::vector<Event> events;
+        std::map<std::thread::id, std::uint32_t> threadIds;
+    };
+
+    // Records a span for its lifetime, does nothing if the tracer is null
+    class TraceScope final
+    {
+    public:
+        TraceScope(Tracer* initTracer, const std::string& initName, const std::string& initCategory):
+            tracer{initTracer}
+        {
+            if (tracer)
+            {
+                name = initName;
+                category = initCategory;
+                start = std::chrono::steady_clock::now();
+            }
+        }
+
+        ~TraceScope()
+        {
+            if (tracer)
+                tracer->addEvent(name, category, start, std::chrono::steady_clock::now());
+        }
+
+        TraceScope(const TraceScope&) = delete;
+        TraceScope& operator=(const TraceScope&) = delete;
+
+    private:
+        Tracer* tracer;
+        std::string name;
+        std::string category;
+        std::chrono::steady_clock::time_point start;
+    };
+}
+
+#endif // TRACE_HPP
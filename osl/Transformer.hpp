@@ -0,0 +1,398 @@
+//
+//  OSL
+//
+
+#ifndef TRANSFORMER_HPP
+#define TRANSFORMER_HPP
+
+#include <vector>
+#include "Parser.hpp"
+
+namespace ouzel
+{
+    // Base class of the passes that rewrite the AST, the nodes are immutable,
+    // so a node is recreated only if one of its children changes
+    class Transformer
+    {
+    public:
+        explicit Transformer(Context& initContext) noexcept:
+            context{initContext}
+        {
+        }
+
+        virtual ~Transformer() = default;
+
+        Transformer(const Transformer&) = delete;
+        Transformer& operator=(const Transformer&) = delete;
+
+        virtual void transform()
+        {
+            for (const auto declaration : context.getDeclarations())
+                transformDeclaration(*declaration);
+        }
+
+    protected:
+        // declarations are referenced by address from the rest of the tree,
+        // so their bodies and initializers are replaced in place
+        virtual const Declaration& transformDeclaration(const Declaration& declaration)
+        {
+            switch (declaration.declarationKind)
+            {
+                case Declaration::Kind::Callable:
+                {
+                    auto& callableDeclaration = const_cast<CallableDeclaration&>(static_cast<const CallableDeclaration&>(declaration));
+
+                    if (callableDeclaration.body)
+                        callableDeclaration.body = &transformStatement(*callableDeclaration.body);
+                    break;
+                }
+
+                case Declaration::Kind::Variable:
+                {
+                    auto& variableDeclaration = const_cast<VariableDeclaration&>(static_cast<const VariableDeclaration&>(declaration));
+
+                    if (variableDeclaration.initialization)
+                        variableDeclaration.initialization = &transformExpression(*variableDeclaration.initialization);
+                    break;
+                }
+
+                default:
+                    break;
+            }
+
+            return declaration;
+        }
+
+        virtual const Statement& transformStatement(const Statement& statement)
+        {
+            switch (statement.statementKind)
+            {
+                case Statement::Kind::Empty:
+                case Statement::Kind::Break:
+                case Statement::Kind::Continue:
+                    return statement;
+
+                case Statement::Kind::Expression:
+                {
+                    auto& expressionStatement = static_cast<const ExpressionStatement&>(statement);
+                    auto& expression = transformExpression(expressionStatement.expression);
+
+                    if (&expression == &expressionStatement.expression) return statement;
+                    return context.create<ExpressionStatement>(expression);
+                }
+
+                case Statement::Kind::Declaration:
+                {
+                    auto& declarationStatement = static_cast<const DeclarationStatement&>(statement);
+                    auto& declaration = transformDeclaration(declarationStatement.declaration);
+
+                    if (&declaration == &declarationStatement.declaration) return statement;
+                    return context.create<DeclarationStatement>(declaration);
+                }
+
+                case Statement::Kind::Compound:
+                {
+                    auto& compoundStatement = static_cast<const CompoundStatement&>(statement);
+
+                    std::vector<StatementRef> statements;
+                    statements.reserve(compoundStatement.statements.size());
+                    bool changed = false;
+
+                    for (const Statement& subStatement : compoundStatement.statements)
+                    {
+                        auto& result = transformStatement(subStatement);
+                        if (&result != &subStatement) changed = true;
+                        statements.push_back(result);
+                    }
+
+                    if (!changed) return statement;
+                    return context.create<CompoundStatement>(std::move(statements));
+                }
+
+                case Statement::Kind::If:
+                {
+                    auto& ifStatement = static_cast<const IfStatement&>(statement);
+                    auto& condition = transformConstruct(ifStatement.condition);
+                    auto& body = transformStatement(ifStatement.body);
+                    auto elseBody = ifStatement.elseBody ? &transformStatement(*ifStatement.elseBody) : nullptr;
+
+                    if (&condition == &ifStatement.condition &&
+                        &body == &ifStatement.body &&
+                        elseBody == ifStatement.elseBody) return statement;
+                    return context.create<IfStatement>(condition, body, elseBody);
+                }
+
+                case Statement::Kind::For:
+                {
+                    auto& forStatement = static_cast<const ForStatement&>(statement);
+                    auto initialization = forStatement.initialization ? &transformConstruct(*forStatement.initialization) : nullptr;
+                    auto condition = forStatement.condition ? &transformConstruct(*forStatement.condition) : nullptr;
+                    auto increment = forStatement.increment ? &transformExpression(*forStatement.increment) : nullptr;
+                    auto& body = transformStatement(forStatement.body);
+
+                    if (initialization == forStatement.initialization &&
+                        condition == forStatement.condition &&
+                        increment == forStatement.increment &&
+                        &body == &forStatement.body) return statement;
+                    return context.create<ForStatement>(initialization, condition, increment, body);
+                }
+
+                case Statement::Kind::Switch:
+                {
+                    auto& switchStatement = static_cast<const SwitchStatement&>(statement);
+                    auto& condition = transformConstruct(switchStatement.condition);
+                    auto& body = transformStatement(switchStatement.body);
+
+                    if (&condition == &switchStatement.condition &&
+                        &body == &switchStatement.body) return statement;
+                    return context.create<SwitchStatement>(condition, body);
+                }
+
+                case Statement::Kind::Case:
+                {
+                    auto& caseStatement = static_cast<const CaseStatement&>(statement);
+                    auto& condition = transformExpression(caseStatement.condition);
+                    auto& body = transformStatement(caseStatement.body);
+
+                    if (&condition == &caseStatement.condition &&
+                        &body == &caseStatement.body) return statement;
+                    return context.create<CaseStatement>(condition, body);
+                }
+
+                case Statement::Kind::Default:
+                {
+                    auto& defaultStatement = static_cast<const DefaultStatement&>(statement);
+                    auto& body = transformStatement(defaultStatement.body);
+
+                    if (&body == &defaultStatement.body) return statement;
+                    return context.create<DefaultStatement>(body);
+                }
+
+                case Statement::Kind::While:
+                {
+                    auto& whileStatement = static_cast<const WhileStatement&>(statement);
+                    auto& condition = transformConstruct(whileStatement.condition);
+                    auto& body = transformStatement(whileStatement.body);
+
+                    if (&condition == &whileStatement.condition &&
+                        &body == &whileStatement.body) return statement;
+                    return context.create<WhileStatement>(condition, body);
+                }
+
+                case Statement::Kind::Do:
+                {
+                    auto& doStatement = static_cast<const DoStatement&>(statement);
+                    auto& condition = transformExpression(doStatement.condition);
+                    auto& body = transformStatement(doStatement.body);
+
+                    if (&condition == &doStatement.condition &&
+                        &body == &doStatement.body) return statement;
+                    return context.create<DoStatement>(condition, body);
+                }
+
+                case Statement::Kind::Return:
+                {
+                    auto& returnStatement = static_cast<const ReturnStatement&>(statement);
+                    if (!returnStatement.result) return statement;
+
+                    auto& result = transformExpression(*returnStatement.result);
+
+                    if (&result == returnStatement.result) return statement;
+                    return context.create<ReturnStatement>(&result);
+                }
+            }
+
+            throw std::runtime_error{"Unknown statement kind"};
+        }
+
+        virtual const Expression& transformExpression(const Expression& expression)
+        {
+            switch (expression.expressionKind)
+            {
+                case Expression::Kind::Literal:
+                case Expression::Kind::DeclarationReference:
+                    return expression;
+
+                case Expression::Kind::Call:
+                {
+                    auto& callExpression = static_cast<const CallExpression&>(expression);
+
+                    std::vector<ExpressionRef> arguments;
+                    if (!transformExpressions(callExpression.arguments, arguments)) return expression;
+                    return context.create<CallExpression>(expression.qualifiedType, expression.category,
+                                                          callExpression.declarationReference,
+                                                          std::move(arguments));
+                }
+
+                case Expression::Kind::Paren:
+                {
+                    auto& parenExpression = static_cast<const ParenExpression&>(expression);
+                    auto& subExpression = transformExpression(parenExpression.expression);
+
+                    if (&subExpression == &parenExpression.expression) return expression;
+                    return context.create<ParenExpression>(subExpression);
+                }
+
+                case Expression::Kind::Member:
+                {
+                    auto& memberExpression = static_cast<const MemberExpression&>(expression);
+                    auto& subExpression = transformExpression(memberExpression.expression);
+
+                    if (&subExpression == &memberExpression.expression) return expression;
+                    return context.create<MemberExpression>(subExpression, memberExpression.fieldDeclaration);
+                }
+
+                case Expression::Kind::ArraySubscript:
+                {
+                    auto& arraySubscriptExpression = static_cast<const ArraySubscriptExpression&>(expression);
+                    auto& subExpression = transformExpression(arraySubscriptExpression.expression);
+                    auto& subscript = transformExpression(arraySubscriptExpression.subscript);
+
+                    if (&subExpression == &arraySubscriptExpression.expression &&
+                        &subscript == &arraySubscriptExpression.subscript) return expression;
+                    return context.create<ArraySubscriptExpression>(expression.qualifiedType, subExpression, subscript);
+                }
+
+                case Expression::Kind::UnaryOperator:
+                {
+                    auto& unaryOperatorExpression = static_cast<const UnaryOperatorExpression&>(expression);
+                    auto& subExpression = transformExpression(unaryOperatorExpression.expression);
+
+                    if (&subExpression == &unaryOperatorExpression.expression) return expression;
+                    return context.create<UnaryOperatorExpression>(unaryOperatorExpression.operatorKind,
+                                                                   expression.qualifiedType.type,
+                                                                   expression.category,
+                                                                   subExpression);
+                }
+
+                case Expression::Kind::BinaryOperator:
+                {
+                    auto& binaryOperatorExpression = static_cast<const BinaryOperatorExpression&>(expression);
+                    auto& leftExpression = transformExpression(binaryOperatorExpression.leftExpression);
+                    auto& rightExpression = transformExpression(binaryOperatorExpression.rightExpression);
+
+                    if (&leftExpression == &binaryOperatorExpression.leftExpression &&
+                        &rightExpression == &binaryOperatorExpression.rightExpression) return expression;
+                    return context.create<BinaryOperatorExpression>(binaryOperatorExpression.operatorKind,
+                                                                    expression.qualifiedType.type,
+                                                                    expression.category,
+                                                                    leftExpression,
+                                                                    rightExpression);
+                }
+
+                case Expression::Kind::TernaryOperator:
+                {
+                    auto& ternaryOperatorExpression = static_cast<const TernaryOperatorExpression&>(expression);
+                    auto& condition = transformExpression(ternaryOperatorExpression.condition);
+                    auto& leftExpression = transformExpression(ternaryOperatorExpression.leftExpression);
+                    auto& rightExpression = transformExpression(ternaryOperatorExpression.rightExpression);
+
+                    if (&condition == &ternaryOperatorExpression.condition &&
+                        &leftExpression == &ternaryOperatorExpression.leftExpression &&
+                        &rightExpression == &ternaryOperatorExpression.rightExpression) return expression;
+                    return context.create<TernaryOperatorExpression>(condition, leftExpression, rightExpression);
+                }
+
+                case Expression::Kind::TemporaryObject:
+                {
+                    auto& temporaryObjectExpression = static_cast<const TemporaryObjectExpression&>(expression);
+
+                    std::vector<ExpressionRef> parameters;
+                    if (!transformExpressions(temporaryObjectExpression.parameters, parameters)) return expression;
+                    return context.create<TemporaryObjectExpression>(expression.qualifiedType.type,
+                                                                     temporaryObjectExpression.constructorDeclaration,
+                                                                     std::move(parameters));
+                }
+
+                case Expression::Kind::InitializerList:
+                {
+                    auto& initializerListExpression = static_cast<const InitializerListExpression&>(expression);
+
+                    std::vector<ExpressionRef> expressions;
+                    if (!transformExpressions(initializerListExpression.expressions, expressions)) return expression;
+                    return context.create<InitializerListExpression>(expression.qualifiedType.type,
+                                                                     std::move(expressions));
+                }
+
+                case Expression::Kind::Cast:
+                {
+                    auto& castExpression = static_cast<const CastExpression&>(expression);
+                    auto& subExpression = transformExpression(castExpression.expression);
+
+                    if (&subExpression == &castExpression.expression) return expression;
+                    return context.create<CastExpression>(castExpression.castKind,
+                                                          expression.qualifiedType.type,
+                                                          subExpression);
+                }
+
+                case Expression::Kind::VectorInitialize:
+                {
+                    auto& vectorInitializeExpression = static_cast<const VectorInitializeExpression&>(expression);
+
+                    std::vector<ExpressionRef> parameters;
+                    if (!transformExpressions(vectorInitializeExpression.parameters, parameters)) return expression;
+                    return context.create<VectorInitializeExpression>(static_cast<const VectorType&>(expression.qualifiedType.type),
+                                                                      std::move(parameters));
+                }
+
+                case Expression::Kind::VectorElement:
+                {
+                    auto& vectorElementExpression = static_cast<const VectorElementExpression&>(expression);
+                    auto& subExpression = transformExpression(vectorElementExpression.expression);
+
+                    if (&subExpression == &vectorElementExpression.expression) return expression;
+                    return context.create<VectorElementExpression>(subExpression,
+                                                                   expression.qualifiedType.type,
+                                                                   expression.qualifiedType.qualifiers,
+                                                                   expression.category,
+                                                                   vectorElementExpression.positions);
+                }
+
+                case Expression::Kind::MatrixInitialize:
+                {
+                    auto& matrixInitializeExpression = static_cast<const MatrixInitializeExpression&>(expression);
+
+                    std::vector<ExpressionRef> parameters;
+                    if (!transformExpressions(matrixInitializeExpression.parameters, parameters)) return expression;
+                    return context.create<MatrixInitializeExpression>(static_cast<const MatrixType&>(expression.qualifiedType.type),
+                                                                      std::move(parameters));
+                }
+            }
+
+            throw std::runtime_error{"Unknown expression kind"};
+        }
+
+        // conditions can be either expressions or variable declarations
+        const Construct& transformConstruct(const Construct& construct)
+        {
+            if (construct.kind == Construct::Kind::Expression)
+                return transformExpression(static_cast<const Expression&>(construct));
+
+            if (construct.kind == Construct::Kind::Declaration)
+                return transformDeclaration(static_cast<const Declaration&>(construct));
+
+            return construct;
+        }
+
+        // returns true if any of the expressions changed
+        bool transformExpressions(const std::vector<ExpressionRef>& expressions,
+                                  std::vector<ExpressionRef>& result)
+        {
+            result.reserve(expressions.size());
+            bool changed = false;
+
+            for (const Expression& expression : expressions)
+            {
+                auto& transformed = transformExpression(expression);
+                if (&transformed != &expression) changed = true;
+                result.push_back(transformed);
+            }
+
+            return changed;
+        }
+
+        Context& context;
+    };
+}
+
+#endif // TRANSFORMER_HPP
@@ -33,6 +33,8 @@ namespace ouzel
 
         Type(const Type&) = delete;
 
+        virtual ~Type() = default;
+
         explicit Type(Kind initTypeKind):
             typeKind{initTypeKind} {}
 
@@ -106,6 +106,7 @@ namespace ouzel
 
                     std::cout << ", result type: " << getPrintableName(functionDeclaration.resultType);
                     if (functionDeclaration.isBuiltin) std::cout << " builtin";
+                    if (functionDeclaration.isInline) std::cout << " inline";
                 }
                 else if (callableDeclaration.callableDeclarationKind == CallableDeclaration::Kind::Method)
                 {
@@ -509,6 +510,8 @@ namespace ouzel
                     std::cout << components[position];
 
                 std::cout << '\n';
+
+                dumpConstruct(vectorElementExpression.expression, level + 1);
                 break;
             }
             case Expression::Kind::MatrixInitialize:
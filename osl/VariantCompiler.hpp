@@ -0,0 +1,137 @@
+//
+//  OSL
+//
+
+#ifndef VARIANTCOMPILER_HPP
+#define VARIANTCOMPILER_HPP
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Parser.hpp"
+#include "Preprocessor.hpp"
+#include "ShaderBundle.hpp"
+#include "Tokenizer.hpp"
+
+namespace ouzel
+{
+    // Compiles the variants of a shader in one pass over a shared token cache,
+    // the lines that are the same in several variants are tokenized only once
+    // and the variants that end up with the same tokens are parsed only once
+    class VariantCompiler final
+    {
+    public:
+        using Defines = std::map<std::string, std::string>;
+
+        struct Statistics final
+        {
+            std::size_t variantCount = 0;
+            std::size_t parsedCount = 0;
+            std::size_t uniqueOutputCount = 0;
+            std::size_t tokenizedLineCount = 0;
+            std::size_t sharedLineCount = 0;
+        };
+
+        // the path of the code is where the files it includes are looked up from
+        explicit VariantCompiler(const std::string& code,
+                                 const Preprocessor::IncludeHandler& initIncludeHandler = nullptr,
+                                 const std::string& initPath = std::string()):
+            source{Preprocessor::removeComments(code)},
+            includeHandler{initIncludeHandler},
+            path{initPath}
+        {
+        }
+
+        ShaderBundle compile(const std::vector<Defines>& variants,
+                             const std::function<std::string(Context&)>& output)
+        {
+            ShaderBundle bundle;
+
+            // outputs of the already parsed token sequences
+            std::map<std::vector<const std::vector<Token>*>, std::string> outputs;
+
+            for (const auto& defines : variants)
+            {
+                const auto key = ShaderBundle::getKey(defines);
+                if (bundle.find(key)) continue;
+
+                ++statistics.variantCount;
+
+                std::vector<const std::vector<Token>*> lines;
+                Preprocessor preprocessor(defines);
+                if (includeHandler) preprocessor.setIncludeHandler(includeHandler);
+                preprocessor.process(source, [this, &lines](std::size_t line, std::string_view text, bool expanded) {
+                    if (text.empty()) return;
+
+                    // the unexpanded lines are the same in every variant, the expanded ones are keyed by their text
+                    auto& tokens = expanded ?
+                        expandedLines[std::make_pair(line, std::string(text))] :
+                        sourceLines[line];
+
+                    if (!tokens.first)
+                    {
+                        tokens.second = tokenizeLine(line, text);
+                        tokens.first = true;
+                        ++statistics.tokenizedLineCount;
+                    }
+                    else
+                        ++statistics.sharedLineCount;
+
+                    if (!tokens.second.empty()) lines.push_back(&tokens.second);
+                }, path);
+
+                for (const auto& include : preprocessor.getIncludes())
+                    if (std::find(includes.begin(), includes.end(), include) == includes.end())
+                        includes.push_back(include);
+
+                auto result = outputs.find(lines);
+                if (result == outputs.end())
+                {
+                    std::vector<Token> tokens;
+                    for (const auto line : lines)
+                        tokens.insert(tokens.end(), line->begin(), line->end());
+
+                    Context context(tokens);
+                    ++statistics.parsedCount;
+                    result = outputs.emplace(std::move(lines), output(context)).first;
+                }
+
+                bundle.add(key, result->second);
+            }
+
+            statistics.uniqueOutputCount = bundle.getOutputs().size();
+
+            return bundle;
+        }
+
+        [[nodiscard]] const Statistics& getStatistics() const noexcept { return statistics; }
+
+        // the files included by any of the variants
+        [[nodiscard]] const std::vector<std::string>& getIncludes() const noexcept { return includes; }
+
+    private:
+        // the line of an #include holds the lines of the included file with their markers
+        static std::vector<Token> tokenizeLine(std::size_t line, std::string_view text)
+        {
+            std::vector<Token> tokens;
+            tokenize(std::string(text), tokens, static_cast<std::uint32_t>(line + 1));
+            return tokens;
+        }
+
+        std::string source;
+        Preprocessor::IncludeHandler includeHandler;
+        std::string path;
+        std::vector<std::string> includes;
+
+        // whether the line was tokenized and its tokens
+        std::map<std::size_t, std::pair<bool, std::vector<Token>>> sourceLines;
+        std::map<std::pair<std::size_t, std::string>, std::pair<bool, std::vector<Token>>> expandedLines;
+
+        Statistics statistics;
+    };
+}
+
+#endif // VARIANTCOMPILER_HPP
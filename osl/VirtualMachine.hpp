@@ -0,0 +1,574 @@
+//
+//  OSL
+//
+
+#ifndef VIRTUALMACHINE_HPP
+#define VIRTUALMACHINE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Bytecode.hpp"
+#include "Interpreter.hpp"
+
+// dispatches through a table of label addresses where the compiler supports it
+#if defined(__GNUC__) || defined(__clang__)
+#  define OSL_COMPUTED_GOTO 1
+#else
+#  define OSL_COMPUTED_GOTO 0
+#endif
+
+namespace ouzel
+{
+    // Executes validated bytecode, registers and globals are 32-bit cells
+    // holding the bits of a float, int, uint or bool (0 or 1)
+    class VirtualMachine final
+    {
+    public:
+        explicit VirtualMachine(const Bytecode& initBytecode, std::size_t stackSize = 65536):
+            bytecode{initBytecode},
+            stack(stackSize),
+            globals(initBytecode.globalSize)
+        {
+            bytecode.validate();
+
+            // texture globals hold the index of their slot
+            for (const auto& global : bytecode.globals)
+                if (global.texture)
+                {
+                    globals[global.offset] = static_cast<std::uint32_t>(textures.size());
+                    textures.push_back(nullptr);
+                }
+
+            if (!execute(bytecode.initializer))
+                throw std::runtime_error{"Global initializer discarded"};
+        }
+
+        [[nodiscard]]
+        const Bytecode& getBytecode() const noexcept
+        {
+            return bytecode;
+        }
+
+        // the cells of a global, scalars, vectors and matrices (row by row) are consecutive,
+        // arrays hold their elements and structs their fields in order
+        [[nodiscard]]
+        std::uint32_t* getGlobal(const std::string& name)
+        {
+            return &globals[findGlobal(name).offset];
+        }
+
+        void setGlobal(const std::string& name, const std::vector<std::uint32_t>& cells)
+        {
+            const auto& global = findGlobal(name);
+            if (global.texture || cells.size() != global.size)
+                throw std::runtime_error{"Invalid value for global " + name};
+
+            std::copy(cells.begin(), cells.end(), globals.begin() + global.offset);
+        }
+
+        // binds the texture to a Texture2D or Texture2DMS global, the texture must outlive the machine
+        void setTexture(const std::string& name, const Texture& texture)
+        {
+            const auto& global = findGlobal(name);
+            if (!global.texture)
+                throw std::runtime_error{"Global " + name + " is not a texture"};
+
+            textures[globals[global.offset]] = &texture;
+        }
+
+        // runs the entry point with the cells of all parameters, returns false if the invocation was discarded
+        bool run(const std::vector<std::uint32_t>& arguments, std::vector<std::uint32_t>& result)
+        {
+            const auto& function = bytecode.functions[bytecode.entryPoint];
+
+            std::size_t parameterSize = 0;
+            for (const auto size : function.parameterSizes) parameterSize += size;
+
+            if (arguments.size() != parameterSize)
+                throw std::runtime_error{"Invalid number of arguments"};
+
+            if (function.frameSize > stack.size())
+                throw std::runtime_error{"Stack overflow"};
+
+            std::copy(arguments.begin(), arguments.end(), stack.begin() + function.resultSize);
+
+            if (!execute(bytecode.entryPoint)) return false;
+
+            result.assign(stack.begin(), stack.begin() + function.resultSize);
+            return true;
+        }
+
+        static std::uint32_t fromFloat(float value) noexcept
+        {
+            std::uint32_t result;
+            std::memcpy(&result, &value, sizeof(result));
+            return result;
+        }
+
+        static float toFloat(std::uint32_t bits) noexcept
+        {
+            float result;
+            std::memcpy(&result, &bits, sizeof(result));
+            return result;
+        }
+
+    private:
+        struct Frame final
+        {
+            std::uint32_t returnAddress;
+            std::uint32_t base;
+            std::uint32_t size;
+        };
+
+        static constexpr std::size_t maxCallDepth = 256;
+
+        const Bytecode::Global& findGlobal(const std::string& name) const
+        {
+            for (const auto& global : bytecode.globals)
+                if (global.name == name) return global;
+
+            throw std::runtime_error{"Global variable " + name + " not found"};
+        }
+
+        static double toDouble(std::uint32_t bits, ValueKind kind) noexcept
+        {
+            switch (kind)
+            {
+                case ValueKind::Boolean: return (bits != 0) ? 1.0 : 0.0;
+                case ValueKind::Integer: return static_cast<double>(static_cast<std::int32_t>(bits));
+                case ValueKind::UnsignedInteger: return static_cast<double>(bits);
+                case ValueKind::FloatingPoint: return static_cast<double>(toFloat(bits));
+            }
+
+            return 0.0;
+        }
+
+        // same conversions as the interpreter
+        static std::uint32_t convert(std::uint32_t bits, ValueKind source, ValueKind target) noexcept
+        {
+            switch (target)
+            {
+                case ValueKind::Boolean:
+                    return (source == ValueKind::FloatingPoint) ?
+                        (toFloat(bits) != 0.0F ? 1U : 0U) : (bits != 0 ? 1U : 0U);
+                case ValueKind::FloatingPoint:
+                    return (source == ValueKind::FloatingPoint) ? bits : fromFloat(static_cast<float>(toDouble(bits, source)));
+                case ValueKind::Integer:
+                case ValueKind::UnsignedInteger:
+                {
+                    if (source != ValueKind::FloatingPoint) return (source == ValueKind::Boolean) ? (bits != 0 ? 1U : 0U) : bits;
+
+                    const auto value = static_cast<double>(toFloat(bits));
+                    if (!(value > -9.2e18 && value < 9.2e18)) return 0;
+                    return static_cast<std::uint32_t>(static_cast<std::int64_t>(value));
+                }
+            }
+
+            return bits;
+        }
+
+        static std::int64_t getTexel(float value) noexcept
+        {
+            return std::isfinite(value) ? static_cast<std::int64_t>(std::floor(std::min(std::max(value, -1.0F), 1e9F))) : 0;
+        }
+
+        // runs the function with its frame at the bottom of the stack until it returns,
+        // returns false if the invocation was discarded
+        bool execute(std::uint32_t functionIndex)
+        {
+            const auto& function = bytecode.functions[functionIndex];
+            if (function.frameSize > stack.size())
+                throw std::runtime_error{"Stack overflow"};
+
+            const Instruction* const code = bytecode.instructions.data();
+            const std::uint32_t* const constants = bytecode.constants.data();
+            std::uint32_t* const globalCells = globals.data();
+            const std::uint32_t globalSize = bytecode.globalSize;
+
+            std::uint32_t base = 0;
+            std::uint32_t frameSize = function.frameSize;
+            std::uint32_t* registers = stack.data();
+            const Instruction* instruction = code + function.entry;
+
+            frames.clear();
+
+#if OSL_COMPUTED_GOTO
+            static const void* const labels[opcodeCount] = {
+                &&labelConstant, &&labelClear, &&labelMove, &&labelLoadGlobal, &&labelStoreGlobal,
+                &&labelLoadIndirect, &&labelStoreIndirect, &&labelLoadGlobalIndirect, &&labelStoreGlobalIndirect,
+                &&labelSplat, &&labelBound,
+                &&labelFloatAdd, &&labelFloatSubtract, &&labelFloatMultiply, &&labelFloatDivide,
+                &&labelFloatNegate, &&labelFloatAbs, &&labelFloatLess, &&labelFloatLessEqual, &&labelFloatEqual,
+                &&labelMatrixMultiply,
+                &&labelIntegerAdd, &&labelIntegerSubtract, &&labelIntegerMultiply, &&labelIntegerDivide,
+                &&labelUnsignedDivide, &&labelIntegerNegate, &&labelIntegerAbs, &&labelIntegerLess,
+                &&labelIntegerLessEqual, &&labelUnsignedLess, &&labelUnsignedLessEqual, &&labelIntegerEqual,
+                &&labelNot, &&labelAnd, &&labelConvert,
+                &&labelJump, &&labelJumpIfFalse, &&labelJumpIfTrue, &&labelCall, &&labelReturn, &&labelDiscard,
+                &&labelTextureSample, &&labelTextureLoad
+            };
+#  define OSL_OPCODE(name) case Opcode::name: label##name:
+#  define OSL_NEXT goto *labels[static_cast<std::size_t>((++instruction)->opcode)]
+#  define OSL_JUMP(target) instruction = code + (target); goto *labels[static_cast<std::size_t>(instruction->opcode)]
+#else
+#  define OSL_OPCODE(name) case Opcode::name:
+#  define OSL_NEXT ++instruction; continue
+#  define OSL_JUMP(target) instruction = code + (target); continue
+#endif
+
+            for (;;)
+            {
+                switch (instruction->opcode)
+                {
+                    OSL_OPCODE(Constant)
+                    {
+                        std::copy(constants + instruction->b, constants + instruction->b + instruction->width, registers + instruction->a);
+                        OSL_NEXT;
+                    }
+
+                    OSL_OPCODE(Clear)
+                    {
+                        std::fill(registers + instruction->a, registers + instruction->a + instruction->width, 0U);
+                        OSL_NEXT;
+                    }
+
+                    // the ranges of moves can overlap
+                    OSL_OPCODE(Move)
+                    {
+                        std::memmove(registers + instruction->a, registers + instruction->b, instruction->width * sizeof(std::uint32_t));
+                        OSL_NEXT;
+                    }
+
+                    OSL_OPCODE(LoadGlobal)
+                    {
+                        std::memcpy(registers + instruction->a, globalCells + instruction->b, instruction->width * sizeof(std::uint32_t));
+                        OSL_NEXT;
+                    }
+
+                    OSL_OPCODE(StoreGlobal)
+                    {
+                        std::memcpy(globalCells + instruction->a, registers + instruction->b, instruction->width * sizeof(std::uint32_t));
+                        OSL_NEXT;
+                    }
+
+                    OSL_OPCODE(LoadIndirect)
+                    {
+                        const std::uint64_t address = std::uint64_t{instruction->b} + registers[instruction->c];
+                        if (address + instruction->width > frameSize)
+                            throw std::runtime_error{"Invalid indirect access"};
+                        std::memmove(registers + instruction->a, registers + address, instruction->width * sizeof(std::uint32_t));
+                        OSL_NEXT;
+                    }
+
+                    OSL_OPCODE(StoreIndirect)
+                    {
+                        const std::uint64_t address = std::uint64_t{instruction->a} + registers[instruction->c];
+                        if (address + instruction->width > frameSize)
+                            throw std::runtime_error{"Invalid indirect access"};
+                        std::memmove(registers + address, registers + instruction->b, instruction->width * sizeof(std::uint32_t));
+                        OSL_NEXT;
+                    }
+
+                    OSL_OPCODE(LoadGlobalIndirect)
+                    {
+                        const std::uint64_t address = std::uint64_t{instruction->b} + registers[instruction->c];
+                        if (address + instruction->width > globalSize)
+                            throw std::runtime_error{"Invalid indirect access"};
+                        std::memcpy(registers + instruction->a, globalCells + address, instruction->width * sizeof(std::uint32_t));
+                        OSL_NEXT;
+                    }
+
+                    OSL_OPCODE(StoreGlobalIndirect)
+                    {
+                        const std::uint64_t address = std::uint64_t{instruction->a} + registers[instruction->c];
+                        if (address + instruction->width > globalSize)
+                            throw std::runtime_error{"Invalid indirect access"};
+                        std::memcpy(globalCells + address, registers + instruction->b, instruction->width * sizeof(std::uint32_t));
+                        OSL_NEXT;
+                    }
+
+                    OSL_OPCODE(Splat)
+                    {
+                        const auto value = registers[instruction->b];
+                        std::fill(registers + instruction->a, registers + instruction->a + instruction->width, value);
+                        OSL_NEXT;
+                    }
+
+                    OSL_OPCODE(Bound)
+                    {
+                        const auto index = toDouble(registers[instruction->b], instruction->kind);
+                        if (index < 0.0 || index >= static_cast<double>(instruction->c))
+                            throw std::runtime_error{"Subscript out of range"};
+                        registers[instruction->a] = static_cast<std::uint32_t>(index);
+                        OSL_NEXT;
+                    }
+
+#define OSL_FLOAT_OPERATION(name, operation) \
+                    OSL_OPCODE(name) \
+                    { \
+                        for (std::uint32_t i = 0; i < instruction->width; ++i) \
+                        { \
+                            const auto left = toFloat(registers[instruction->b + i]); \
+                            const auto right = toFloat(registers[instruction->c + i]); \
+                            registers[instruction->a + i] = fromFloat(operation); \
+                        } \
+                        OSL_NEXT; \
+                    }
+
+                    OSL_FLOAT_OPERATION(FloatAdd, left + right)
+                    OSL_FLOAT_OPERATION(FloatSubtract, left - right)
+                    OSL_FLOAT_OPERATION(FloatMultiply, left * right)
+                    OSL_FLOAT_OPERATION(FloatDivide, left / right)
+#undef OSL_FLOAT_OPERATION
+
+                    OSL_OPCODE(FloatNegate)
+                    {
+                        for (std::uint32_t i = 0; i < instruction->width; ++i)
+                            registers[instruction->a + i] = registers[instruction->b + i] ^ 0x80000000U;
+                        OSL_NEXT;
+                    }
+
+                    OSL_OPCODE(FloatAbs)
+                    {
+                        for (std::uint32_t i = 0; i < instruction->width; ++i)
+                            registers[instruction->a + i] = registers[instruction->b + i] & 0x7FFFFFFFU;
+                        OSL_NEXT;
+                    }
+
+                    OSL_OPCODE(FloatLess)
+                    {
+                        registers[instruction->a] = toFloat(registers[instruction->b]) < toFloat(registers[instruction->c]) ? 1U : 0U;
+                        OSL_NEXT;
+                    }
+
+                    OSL_OPCODE(FloatLessEqual)
+                    {
+                        registers[instruction->a] = toFloat(registers[instruction->b]) <= toFloat(registers[instruction->c]) ? 1U : 0U;
+                        OSL_NEXT;
+                    }
+
+                    OSL_OPCODE(FloatEqual)
+                    {
+                        bool equal = true;
+                        for (std::uint32_t i = 0; i < instruction->width; ++i)
+                            if (toFloat(registers[instruction->b + i]) != toFloat(registers[instruction->c + i])) equal = false;
+                        registers[instruction->a] = equal ? 1U : 0U;
+                        OSL_NEXT;
+                    }
+
+                    OSL_OPCODE(MatrixMultiply)
+                    {
+                        // the result is computed before it is written, so it can overlap the operands
+                        const std::uint32_t rows = instruction->width & 0x0FU;
+                        const std::uint32_t inner = (instruction->width >> 4) & 0x0FU;
+                        const std::uint32_t columns = (instruction->width >> 8) & 0x0FU;
+
+                        std::uint32_t result[16];
+                        for (std::uint32_t row = 0; row < rows; ++row)
+                            for (std::uint32_t column = 0; column < columns; ++column)
+                            {
+                                float sum = 0.0F;
+                                for (std::uint32_t i = 0; i < inner; ++i)
+                                    sum += toFloat(registers[instruction->b + row * inner + i]) *
+                                        toFloat(registers[instruction->c + i * columns + column]);
+                                result[row * columns + column] = fromFloat(sum);
+                            }
+
+                        std::copy(result, result + rows * columns, registers + instruction->a);
+                        OSL_NEXT;
+                    }
+
+#define OSL_INTEGER_OPERATION(name, operation) \
+                    OSL_OPCODE(name) \
+                    { \
+                        for (std::uint32_t i = 0; i < instruction->width; ++i) \
+                        { \
+                            const std::uint32_t left = registers[instruction->b + i]; \
+                            const std::uint32_t right = registers[instruction->c + i]; \
+                            registers[instruction->a + i] = (operation); \
+                        } \
+                        OSL_NEXT; \
+                    }
+
+                    // unsigned arithmetic wraps in the same way for int and uint,
+                    // division by zero results in zero instead of trapping
+                    OSL_INTEGER_OPERATION(IntegerAdd, left + right)
+                    OSL_INTEGER_OPERATION(IntegerSubtract, left - right)
+                    OSL_INTEGER_OPERATION(IntegerMultiply, left * right)
+                    OSL_INTEGER_OPERATION(IntegerDivide, right == 0 ? 0U :
+                                          static_cast<std::uint32_t>(static_cast<std::int64_t>(static_cast<std::int32_t>(left)) /
+                                                                     static_cast<std::int32_t>(right)))
+                    OSL_INTEGER_OPERATION(UnsignedDivide, right == 0 ? 0U : left / right)
+#undef OSL_INTEGER_OPERATION
+
+                    OSL_OPCODE(IntegerNegate)
+                    {
+                        for (std::uint32_t i = 0; i < instruction->width; ++i)
+                            registers[instruction->a + i] = 0U - registers[instruction->b + i];
+                        OSL_NEXT;
+                    }
+
+                    OSL_OPCODE(IntegerAbs)
+                    {
+                        for (std::uint32_t i = 0; i < instruction->width; ++i)
+                        {
+                            const auto value = registers[instruction->b + i];
+                            registers[instruction->a + i] = (static_cast<std::int32_t>(value) < 0) ? 0U - value : value;
+                        }
+                        OSL_NEXT;
+                    }
+
+                    OSL_OPCODE(IntegerLess)
+                    {
+                        registers[instruction->a] = static_cast<std::int32_t>(registers[instruction->b]) <
+                            static_cast<std::int32_t>(registers[instruction->c]) ? 1U : 0U;
+                        OSL_NEXT;
+                    }
+
+                    OSL_OPCODE(IntegerLessEqual)
+                    {
+                        registers[instruction->a] = static_cast<std::int32_t>(registers[instruction->b]) <=
+                            static_cast<std::int32_t>(registers[instruction->c]) ? 1U : 0U;
+                        OSL_NEXT;
+                    }
+
+                    OSL_OPCODE(UnsignedLess)
+                    {
+                        registers[instruction->a] = registers[instruction->b] < registers[instruction->c] ? 1U : 0U;
+                        OSL_NEXT;
+                    }
+
+                    OSL_OPCODE(UnsignedLessEqual)
+                    {
+                        registers[instruction->a] = registers[instruction->b] <= registers[instruction->c] ? 1U : 0U;
+                        OSL_NEXT;
+                    }
+
+                    OSL_OPCODE(IntegerEqual)
+                    {
+                        registers[instruction->a] = std::equal(registers + instruction->b, registers + instruction->b + instruction->width,
+                                                               registers + instruction->c) ? 1U : 0U;
+                        OSL_NEXT;
+                    }
+
+                    OSL_OPCODE(Not)
+                    {
+                        registers[instruction->a] = (registers[instruction->b] != 0) ? 0U : 1U;
+                        OSL_NEXT;
+                    }
+
+                    OSL_OPCODE(And)
+                    {
+                        registers[instruction->a] = (registers[instruction->b] != 0 && registers[instruction->c] != 0) ? 1U : 0U;
+                        OSL_NEXT;
+                    }
+
+                    OSL_OPCODE(Convert)
+                    {
+                        const auto source = static_cast<ValueKind>(instruction->c);
+                        for (std::uint32_t i = 0; i < instruction->width; ++i)
+                            registers[instruction->a + i] = convert(registers[instruction->b + i], source, instruction->kind);
+                        OSL_NEXT;
+                    }
+
+                    OSL_OPCODE(Jump)
+                    {
+                        OSL_JUMP(instruction->b);
+                    }
+
+                    OSL_OPCODE(JumpIfFalse)
+                    {
+                        if (registers[instruction->a] == 0)
+                        {
+                            OSL_JUMP(instruction->b);
+                        }
+                        OSL_NEXT;
+                    }
+
+                    OSL_OPCODE(JumpIfTrue)
+                    {
+                        if (registers[instruction->a] != 0)
+                        {
+                            OSL_JUMP(instruction->b);
+                        }
+                        OSL_NEXT;
+                    }
+
+                    OSL_OPCODE(Call)
+                    {
+                        const auto& callee = bytecode.functions[instruction->b];
+                        const auto calleeBase = base + instruction->a;
+
+                        if (frames.size() >= maxCallDepth)
+                            throw std::runtime_error{"Call stack overflow"};
+                        if (std::uint64_t{calleeBase} + callee.frameSize > stack.size())
+                            throw std::runtime_error{"Stack overflow"};
+
+                        frames.push_back(Frame{static_cast<std::uint32_t>(instruction - code) + 1, base, frameSize});
+                        base = calleeBase;
+                        frameSize = callee.frameSize;
+                        registers = stack.data() + base;
+                        OSL_JUMP(callee.entry);
+                    }
+
+                    OSL_OPCODE(Return)
+                    {
+                        if (frames.empty()) return true;
+
+                        const auto frame = frames.back();
+                        frames.pop_back();
+                        base = frame.base;
+                        frameSize = frame.size;
+                        registers = stack.data() + base;
+                        OSL_JUMP(frame.returnAddress);
+                    }
+
+                    OSL_OPCODE(Discard)
+                    {
+                        return false;
+                    }
+
+                    OSL_OPCODE(TextureSample)
+                    OSL_OPCODE(TextureLoad)
+                    {
+                        const auto slot = registers[instruction->b];
+                        const auto texture = (slot < textures.size()) ? textures[slot] : nullptr;
+                        if (!texture)
+                            throw std::runtime_error{"No texture bound"};
+
+                        const auto x = toFloat(registers[instruction->c]);
+                        const auto y = toFloat(registers[instruction->c + 1]);
+
+                        // load takes texel coordinates
+                        const auto color = (instruction->opcode == Opcode::TextureSample) ?
+                            texture->sample(x, y) :
+                            texture->load(getTexel(x), getTexel(y));
+
+                        for (std::uint32_t i = 0; i < 4; ++i)
+                            registers[instruction->a + i] = fromFloat(color[i]);
+                        OSL_NEXT;
+                    }
+                }
+
+                throw std::runtime_error{"Invalid instruction"};
+            }
+
+#undef OSL_OPCODE
+#undef OSL_NEXT
+#undef OSL_JUMP
+        }
+
+        Bytecode bytecode;
+        std::vector<std::uint32_t> stack;
+        std::vector<std::uint32_t> globals;
+        std::vector<const Texture*> textures;
+        std::vector<Frame> frames;
+    };
+}
+
+#endif // VIRTUALMACHINE_HPP
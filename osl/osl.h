@@ -0,0 +1,110 @@
+/*
+ *  OSL
+ */
+
+#ifndef OSL_H
+#define OSL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#  if defined(OSL_BUILD_LIBRARY)
+#    define OSL_API __declspec(dllexport)
+#  else
+#    define OSL_API __declspec(dllimport)
+#  endif
+#elif defined(__GNUC__)
+#  define OSL_API __attribute__((visibility("default")))
+#else
+#  define OSL_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* incremented when a function or a structure changes in an incompatible way */
+#define OSL_API_VERSION 1
+
+typedef struct OSLCompiler OSLCompiler;
+typedef struct OSLResult OSLResult;
+
+typedef enum OSLTarget
+{
+    OSL_TARGET_HLSL = 0,
+    OSL_TARGET_GLSL = 1,
+    OSL_TARGET_MSL = 2,
+    OSL_TARGET_CPP = 3,
+    OSL_TARGET_BYTECODE = 4
+} OSLTarget;
+
+typedef enum OSLProgram
+{
+    OSL_PROGRAM_FRAGMENT = 0,
+    OSL_PROGRAM_VERTEX = 1
+} OSLProgram;
+
+typedef enum OSLOption
+{
+    OSL_OPTION_OPTIMIZE = 0, /* 0 or 1 */
+    OSL_OPTION_INLINE_THRESHOLD = 1,
+    OSL_OPTION_MINIFY = 2, /* 0 or 1 */
+    OSL_OPTION_WHITESPACES = 3, /* 0 or 1 */
+    OSL_OPTION_OUTPUT_VERSION = 4, /* GLSL version */
+    OSL_OPTION_PARSE_THREADS = 5, /* 0 parses on the calling thread */
+    OSL_OPTION_REFLECTION = 6 /* 0 or 1 */
+} OSLOption;
+
+/* the functions take the values of the enums as fixed-width integers, so that any value a caller passes
+   is well-defined and is rejected if it is out of range */
+
+/* an error in the source, the end column is one past the last character */
+typedef struct OSLDiagnostic
+{
+    const char* code;
+    const char* message;
+    uint32_t line;
+    uint32_t column;
+    uint32_t endLine;
+    uint32_t endColumn;
+} OSLDiagnostic;
+
+OSL_API uint32_t oslGetApiVersion(void);
+
+/* returns null if the compiler could not be created */
+OSL_API OSLCompiler* oslCreateCompiler(void);
+OSL_API void oslDestroyCompiler(OSLCompiler* compiler);
+
+/* the functions that return int return 0 on success and -1 on failure, the message of the last failure
+   is returned by oslGetError and stays valid until the next call with the same compiler */
+OSL_API const char* oslGetError(const OSLCompiler* compiler);
+
+/* the option is an OSLOption */
+OSL_API int oslSetOption(OSLCompiler* compiler, uint32_t option, uint32_t value);
+/* a null value removes the define */
+OSL_API int oslSetDefine(OSLCompiler* compiler, const char* name, const char* value);
+OSL_API int oslSetNamespace(OSLCompiler* compiler, const char* outputNamespace);
+OSL_API int oslSetPrelude(OSLCompiler* compiler, const char* code, size_t size);
+
+/* the target is an OSLTarget and the program is an OSLProgram,
+   the result is owned by the compiler and is reused by its next compilation, returns null if the compilation failed for a reason other than an error in the source */
+OSL_API const OSLResult* oslCompile(OSLCompiler* compiler,
+                                    const char* source, size_t size,
+                                    uint32_t target, uint32_t program);
+
+/* 1 if the source compiled without errors */
+OSL_API int oslGetResultSuccess(const OSLResult* result);
+/* the output is not null-terminated for the bytecode target */
+OSL_API const char* oslGetResultOutput(const OSLResult* result, size_t* size);
+OSL_API size_t oslGetDiagnosticCount(const OSLResult* result);
+OSL_API int oslGetDiagnostic(const OSLResult* result, size_t index, OSLDiagnostic* diagnostic);
+OSL_API const char* oslGetStatisticsJson(const OSLResult* result);
+/* the serialized reflection if OSL_OPTION_REFLECTION is set, otherwise the size is 0 */
+OSL_API const uint8_t* oslGetResultReflection(const OSLResult* result, size_t* size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OSL_H */
@@ -2,14 +2,29 @@
 //  OSL
 //
 
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <optional>
+#include <set>
+#include "AllocationTracker.hpp"
+#include "Bytecode.hpp"
+#include "Compiler.hpp"
+#include "Diagnostics.hpp"
+#include "FileWatcher.hpp"
+#include "Layout.hpp"
+#include "Module.hpp"
 #include "Tokenizer.hpp"
 #include "Parser.hpp"
 #include "Preprocessor.hpp"
-#include "OutputHLSL.hpp"
-#include "OutputGLSL.hpp"
-#include "OutputMSL.hpp"
+#include "Reflection.hpp"
+#include "Statistics.hpp"
+#include "Trace.hpp"
+#include "VariantCompiler.hpp"
+
+OSL_DEFINE_ALLOCATION_TRACKER()
 
 namespace
 {
@@ -26,6 +41,279 @@ namespace
             (outputProgram == OutputProgram::Vertex) ? ouzel::Program::Vertex :
             throw std::runtime_error{"Invalid program"};
     }
+
+    // parses a comma separated list of NAME or NAME=VALUE
+    std::map<std::string, std::string> parseDefines(const std::string& list)
+    {
+        std::map<std::string, std::string> result;
+
+        for (std::size_t start = 0; start < list.size();)
+        {
+            auto end = list.find(',', start);
+            if (end == std::string::npos) end = list.size();
+
+            const auto define = list.substr(start, end - start);
+            const auto equals = define.find('=');
+            const auto name = define.substr(0, equals);
+
+            if (name.empty())
+                throw std::runtime_error{"Invalid define: " + list};
+
+            result[name] = (equals == std::string::npos) ? std::string() : define.substr(equals + 1);
+            start = end + 1;
+        }
+
+        return result;
+    }
+
+    ouzel::Target getTarget(const std::string& format)
+    {
+        if (format.empty()) throw std::runtime_error{"No format"};
+        else if (format == "hlsl") return ouzel::Target::HLSL;
+        else if (format == "glsl") return ouzel::Target::GLSL;
+        else if (format == "msl") return ouzel::Target::MSL;
+        else if (format == "cpp") return ouzel::Target::CPP;
+        else if (format == "bytecode") return ouzel::Target::Bytecode;
+        else throw std::runtime_error{"Invalid format"};
+    }
+
+    std::string formatMilliseconds(std::chrono::steady_clock::duration duration)
+    {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.3f ms",
+                      std::chrono::duration<double, std::milli>(duration).count());
+        return buffer;
+    }
+
+    // Recompiles the shaders of a directory when they or the files they include change,
+    // the contexts of the shaders are kept, so that only the changed declarations are parsed again,
+    // the output of a shader is written next to it or to the same relative path in the output directory
+    // with the format as its extension, the included files outside of the directory are not watched
+    class Watch final
+    {
+    public:
+        Watch(const std::string& initDirectory, const std::string& initOutputDirectory,
+              const ouzel::Compiler::Options& options,
+              ouzel::Target initTarget, ouzel::Program initProgram,
+              const std::string& initFormat, const std::string& initDiagnosticsFormat):
+            directory{initDirectory},
+            outputDirectory{initOutputDirectory},
+            compiler{options},
+            target{initTarget},
+            program{initProgram},
+            format{initFormat},
+            diagnosticsFormat{initDiagnosticsFormat},
+            watcher{initDirectory} // watching starts before the first compilation, so that no change is missed
+        {
+        }
+
+        [[noreturn]] void run()
+        {
+            std::size_t shaderCount = 0;
+            const auto start = std::chrono::steady_clock::now();
+
+            for (const auto& entry : std::filesystem::recursive_directory_iterator(directory))
+                if (entry.is_regular_file() && isShader(entry.path()))
+                {
+                    compile(entry.path().lexically_normal().string(), std::chrono::steady_clock::now());
+                    ++shaderCount;
+                }
+
+            std::cout << "Compiled " << shaderCount << (shaderCount == 1 ? " shader" : " shaders") <<
+                " in " << formatMilliseconds(std::chrono::steady_clock::now() - start) <<
+                ", watching " << directory << std::endl;
+
+            for (;;)
+                for (const auto& change : watcher.wait(std::chrono::milliseconds(1000)))
+                {
+                    const auto changeTime = std::chrono::steady_clock::now();
+                    const auto path = std::filesystem::path(change.path).lexically_normal().string();
+
+                    // the shaders that include the file are compiled again, even if it was removed
+                    std::set<std::string> affected;
+                    const auto includers = dependents.find(path);
+                    if (includers != dependents.end())
+                        affected = includers->second;
+
+                    if (isShader(path))
+                    {
+                        if (change.removed)
+                        {
+                            compiler.removeCached(path);
+                            setIncludes(path, std::vector<std::string>());
+                            std::cout << path << ": removed" << std::endl;
+                        }
+                        else
+                            affected.insert(path);
+                    }
+
+                    for (const auto& shader : affected)
+                        compile(shader, changeTime);
+                }
+        }
+
+    private:
+        static bool isShader(const std::filesystem::path& path)
+        {
+            return path.extension() == ".osl";
+        }
+
+        void setIncludes(const std::string& shader, const std::vector<std::string>& includes)
+        {
+            for (auto i = dependents.begin(); i != dependents.end();)
+                if (i->second.erase(shader) && i->second.empty())
+                    i = dependents.erase(i);
+                else
+                    ++i;
+
+            for (const auto& include : includes)
+                dependents[std::filesystem::path(include).lexically_normal().string()].insert(shader);
+        }
+
+        // the latency is measured from the time the change was seen to the time the output was written
+        void compile(const std::string& path, std::chrono::steady_clock::time_point changeTime)
+        {
+            std::ifstream file(path, std::ios::binary);
+            if (!file)
+            {
+                std::cerr << path << ": failed to open file" << std::endl;
+                return;
+            }
+
+            const std::string source{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+            const auto reparse = compiler.isCached(path);
+
+            try
+            {
+                compiler.compile(path, source, target, program, result);
+            }
+            catch (const std::exception& e)
+            {
+                std::cerr << path << ": " << e.what() << std::endl;
+                return;
+            }
+
+            // the includes of a shader that failed to preprocess are not known, so the old ones are kept
+            if (result.success || !result.includes.empty())
+                setIncludes(path, result.includes);
+
+            if (!result.success)
+            {
+                if (diagnosticsFormat == "json")
+                    std::cerr << ouzel::getDiagnosticsJson(path, result.diagnostics, result.includes) << std::endl;
+                else
+                    std::cerr << ouzel::getDiagnosticsText(path, result.diagnostics, result.includes) << std::flush;
+                return;
+            }
+
+            auto outputPath = std::filesystem::path(path);
+            if (!outputDirectory.empty())
+                outputPath = std::filesystem::path(outputDirectory) / std::filesystem::relative(outputPath, directory);
+            outputPath.replace_extension(format);
+
+            if (outputPath.has_parent_path())
+                std::filesystem::create_directories(outputPath.parent_path());
+
+            std::ofstream outputFile(outputPath, std::ios::binary);
+            if (!outputFile)
+            {
+                std::cerr << path << ": failed to open file " << outputPath.string() << std::endl;
+                return;
+            }
+
+            outputFile.write(result.output.data(), static_cast<std::streamsize>(result.output.size()));
+            outputFile.close();
+
+            std::cout << path << " -> " << outputPath.string() << ": " <<
+                formatMilliseconds(std::chrono::steady_clock::now() - changeTime) <<
+                (reparse ? " (changed declarations reparsed)" : "") << std::endl;
+        }
+
+        std::string directory;
+        std::string outputDirectory;
+        ouzel::Compiler compiler;
+        ouzel::Compiler::Result result;
+        ouzel::Target target;
+        ouzel::Program program;
+        std::string format;
+        std::string diagnosticsFormat;
+        // the shaders that include each file
+        std::map<std::string, std::set<std::string>> dependents;
+        ouzel::FileWatcher watcher;
+    };
+
+    // escapes the characters that have a meaning in a Makefile rule
+    std::string escapeDependency(const std::string& path)
+    {
+        std::string result;
+
+        for (const auto c : path)
+            if (c == ' ' || c == '#')
+            {
+                result += '\\';
+                result += c;
+            }
+            else if (c == '$')
+                result += "$$";
+            else
+                result += c;
+
+        return result;
+    }
+
+    // writes a Makefile rule with the input and the included files as the prerequisites of the target
+    void writeDependencies(const std::string& filename, const std::string& target,
+                           const std::string& input, const std::vector<std::string>& includes)
+    {
+        std::string result = escapeDependency(target) + ": " + escapeDependency(input);
+        for (const auto& include : includes)
+            result += " \\\n  " + escapeDependency(include);
+        result += '\n';
+
+        std::ofstream dependencyFile(filename, std::ios::binary);
+
+        if (!dependencyFile)
+            throw std::runtime_error{"Failed to open file " + filename};
+
+        dependencyFile << result;
+    }
+
+    // thrown after the diagnostics were reported
+    class DiagnosticsError final: public std::runtime_error
+    {
+    public:
+        explicit DiagnosticsError(std::size_t count):
+            std::runtime_error(std::to_string(count) + (count == 1 ? " error" : " errors"))
+        {
+        }
+    };
+
+    void writeStatistics(const ouzel::Statistics& statistics,
+                         bool timePasses, bool printStatistics,
+                         const std::string& format,
+                         const std::string& filename)
+    {
+        std::string result;
+
+        if (format == "json")
+            result = statistics.getJson() + '\n';
+        else if (printStatistics)
+            result = statistics.getText();
+        else if (timePasses)
+            result = statistics.getPhasesText();
+
+        if (filename.empty())
+            std::cerr << result;
+        else
+        {
+            std::ofstream statisticsFile(filename, std::ios::binary);
+
+            if (!statisticsFile)
+                throw std::runtime_error{"Failed to open file " + filename};
+
+            statisticsFile << result;
+        }
+    }
 }
 
 int main(int argc, const char* argv[])
@@ -38,7 +326,30 @@ int main(int argc, const char* argv[])
     std::string format;
     std::string outputFilename;
     std::uint32_t outputVersion = 0;
+    std::string outputNamespace = "shader";
     OutputProgram program = OutputProgram::None;
+    bool timePasses = false;
+    bool printStatistics = false;
+    std::string statisticsFormat = "text";
+    std::string statisticsFilename;
+    std::string diagnosticsFormat = "text";
+    std::string traceFilename;
+    std::string reflectionFilename;
+    std::string reflectionFormat = "binary";
+    std::string reflectionLayout;
+    bool optimize = false;
+    bool printOptimizationReport = false;
+    std::size_t inlineThreshold = 16;
+    std::size_t parseThreads = 0;
+    bool minify = false;
+    std::string nameMapFilename;
+    std::map<std::string, std::string> defines;
+    std::vector<std::map<std::string, std::string>> variants;
+    std::string watchDirectory;
+    std::vector<std::string> includeDirectories;
+    bool writeDependencyFile = false;
+    std::string dependencyFilename;
+    std::string dependencyTarget;
 
     try
     {
@@ -76,6 +387,12 @@ int main(int argc, const char* argv[])
                     throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
                 outputVersion = static_cast<std::uint32_t>(std::stoi(argv[i]));
             }
+            else if (std::string(argv[i]) == "--output-namespace")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+                outputNamespace = argv[i];
+            }
             else if (std::string(argv[i]) == "--program")
             {
                 if (++i >= argc)
@@ -86,13 +403,179 @@ int main(int argc, const char* argv[])
                 else
                     throw std::runtime_error{"Invalid program: " + std::string(argv[i])};
             }
+            else if (std::string(argv[i]) == "--time-passes")
+                timePasses = true;
+            else if (std::string(argv[i]) == "--stats")
+                printStatistics = true;
+            else if (std::string(argv[i]) == "--stats-format")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+
+                if (std::string(argv[i]) != "text" && std::string(argv[i]) != "json")
+                    throw std::runtime_error{"Invalid statistics format: " + std::string(argv[i])};
+
+                statisticsFormat = argv[i];
+            }
+            else if (std::string(argv[i]) == "--diagnostics-format")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+
+                if (std::string(argv[i]) != "text" && std::string(argv[i]) != "json")
+                    throw std::runtime_error{"Invalid diagnostics format: " + std::string(argv[i])};
+
+                diagnosticsFormat = argv[i];
+            }
+            else if (std::string(argv[i]) == "--reflection")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+                reflectionFilename = argv[i];
+            }
+            else if (std::string(argv[i]) == "--reflection-format")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+
+                if (std::string(argv[i]) != "binary" && std::string(argv[i]) != "json")
+                    throw std::runtime_error{"Invalid reflection format: " + std::string(argv[i])};
+
+                reflectionFormat = argv[i];
+            }
+            else if (std::string(argv[i]) == "--reflection-layout")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+
+                ouzel::Layout::getRules(argv[i]);
+                reflectionLayout = argv[i];
+            }
+            else if (std::string(argv[i]) == "--stats-output")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+                statisticsFilename = argv[i];
+            }
+            else if (std::string(argv[i]) == "--trace")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+                traceFilename = argv[i];
+            }
+            else if (std::string(argv[i]) == "--optimize")
+                optimize = true;
+            else if (std::string(argv[i]) == "--optimization-report")
+                printOptimizationReport = true;
+            else if (std::string(argv[i]) == "--inline-threshold")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+                inlineThreshold = static_cast<std::size_t>(std::stoul(argv[i]));
+            }
+            else if (std::string(argv[i]) == "--parse-threads")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+                parseThreads = static_cast<std::size_t>(std::stoul(argv[i]));
+            }
+            else if (std::string(argv[i]) == "--minify")
+                minify = true;
+            else if (std::string(argv[i]) == "--name-map")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+                nameMapFilename = argv[i];
+            }
+            else if (std::string(argv[i]) == "--define")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+
+                for (const auto& define : parseDefines(argv[i]))
+                    defines[define.first] = define.second;
+            }
+            else if (std::string(argv[i]) == "-I")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+                includeDirectories.push_back(argv[i]);
+            }
+            else if (std::string(argv[i]) == "-MD")
+                writeDependencyFile = true;
+            else if (std::string(argv[i]) == "-MF")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+                writeDependencyFile = true;
+                dependencyFilename = argv[i];
+            }
+            else if (std::string(argv[i]) == "-MT")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+                dependencyTarget = argv[i];
+            }
+            else if (std::string(argv[i]) == "--watch")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+                watchDirectory = argv[i];
+            }
+            else if (std::string(argv[i]) == "--variant")
+            {
+                if (++i >= argc)
+                    throw std::runtime_error{"Argument to " + std::string(argv[i]) + " is missing"};
+                variants.push_back(parseDefines(argv[i]));
+            }
             else
                 throw std::runtime_error{"Invalid argument " + std::string(argv[i])};
         }
 
+        ouzel::Compiler::Options options;
+        options.defines = defines;
+        options.optimize = optimize;
+        options.inlineThreshold = inlineThreshold;
+        options.optimizationReport = printOptimizationReport;
+        options.minify = minify;
+        options.nameMap = !nameMapFilename.empty();
+        options.whitespaces = whitespaces;
+        options.outputVersion = outputVersion;
+        options.outputNamespace = outputNamespace;
+        options.parseThreads = parseThreads;
+        options.includeDirectories = includeDirectories;
+
+        if (!watchDirectory.empty())
+        {
+            if (!inputFilename.empty() || !variants.empty() || preprocess || printTokens || printAST ||
+                !nameMapFilename.empty() || timePasses || printStatistics || !traceFilename.empty() || writeDependencyFile ||
+                !reflectionFilename.empty())
+                throw std::runtime_error{"--watch can not be combined with --input, --variant, --preprocess, --print-tokens, --print-ast, --name-map, --time-passes, --stats, --trace, -MD, -MF or --reflection"};
+
+            Watch watch(watchDirectory, outputFilename, options,
+                        getTarget(format), getProgram(program),
+                        format, diagnosticsFormat);
+            watch.run();
+        }
+
         if (inputFilename.empty())
             throw std::runtime_error{"No input file"};
 
+        // like a C compiler, the dependencies of foo.hlsl go to foo.hlsl.d by default
+        if (writeDependencyFile)
+        {
+            if (dependencyTarget.empty())
+                dependencyTarget = outputFilename.empty() ? inputFilename : outputFilename;
+            if (dependencyFilename.empty())
+                dependencyFilename = (outputFilename.empty() ? inputFilename : outputFilename) + ".d";
+        }
+
+        if (!nameMapFilename.empty() && !minify)
+            throw std::runtime_error{"--name-map requires --minify"};
+
+        if (!reflectionFilename.empty() && program == OutputProgram::None)
+            throw std::runtime_error{"--reflection requires --program"};
+
         std::ifstream inputFile(inputFilename, std::ios::binary);
 
         if (!inputFile)
@@ -101,46 +584,167 @@ int main(int argc, const char* argv[])
         std::string inCode;
         inCode.assign(std::istreambuf_iterator<char>(inputFile), std::istreambuf_iterator<char>());
 
-        ouzel::Preprocessor preprocessor;
-        auto preprocessed = preprocessor.preprocess(inCode);
+        ouzel::Tracer tracer;
+        ouzel::Tracer* const activeTracer = traceFilename.empty() ? nullptr : &tracer;
+        ouzel::AllocationTracker::resetPeak();
+
+        // the same pipeline as the one of the library, the stages are run one by one to print their results
+        options.tracer = activeTracer;
+        ouzel::Compiler compiler(options);
+        ouzel::Compiler::Result result;
+        ouzel::Compiler::Phases phases(result.statistics, activeTracer);
+
+        // all the errors are reported before giving up
+        const auto reportDiagnostics = [&]() {
+            if (diagnosticsFormat == "json")
+                std::cerr << ouzel::getDiagnosticsJson(inputFilename, result.diagnostics, result.includes) << '\n';
+            else
+                std::cerr << ouzel::getDiagnosticsText(inputFilename, result.diagnostics, result.includes);
+
+            throw DiagnosticsError{result.diagnostics.size()};
+        };
 
-        if (preprocess)
+        if (!variants.empty())
         {
-            std::cout << std::string(preprocessed.begin(), preprocessed.end()) << "\n";
+            if (preprocess || printTokens || printAST || optimize || !nameMapFilename.empty() || !reflectionFilename.empty())
+                throw std::runtime_error{"--variant can not be combined with --preprocess, --print-tokens, --print-ast, --optimize, --name-map or --reflection"};
+
+            // the defines given with --define are the base of every variant
+            for (auto& variant : variants)
+                variant.insert(defines.begin(), defines.end());
+
+            const auto target = getTarget(format);
+
+            phases.start();
+
+            ouzel::VariantCompiler variantCompiler(inCode,
+                                                   ouzel::Preprocessor::getFileIncludeHandler(includeDirectories),
+                                                   inputFilename);
+            ouzel::Compiler::Result variantResult;
+            const auto bundle = variantCompiler.compile(variants, [&](ouzel::Context& context) {
+                try
+                {
+                    compiler.generate(context, target, getProgram(program), variantResult);
+                }
+                catch (const std::exception& e)
+                {
+                    throw std::runtime_error{std::string("Failed to output code: ") + e.what()};
+                }
+
+                return variantResult.output;
+            });
+
+            phases.end("compile variants");
+
+            if (writeDependencyFile)
+                writeDependencies(dependencyFilename, dependencyTarget, inputFilename, variantCompiler.getIncludes());
+
+            const auto data = bundle.serialize();
+            result.statistics.outputSize = data.size();
+
+            if (outputFilename.empty())
+            {
+                const auto& variantStatistics = variantCompiler.getStatistics();
+                std::cout << bundle.dump();
+                std::cout << variantStatistics.variantCount << " variants, " <<
+                    variantStatistics.parsedCount << " parsed, " <<
+                    variantStatistics.uniqueOutputCount << " unique outputs, " <<
+                    variantStatistics.tokenizedLineCount << " lines tokenized, " <<
+                    variantStatistics.sharedLineCount << " lines shared\n";
+            }
+            else
+            {
+                std::ofstream outputFile(outputFilename, std::ios::binary);
+
+                if (!outputFile)
+                    throw std::runtime_error{"Failed to open file " + outputFilename};
+
+                outputFile.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+            }
         }
         else
         {
-            std::vector<ouzel::Token> tokens = ouzel::tokenize(preprocessed);
+            if (!compiler.preprocess(inCode, inputFilename, result))
+                reportDiagnostics();
 
-            if (printTokens)
-                dump(tokens);
+            if (preprocess)
+            {
+                if (writeDependencyFile)
+                    writeDependencies(dependencyFilename, dependencyTarget, inputFilename, result.includes);
+
+                // the markers of the included files are internal to the tokenizer
+                std::cout << ouzel::Preprocessor::removeLineMarkers(compiler.getPreprocessed()) << "\n";
+            }
             else
             {
-                ouzel::Context context(tokens);
+                if (!compiler.tokenize(result))
+                    reportDiagnostics();
+
+                // a module keeps its import directives, the imported declarations are only checked with it
+                std::vector<ouzel::Token> moduleTokens;
+                if (format == "module") moduleTokens = compiler.getTokens();
 
-                if (printAST)
-                    context.dump();
+                if (!compiler.import(result))
+                    reportDiagnostics();
+
+                if (writeDependencyFile)
+                    writeDependencies(dependencyFilename, dependencyTarget, inputFilename, result.includes);
+
+                if (printTokens)
+                    dump(compiler.getTokens());
                 else
                 {
-                    std::unique_ptr<ouzel::Output> output;
-
-                    if (format.empty())
-                        throw std::runtime_error{"No format"};
-                    if (format == "hlsl")
-                        output.reset(new ouzel::OutputHLSL(getProgram(program)));
-                    else if (format == "glsl")
-                        output.reset(new ouzel::OutputGLSL(getProgram(program), outputVersion));
-                    else if (format == "msl")
-                        output.reset(new ouzel::OutputMSL(getProgram(program)));
-                    else
-                        throw std::runtime_error{"Invalid format"};
+                    const auto context = compiler.parse(inputFilename, result);
+
+                    if (!context)
+                        reportDiagnostics();
+
+                    if (optimize)
+                    {
+                        compiler.optimize(*context, (program != OutputProgram::None) ?
+                                          std::optional<ouzel::Program>(getProgram(program)) : std::nullopt,
+                                          result);
+                        std::cerr << result.optimizationReport;
+                    }
+
+                    result.statistics.addContext(*context);
+
+                    if (!reflectionFilename.empty())
+                    {
+                        // the uniforms are laid out like in the output of the format unless the rules are given
+                        const auto layoutRules = !reflectionLayout.empty() ? ouzel::Layout::getRules(reflectionLayout) :
+                            (format == "hlsl" || format == "glsl" || format == "msl" || format == "cpp" || format == "bytecode") ?
+                            ouzel::getLayoutRules(getTarget(format), outputVersion) :
+                            ouzel::Layout::Rules::Packed;
+
+                        compiler.reflect(*context, getProgram(program), layoutRules, result);
+
+                        std::ofstream reflectionFile(reflectionFilename, std::ios::binary);
+
+                        if (!reflectionFile)
+                            throw std::runtime_error{"Failed to open file " + reflectionFilename};
+
+                        if (reflectionFormat == "json")
+                            reflectionFile << ouzel::Reflection::deserialize(result.reflection).getJson() << '\n';
+                        else
+                            reflectionFile.write(reinterpret_cast<const char*>(result.reflection.data()), static_cast<std::streamsize>(result.reflection.size()));
+                    }
 
-                    try
+                    if (printAST)
+                        context->dump();
+                    else if (format == "module")
                     {
-                        const std::string outCode = output->output(context, whitespaces);
+                        // the binary module is written to the output file, its symbols to the standard output
+                        phases.start();
+
+                        const ouzel::Module module(moduleTokens, compiler.getModuleLoader());
+                        const auto& data = module.serialize();
+
+                        phases.end("output module");
+                        result.statistics.outputSize = data.size();
 
                         if (outputFilename.empty())
-                            std::cout << outCode << '\n';
+                            std::cout << module.dump();
                         else
                         {
                             std::ofstream outputFile(outputFilename, std::ios::binary);
@@ -148,16 +752,73 @@ int main(int argc, const char* argv[])
                             if (!outputFile)
                                 throw std::runtime_error{"Failed to open file " + outputFilename};
 
-                            outputFile << outCode;
+                            outputFile.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
                         }
                     }
-                    catch (const std::exception& e)
+                    else
                     {
-                        throw std::runtime_error{std::string("Failed to output code: ") + e.what()};
+                        const auto target = getTarget(format);
+
+                        try
+                        {
+                            compiler.generate(*context, target, getProgram(program), result);
+                        }
+                        catch (const std::exception& e)
+                        {
+                            throw std::runtime_error{std::string("Failed to output code: ") + e.what()};
+                        }
+
+                        if (!nameMapFilename.empty())
+                        {
+                            std::ofstream nameMapFile(nameMapFilename, std::ios::binary);
+
+                            if (!nameMapFile)
+                                throw std::runtime_error{"Failed to open file " + nameMapFilename};
+
+                            nameMapFile << result.nameMap;
+                        }
+
+                        // the binary bytecode is written to the output file, the disassembly to the standard output
+                        if (target == ouzel::Target::Bytecode && outputFilename.empty())
+                            std::cout << ouzel::Bytecode::deserialize(std::vector<std::uint8_t>(result.output.begin(), result.output.end())).disassemble();
+                        else if (outputFilename.empty())
+                            std::cout << result.output << '\n';
+                        else
+                        {
+                            std::ofstream outputFile(outputFilename, std::ios::binary);
+
+                            if (!outputFile)
+                                throw std::runtime_error{"Failed to open file " + outputFilename};
+
+                            outputFile.write(result.output.data(), static_cast<std::streamsize>(result.output.size()));
+                        }
                     }
                 }
             }
         }
+
+        result.statistics.peakAllocationBytes = ouzel::AllocationTracker::getPeakBytes();
+
+        if (timePasses || printStatistics)
+            writeStatistics(result.statistics, timePasses, printStatistics,
+                            statisticsFormat, statisticsFilename);
+
+        if (activeTracer)
+        {
+            std::ofstream traceFile(traceFilename, std::ios::binary);
+
+            if (!traceFile)
+                throw std::runtime_error{"Failed to open file " + traceFilename};
+
+            traceFile << tracer.getJson();
+        }
+    }
+    catch (const DiagnosticsError& e)
+    {
+        // the JSON output is kept parseable
+        if (diagnosticsFormat != "json")
+            std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
     }
     catch (const std::exception& e)
     {
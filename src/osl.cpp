@@ -0,0 +1,201 @@
+//
+//  OSL
+//
+
+#include <exception>
+#include <string>
+#include <vector>
+#include "Compiler.hpp"
+#include "osl.h"
+
+struct OSLResult final
+{
+    ouzel::Compiler::Result result;
+    // the storage of the strings returned through the C interface
+    std::vector<std::string> codes;
+    std::string statistics;
+};
+
+struct OSLCompiler final
+{
+    ouzel::Compiler compiler;
+    OSLResult result;
+    std::string error;
+};
+
+namespace
+{
+    // exceptions must not leave the C interface
+    template <class Function>
+    int call(OSLCompiler* compiler, Function function) noexcept
+    {
+        if (!compiler) return -1;
+
+        try
+        {
+            compiler->error.clear();
+            function();
+            return 0;
+        }
+        catch (const std::exception& e)
+        {
+            compiler->error = e.what();
+        }
+        catch (...)
+        {
+            compiler->error = "Unknown error";
+        }
+
+        return -1;
+    }
+}
+
+extern "C"
+{
+    uint32_t oslGetApiVersion(void)
+    {
+        return OSL_API_VERSION;
+    }
+
+    OSLCompiler* oslCreateCompiler(void)
+    {
+        // the constructor of the compiler can throw too, which must not leave the C interface
+        try
+        {
+            return new OSLCompiler();
+        }
+        catch (...)
+        {
+            return nullptr;
+        }
+    }
+
+    void oslDestroyCompiler(OSLCompiler* compiler)
+    {
+        delete compiler;
+    }
+
+    const char* oslGetError(const OSLCompiler* compiler)
+    {
+        return compiler ? compiler->error.c_str() : "Invalid compiler";
+    }
+
+    int oslSetOption(OSLCompiler* compiler, uint32_t option, uint32_t value)
+    {
+        return call(compiler, [compiler, option, value]() {
+            auto& options = compiler->compiler.getOptions();
+
+            switch (option)
+            {
+                case OSL_OPTION_OPTIMIZE: options.optimize = value != 0; break;
+                case OSL_OPTION_INLINE_THRESHOLD: options.inlineThreshold = value; break;
+                case OSL_OPTION_MINIFY: options.minify = value != 0; break;
+                case OSL_OPTION_WHITESPACES: options.whitespaces = value != 0; break;
+                case OSL_OPTION_OUTPUT_VERSION: options.outputVersion = value; break;
+                case OSL_OPTION_PARSE_THREADS: options.parseThreads = value; break;
+                case OSL_OPTION_REFLECTION: options.reflection = value != 0; break;
+                default: throw std::runtime_error{"Invalid option"};
+            }
+        });
+    }
+
+    int oslSetDefine(OSLCompiler* compiler, const char* name, const char* value)
+    {
+        return call(compiler, [compiler, name, value]() {
+            if (!name || !*name) throw std::runtime_error{"Invalid define"};
+
+            auto& defines = compiler->compiler.getOptions().defines;
+            if (value)
+                defines[name] = value;
+            else
+                defines.erase(name);
+        });
+    }
+
+    int oslSetNamespace(OSLCompiler* compiler, const char* outputNamespace)
+    {
+        return call(compiler, [compiler, outputNamespace]() {
+            if (!outputNamespace) throw std::runtime_error{"Invalid namespace"};
+            compiler->compiler.getOptions().outputNamespace = outputNamespace;
+        });
+    }
+
+    int oslSetPrelude(OSLCompiler* compiler, const char* code, size_t size)
+    {
+        return call(compiler, [compiler, code, size]() {
+            if (!code && size) throw std::runtime_error{"Invalid prelude"};
+            compiler->compiler.setPrelude(code ? std::string(code, size) : std::string());
+        });
+    }
+
+    const OSLResult* oslCompile(OSLCompiler* compiler,
+                                const char* source, size_t size,
+                                uint32_t target, uint32_t program)
+    {
+        const auto status = call(compiler, [compiler, source, size, target, program]() {
+            if (!source && size) throw std::runtime_error{"Invalid source"};
+            if (target > OSL_TARGET_BYTECODE) throw std::runtime_error{"Invalid target"};
+            if (program != OSL_PROGRAM_FRAGMENT && program != OSL_PROGRAM_VERTEX) throw std::runtime_error{"Invalid program"};
+
+            auto& result = compiler->result;
+            result.codes.clear();
+            result.statistics.clear();
+
+            compiler->compiler.compile(source ? std::string(source, size) : std::string(),
+                                       static_cast<ouzel::Target>(target),
+                                       program == OSL_PROGRAM_FRAGMENT ? ouzel::Program::Fragment : ouzel::Program::Vertex,
+                                       result.result);
+
+            for (const auto& diagnostic : result.result.diagnostics)
+                result.codes.push_back(toString(diagnostic.errorCode));
+
+            result.statistics = result.result.statistics.getJson();
+        });
+
+        return status == 0 ? &compiler->result : nullptr;
+    }
+
+    int oslGetResultSuccess(const OSLResult* result)
+    {
+        return (result && result->result.success) ? 1 : 0;
+    }
+
+    const char* oslGetResultOutput(const OSLResult* result, size_t* size)
+    {
+        if (!result) return nullptr;
+        if (size) *size = result->result.output.size();
+        return result->result.output.c_str();
+    }
+
+    size_t oslGetDiagnosticCount(const OSLResult* result)
+    {
+        return result ? result->codes.size() : 0;
+    }
+
+    int oslGetDiagnostic(const OSLResult* result, size_t index, OSLDiagnostic* diagnostic)
+    {
+        if (!result || !diagnostic || index >= result->codes.size())
+            return -1;
+
+        const auto& source = result->result.diagnostics[index];
+        diagnostic->code = result->codes[index].c_str();
+        diagnostic->message = source.message.c_str();
+        diagnostic->line = source.line;
+        diagnostic->column = source.column;
+        diagnostic->endLine = source.endLine;
+        diagnostic->endColumn = source.endColumn;
+        return 0;
+    }
+
+    const char* oslGetStatisticsJson(const OSLResult* result)
+    {
+        return result ? result->statistics.c_str() : nullptr;
+    }
+
+    const uint8_t* oslGetResultReflection(const OSLResult* result, size_t* size)
+    {
+        if (!result) return nullptr;
+        if (size) *size = result->result.reflection.size();
+        return result->result.reflection.data();
+    }
+}
@@ -2,9 +2,38 @@
 //  OSL
 //
 
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <type_traits>
 #include "catch2/catch.hpp"
+#include "AsyncCompiler.hpp"
+#include "CommonSubexpressionEliminator.hpp"
+#include "Compiler.hpp"
+#include "ConstantFolder.hpp"
+#include "DeadCodeEliminator.hpp"
+#include "Diagnostics.hpp"
+#include "FileWatcher.hpp"
+#include "Inliner.hpp"
+#include "Layout.hpp"
+#include "BytecodeCompiler.hpp"
+#include "Interpreter.hpp"
+#include "SimdInterpreter.hpp"
+#include "VirtualMachine.hpp"
+#include "Minifier.hpp"
+#include "Module.hpp"
 #include "Parser.hpp"
+#include "Preprocessor.hpp"
+#include "Reflection.hpp"
+#include "Statistics.hpp"
+#include "Trace.hpp"
+#include "OutputGLSL.hpp"
+#include "OutputHLSL.hpp"
+#include "OutputCPP.hpp"
+#include "VariantCompiler.hpp"
+#include "osl.h"
+#include "../bench/ShaderGenerator.hpp"
 
 namespace
 {
@@ -628,3 +657,1578 @@ TEST_CASE("Extern", "[extern]")
     REQUIRE(colorVariableDeclaration->name == "color");
     REQUIRE(colorVariableDeclaration->storageClass == ouzel::StorageClass::Extern);
 }
+
+TEST_CASE("Statistics", "[statistics]")
+{
+    std::string code = R"OSL(
+    function main():void
+    {
+        var i:int = 3;
+    }
+    )OSL";
+
+    const auto tokens = ouzel::tokenize(code);
+    ouzel::Context context(tokens);
+
+    ouzel::Statistics statistics;
+    statistics.tokenCount = tokens.size();
+    statistics.addContext(context);
+    statistics.addPhase("parse", std::chrono::milliseconds(1), 2, 64);
+    statistics.addPhase("parse", std::chrono::milliseconds(2), 3, 32);
+
+    REQUIRE(statistics.getPhases().size() == 1);
+    REQUIRE(statistics.getPhases()[0].duration == std::chrono::milliseconds(3));
+    REQUIRE(statistics.getPhases()[0].allocatedBytes == 96);
+    REQUIRE(statistics.getAllocationCount() == 5);
+    REQUIRE(statistics.getConstructCount() == context.getConstructs().size());
+    REQUIRE(statistics.getConstructCount(ouzel::Construct::Kind::Statement) == 2);
+    REQUIRE(statistics.getConstructCount(ouzel::Construct::Kind::Expression) == 1);
+    REQUIRE(statistics.typeCount == context.getTypes().size());
+
+    const auto json = statistics.getJson();
+    REQUIRE(json.find("\"phases\":[{\"name\":\"parse\",\"milliseconds\":3.000,\"allocations\":5,\"allocatedBytes\":96}]") != std::string::npos);
+    REQUIRE(json.find("\"tokens\":" + std::to_string(tokens.size())) != std::string::npos);
+}
+
+TEST_CASE("Trace", "[trace]")
+{
+    std::string code = R"OSL(
+    function helper():float
+    {
+        return 1.0f;
+    }
+    function main():float
+    {
+        return helper();
+    }
+    )OSL";
+
+    ouzel::Tracer tracer;
+    ouzel::Context context(ouzel::tokenize(code), &tracer);
+
+    const auto events = tracer.getEvents();
+    REQUIRE(events.size() == 3);
+    REQUIRE(events[0].name == "helper");
+    REQUIRE(events[0].category == "parse");
+    REQUIRE(events[1].name == "helper");
+    REQUIRE(events[1].category == "resolve");
+    REQUIRE(events[2].name == "main");
+    REQUIRE(events[2].category == "parse");
+    REQUIRE(events[2].threadId == 0);
+
+    const auto json = tracer.getJson();
+    REQUIRE(json.find("\"name\":\"main\",\"cat\":\"parse\",\"ph\":\"X\"") != std::string::npos);
+}
+
+TEST_CASE("ShaderGenerator", "[shader_generator]")
+{
+    ouzel::ShaderGenerator::Options options;
+    options.structCount = 2;
+    options.functionCount = 4;
+    options.statementCount = 3;
+    options.expressionDepth = 3;
+
+    ouzel::ShaderGenerator generator(options);
+    const auto code = generator.generate();
+
+    ouzel::ShaderGenerator sameGenerator(options);
+    REQUIRE(sameGenerator.generate() == code);
+
+    options.seed = 2;
+    ouzel::ShaderGenerator otherGenerator(options);
+    REQUIRE(otherGenerator.generate() != code);
+
+    ouzel::Context context(ouzel::tokenize(code));
+    REQUIRE(context.getDeclarations().size() == 2 + 4 * 3 + 1);
+
+    ouzel::OutputHLSL output(ouzel::Program::Fragment);
+    REQUIRE_FALSE(output.output(context, false).empty());
+}
+
+TEST_CASE("ParallelParse", "[parallel_parse]")
+{
+    ouzel::ShaderGenerator::Options options;
+    options.functionCount = 8;
+
+    ouzel::ShaderGenerator generator(options);
+    const auto tokens = ouzel::tokenize(generator.generate() +
+                                        "var values = {1.0f, 2.0f};\n"
+                                        "function last(index:int):float { var copy = {1.0f, 2.0f}; return copy[index] + values[index]; }\n");
+
+    ouzel::Context context(tokens);
+    ouzel::OutputHLSL output(ouzel::Program::Fragment);
+    const auto expected = output.output(context, true);
+
+    // the result does not depend on the number of threads
+    for (const std::size_t threadCount : {1, 3, 8})
+    {
+        ouzel::Context parallelContext(tokens, nullptr, threadCount);
+        REQUIRE(output.output(parallelContext, true) == expected);
+        REQUIRE(parallelContext.getConstructs().size() == context.getConstructs().size());
+    }
+
+    // the first error in the code is reported
+    const std::string code = R"OSL(
+    function first():float { return 1; }
+    function second():float { return 2.0f; }
+    var x
+    )OSL";
+
+    REQUIRE_THROWS_WITH(ouzel::Context(ouzel::tokenize(code), nullptr, 2), "Wrong type in return statement");
+    REQUIRE_THROWS_WITH(ouzel::Context(ouzel::tokenize(code.substr(code.find("function second"))), nullptr, 2),
+                        "Missing type for the variable");
+}
+
+TEST_CASE("ErrorRecovery", "[error_recovery]")
+{
+    std::string code = R"OSL(
+    function first():float
+    {
+        var a = 1.0f;
+        a = a + ;
+        return a;
+    }
+    var broken = ;
+    function second(v:float):float
+    {
+        if (v > 0.0f)
+        {
+            v = missing;
+        }
+        return v * 2.0f;
+    }
+    function third():int
+    {
+        return 1.0f;
+    }
+    fragment main():float4
+    {
+        return float4(second(first()), 0.0f, 0.0f, 1.0f);
+    }
+    )OSL";
+
+    const auto tokens = ouzel::tokenize(code);
+    REQUIRE_THROWS_AS(ouzel::Context(tokens), ouzel::ParseError);
+
+    // parsing continues after each error
+    std::vector<ouzel::Diagnostic> diagnostics;
+    ouzel::Context context(tokens, diagnostics);
+
+    REQUIRE(diagnostics.size() == 4);
+    REQUIRE(diagnostics[0].errorCode == ouzel::ErrorCode::ExpressionExpected);
+    REQUIRE(diagnostics[0].line == 5);
+    REQUIRE(diagnostics[0].column == 17);
+    REQUIRE(diagnostics[1].line == 8);
+    REQUIRE(diagnostics[2].errorCode == ouzel::ErrorCode::InvalidDeclarationReference);
+    REQUIRE(diagnostics[2].line == 13);
+    REQUIRE(diagnostics[3].errorCode == ouzel::ErrorCode::WrongTypeInReturn);
+
+    // the partial AST has the declarations that could be parsed
+    REQUIRE(context.getDeclarations().size() == 3);
+    REQUIRE(context.getDeclarations().back()->name == "main");
+
+    std::vector<ouzel::Diagnostic> parallelDiagnostics;
+    ouzel::Context parallelContext(tokens, parallelDiagnostics, nullptr, 2);
+    REQUIRE(parallelDiagnostics.size() == diagnostics.size());
+    for (std::size_t i = 0; i < diagnostics.size(); ++i)
+        REQUIRE(parallelDiagnostics[i].message == diagnostics[i].message);
+
+    // the end of the file is reported once
+    diagnostics.clear();
+    ouzel::Context unterminatedContext(ouzel::tokenize("function f():void { var a = 1"), diagnostics);
+    REQUIRE(diagnostics.size() == 1);
+    REQUIRE(diagnostics[0].errorCode == ouzel::ErrorCode::UnexpectedEndOfFile);
+
+    // a declaration that failed after it was declared is still referenced by the bodies parsed on the threads
+    const auto failedTokens = ouzel::tokenize("function f():float\nfunction g():float { return f(); }");
+    diagnostics.clear();
+    ouzel::Context failedContext(failedTokens, diagnostics);
+    parallelDiagnostics.clear();
+    ouzel::Context parallelFailedContext(failedTokens, parallelDiagnostics, nullptr, 2);
+    REQUIRE(parallelDiagnostics.size() == 1);
+    REQUIRE(parallelDiagnostics[0].message == diagnostics[0].message);
+    REQUIRE(parallelFailedContext.getDeclarations().size() == 1);
+    REQUIRE(parallelFailedContext.getConstructs().size() == failedContext.getConstructs().size());
+}
+
+TEST_CASE("Diagnostics", "[diagnostics]")
+{
+    // the tokenizer errors have the position of the invalid token
+    try
+    {
+        (void)ouzel::tokenize("var a = 1;\n  var b = 2.0e;");
+        FAIL("Expected an exception");
+    }
+    catch (const ouzel::SourceError& e)
+    {
+        REQUIRE(std::string(e.what()) == "Invalid exponent");
+        REQUIRE(e.getLine() == 2);
+        REQUIRE(e.getColumn() == 11);
+    }
+
+    REQUIRE_THROWS_AS(ouzel::tokenize("var a = 1 @ 2;"), std::runtime_error);
+
+    // the preprocessor errors have the line of the directive or the start of the comment
+    try
+    {
+        (void)ouzel::Preprocessor().preprocess("var a = 1;\n\n  #else\n");
+        FAIL("Expected an exception");
+    }
+    catch (const ouzel::SourceError& e)
+    {
+        REQUIRE(e.getLine() == 3);
+        REQUIRE(e.getColumn() == 3);
+    }
+
+    try
+    {
+        (void)ouzel::Preprocessor().preprocess("var a = 1; // /*\n var b /* = 2;\n");
+        FAIL("Expected an exception");
+    }
+    catch (const ouzel::SourceError& e)
+    {
+        REQUIRE(std::string(e.what()) == "Unterminated block comment");
+        REQUIRE(e.getLine() == 2);
+        REQUIRE(e.getColumn() == 8);
+    }
+
+    // the parse errors span the token they were found at
+    std::vector<ouzel::Diagnostic> diagnostics;
+    ouzel::Context context(ouzel::tokenize("function f():float\n{\n    var a = else;\n    return 1.0f;\n}"), diagnostics);
+    REQUIRE(diagnostics.size() == 1);
+    REQUIRE(diagnostics[0].line == 3);
+    REQUIRE(diagnostics[0].column == 13);
+    REQUIRE(diagnostics[0].endLine == 3);
+    REQUIRE(diagnostics[0].endColumn == 17);
+
+    diagnostics.push_back(ouzel::getDiagnostic(ouzel::ErrorCode::InvalidToken, ouzel::SourceError{"Unknown \"character\"", 4, 2}));
+
+    REQUIRE(ouzel::getDiagnosticsText("a.osl", diagnostics) ==
+            "a.osl:3:13: " + diagnostics[0].message + "\n"
+            "a.osl:4:2: Unknown \"character\"\n");
+
+    REQUIRE(ouzel::getDiagnosticsJson("a.osl", diagnostics) ==
+            "{\"diagnostics\":["
+            "{\"file\":\"a.osl\",\"severity\":\"error\",\"code\":\"ExpressionExpected\","
+            "\"message\":\"" + diagnostics[0].message + "\","
+            "\"range\":{\"start\":{\"line\":3,\"column\":13},\"end\":{\"line\":3,\"column\":17}}},"
+            "{\"file\":\"a.osl\",\"severity\":\"error\",\"code\":\"InvalidToken\","
+            "\"message\":\"Unknown \\\"character\\\"\","
+            "\"range\":{\"start\":{\"line\":4,\"column\":2},\"end\":{\"line\":4,\"column\":3}}}]}");
+
+    // the errors found after the tokens they are about are reported at those tokens
+    const auto getDiagnostics = [](const std::string& code) {
+        std::vector<ouzel::Diagnostic> result;
+        const ouzel::Context errorContext(ouzel::tokenize(ouzel::Preprocessor().preprocess(code)), result);
+        return result;
+    };
+
+    const auto expectRange = [](const std::vector<ouzel::Diagnostic>& result, std::uint32_t line,
+                                std::uint32_t column, std::uint32_t endColumn) {
+        REQUIRE(result.size() == 1);
+        REQUIRE(result[0].line == line);
+        REQUIRE(result[0].column == column);
+        REQUIRE(result[0].endLine == line);
+        REQUIRE(result[0].endColumn == endColumn);
+    };
+
+    expectRange(getDiagnostics("const a = !0.0f;"), 1, 11, 12);
+    expectRange(getDiagnostics("var b:bool = 1.0f + 2.0f;"), 1, 14, 25);
+    expectRange(getDiagnostics("function g():int { return 1.0f; }"), 1, 20, 26);
+
+    // the comments keep the columns of the tokens after them
+    expectRange(getDiagnostics("function h():float\n{\n    /* a fairly long comment */ return bogus;\n}"), 3, 40, 45);
+    expectRange(getDiagnostics("// comment\nvar c = /* a\ncomment */ d;"), 3, 12, 13);
+}
+
+TEST_CASE("ConstantFolding", "[constant_folding]")
+{
+    std::string code = R"OSL(
+    function main():void
+    {
+        (1 + 2) * -3;
+        var v = float4(1.0f, 2.0f, 3.0f, 4.0f).zw * float2(2.0f, 0.5f);
+        var b = 1.5f < 2.0f && !(2 == 3);
+        var i = 7 / 0;
+    }
+    )OSL";
+
+    ouzel::Context context(ouzel::tokenize(code));
+    ouzel::ConstantFolder constantFolder(context);
+    constantFolder.transform();
+
+    REQUIRE(constantFolder.getFoldedCount() > 0);
+    expectLiteral(&getMainExpression(context), -9);
+
+    auto mainCompoundStatement = getMainBody(context);
+    REQUIRE(mainCompoundStatement->statements.size() == 4);
+
+    const auto getInitialization = [&mainCompoundStatement](std::size_t index) {
+        const ouzel::Statement& statement = mainCompoundStatement->statements[index];
+        REQUIRE(statement.statementKind == ouzel::Statement::Kind::Declaration);
+        auto& declaration = static_cast<const ouzel::DeclarationStatement&>(statement).declaration;
+        return static_cast<const ouzel::VariableDeclaration&>(declaration).initialization;
+    };
+
+    const auto v = getInitialization(1);
+    REQUIRE(v->expressionKind == ouzel::Expression::Kind::VectorInitialize);
+    auto& vectorInitializeExpression = static_cast<const ouzel::VectorInitializeExpression&>(*v);
+    REQUIRE(vectorInitializeExpression.parameters.size() == 2);
+    expectLiteral(&vectorInitializeExpression.parameters[0].get(), 6.0);
+    expectLiteral(&vectorInitializeExpression.parameters[1].get(), 2.0);
+
+    expectLiteral(getInitialization(2), true);
+
+    // division by zero is left for the target compiler to report
+    REQUIRE(getInitialization(3)->expressionKind == ouzel::Expression::Kind::BinaryOperator);
+
+    ouzel::OutputHLSL output(ouzel::Program::Fragment);
+    REQUIRE(output.output(context, false).find("(-9)") != std::string::npos);
+}
+
+TEST_CASE("ExpressionNotConst", "[expression_not_const]")
+{
+    std::string constantCode = R"OSL(
+    const scale = 2.0f * 0.5f;
+    const size:int = 4 / 2;
+    function main():void
+    {
+        var i = 1;
+        switch (i)
+        {
+            case size + 1: break;
+        }
+    }
+    )OSL";
+
+    REQUIRE_NOTHROW(ouzel::Context(ouzel::tokenize(constantCode)));
+
+    std::string caseCode = R"OSL(
+    function main():void
+    {
+        var i = 1;
+        switch (i)
+        {
+            case i: break;
+        }
+    }
+    )OSL";
+
+    REQUIRE_THROWS_AS(ouzel::Context(ouzel::tokenize(caseCode)), ouzel::ParseError);
+
+    std::string globalCode = R"OSL(
+    extern color:float4;
+    const alpha = color.w;
+    )OSL";
+
+    REQUIRE_THROWS_AS(ouzel::Context(ouzel::tokenize(globalCode)), ouzel::ParseError);
+}
+
+TEST_CASE("DeadCodeElimination", "[dead_code_elimination]")
+{
+    std::string code = R"OSL(
+    struct Used
+    {
+        var a:float;
+    }
+    struct Unused
+    {
+        var b:float;
+    }
+    extern color:float4;
+    extern unusedColor:float4;
+    function helper(u:Used):float;
+    function unused():float
+    {
+        return 1.0f;
+    }
+    function helper(u:Used):float
+    {
+        return u.a;
+    }
+    vertex vertexMain():float4
+    {
+        return unusedColor;
+    }
+    fragment main():float4
+    {
+        var u:Used;
+        if (1 > 2) unused();
+        return color * helper(u);
+        unused();
+        discard();
+    }
+    )OSL";
+
+    ouzel::Context context(ouzel::tokenize(code));
+    ouzel::DeadCodeEliminator deadCodeEliminator(context, ouzel::Program::Fragment);
+    deadCodeEliminator.transform();
+
+    std::vector<std::string> names;
+    for (const auto declaration : context.getDeclarations())
+        names.push_back(declaration->name);
+
+    REQUIRE(names == std::vector<std::string>{"Used", "color", "helper", "helper", "main"});
+    REQUIRE(deadCodeEliminator.getRemovedDeclarationCount() == 4);
+    REQUIRE(deadCodeEliminator.getRemovedStatementCount() == 3);
+
+    auto mainDeclaration = static_cast<const ouzel::CallableDeclaration*>(context.getDeclarations().back());
+    auto& body = static_cast<const ouzel::CompoundStatement&>(*mainDeclaration->body);
+    REQUIRE(body.statements.size() == 3);
+    REQUIRE(body.statements[1].get().statementKind == ouzel::Statement::Kind::Empty);
+    REQUIRE(body.statements[2].get().statementKind == ouzel::Statement::Kind::Return);
+}
+
+TEST_CASE("Inlining", "[inlining]")
+{
+    std::string code = R"OSL(
+    function square(x:float):float
+    {
+        return x * x;
+    }
+    function swap(inout a:float, out b:float):void
+    {
+        b = a;
+        a = 2.0f;
+    }
+    function clamped(x:float):float
+    {
+        if (x > 1.0f) return 1.0f;
+        return x;
+    }
+    fragment main():float4
+    {
+        var x = square(2.0f);
+        var y:float;
+        swap(x, y);
+        while (square(x) > 1.0f) x = x - 1.0f;
+        return float4(clamped(x), y, 0.0f, 1.0f);
+    }
+    )OSL";
+
+    ouzel::Context context(ouzel::tokenize(code));
+    ouzel::Inliner inliner(context);
+    inliner.transform();
+
+    std::vector<std::string> names;
+    for (const auto& inlinedCall : inliner.getInlinedCalls())
+    {
+        REQUIRE(inlinedCall.caller == "main");
+        names.push_back(inlinedCall.function);
+    }
+
+    // calls in loop conditions and functions with an early return are not inlined
+    REQUIRE(names == std::vector<std::string>{"square", "swap"});
+
+    auto mainDeclaration = static_cast<const ouzel::CallableDeclaration*>(context.getDeclarations().back());
+    auto& body = static_cast<const ouzel::CompoundStatement&>(*mainDeclaration->body);
+    REQUIRE(body.statements.size() == 13);
+    REQUIRE(body.statements[12].get().statementKind == ouzel::Statement::Kind::Return);
+}
+
+TEST_CASE("CommonSubexpressionElimination", "[common_subexpression_elimination]")
+{
+    std::string code = R"OSL(
+    extern scale:float;
+    fragment main(uv:float2):float4
+    {
+        var v = float4(uv, 0.0f, 1.0f);
+        var a = uv.x * scale + (uv.x * scale);
+        uv = uv * 2.0f;
+        var b = uv.x * scale;
+        return float4(a, b, v.xyzw.zy.y, 1.0f);
+    }
+    )OSL";
+
+    ouzel::Context context(ouzel::tokenize(code));
+    ouzel::CommonSubexpressionEliminator commonSubexpressionEliminator(context);
+    commonSubexpressionEliminator.transform();
+
+    // the assignment to uv makes the last multiplication different
+    REQUIRE(commonSubexpressionEliminator.getTemporaryCount() == 1);
+    REQUIRE(commonSubexpressionEliminator.getEliminatedCount() == 1);
+    REQUIRE(commonSubexpressionEliminator.getCollapsedSwizzleCount() == 2);
+
+    auto mainDeclaration = static_cast<const ouzel::CallableDeclaration*>(context.getDeclarations().back());
+    auto& body = static_cast<const ouzel::CompoundStatement&>(*mainDeclaration->body);
+    REQUIRE(body.statements.size() == 6);
+
+    auto& temporary = static_cast<const ouzel::DeclarationStatement&>(body.statements[1].get()).declaration;
+    REQUIRE(temporary.name == "temporary_1");
+
+    auto& returnStatement = static_cast<const ouzel::ReturnStatement&>(body.statements[5].get());
+    auto& result = static_cast<const ouzel::VectorInitializeExpression&>(*returnStatement.result);
+    auto& element = static_cast<const ouzel::VectorElementExpression&>(result.parameters[2].get());
+    REQUIRE(element.positions == std::vector<std::uint8_t>{1});
+    REQUIRE(element.expression.expressionKind == ouzel::Expression::Kind::DeclarationReference);
+}
+
+TEST_CASE("Minify", "[minify]")
+{
+    std::string code = R"OSL(
+    struct Input
+    {
+        var uv:float2;
+    }
+    struct Light
+    {
+        var color:float4;
+    }
+    extern scale:float;
+    function shade(light:Light, factor:float):float4
+    {
+        var result = light.color * factor;
+        return result;
+    }
+    fragment main(input:Input):float4
+    {
+        var light:Light;
+        light.color = float4(input.uv, 0.0f, 1.0f);
+        return shade(light, scale);
+    }
+    )OSL";
+
+    ouzel::Context context(ouzel::tokenize(code));
+    ouzel::Minifier minifier(context);
+    ouzel::OutputHLSL output(ouzel::Program::Fragment, &minifier);
+
+    // the entry point, its parameters, the structs they use and the externs keep their names
+    REQUIRE(output.output(context, false) ==
+            "struct Input{float2 uv;};"
+            "struct b{float4 a;};"
+            "cbuffer Uniforms{float scale:packoffset(c0);};"
+            "float4 a(b c,float d){float4 e=c.a*d;return e;}"
+            "float4 main(Input input){b c;c.a=float4(input.uv,0.0,1.0);return a(c,scale);}");
+}
+
+TEST_CASE("OutputCPP", "[output_cpp]")
+{
+    std::string code = R"OSL(
+    extern scale:float;
+    function split(v:float4, out low:float2):float
+    {
+        low = v.xy;
+        return v.z;
+    }
+    fragment main(uv:float2):float4
+    {
+        var count = 2;
+        count += 1;
+        var color = float4(uv, 0.0f, 1.0f);
+        color.zw = color.xy * scale;
+        var low:float2;
+        var depth = split(color, low);
+        if (depth < 0.0f) discard();
+        return color * float(count);
+    }
+    )OSL";
+
+    ouzel::Context context(ouzel::tokenize(code));
+    ouzel::OutputCPP output(ouzel::Program::Fragment);
+    const auto result = output.output(context, false);
+
+    // the types come first, followed by the shader in its namespace
+    REQUIRE(result.find("#ifndef OSL_CPP_TYPES") == 0);
+    REQUIRE(result.substr(result.find("namespace shader")) ==
+            "namespace shader{"
+            "inline float scale{};"
+            "inline float split(osl::float4 v,osl::float2& low){low=osl::float2{};low=osl::swizzle<0,1>(v);return v[2];}"
+            "inline osl::float4 main(osl::float2 uv){int count=2;osl::addAssign(count,1);"
+            "osl::float4 color=osl::float4(uv,0.0f,1.0f);"
+            "osl::swizzleReference<2,3>(color)=osl::swizzle<0,1>(color)*scale;"
+            "osl::float2 low{};float depth=split(color,low);"
+            "if(depth<0.0f){osl::discarded=true;return {};}"
+            "return color*osl::convert<float>(count);}"
+            "inline bool run(osl::float2 uv,osl::float4& result){osl::discarded=false;"
+            "try{result=main(uv);}catch(const osl::Discard&){return false;}return !osl::discarded;}"
+            "}");
+
+    // negative case labels use the constexpr helpers and an intended fall-through is marked
+    std::string switchCode = R"OSL(
+    fragment main(uv:float2):float4
+    {
+        var count = int(uv.x);
+        switch (count)
+        {
+            case -4: count = 1;
+            case 2: count += 1; break;
+            default: count = 0;
+        }
+        return float4(uv, float(count), 1.0f);
+    }
+    )OSL";
+
+    ouzel::Context switchContext(ouzel::tokenize(switchCode));
+    const auto switchResult = output.output(switchContext, false);
+    REQUIRE(switchResult.find("case osl::negate(4):") != std::string::npos);
+    REQUIRE(switchResult.find("[[fallthrough]];case 2:") != std::string::npos);
+    REQUIRE(switchResult.find("break;default:") != std::string::npos);
+}
+
+TEST_CASE("Compiler", "[compiler]")
+{
+    std::string code = R"OSL(
+    fragment main():float4
+    {
+        return float4(scale(0.5f), 0.0f, 0.0f, 1.0f);
+    }
+    )OSL";
+
+    ouzel::Compiler compiler;
+    compiler.setPrelude("function scale(v:float):float { return v * 2.0f; }");
+    REQUIRE_THROWS_AS(compiler.setPrelude("var broken = ;"), ouzel::ParseError);
+
+    const auto result = compiler.compile(code, ouzel::Target::HLSL, ouzel::Program::Fragment);
+    REQUIRE(result.success);
+    REQUIRE(result.diagnostics.empty());
+    REQUIRE(result.output.find("scale") != std::string::npos);
+    REQUIRE(result.statistics.tokenCount > 0);
+
+    // the same result is reused and the prelude is kept
+    ouzel::Compiler::Result reused;
+    compiler.getOptions().optimize = true;
+    compiler.compile(code, ouzel::Target::GLSL, ouzel::Program::Fragment, reused);
+    REQUIRE(reused.success);
+    compiler.compile("fragment main():float4 { return missing; }", ouzel::Target::GLSL, ouzel::Program::Fragment, reused);
+    REQUIRE(!reused.success);
+    REQUIRE(reused.output.empty());
+    REQUIRE(reused.diagnostics.size() == 1);
+
+    compiler.compile("var a = 1 @ 2;", ouzel::Target::GLSL, ouzel::Program::Fragment, reused);
+    REQUIRE(reused.diagnostics.size() == 1);
+    REQUIRE(reused.diagnostics[0].errorCode == ouzel::ErrorCode::InvalidToken);
+
+    // without optimizing the context of the previous source is updated and the output is written to the same storage
+    compiler.getOptions().optimize = false;
+    compiler.compile(code, ouzel::Target::HLSL, ouzel::Program::Fragment, reused);
+    REQUIRE(reused.success);
+    REQUIRE(compiler.isCached(std::string()));
+    const auto outputData = reused.output.data();
+    compiler.compile(code, ouzel::Target::HLSL, ouzel::Program::Fragment, reused);
+    REQUIRE(reused.output == result.output);
+    REQUIRE(reused.output.data() == outputData);
+
+    std::vector<std::string> phaseNames;
+    for (const auto& phase : reused.statistics.getPhases())
+        phaseNames.push_back(phase.name);
+    REQUIRE(phaseNames == std::vector<std::string>{"preprocess", "tokenize", "import", "parse", "output hlsl"});
+
+    // the C interface
+    REQUIRE(oslGetApiVersion() == OSL_API_VERSION);
+
+    OSLCompiler* const cCompiler = oslCreateCompiler();
+    REQUIRE(cCompiler);
+    REQUIRE(oslSetOption(cCompiler, OSL_OPTION_OPTIMIZE, 1) == 0);
+    REQUIRE(oslSetOption(cCompiler, 100, 1) == -1);
+    REQUIRE(std::string(oslGetError(cCompiler)) == "Invalid option");
+    REQUIRE(oslSetDefine(cCompiler, "SCALE", "0.5f") == 0);
+    REQUIRE(oslSetPrelude(cCompiler, "function scale(v:float):float { return v * 2.0f; }", 50) == 0);
+
+    const std::string cCode = "fragment main():float4 { return float4(scale(SCALE), 0.0f, 0.0f, 1.0f); }";
+    const OSLResult* cResult = oslCompile(cCompiler, cCode.data(), cCode.size(), OSL_TARGET_HLSL, OSL_PROGRAM_FRAGMENT);
+    REQUIRE(cResult);
+    REQUIRE(oslGetResultSuccess(cResult) == 1);
+    ouzel::Compiler::Options options;
+    options.optimize = true;
+    options.defines["SCALE"] = "0.5f";
+    ouzel::Compiler reference(options);
+    reference.setPrelude("function scale(v:float):float { return v * 2.0f; }");
+    const auto referenceOutput = reference.compile(cCode, ouzel::Target::HLSL, ouzel::Program::Fragment).output;
+
+    std::size_t size = 0;
+    REQUIRE(std::string(oslGetResultOutput(cResult, &size)) == referenceOutput);
+    REQUIRE(size == referenceOutput.size());
+    REQUIRE(std::string(oslGetStatisticsJson(cResult)).find("\"phases\"") != std::string::npos);
+
+    const std::string brokenCode = "fragment main():float4\n{\n    return missing;\n}";
+    cResult = oslCompile(cCompiler, brokenCode.data(), brokenCode.size(), OSL_TARGET_GLSL, OSL_PROGRAM_FRAGMENT);
+    REQUIRE(cResult);
+    REQUIRE(oslGetResultSuccess(cResult) == 0);
+    REQUIRE(oslGetDiagnosticCount(cResult) == 1);
+    OSLDiagnostic diagnostic;
+    REQUIRE(oslGetDiagnostic(cResult, 0, &diagnostic) == 0);
+    REQUIRE(std::string(diagnostic.code) == "InvalidDeclarationReference");
+    REQUIRE(diagnostic.line == 3);
+    REQUIRE(oslGetDiagnostic(cResult, 1, &diagnostic) == -1);
+
+    REQUIRE(!oslCompile(cCompiler, cCode.data(), cCode.size(), 100, OSL_PROGRAM_FRAGMENT));
+    REQUIRE(std::string(oslGetError(cCompiler)) == "Invalid target");
+    REQUIRE(!oslCompile(cCompiler, cCode.data(), cCode.size(), OSL_TARGET_HLSL, 9));
+    REQUIRE(std::string(oslGetError(cCompiler)) == "Invalid program");
+
+    oslDestroyCompiler(cCompiler);
+}
+
+TEST_CASE("Watch", "[watch]")
+{
+    const std::string first = R"OSL(
+    function scale(v:float):float { return v * 2.0f; }
+    fragment main():float4 { return float4(scale(1.0f), 0.0f, 0.0f, 1.0f); }
+    )OSL";
+    const std::string second = R"OSL(
+    function scale(v:float):float { return v * 3.0f; }
+    fragment main():float4 { return float4(scale(1.0f), 0.0f, 0.0f, 1.0f); }
+    )OSL";
+
+    // the named sources keep their contexts and give the same output as a full compilation
+    ouzel::Compiler compiler;
+    ouzel::Compiler::Result result;
+    REQUIRE(!compiler.isCached("a.osl"));
+    compiler.compile("a.osl", first, ouzel::Target::HLSL, ouzel::Program::Fragment, result);
+    REQUIRE(result.success);
+    REQUIRE(compiler.isCached("a.osl"));
+
+    compiler.compile("a.osl", second, ouzel::Target::HLSL, ouzel::Program::Fragment, result);
+    REQUIRE(result.success);
+    REQUIRE(result.output == compiler.compile(second, ouzel::Target::HLSL, ouzel::Program::Fragment).output);
+
+    // a failed update keeps the last context
+    compiler.compile("a.osl", "function scale(v:float):float { return x; }", ouzel::Target::HLSL, ouzel::Program::Fragment, result);
+    REQUIRE(!result.success);
+    REQUIRE(result.diagnostics.size() == 1);
+    REQUIRE(compiler.isCached("a.osl"));
+    compiler.compile("a.osl", first, ouzel::Target::HLSL, ouzel::Program::Fragment, result);
+    REQUIRE(result.output == compiler.compile(first, ouzel::Target::HLSL, ouzel::Program::Fragment).output);
+
+    compiler.removeCached("a.osl");
+    REQUIRE(!compiler.isCached("a.osl"));
+
+#ifdef __linux__
+    const auto directory = std::filesystem::temp_directory_path() / ("osl_watch_" + std::to_string(std::rand()));
+    std::filesystem::create_directories(directory);
+    {
+        ouzel::FileWatcher watcher(directory.string());
+        REQUIRE(watcher.wait(std::chrono::milliseconds(0)).empty());
+
+        std::filesystem::create_directory(directory / "sub");
+        REQUIRE(watcher.wait(std::chrono::milliseconds(1000)).empty());
+
+        std::ofstream(directory / "sub" / "b.osl") << first;
+        std::ofstream(directory / "a.osl") << first;
+
+        const auto changes = watcher.wait(std::chrono::milliseconds(1000));
+        REQUIRE(changes.size() == 2);
+        REQUIRE(changes[0].path == (directory / "a.osl").string());
+        REQUIRE(!changes[0].removed);
+        REQUIRE(changes[1].path == (directory / "sub" / "b.osl").string());
+
+        std::filesystem::remove(directory / "a.osl");
+        const auto removals = watcher.wait(std::chrono::milliseconds(1000));
+        REQUIRE(removals.size() == 1);
+        REQUIRE(removals[0].removed);
+    }
+    std::filesystem::remove_all(directory);
+#endif
+}
+
+TEST_CASE("AsyncCompiler", "[async_compiler]")
+{
+    // the tasks submitted from the tasks run too and the remaining tasks run before the pool is destroyed
+    std::atomic<std::size_t> count{0};
+    {
+        ouzel::ThreadPool pool(3);
+        REQUIRE(pool.getThreadCount() == 3);
+
+        for (std::size_t i = 0; i < 100; ++i)
+            pool.submit([&pool, &count](std::size_t) {
+                ++count;
+                pool.submit([&count](std::size_t index) { if (index < 3) ++count; });
+            });
+    }
+    REQUIRE(count == 200);
+
+    const auto getSource = [](int i) {
+        return "fragment main():float4 { return float4(" + std::to_string(i) + ".0f, 0.0f, 0.0f, 1.0f); }";
+    };
+
+    ouzel::Compiler compiler;
+    ouzel::AsyncCompiler asyncCompiler(ouzel::Compiler::Options(), std::string(), 2);
+
+    std::atomic<std::size_t> callbackCount{0};
+    std::vector<ouzel::CompileJob> jobs;
+    for (int i = 0; i < 16; ++i)
+        jobs.push_back(asyncCompiler.submit(getSource(i), ouzel::Target::HLSL, ouzel::Program::Fragment,
+                                            [&callbackCount](const ouzel::Compiler::Result& result) {
+                                                if (result.success) ++callbackCount;
+                                            }));
+
+    for (int i = 0; i < 16; ++i)
+        REQUIRE(jobs[static_cast<std::size_t>(i)].get().output ==
+                compiler.compile(getSource(i), ouzel::Target::HLSL, ouzel::Program::Fragment).output);
+    REQUIRE(callbackCount == 16);
+
+    // the errors in the source are diagnostics of the result
+    REQUIRE(asyncCompiler.submit("var a = ;", ouzel::Target::HLSL, ouzel::Program::Fragment).get().diagnostics.size() == 1);
+
+    // a single thread is blocked, so that the cancelled jobs are still waiting
+    ouzel::AsyncCompiler serialCompiler(ouzel::Compiler::Options(), std::string(), 1);
+    std::promise<void> gate;
+    auto gateFuture = gate.get_future().share();
+    auto blocking = serialCompiler.submit(getSource(0), ouzel::Target::GLSL, ouzel::Program::Fragment,
+                                          [gateFuture](const ouzel::Compiler::Result&) { gateFuture.wait(); });
+
+    auto outdated = serialCompiler.submit("shader.osl", getSource(1), ouzel::Target::GLSL, ouzel::Program::Fragment);
+    auto current = serialCompiler.submit("shader.osl", getSource(2), ouzel::Target::GLSL, ouzel::Program::Fragment);
+    auto cancelled = serialCompiler.submit(getSource(3), ouzel::Target::GLSL, ouzel::Program::Fragment);
+    cancelled.cancel();
+    gate.set_value();
+
+    REQUIRE(blocking.get().success);
+    REQUIRE(outdated.isCancelled());
+    REQUIRE_THROWS_AS(outdated.get(), ouzel::CompileCancelled);
+    REQUIRE(!current.isCancelled());
+    REQUIRE(current.get().success);
+    REQUIRE_THROWS_AS(cancelled.get(), ouzel::CompileCancelled);
+}
+
+TEST_CASE("Interpreter", "[interpreter]")
+{
+    std::string code = R"OSL(
+    struct Input
+    {
+        var uv:float2;
+    }
+    extern diffuse:Texture2D;
+    extern threshold:float;
+    function scale(inout color:float4, factor:float):void
+    {
+        color = color * factor;
+    }
+    function count(n:int):int
+    {
+        var result = 0;
+        for (var i = 0; i < n; ++i)
+        {
+            if (i == 1) continue;
+            result += i;
+        }
+        switch (result)
+        {
+            case 5: result = 10;
+            case 6: result += 1; break;
+            default: result = -1;
+        }
+        result *= 3;
+        result /= 3;
+        return result;
+    }
+    fragment main(input:Input):float4
+    {
+        if (input.uv.x < threshold) discard();
+        var color = sample(diffuse, input.uv);
+        scale(color, abs(-2.0f));
+        var m = float2x2(float2(1.0f, 2.0f), float2(3.0f, 4.0f));
+        var v = float2(1.0f, 1.0f) * m;
+        color.y = v.x + v.y;
+        color.z = float(count(4));
+        color.w = m[1][0];
+        return color;
+    }
+    )OSL";
+
+    ouzel::Context context(ouzel::tokenize(code));
+    ouzel::Interpreter interpreter(context, ouzel::Program::Fragment);
+
+    // 2x2 texture sampled at the center of the top left texel
+    const ouzel::Texture texture{2, 2, {0.25F, 0.0F, 0.0F, 1.0F, 0.0F, 1.0F, 0.0F, 1.0F,
+                                        0.0F, 0.0F, 1.0F, 1.0F, 1.0F, 1.0F, 1.0F, 1.0F}};
+    interpreter.setTexture("diffuse", texture);
+    interpreter.getGlobal("threshold").components[0] = 0.1;
+
+    ouzel::Value input{interpreter.getEntryPoint().parameterDeclarations[0]->qualifiedType.type};
+    input.elements[0].components[0] = 0.25;
+    input.elements[0].components[1] = 0.25;
+
+    const auto result = interpreter.run({input});
+    REQUIRE(result);
+    REQUIRE(result->components[0] == 0.5);
+    REQUIRE(result->components[1] == 10.0); // a row vector times the matrix
+    REQUIRE(result->components[2] == 11.0); // 0 + 2 + 3, then falls through to the next case
+    REQUIRE(result->components[3] == 3.0);
+
+    input.elements[0].components[0] = 0.0;
+    REQUIRE(!interpreter.run({input}));
+}
+
+TEST_CASE("SimdInterpreter", "[interpreter]")
+{
+    std::string code = R"OSL(
+    struct Input
+    {
+        var uv:float2;
+        var n:int;
+    }
+    extern diffuse:Texture2D;
+    function count(n:int):int
+    {
+        var total = 0;
+        var i = 0;
+        while (i < n)
+        {
+            ++i;
+            if (i == 3) continue;
+            if (total > 10) break;
+            total += i;
+        }
+        if (n == 7) return -5;
+        switch (n)
+        {
+            case 1: total = 100;
+            case 2: total += 1; break;
+            default: total -= 1;
+        }
+        return total;
+    }
+    function bump(inout color:float4, n:int):void
+    {
+        if (n > 3) color.x = color.x + 1.0f;
+        else return;
+        color.y = 2.0f;
+    }
+    fragment main(input:Input):float4
+    {
+        if (input.n == 5) discard();
+        var color = sample(diffuse, input.uv);
+        color.z = float(count(input.n));
+        bump(color, input.n);
+        color.w = (input.n > 2 && input.uv.x > 0.3f) ? 1.0f : -1.0f;
+        for (var i = 0; i < input.n; ++i) { if (i == 6) discard(); }
+        return color;
+    }
+    )OSL";
+
+    ouzel::Context context(ouzel::tokenize(code));
+    ouzel::Interpreter interpreter(context, ouzel::Program::Fragment);
+    ouzel::SimdInterpreter<8> simdInterpreter(context, ouzel::Program::Fragment);
+
+    const ouzel::Texture texture{2, 2, {0.25F, 0.0F, 0.0F, 1.0F, 0.0F, 1.0F, 0.0F, 1.0F,
+                                        0.0F, 0.0F, 1.0F, 1.0F, 1.0F, 1.0F, 1.0F, 1.0F}};
+    interpreter.setTexture("diffuse", texture);
+    simdInterpreter.setTexture("diffuse", texture);
+
+    // every lane takes a different path through the loops, the switch and the early returns
+    const auto setArguments = [](std::size_t x, std::size_t, std::size_t lane,
+                                 std::vector<ouzel::SimdInterpreter<8>::Value>& arguments) {
+        arguments[0].elements[0].setFloat(0, lane, static_cast<float>(x) * 0.1F);
+        arguments[0].elements[0].setFloat(1, lane, 0.7F);
+        arguments[0].elements[1].setInteger(0, lane, static_cast<std::int64_t>(x));
+    };
+
+    std::vector<float> colors(9 * 4, -10.0F);
+    simdInterpreter.runTile(9, 1, setArguments, colors);
+
+    for (std::size_t x = 0; x < 9; ++x)
+    {
+        ouzel::Value input{interpreter.getEntryPoint().parameterDeclarations[0]->qualifiedType.type};
+        input.elements[0].components[0] = static_cast<double>(static_cast<float>(x) * 0.1F);
+        input.elements[0].components[1] = static_cast<double>(0.7F);
+        input.elements[1].components[0] = static_cast<double>(x);
+
+        const auto result = interpreter.run({input});
+        for (std::size_t component = 0; component < 4; ++component)
+            REQUIRE(colors[x * 4 + component] == (result ? static_cast<float>(result->components[component]) : -10.0F));
+    }
+
+    REQUIRE(colors[5 * 4] == -10.0F); // discarded before any divergence
+    REQUIRE(colors[7 * 4] == -10.0F); // discarded inside the loop
+    REQUIRE(colors[6 * 4 + 2] == 11.0F); // broke out of the loop
+}
+
+TEST_CASE("Bytecode", "[bytecode]")
+{
+    std::string code = R"OSL(
+    struct Input
+    {
+        var uv:float2;
+        var n:int;
+    }
+    struct Item
+    {
+        var value:float;
+        var weight:int;
+    }
+    extern diffuse:Texture2D;
+    var offset:int = 2;
+    function weigh(item:Item):float
+    {
+        return item.value * float(item.weight);
+    }
+    function swap(inout v:float2):void
+    {
+        v = v.yx;
+    }
+    fragment main(input:Input):float4
+    {
+        if (input.n == 5) discard();
+        var items:Item[4];
+        for (var i = 0; i < 4; ++i)
+        {
+            items[i].value = float(i) + 0.5f;
+            items[i].weight = i * 2 - input.n;
+        }
+        var total = 0.0f;
+        var j = 0;
+        while (j < 4)
+        {
+            if (j == input.n) break;
+            total += weigh(items[j]);
+            j++;
+        }
+        var color = sample(diffuse, input.uv);
+        color.wx = color.xw;
+        var uv = input.uv;
+        swap(uv);
+        color[(input.n + offset) / 3] = uv.x + total;
+        var m = float2x2(float2(1.0f, 2.0f), float2(3.0f, 4.0f));
+        m[input.n > 2 ? 0 : 1][1] = -1.0f;
+        color.zw = color.zw * m;
+        switch (input.n)
+        {
+            case 1: color.x = 10.0f;
+            case 2: color.x = color.x + 1.0f; break;
+            default: color.x = -color.x;
+        }
+        return input.n > 3 && uv.y > 0.3f ? color : -color;
+    }
+    )OSL";
+
+    ouzel::Context context(ouzel::tokenize(code));
+    ouzel::Interpreter interpreter(context, ouzel::Program::Fragment);
+    const ouzel::BytecodeCompiler compiler(context, ouzel::Program::Fragment);
+
+    // the serialized bytecode is read back unchanged
+    const auto data = compiler.getBytecode().serialize();
+    const auto bytecode = ouzel::Bytecode::deserialize(data);
+    REQUIRE(bytecode.serialize() == data);
+    REQUIRE(bytecode.disassemble().find("call") != std::string::npos);
+    REQUIRE_THROWS_AS(ouzel::Bytecode::deserialize(std::vector<std::uint8_t>(data.begin(), data.end() - 1)), std::runtime_error);
+
+    ouzel::VirtualMachine virtualMachine(bytecode);
+
+    const ouzel::Texture texture{2, 2, {0.25F, 0.0F, 0.0F, 1.0F, 0.0F, 1.0F, 0.0F, 1.0F,
+                                        0.0F, 0.0F, 1.0F, 1.0F, 1.0F, 1.0F, 1.0F, 1.0F}};
+    interpreter.setTexture("diffuse", texture);
+    virtualMachine.setTexture("diffuse", texture);
+
+    for (std::int32_t n = 0; n < 8; ++n)
+    {
+        const auto u = static_cast<float>(n) * 0.1F;
+
+        ouzel::Value input{interpreter.getEntryPoint().parameterDeclarations[0]->qualifiedType.type};
+        input.elements[0].components[0] = static_cast<double>(u);
+        input.elements[0].components[1] = static_cast<double>(0.7F);
+        input.elements[1].components[0] = static_cast<double>(n);
+
+        const auto expected = interpreter.run({input});
+
+        std::vector<std::uint32_t> result;
+        const auto finished = virtualMachine.run({ouzel::VirtualMachine::fromFloat(u),
+                                                  ouzel::VirtualMachine::fromFloat(0.7F),
+                                                  static_cast<std::uint32_t>(n)}, result);
+
+        REQUIRE(finished == expected.has_value());
+        if (expected)
+            for (std::size_t component = 0; component < 4; ++component)
+                REQUIRE(ouzel::VirtualMachine::toFloat(result[component]) == static_cast<float>(expected->components[component]));
+    }
+}
+
+TEST_CASE("IncrementalParse", "[incremental_parse]")
+{
+    std::string code = R"OSL(
+    struct Light
+    {
+        var color:float4;
+        var intensity:float;
+    }
+    function shade(light:Light):float4;
+    function scale(v:float4):float4
+    {
+        return v * 2.0f;
+    }
+    function shade(light:Light):float4
+    {
+        return scale(light.color) * light.intensity;
+    }
+    const bias = 0.5f;
+    fragment main(uv:float2):float4
+    {
+        var light:Light;
+        light.color = float4(uv, bias, 1.0f);
+        light.intensity = 2.0f;
+        return shade(light);
+    }
+    )OSL";
+
+    ouzel::Context context(ouzel::tokenize(code));
+
+    // the updated context must give the same result as a new one
+    const auto update = [&context, &code](const std::string& from, const std::string& to) {
+        for (auto i = code.find(from); !from.empty() && i != std::string::npos; i = code.find(from, i + to.size()))
+            code.replace(i, from.size(), to);
+
+        const auto tokens = ouzel::tokenize(code);
+        const auto changedCount = context.update(tokens);
+
+        ouzel::Context fullContext(tokens);
+        ouzel::OutputHLSL output(ouzel::Program::Fragment);
+        REQUIRE(output.output(context, true) == output.output(fullContext, true));
+        REQUIRE(context.getDeclarations().size() == fullContext.getDeclarations().size());
+        REQUIRE(context.getConstructs().size() == fullContext.getConstructs().size());
+        REQUIRE(context.getTypes().size() == fullContext.getTypes().size());
+
+        return changedCount;
+    };
+
+    REQUIRE(update("", "") == 0);
+
+    // the callers are parsed again, because they refer to the changed declaration
+    REQUIRE(update("v * 2.0f", "v * 3.0f") == 3);
+    REQUIRE(update("0.5f", "0.25f") == 2);
+    REQUIRE(update("return shade(light);\n    }\n", "return shade(light);\n    }\n    function unused():float { return 1.0f; }\n") == 1);
+    REQUIRE(update("    function unused():float { return 1.0f; }\n", "") == 1);
+    REQUIRE(update("intensity", "strength") == 4);
+
+    // the type of the removed struct is released
+    REQUIRE(update("Light", "Lamp") == 4);
+
+    // the context is not changed by a failed update
+    const auto before = ouzel::OutputHLSL(ouzel::Program::Fragment).output(context, true);
+    const auto constructCount = context.getConstructs().size();
+    REQUIRE_THROWS_AS(context.update(ouzel::tokenize("function scale(v:float4):float4 { return v * ; }")), ouzel::ParseError);
+    REQUIRE(ouzel::OutputHLSL(ouzel::Program::Fragment).output(context, true) == before);
+    REQUIRE(context.getConstructs().size() == constructCount);
+}
+
+TEST_CASE("Preprocessor", "[preprocessor]")
+{
+    std::string code = "#define SCALE 2.0f\n"
+        "#ifdef RED // comment\n"
+        "var c = float4(SCALE, 0.0f, 0.0f, 1.0f);\n"
+        "#else\n"
+        "var c = float4(0.0f, /* SCALE */ SCALE, 0.0f, 1.0f);\n"
+        "#endif\n"
+        "var s = \"SCALE\";";
+
+    ouzel::Preprocessor preprocessor;
+    // the directives and the excluded code leave empty lines, so that the lines keep their numbers
+    REQUIRE(preprocessor.preprocess(code) ==
+            "\n\n\n\nvar c = float4(0.0f,             2.0f, 0.0f, 1.0f);\n\nvar s = \"SCALE\";");
+    REQUIRE(preprocessor.getDefines().at("SCALE") == "2.0f");
+
+    ouzel::Preprocessor redPreprocessor(std::map<std::string, std::string>{{"RED", ""}});
+    REQUIRE(redPreprocessor.preprocess(code) ==
+            "\n\nvar c = float4(2.0f, 0.0f, 0.0f, 1.0f);\n\n\n\nvar s = \"SCALE\";");
+
+    // a define is not expanded in its own value
+    ouzel::Preprocessor recursivePreprocessor;
+    recursivePreprocessor.define("A", "B + 1");
+    recursivePreprocessor.define("B", "A");
+    REQUIRE(recursivePreprocessor.preprocess("A") == "A + 1");
+
+    // a line continuation joins the lines, and its newline is kept after the joined line
+    const auto continued = ouzel::Preprocessor().preprocess("#define X 1.0f + \\\n2.0f\nvar a = X;\nvar b = 1;");
+    REQUIRE(continued == "\n\nvar a = 1.0f + 2.0f;\nvar b = 1;");
+    REQUIRE(ouzel::tokenize(continued).back().line == 4);
+
+    REQUIRE_THROWS_AS(ouzel::Preprocessor().preprocess("#ifdef A\n"), std::runtime_error);
+    REQUIRE_THROWS_AS(ouzel::Preprocessor().preprocess("#endif\n"), std::runtime_error);
+    REQUIRE_THROWS_AS(ouzel::Preprocessor().preprocess("#include \"a.osl\"\n"), std::runtime_error);
+    REQUIRE_THROWS_AS(ouzel::Preprocessor().preprocess("/* a"), std::runtime_error);
+}
+
+TEST_CASE("Include", "[include]")
+{
+    const std::map<std::string, std::string> files{
+        {"lib/common.oslh", "#ifndef COMMON\n#define COMMON\nfunction scale(v:float):float { return v * SCALE; }\n#endif\n"},
+        {"lib/scale.oslh", "#define SCALE 2.0f\n#include \"common.oslh\"\n"},
+        {"lib/loop.oslh", "#include \"loop.oslh\"\n"},
+        {"lib/bad.oslh", "\n#else\n"},
+        {"lib/broken.oslh", "var b:float = 1.0f\nvar c:float = 2.0f;\n"}
+    };
+
+    const auto includeHandler = [&files](const std::string& name, const std::string& includingPath) {
+        const auto path = (std::filesystem::path(includingPath).parent_path() / name).lexically_normal().string();
+        const auto file = files.find(path);
+        if (file == files.end()) throw std::runtime_error{"File not found: " + name};
+        return std::make_pair(path, file->second);
+    };
+
+    ouzel::Preprocessor preprocessor;
+    preprocessor.setIncludeHandler(includeHandler);
+
+    // the included code is marked with the file and the lines it came from, so that the tokens keep their origin
+    const auto result = preprocessor.preprocess("#include \"lib/scale.oslh\"\n#include \"lib/common.oslh\"\nvar a = 1;", "a.osl");
+    REQUIRE(result.find("function scale(v:float):float { return v * 2.0f; }") != std::string::npos);
+    REQUIRE(result.find("scale", result.find("scale") + 1) == std::string::npos);
+    REQUIRE(result.substr(result.rfind('\n') + 1) == "var a = 1;");
+    REQUIRE(preprocessor.getIncludes() == std::vector<std::string>{"lib/scale.oslh", "lib/common.oslh"});
+
+    const auto tokens = ouzel::tokenize(result);
+    REQUIRE(tokens.front().type == ouzel::Token::Type::Function);
+    REQUIRE(tokens.front().line == 3);
+    REQUIRE(tokens.front().file == 2);
+    REQUIRE(tokens[tokens.size() - 5].type == ouzel::Token::Type::Var);
+    REQUIRE(tokens[tokens.size() - 5].line == 3);
+    REQUIRE(tokens[tokens.size() - 5].file == 0);
+
+    REQUIRE_THROWS_AS(ouzel::tokenize("#line 1\nvar a = 1;"), ouzel::SourceError);
+
+    // without the markers the included code is a single source, which can be preprocessed again
+    const auto single = ouzel::Preprocessor::removeLineMarkers(result);
+    REQUIRE(single.find("#line") == std::string::npos);
+    REQUIRE(single == "\n\n\nfunction scale(v:float):float { return v * 2.0f; }\n\n\n\n\n\n\n\n\nvar a = 1;");
+    REQUIRE(preprocessor.preprocess(single, "b.osl") == single);
+    REQUIRE(ouzel::Preprocessor::removeLineMarkers("var b = 1;\n#line 1 1\nvar c = 2;\n#line 3 0") == "var b = 1;\nvar c = 2;");
+
+    try
+    {
+        preprocessor.preprocess("#include \"lib/loop.oslh\"", "a.osl");
+        FAIL("Recursive #include was not detected");
+    }
+    catch (const ouzel::SourceError& e)
+    {
+        REQUIRE(std::string(e.what()).find("Recursive #include") != std::string::npos);
+    }
+
+    // an error in an included file is reported at the #include with the position in the file
+    try
+    {
+        preprocessor.preprocess("\n  #include \"lib/bad.oslh\"", "a.osl");
+        FAIL("The error in the included file was not reported");
+    }
+    catch (const ouzel::SourceError& e)
+    {
+        REQUIRE(std::string(e.what()).find("lib/bad.oslh:2:1: ") == 0);
+        REQUIRE(e.getLine() == 2);
+    }
+
+    REQUIRE_THROWS_AS(preprocessor.preprocess("#include \"missing.oslh\"", "a.osl"), std::runtime_error);
+
+    ouzel::Compiler::Options options;
+    options.includeHandler = includeHandler;
+    ouzel::Compiler compiler(options);
+    ouzel::Compiler::Result compileResult;
+    compiler.compile("#include \"lib/scale.oslh\"\nfragment main():float4 { return float4(scale(1.0f), 0.0f, 0.0f, 1.0f); }",
+                     ouzel::Target::HLSL, ouzel::Program::Fragment, compileResult);
+    REQUIRE(compileResult.success);
+    REQUIRE(compileResult.includes == std::vector<std::string>{"lib/scale.oslh", "lib/common.oslh"});
+
+    // a parse error in an included file is reported at its path, line and column
+    compiler.compile("#include \"lib/broken.oslh\"\nfragment main():float4 { return float4(1.0f); }",
+                     ouzel::Target::HLSL, ouzel::Program::Fragment, compileResult);
+    REQUIRE_FALSE(compileResult.success);
+    REQUIRE_FALSE(compileResult.diagnostics.empty());
+    REQUIRE(compileResult.diagnostics.front().line == 2);
+    REQUIRE(compileResult.diagnostics.front().column == 1);
+    REQUIRE(ouzel::getDiagnosticsText("a.osl", compileResult.diagnostics, compileResult.includes).find("lib/broken.oslh:2:1: ") == 0);
+    REQUIRE(ouzel::getDiagnosticsJson("a.osl", compileResult.diagnostics, compileResult.includes).find("\"file\":\"lib/broken.oslh\"") != std::string::npos);
+}
+
+TEST_CASE("Module", "[module]")
+{
+    const auto math = ouzel::Module::deserialize(ouzel::Module(ouzel::tokenize(R"OSL(
+    struct Pair
+    {
+        var a:float;
+        var b:float;
+    }
+    function half(v:float):float { return v * 0.5f; }
+    function scale(v:float):float { return half(v) * 4.0f; }
+    function unused():float { return 1.0f; }
+    )OSL")).serialize());
+
+    REQUIRE(math.getSymbols().size() == 4);
+    REQUIRE(math.getSymbols()[0].name == "Pair");
+    REQUIRE(math.getSymbols()[0].kind == ouzel::Declaration::Kind::Type);
+    REQUIRE(math.getSymbols()[2].name == "scale");
+
+    std::map<std::string, std::shared_ptr<const ouzel::Module>> modules{
+        {"math", std::make_shared<const ouzel::Module>(math)}
+    };
+
+    const ouzel::Module::Loader loader = [&modules](const std::string& name) {
+        const auto module = modules.find(name);
+        if (module == modules.end()) throw std::runtime_error{"Module not found: " + name};
+        return module->second;
+    };
+
+    // a module that imports another one only stores its own declarations
+    const ouzel::Module lighting(ouzel::tokenize(R"OSL(
+    import "math";
+    function light(v:float):float { return scale(v) + 1.0f; }
+    )OSL"), loader);
+    REQUIRE(lighting.getImports() == std::vector<std::string>{"math"});
+    REQUIRE(lighting.getSymbols().size() == 1);
+    modules["lighting"] = std::make_shared<const ouzel::Module>(lighting);
+
+    // only the used declarations and the ones they use are imported, in the order of their modules
+    auto tokens = ouzel::tokenize("import \"lighting\";\nfragment main():float4 { return float4(light(1.0f), 0.0f, 0.0f, 1.0f); }");
+    REQUIRE(ouzel::Module::import(tokens, loader).size() == 2);
+
+    const ouzel::Context context(tokens);
+    std::vector<std::string> names;
+    for (const auto declaration : context.getDeclarations())
+        names.push_back(declaration->name);
+    REQUIRE(names == std::vector<std::string>{"half", "scale", "light", "main"});
+
+    // the imported tokens are reported at the import directive
+    REQUIRE(tokens.front().line == 1);
+    REQUIRE(tokens.front().column == 1);
+
+    auto missing = ouzel::tokenize("var a = 1;\nimport \"missing\";");
+    try
+    {
+        ouzel::Module::import(missing, loader);
+        FAIL("The missing module was not reported");
+    }
+    catch (const ouzel::SourceError& e)
+    {
+        REQUIRE(e.getLine() == 2);
+    }
+
+    REQUIRE_THROWS_AS(ouzel::Module(ouzel::tokenize("function f():float { return 1.0f; }\nimport \"math\";"), loader), ouzel::SourceError);
+    REQUIRE_THROWS_AS(ouzel::Module(ouzel::tokenize("var a = 1;")), std::runtime_error);
+    REQUIRE_THROWS_AS(ouzel::Module::deserialize(std::vector<std::uint8_t>{'O', 'S', 'L', 'M', 1, 0, 0, 0, 5}), std::runtime_error);
+
+    ouzel::Compiler::Options options;
+    options.moduleLoader = loader;
+    ouzel::Compiler compiler(options);
+    const auto result = compiler.compile("import \"math\";\nfragment main():float4 { return float4(scale(1.0f), 0.0f, 0.0f, 1.0f); }",
+                                         ouzel::Target::HLSL, ouzel::Program::Fragment);
+    REQUIRE(result.success);
+    REQUIRE(result.output.find("unused") == std::string::npos);
+
+    const auto failed = compiler.compile("import \"missing\";", ouzel::Target::HLSL, ouzel::Program::Fragment);
+    REQUIRE(failed.diagnostics.size() == 1);
+    REQUIRE(failed.diagnostics[0].errorCode == ouzel::ErrorCode::InvalidImport);
+}
+
+TEST_CASE("Reflection", "[reflection]")
+{
+    const std::string code = R"OSL(
+    struct VertexInput
+    {
+        var position:float3 -> Position;
+        var texCoord:float2 -> TextureCoordinates(1);
+    }
+    struct VertexOutput
+    {
+        var position:float4 -> PositionTransformed;
+        var color:float4 -> Color(0);
+    }
+    extern modelViewProj:float4x4;
+    extern weights:float[3];
+    extern diffuse:Texture2D;
+    extern shadows:Texture2D[2];
+    extern normals:Texture2D;
+    vertex main(input:VertexInput):VertexOutput
+    {
+        var output:VertexOutput;
+        output.position = float4(input.position, 1.0f) * modelViewProj;
+        output.color = float4(weights[0], 0.0f, 0.0f, 1.0f);
+        return output;
+    }
+    )OSL";
+
+    const ouzel::Context context(ouzel::tokenize(code));
+    const ouzel::Reflection reflection(context, ouzel::Program::Vertex);
+
+    REQUIRE(reflection.getEntryPoint() == "main");
+
+    const auto& inputs = reflection.getInputs();
+    REQUIRE(inputs.size() == 2);
+    REQUIRE(inputs[0].name == "input.position");
+    REQUIRE(inputs[0].semantic == static_cast<std::uint8_t>(ouzel::Attribute::Kind::Position));
+    REQUIRE(inputs[1].columns == 2);
+    REQUIRE(inputs[1].semanticIndex == 1);
+    REQUIRE(inputs[1].offset == 12);
+
+    // the fields of the result are the outputs
+    const auto& outputs = reflection.getOutputs();
+    REQUIRE(outputs.size() == 2);
+    REQUIRE(outputs[1].name == "color");
+    REQUIRE(outputs[1].semantic == static_cast<std::uint8_t>(ouzel::Attribute::Kind::Color));
+
+    const auto& uniforms = reflection.getUniforms();
+    REQUIRE(uniforms.size() == 2);
+    REQUIRE(uniforms[0].rows == 4);
+    REQUIRE(uniforms[0].size == 64);
+    REQUIRE(uniforms[1].arraySize == 3);
+    REQUIRE(uniforms[1].offset == 64);
+    REQUIRE(reflection.getUniformSize() == 76);
+
+    // an array of textures takes a binding per element
+    const auto& textures = reflection.getTextures();
+    REQUIRE(textures.size() == 3);
+    REQUIRE(textures[1].binding == 1);
+    REQUIRE(textures[2].binding == 3);
+
+    REQUIRE(reflection.getStructs().size() == 2);
+    REQUIRE(reflection.getStructs()[0].size == 20);
+
+    const auto deserialized = ouzel::Reflection::deserialize(reflection.serialize());
+    REQUIRE(deserialized.serialize() == reflection.serialize());
+    REQUIRE(deserialized.getJson() == reflection.getJson());
+    REQUIRE(reflection.getJson().find("\"semantic\":\"TextureCoordinates\",\"semanticIndex\":1") != std::string::npos);
+
+    auto truncated = reflection.serialize();
+    truncated.resize(truncated.size() - 1);
+    REQUIRE_THROWS_AS(ouzel::Reflection::deserialize(truncated), std::runtime_error);
+    REQUIRE_THROWS_AS(ouzel::Reflection(context, ouzel::Program::Fragment), std::runtime_error);
+
+    ouzel::Compiler::Options options;
+    options.reflection = true;
+    ouzel::Compiler compiler(options);
+    const auto result = compiler.compile(code, ouzel::Target::GLSL, ouzel::Program::Vertex);
+    REQUIRE(result.success);
+    REQUIRE(result.reflection == reflection.serialize());
+}
+
+TEST_CASE("Layout", "[layout]")
+{
+    const std::string code = R"OSL(
+    struct Light
+    {
+        var direction:float3;
+        var intensity:float;
+    }
+    extern modelViewProj:float4x4;
+    extern scale:float;
+    extern offset:float2;
+    extern tint:float3;
+    extern weights:float[3];
+    extern light:Light;
+    extern bias:float;
+    extern normalMatrix:float3x3;
+    extern diffuse:Texture2D;
+    fragment main():float4
+    {
+        return float4(tint * scale, weights[1] + bias);
+    }
+    )OSL";
+
+    const ouzel::Context context(ouzel::tokenize(code));
+
+    const auto getOffsets = [&context](ouzel::Layout::Rules rules) {
+        std::vector<std::uint32_t> result;
+        const ouzel::Layout layout(context, rules);
+        for (const auto& member : layout.getMembers())
+            result.push_back(member.offset);
+        return result;
+    };
+
+    // the texture is not a part of the buffer
+    REQUIRE(getOffsets(ouzel::Layout::Rules::Packed) == std::vector<std::uint32_t>{0, 64, 68, 76, 88, 100, 116, 120});
+    REQUIRE(getOffsets(ouzel::Layout::Rules::Std140) == std::vector<std::uint32_t>{0, 64, 72, 80, 96, 144, 160, 176});
+    REQUIRE(getOffsets(ouzel::Layout::Rules::Std430) == std::vector<std::uint32_t>{0, 64, 72, 80, 92, 112, 128, 144});
+    // a vector that would cross a register starts a new one, and so does the member after a struct
+    REQUIRE(getOffsets(ouzel::Layout::Rules::HLSL) == std::vector<std::uint32_t>{0, 64, 68, 80, 96, 144, 160, 176});
+    REQUIRE(getOffsets(ouzel::Layout::Rules::Metal) == std::vector<std::uint32_t>{0, 64, 72, 80, 96, 112, 144, 160});
+
+    REQUIRE(ouzel::Layout(context, ouzel::Layout::Rules::Packed).getSize() == 156);
+    REQUIRE(ouzel::Layout(context, ouzel::Layout::Rules::Std140).getSize() == 224);
+    REQUIRE(ouzel::Layout(context, ouzel::Layout::Rules::Std430).getSize() == 192);
+    REQUIRE(ouzel::Layout(context, ouzel::Layout::Rules::HLSL).getSize() == 224);
+    REQUIRE(ouzel::Layout(context, ouzel::Layout::Rules::Metal).getSize() == 208);
+
+    const ouzel::Layout std140Layout(context, ouzel::Layout::Rules::Std140);
+    REQUIRE(std140Layout.getMembers()[4].arrayStride == 16);
+    REQUIRE(std140Layout.getMembers()[4].size == 48);
+    REQUIRE(std140Layout.getMembers()[7].matrixStride == 16);
+
+    // the last element of a constant buffer array and the last row of a matrix are not padded
+    const ouzel::Layout hlslLayout(context, ouzel::Layout::Rules::HLSL);
+    REQUIRE(hlslLayout.getMembers()[4].size == 36);
+    REQUIRE(hlslLayout.getMembers()[7].size == 44);
+
+    REQUIRE(ouzel::Layout(context, ouzel::Layout::Rules::Std430).getMembers()[4].arrayStride == 4);
+    REQUIRE(ouzel::Layout(context, ouzel::Layout::Rules::Packed).getMembers()[7].matrixStride == 12);
+
+    // the outputs carry the offsets
+    const auto hlsl = ouzel::OutputHLSL(ouzel::Program::Fragment).output(context, false);
+    REQUIRE(hlsl.find("cbuffer Uniforms{float4x4 modelViewProj:packoffset(c0);float scale:packoffset(c4);"
+                      "float2 offset:packoffset(c4.y);float3 tint:packoffset(c5);") != std::string::npos);
+
+    const auto glsl = ouzel::OutputGLSL(ouzel::Program::Fragment, 450).output(context, false);
+    REQUIRE(glsl.find("layout(std140) uniform Uniforms{layout(offset=0) ") != std::string::npos);
+    REQUIRE(glsl.find("layout(offset=176) ") != std::string::npos);
+    REQUIRE(ouzel::OutputGLSL(ouzel::Program::Fragment, 120).output(context, false).find("uniform float scale;") != std::string::npos);
+
+    const ouzel::Reflection reflection(context, ouzel::Program::Fragment, ouzel::Layout::Rules::Std140);
+    REQUIRE(reflection.getUniformSize() == 224);
+    REQUIRE(reflection.getUniforms()[5].offset == 144);
+    REQUIRE(reflection.getStructs()[0].size == 16);
+    REQUIRE(reflection.getJson().find("\"uniforms\":{\"layout\":\"std140\",\"size\":224") != std::string::npos);
+    REQUIRE(ouzel::Reflection::deserialize(reflection.serialize()).getLayoutRules() == ouzel::Layout::Rules::Std140);
+
+    ouzel::Compiler::Options options;
+    options.reflection = true;
+    ouzel::Compiler compiler(options);
+    const auto result = compiler.compile(code, ouzel::Target::HLSL, ouzel::Program::Fragment);
+    REQUIRE(result.success);
+    REQUIRE(ouzel::Reflection::deserialize(result.reflection).getUniformSize() == 224);
+}
+
+TEST_CASE("VariantCompiler", "[variant_compiler]")
+{
+    std::string code = R"OSL(
+    extern scale:float;
+    #ifdef TINT
+    extern tint:float4;
+    #endif
+    fragment main(uv:float2):float4
+    {
+        var color = float4(uv, 0.0f, 1.0f);
+    #ifdef TINT
+        color = color * tint;
+    #endif
+    #ifdef SCALE
+        color = color * SCALE;
+    #endif
+        return color * scale;
+    }
+    )OSL";
+
+    const std::vector<ouzel::VariantCompiler::Defines> variants = {
+        {},
+        {{"TINT", ""}},
+        {{"SCALE", "2.0f"}},
+        {{"SCALE", "4.0f"}, {"TINT", ""}},
+        {{"UNUSED", ""}} // the same tokens as the base variant
+    };
+
+    const auto generate = [](ouzel::Context& context) {
+        ouzel::OutputHLSL output(ouzel::Program::Fragment);
+        return output.output(context, false);
+    };
+
+    ouzel::VariantCompiler compiler(code);
+    const auto bundle = compiler.compile(variants, generate);
+
+    // every variant is the same as if it was compiled on its own
+    for (const auto& defines : variants)
+    {
+        ouzel::Context context(ouzel::tokenize(ouzel::Preprocessor(defines).preprocess(code)));
+        const auto variantOutput = bundle.find(ouzel::ShaderBundle::getKey(defines));
+        REQUIRE(variantOutput);
+        REQUIRE(*variantOutput == generate(context));
+    }
+
+    REQUIRE(ouzel::ShaderBundle::getKey(variants[3]) == "SCALE=4.0f,TINT");
+    REQUIRE(bundle.find("TINT,SCALE=4.0f") == nullptr);
+
+    const auto& statistics = compiler.getStatistics();
+    REQUIRE(statistics.variantCount == 5);
+    REQUIRE(statistics.parsedCount == 4);
+    REQUIRE(statistics.uniqueOutputCount == 4);
+    REQUIRE(statistics.sharedLineCount > statistics.tokenizedLineCount);
+
+    // the bundle is read back unchanged
+    const auto data = bundle.serialize();
+    const auto loadedBundle = ouzel::ShaderBundle::deserialize(data);
+    REQUIRE(loadedBundle.serialize() == data);
+    REQUIRE(loadedBundle.getVariants().size() == 5);
+    REQUIRE(loadedBundle.getOutputs().size() == 4);
+    REQUIRE_THROWS_AS(ouzel::ShaderBundle::deserialize(std::vector<std::uint8_t>(data.begin(), data.end() - 1)), std::runtime_error);
+}